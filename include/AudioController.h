@@ -1,69 +1,110 @@
 #ifndef AUDIO_CONTROLLER_H
 #define AUDIO_CONTROLLER_H
 
-#include <driver/i2s.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include "Config.h"
+#include "DeviceConfig.h"
+#include "Hal.h"
+#include "ToneSequencer.h"
+#include "PromptLibrary.h"
 
 class AudioController {
 public:
-    // Constructor with default pins
-    AudioController(int bclk_pin = BCLK_PIN, int lrc_pin = LRC_PIN, int data_pin = DIN_PIN);
+    // Output goes to sink (I2sAudioSink on the device), alarm sound settings come from config
+    AudioController(AudioSink &sink, DeviceConfig &config);
     
     // Destructor
     ~AudioController();
     
-    // Initialize the I2S audio system
-    bool begin(uint32_t sample_rate = 44100);
+    // Initialize the audio output
+    bool begin(uint32_t sample_rate = AUDIO_SAMPLE_RATE);
         
-    // Tone generation
+    // Tone generation. These only change what the audio task renders next and return
+    // straight away, the new sound starts within one DMA buffer (~23ms).
+    // playTone() is the 150ms on/off alarm pulse at frequency_hz, playPattern() plays any
+    // pattern (see ToneSequencer.h) in its place. Both run in the background voice.
     void playTone(int frequency_hz, float volume = 0.1);
+    void playPattern(const TonePattern &pattern, float volume = 0.1);
     void stopTone();
+    // playTone() with the alarm frequency and volume from the device config
+    void playAlarm();
     
     // Get frequency or volume from latest sound
     int getFrequency() const;
     float getVolume() const;
     
-    // Audio processing - call this regularly in the main loop
+    // Kept for existing callers, the audio task does all the work now
     void update();
     
-    // Utility functions
+    // Utility functions. A beep plays in the foreground voice, mixed over whatever the
+    // background voice is doing.
     void playBeep(int frequency_hz = 1000, uint32_t duration_ms = 200, float volume = 0.1);
     
+    // Spoken prompts, streamed straight from the memory-mapped prompt partition. A prompt
+    // takes over the output while it plays, tones pick up where they were afterwards.
+    // false if the partition or the clip isn't there.
+    bool playPrompt(PromptId id);
+    bool isPromptPlaying() const;
+    
     // Status
     bool isInitialized() const;
     
 private:
-    // Pin configuration
-    int _bclk_pin;
-    int _lrc_pin;
-    int _data_pin;
+    AudioSink &_sink;
+    DeviceConfig &_config;
     
     // Audio configuration
     uint32_t _sample_rate;
-    static const int BUFFER_SIZE = 1024;
+    static const int BUFFER_SIZE = AUDIO_BUFFER_SAMPLES;
     int16_t _audio_buffer[BUFFER_SIZE];
     
     // State variables
     bool _initialized;
-    bool _tone_playing;
     float _volume;
     int _frequency_hz;
-    float _phase;
-    
-    // Beep functionality
-    bool _beep_playing;
-    uint32_t _beep_start_time;
-    uint32_t _beep_duration;
-    int _beep_frequency;
-    float _beep_volume;
+
+    // What the API asked a voice to do, picked up by the audio task before the next buffer
+    struct VoiceRequest {
+        bool pending;
+        const TonePattern *pattern;   // NULL = stop
+        int frequency_hz;             // for the built-in tone/beep patterns below
+        uint32_t duration_ms;
+        float volume;
+    };
+    VoiceRequest _alarm_request;
+    VoiceRequest _beep_request;
+    bool _prompt_request_pending;
+    const int16_t *_prompt_request_samples;   // NULL = stop
+    uint32_t _prompt_request_length;
+
+    // Voices, only touched by the audio task
+    ToneVoice _alarm_voice;       // background
+    ToneVoice _beep_voice;        // foreground, mixed on top
+    ToneStep _tone_steps[2];      // playTone() pulse
+    TonePattern _tone_pattern;
+    ToneStep _beep_steps[1];      // playBeep()
+    TonePattern _beep_pattern;
+
+    // Prompt playback, pointers into flash
+    PromptLibrary _prompts;
+    const int16_t *_prompt_samples;
+    uint32_t _prompt_length;
+    uint32_t _prompt_pos;
     
-    // I2S port
-    static const i2s_port_t I2S_PORT = I2S_NUM_0;
+    // Audio task, woken whenever the sink has room for another buffer
+    TaskHandle_t _task;
+    portMUX_TYPE _lock;          // guards the requests above against the API calls
+    const uint8_t *_write_ptr;   // block being handed to the driver, _audio_buffer or flash
+    size_t _write_len;
+    size_t _write_offset;        // bytes of it the driver already took
     
     // Private methods
-    void generateToneBuffer();
-    void playAudioBuffer();
-    bool setupI2S();
+    static void audioTaskEntry(void *param);
+    void audioTask();
+    void fillDmaBuffers();
+    bool nextBlock();
+    void applyRequest(VoiceRequest &request, ToneVoice &voice);
 };
 
 #endif // AUDIO_CONTROLLER_H
\ No newline at end of file
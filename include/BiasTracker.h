@@ -0,0 +1,54 @@
+#ifndef BIAS_TRACKER_H
+#define BIAS_TRACKER_H
+
+#include "Config.h"
+#include "ImuSample.h"
+
+// Sum, min and max of each raw axis over a run of samples
+struct StillnessWindow {
+  uint16_t count;
+  uint32_t startUs;     // timestamp of the first sample
+  int32_t accelSum[3], gyroSum[3];
+  int16_t accelMin[3], accelMax[3];
+  int16_t gyroMin[3], gyroMax[3];
+
+  void clear();
+  void add(const RawImuSample &raw);
+  // every axis stayed within BIAS_STILL_ACCEL_SPAN / BIAS_STILL_GYRO_SPAN
+  bool isStill() const;
+  void mean(float accel[3], float gyro[3]) const;
+};
+
+// Keeps the calibration offsets right while the device is in use. Every raw sample goes
+// through add() on the sampling task; each BIAS_WINDOW_US of sample time in which the
+// device didn't move refines the offsets, whatever the rate profile:
+//  - gyro: the window mean is the bias, blended in with BIAS_GYRO_GAIN
+//  - accel: at rest the corrected mean has to be 1g long whichever way up the device
+//    lies, so the offset moves along the mean by a share of the length error. Each new
+//    resting orientation makes another axis observable.
+// Windows that look still but don't fit (slow steady rotation, a shaky surface) are
+// skipped rather than learned. All offsets are in raw counts.
+class BiasTracker {
+public:
+  BiasTracker();
+
+  void reset(const float accelOffset[3], const float gyroOffset[3]);
+  // true when a window just finished and moved the offsets
+  bool add(const RawImuSample &raw);
+  void getOffsets(float accelOffset[3], float gyroOffset[3]) const;
+  uint32_t getUpdateCount() const;
+
+  // First offsets from a single still window, without any earlier estimate: gyro bias
+  // is the mean, the accel offset is whatever the mean has beyond 1g along gravity.
+  static void estimate(const StillnessWindow &window, float accelOffset[3], float gyroOffset[3]);
+
+private:
+  StillnessWindow window;
+  float accelOffset[3];
+  float gyroOffset[3];
+  uint32_t updates;
+
+  bool update();
+};
+
+#endif // BIAS_TRACKER_H
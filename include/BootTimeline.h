@@ -0,0 +1,29 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <Arduino.h>
+
+// Milestones of the startup sequence, roughly in the order they are reached. The
+// network ones happen in the background and can come before or after monitoring.
+enum BootMilestone {
+  BOOT_SENSOR_READY,
+  BOOT_CALIBRATED,
+  BOOT_MONITORING,        // the sampling task runs and detection gets samples
+  BOOT_SETUP_DONE,
+  BOOT_WIFI_CONNECTED,
+  BOOT_SESSION_READY,     // auth token and registration, fetched or from NVS
+  BOOT_CONFIG_CURRENT,    // device config checked with the server
+  BOOT_MILESTONE_COUNT
+};
+
+// When each milestone was first reached, in ms since the app started (the ROM and
+// second stage bootloader before that aren't counted). Any task can mark.
+class BootTimeline {
+public:
+  static void mark(BootMilestone milestone);
+  // 0 = not reached yet
+  static uint32_t getMs(BootMilestone milestone);
+  static void report(Print &out);
+};
+
+#endif // BOOT_TIMELINE_H
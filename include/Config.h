@@ -4,9 +4,13 @@
 #include <Arduino.h>
 
 
+// Unique device identifier
+#define DEVICE_ID "ESP32_FALL_001"
+
 #define SDA_PIN           21
 #define SCL_PIN           22
 #define LED_PIN           2    // Onboard LED
+#define LED_TICK_MS       10   // LED pattern timer resolution
 #define BUTTON_PIN        15   // Button pin (was GPIO0)
 
 // Audio Controller pins
@@ -14,6 +18,8 @@
 #define LRC_PIN           27
 #define DIN_PIN           25
 
+// Detection and alarm defaults. The server can override these at runtime through
+// /device-config (DeviceConfig.h), code should read them from there.
 #define FREEFALL_THRESHOLD        8.0F   // g-force threshold for free-fall detection
 #define IMPACT_THRESHOLD          5.0F   // g-force threshold for impact detection
 #define INACTIVITY_THRESHOLD      2.5F   // g-force threshold for post-fall inactivity
@@ -21,10 +27,157 @@
 #define PRE_IMPACT_WINDOW_MS      500    // Size of pre-impact buffer window
 #define POST_IMPACT_WINDOW_MS     2000   // Time to monitor after impact
 #define ALARM_DELAY_MS            10000  // Delay before full alarm after fall detection
-#define SAMPLING_PERIOD_MS        10     // Sample sensor every 10ms
+#define SAMPLING_PERIOD_MS        10     // nominal sample period, the real one depends on the rate profile
 #define REQUIRED_STILL_SAMPLES    50     // ~500ms of stillness to confirm emergency
 #define ALARM_SOUND_FREQUENCY_HZ  880    // A5, plays during an emergency
 #define ALARM_SOUND_VOLUME        0.1F   // speaker volume for alarm (0.0F - 1.0F)
+#define CALIBRATION_SAMPLES       100    // readings averaged into the calibration offsets
+
+// Calibration is kept in NVS and only measured at boot when none is stored. From then on
+// BiasTracker refines it whenever the readings stay within a small span for a whole
+// window (the device is lying still): gyro bias straight from the window mean, accel
+// offsets by nudging the mean onto the 1g sphere. An accel axis is only learned once the
+// device has rested with gravity along it; lying flat alone fixes Z and nothing else.
+#define BIAS_TRACKING             1
+#define BIAS_WINDOW_US            1000000UL // of sample time: 50, 100 or 1000 samples by rate profile
+#define BIAS_STILL_ACCEL_SPAN     123    // counts max - min per axis, ~0.03g
+#define BIAS_STILL_GYRO_SPAN      66     // counts, ~1 deg/s
+#define BIAS_MAX_GYRO_STEP        131    // counts (2 deg/s), a bigger gap to the bias is slow rotation, not drift
+#define BIAS_MAX_GRAVITY_ERROR    410    // counts (0.1g), a still window further off 1g is not trusted
+#define BIAS_GYRO_GAIN            0.3F   // share of a still window's error taken per window
+#define BIAS_ACCEL_GAIN           0.2F
+#define CALIBRATION_SAVE_INTERVAL_MS (10UL * 60UL * 1000UL)
+#define CALIBRATION_SAVE_DELTA    4      // counts, less drift than this isn't worth a flash write
+
+// Runtime device config - fetched with If-None-Match, so an unchanged config is one
+// empty 304, and the last one the server sent is kept in NVS for the next boot
+#define NVS_NAMESPACE             "fallsense"
+#define DEVICE_CONFIG_REFRESH_MS  (15UL * 60UL * 1000UL)
+#define DEVICE_CONFIG_RETRY_MS    60000  // after a failed fetch
+#define DEVICE_CONFIG_ETAG_MAX    64     // longer ETags are not stored, the next fetch is a full one
+#define HTTP_MAX_RESPONSE_HEADERS 4
+
+// Tone synthesis in AudioController
+#define AUDIO_SYNTH_SINE          0      // sinf() per sample, the old path, as a reference
+#define AUDIO_SYNTH_DDS           1      // phase accumulator + interpolated sine table
+#define AUDIO_SYNTH_DDS_LOOP      2      // pre-rendered periods, memcpy per buffer
+#define AUDIO_SYNTH_MODE          AUDIO_SYNTH_DDS_LOOP
+
+// Audio task - refills the I2S DMA buffers when the driver reports them free
+#define AUDIO_TASK_CORE           0      // off the sampling core
+#define AUDIO_TASK_PRIORITY       3      // above the network worker so HTTP can't starve the codec
+#define AUDIO_TASK_STACK          4096
+#define AUDIO_DMA_BUFFER_COUNT    8
+#define AUDIO_BUFFER_SAMPLES      1024   // per DMA buffer and per rendered block
+#define AUDIO_EVENT_QUEUE_LENGTH  AUDIO_DMA_BUFFER_COUNT
+#define AUDIO_SAMPLE_RATE         44100  // prompts have to be packed at this rate
+
+// Spoken prompts in their own flash partition, see partitions.csv and tools/pack_prompts.py
+#define PROMPT_PARTITION_LABEL    "prompts"
+#define PROMPT_PARTITION_SUBTYPE  0x40   // first custom data subtype
+
+// MPU6050 FIFO burst mode - the sensor buffers samples on-chip and we drain them in one go
+#define GYRO_USE_FIFO             1      // 0 = old per-tick getEvent() path
+#define GYRO_FIFO_BURST_MAX       85     // whole FIFO (1024 bytes / 12 byte frames)
+#define ACCEL_LSB_PER_G           4096.0F // raw counts per g at MPU6050_RANGE_8_G
+#define GYRO_LSB_PER_DPS          65.5F   // raw counts per deg/s at MPU6050_RANGE_500_DEG
+#define MPU6050_SETTLE_MS         50      // gyro start-up is 30ms typical
+
+// Raw IMU trace capture for replay on the host (ImuTrace.h, native build --replay)
+#define TRACE_CAPTURE_OFF         0
+#define TRACE_CAPTURE_SERIAL      1      // blocks go out on Serial between the log lines
+#define TRACE_CAPTURE_FLASH       2      // into TRACE_FILE_PATH on LittleFS
+#define TRACE_CAPTURE             TRACE_CAPTURE_OFF
+#define TRACE_FILE_PATH           "/trace.imt"
+#define TRACE_FILE_MAX_BYTES      (128 * 1024) // ~90s at 100Hz, shares the partition with the offline store
+#define TRACE_QUEUE_BLOCKS        8      // power of two, full blocks waiting for the trace task (~460 bytes each)
+#define TRACE_TASK_CORE           0
+#define TRACE_TASK_PRIORITY       1      // same as the log task, the writes can wait
+#define TRACE_TASK_STACK          3072
+#define TRACE_DRAIN_INTERVAL_MS   50
+
+// Integer sensor pipeline - calibration as integer count offsets and magnitudes compared
+// squared, so the per-sample path has no sqrt and no float math. 0 = old float/sqrt path.
+#define GYRO_FIXED_POINT          1
+#define ACCEL_COUNTS_PER_MS2      (ACCEL_LSB_PER_G / 9.80665F)
+#define ACCEL_SQ_COUNTS(ms2)      ((uint32_t)((ms2) * ACCEL_COUNTS_PER_MS2 * (ms2) * ACCEL_COUNTS_PER_MS2))
+#define GYRO_SQ_COUNTS(dps)       ((uint32_t)((dps) * GYRO_LSB_PER_DPS * (dps) * GYRO_LSB_PER_DPS))
+// FallDetection squares the runtime thresholds with these whenever the config changes
+
+// Orientation (OrientationFilter) - Madgwick filter over every calibrated sample on the
+// consumer side. Budget is per update at 240MHz, "prof" shows it as orientation.update;
+// even at 1kHz input that is under 1% of a core.
+#define ORIENTATION_BETA          0.1F   // rad/s, accel correction while moving
+#define ORIENTATION_BETA_STILL    1.0F   // rad/s, lying still gravity can be trusted, converge fast
+#define ORIENTATION_STILL_DPS     5.0F   // below this rotation (and near 1g) counts as still
+#define ORIENTATION_ACCEL_GATE    0.25F  // g, further off 1g (free fall, impacts) is gyro only
+#define ORIENTATION_MAX_GAP_US    200000UL // a longer gap in the samples restarts from the accelerometer
+#define ORIENTATION_CYCLE_BUDGET  2000
+// An emergency can also be made to need the wearer to end up in a different posture than
+// before the fall, lying still the way they stood (sat down, landed a jump) isn't one. Off
+// (0) until it is validated on recorded real falls, the server turns it on per device with
+// minPostureChangeDeg; 45 is what the synthetic bench was tuned with.
+#define FALL_MIN_POSTURE_CHANGE_DEG 0.0F
+
+// Sampling task - reads the sensor on a fixed deadline independent of loop()
+#define SAMPLING_TASK_CORE        1      // same core as loop(), WiFi lives on core 0
+#define SAMPLING_TASK_PRIORITY    5      // above loopTask (1) so HTTP/audio can't delay it
+#define SAMPLING_TASK_STACK       4096
+#define SAMPLE_RING_SIZE          256    // power of two, ~250ms of samples in burst mode
+
+// Rate profiles (RateProfile.h) - the sensor idles at a low rate, and GyroSensor switches
+// to the burst profile as soon as a sample comes near the free-fall threshold, then back
+// once postImpactWindowMs passed without another.
+// 0 = always RATE_PROFILE_NORMAL, the old fixed 100Hz setup.
+#define RATE_ADAPTIVE             1
+#define RATE_BURST_MARGIN         1.0F   // m/s^2 above freeFallThreshold that already starts a burst
+
+// Telemetry batching - one upload per window instead of one per sample
+#define TELEMETRY_BATCH_CAPACITY  100    // max samples a window can hold
+#define TELEMETRY_BATCH_SIZE      100    // flush when this many samples are collected...
+#define TELEMETRY_FLUSH_INTERVAL_MS 1000 // ...or when the window is this old
+#define TELEMETRY_FORMAT          TELEMETRY_FORMAT_JSON // TELEMETRY_FORMAT_CBOR only once the server accepts application/cbor
+#define TELEMETRY_PAYLOAD_BUFFER  6144   // fits a full window even as JSON (~50 bytes/sample)
+#define TELEMETRY_MIN_SPACING_MS  SAMPLING_PERIOD_MS // burst samples are thinned out to the nominal rate
+
+// Network worker - all HTTP runs on its own task so loop() never blocks on it
+#define NETWORK_TASK_CORE         0      // next to the WiFi stack, away from sampling
+#define NETWORK_TASK_PRIORITY     1
+#define NETWORK_TASK_STACK        8192   // TLS handshakes need a deep stack
+#define NETWORK_QUEUE_LENGTH      4      // one slot is always kept for fall alerts
+#define NETWORK_ALERT_RETRIES     3
+#define NETWORK_ALERT_RETRY_DELAY_MS 2000
+#define NETWORK_ALERT_RESUBMIT_MS    5000 // loop() offers a refused or failed alert to the queue again this often
+#define NETWORK_REPLAY_INTERVAL_MS   5000 // how often to retry the offline backlog
+#define NETWORK_CONNECT_TIMEOUT_MS   10000
+#define NETWORK_SESSION_RETRY_MS     30000 // WiFi/token/registration, until it works once...
+#define NETWORK_SESSION_RETRY_MAX_MS 600000 // ...doubling up to this
+#define AUTH_TOKEN_MAX               1024  // longest token cached in NVS
+#define WIFI_POLL_MS                 10    // link status poll while connecting
+#define WIFI_CACHED_CONNECT_MS       3000  // try the remembered access point this long, then scan
+
+// Deferred logging (Log.h) - hot paths queue binary records, a low priority task prints them
+#define LOG_RING_SIZE             64     // power of two, records
+#define LOG_PAYLOAD_BYTES         44     // arguments per record, 60 byte slots on the ESP32
+#define LOG_LINE_BYTES            192    // longest formatted line
+#define LOG_DEFAULT_LEVEL         LOG_LEVEL_INFO // per module at boot, "log <module> <level>" changes it
+#define LOG_TASK_CORE             0
+#define LOG_TASK_PRIORITY         1      // just above idle, below everything that logs
+#define LOG_TASK_STACK            3072
+#define LOG_DRAIN_INTERVAL_MS     20
+
+// Offline store-and-forward on LittleFS (default "spiffs" partition). A full window is
+// 1208 bytes on flash (100 x 12 byte samples + 8 byte header), 13 to a segment, so the
+// batch log holds ~208 windows: ~3.5 minutes of telemetry at 100Hz, ~7 at the 50Hz idle
+// rate. A longer outage keeps the most recent part, rotate() drops the oldest segments.
+// Alerts have their own log and are never pushed out by telemetry. The partition has no
+// room for much more next to the trace file.
+#define STORE_BATCH_SEGMENTS      16     // x STORE_BATCH_SEGMENT_BYTES
+#define STORE_BATCH_SEGMENT_BYTES 16384
+#define STORE_ALERT_SEGMENTS      2
+#define STORE_ALERT_SEGMENT_BYTES 4096
+#define STORE_FLUSH_INTERVAL_MS   30000  // telemetry is flushed at most this often and on rotation, a reset loses up to this much; alerts always
+#define STORE_CURSOR_SAVE_RECORDS 16     // replayed records between cursor writes to NVS (and on every new segment); a reset sends up to this many again
 
 
 #define ACCEL_BUFFER_SIZE         (PRE_IMPACT_WINDOW_MS / SAMPLING_PERIOD_MS)
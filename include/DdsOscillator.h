@@ -0,0 +1,63 @@
+#ifndef DDS_OSCILLATOR_H
+#define DDS_OSCILLATOR_H
+
+#include <Arduino.h>
+
+// Sine oscillator for AudioController, direct digital synthesis style: a 32-bit phase
+// accumulator (wraps for free) indexes a small sine table and interpolates between
+// entries, so rendering is integer adds and one multiply per sample.
+//
+// Loop mode renders a whole number of periods into a table once per frequency/volume
+// change and afterwards only copies from it.
+enum DdsMode {
+    DDS_MODE_INTERPOLATED,   // phase accumulator + table lookup per sample
+    DDS_MODE_LOOP,           // pre-rendered periods, copied out
+    DDS_MODE_SINE            // sinf() of the accumulator phase per sample, slow reference
+};
+
+class DdsOscillator {
+public:
+    DdsOscillator();
+
+    void setMode(DdsMode mode);
+    void setSampleRate(uint32_t sample_rate);
+    void setTone(int frequency_hz, float volume);
+    void resetPhase();
+
+    // Writes count samples, continuing where the last call stopped
+    void render(int16_t *out, int count);
+    // Same, but adds onto what is already in out (saturating) so voices can be layered
+    void mix(int16_t *out, int count);
+
+    DdsMode getMode() const;
+
+    static const int SINE_TABLE_BITS = 8;
+    static const int SINE_TABLE_SIZE = 1 << SINE_TABLE_BITS;
+    static const int LOOP_TABLE_MAX = 1024;
+
+private:
+    DdsMode _mode;
+    uint32_t _sample_rate;
+    int _frequency_hz;
+    int32_t _amplitude;          // volume in Q15
+
+    uint32_t _phase;
+    uint32_t _phase_increment;
+
+    // loop mode
+    int16_t _loop_table[LOOP_TABLE_MAX];
+    int _loop_length;
+    int _loop_pos;
+    bool _loop_dirty;
+
+    static int16_t _sine_table[SINE_TABLE_SIZE + 1];  // +1 so interpolation never wraps
+    static bool _sine_table_ready;
+    static void buildSineTable();
+
+    void renderInto(int16_t *out, int count, bool add);
+    void renderInterpolated(int16_t *out, int count, bool add);
+    void renderSine(int16_t *out, int count, bool add);
+    void buildLoopTable();
+};
+
+#endif // DDS_OSCILLATOR_H
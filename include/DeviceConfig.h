@@ -0,0 +1,83 @@
+#ifndef DEVICE_CONFIG_H
+#define DEVICE_CONFIG_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "Hal.h"
+
+// Everything the server can tune. Starts out as the Config.h defaults. All fields are
+// 4 bytes so there is no padding and two copies can be compared with memcmp().
+struct DeviceSettings {
+  float freeFallThreshold;        // m/s^2, below this counts as free fall
+  float impactThreshold;          // m/s^2, above this after a free fall is an impact
+  float inactivityThreshold;      // m/s^2 around gravity that still counts as lying still
+  float gyroThreshold;            // deg/s, rotation worth reporting during a free fall
+  uint32_t postImpactWindowMs;
+  uint32_t alarmDelayMs;
+  uint32_t requiredStillSamples;
+  uint32_t calibrationSamples;
+  uint32_t alarmFrequencyHz;
+  float alarmVolume;              // 0.0 - 1.0
+  float minPostureChangeDeg;      // deg an emergency has to move the posture, 0 = no check
+};
+
+// The device config shared by FallDetection, GyroSensor and AudioController.
+//
+// At boot load() brings back whatever the server sent last, straight from NVS, so the
+// thresholds are right before the network is even up. NetworkManager::fetchDeviceConfig()
+// later asks the server for it with the stored ETag, and only a changed config is parsed,
+// applied and written back.
+//
+// Written by the network task, read by the others: get() hands out a consistent copy,
+// and readers that cache derived values compare getVersion() to see when to redo them.
+class DeviceConfig {
+public:
+  DeviceConfig();
+
+  // Where applied configs are persisted, call before load()
+  void setStore(KeyValueStore *store);
+  // false = nothing usable stored, the defaults stay
+  bool load();
+
+  DeviceSettings get();
+  uint32_t getVersion();
+  // ETag of the config in use, "" if there is none
+  String getEtag();
+
+  // Parses a /device-config body. Missing (or null) keys get their defaults, and the
+  // whole document is rejected if a key has the wrong type or anything is out of range.
+  // The body is one JSON object, every key optional:
+  //
+  //   freeFallThreshold      number  m/s^2   0.5 - 9.8
+  //   impactThreshold        number  m/s^2   1 - 78
+  //   fallDetectionSensitivity       m/s^2   the older name of impactThreshold (the
+  //                                          first server API), used when that is absent
+  //   inactivityThreshold    number  m/s^2   0.1 - 9.8
+  //   gyroThreshold          number  deg/s   10 - 500
+  //   postImpactWindowMs     integer ms      500 - 30000
+  //   alarmDelayMs           integer ms      0 - 120000
+  //   requiredStillSamples   integer         1 - 3000, and * SAMPLING_PERIOD_MS within
+  //                                          postImpactWindowMs
+  //   calibrationSamples     integer         10 - 200
+  //   alarmFrequencyHz       integer Hz      100 - 8000
+  //   alarmVolume            number          0.0 - 1.0
+  //   minPostureChangeDeg    number  deg     0 - 180, 0 turns the posture check off
+  //
+  // Unknown keys are ignored, so the server can add some before the firmware knows them.
+  static bool parse(const char *json, size_t length, DeviceSettings &out);
+  static bool validate(const DeviceSettings &settings);
+  static DeviceSettings defaults();
+
+  // Makes settings current and persists them with their ETag. Unchanged settings
+  // keep the version, so readers don't redo anything for a config that didn't change.
+  bool apply(const DeviceSettings &settings, const char *etag);
+
+private:
+  KeyValueStore *store;
+  portMUX_TYPE lock;
+  DeviceSettings settings;
+  char etag[DEVICE_CONFIG_ETAG_MAX];
+  volatile uint32_t version;
+};
+
+#endif // DEVICE_CONFIG_H
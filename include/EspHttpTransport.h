@@ -0,0 +1,54 @@
+#ifndef ESP_HTTP_TRANSPORT_H
+#define ESP_HTTP_TRANSPORT_H
+
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include "Config.h"
+#include "Hal.h"
+
+#define WIFI_CACHE_KEY "wifi_ap"
+
+// WiFi station plus one long-lived HTTPS connection shared by every endpoint
+class EspHttpTransport : public HttpTransport {
+public:
+  EspHttpTransport(const char *ssid, const char *password);
+
+  // Remembers the access point (BSSID and channel) for a faster connect after reboot
+  void setStore(KeyValueStore *store);
+
+  bool connect(uint32_t timeoutMs);
+  bool isConnected();
+
+  int request(const char *method, const char *url,
+              const HttpHeader *headers, size_t headerCount,
+              const uint8_t *body, size_t bodyLength, String *response,
+              HttpResponseHeader *responseHeaders, size_t responseHeaderCount);
+  String errorToString(int code);
+
+  uint32_t getRequestCount();
+  uint32_t getHandshakeCount();
+
+private:
+  const char *ssid;
+  const char *password;
+  bool wifiStarted;
+  KeyValueStore *store;
+
+  struct WifiAccessPoint {
+    int32_t channel;
+    uint8_t bssid[6];
+  };
+
+  WiFiClientSecure secureClient;
+  HTTPClient http;
+  bool clientConfigured;
+  uint32_t requestCount;
+  uint32_t handshakeCount;
+
+  void closeConnection();
+  bool waitForLink(uint32_t timeoutMs);
+  void rememberAccessPoint();
+};
+
+#endif // ESP_HTTP_TRANSPORT_H
@@ -2,25 +2,109 @@
 #define FALL_DETECTION_H
 
 #include "Config.h"
+#include "DeviceConfig.h"
 #include "GyroSensor.h"
+#include "LedController.h"
+#include "OrientationFilter.h"
+#include "WindowStats.h"
+#include <CircularBuffer.hpp>
+
+// Outcome of the post-impact inactivity check, one answer per sample fed in
+enum PostImpactResult {
+  POST_IMPACT_PENDING,    // still watching
+  POST_IMPACT_CONFIRMED,  // lay still long enough - medical emergency
+  POST_IMPACT_CLEARED     // window ran out with movement, probably fine
+};
 
 class FallDetection {
 public:
-  FallDetection(GyroSensor &sensor);
+  // Thresholds and windows come from config, picked up whenever it changes
+  FallDetection(GyroSensor &sensor, LedController &led, DeviceConfig &config);
   
-  bool detectFall();
-  bool detectInactivityAfterImpact();
+  // Every sample in every state goes through here first, so the orientation is current
+  // when detectFall() or the post-impact check look at it
+  void updateOrientation(const ImuSample &sample);
+  OrientationFilter &getOrientation();
+
+  bool detectFall(const ImuSample &sample);
+  // Sample time the current (or last detected) free fall started
+  uint32_t getFreeFallStartUs();
+
+  // Post-impact inactivity check as a state machine: start it once, then hand it every
+  // sample from the normal stream until it stops answering PENDING. Never blocks, so
+  // loop() keeps servicing the button and audio while it runs.
+  void beginPostImpactCheck();
+  PostImpactResult updatePostImpactCheck(const ImuSample &sample);
+  bool isPostImpactCheckActive();
   void triggerAlarm();
   void cancelAlarm();
+  // How long after detectFall() the post-impact check should begin
+  uint32_t getAlarmDelayMs();
   
   SystemState getState();
   void setState(SystemState state);
+
+  // Pre-impact history, squared magnitudes in counts^2 (see ImuSample). Lives here on the
+  // consumer side so it can be read without racing the sampling task. One entry per
+  // SAMPLING_PERIOD_MS slot of sample time whatever the rate profile, so it always spans
+  // PRE_IMPACT_WINDOW_MS: the sample furthest from 1g in that slot, and the fastest rotation.
+  // A slot no sample fell in (the idle rate is half the nominal one) repeats the one before.
+  CircularBuffer<uint32_t, ACCEL_BUFFER_SIZE>& getAccelBuffer();
+  CircularBuffer<uint32_t, GYRO_BUFFER_SIZE>& getGyroBuffer();
+  const WindowStats<uint32_t, ACCEL_BUFFER_SIZE>& getAccelStats();
+  const WindowStats<uint32_t, GYRO_BUFFER_SIZE>& getGyroStats();
   
 private:
   GyroSensor &gyroSensor;
+  LedController &led;
+  DeviceConfig &config;
+
+  // the config in use, with its thresholds squared into counts^2 for the sample path
+  uint32_t configVersion;
+  DeviceSettings settings;
+  uint32_t freeFallThresholdSq;
+  uint32_t impactThresholdSq;
+  uint32_t gyroThresholdSq;
+  // |accel - 9.8| < inactivityThreshold  <=>  (9.8 - t)^2 < accel^2 < (9.8 + t)^2
+  uint32_t stillAccelMinSq;
+  uint32_t stillAccelMaxSq;
+  OrientationFilter orientation;
   SystemState currentState;
   unsigned long fallTimestamp;
   bool fallDetected;
+
+  // free-fall tracking; both timers run on sample time like the post-impact window, so
+  // detection only depends on the data and a replayed trace gives the same answer
+  bool inFreeFall;
+  uint32_t freeFallStartUs;
+  uint32_t lastDebugUs;
+
+  // post-impact check progress. Stillness is timed on the samples, so a run at the burst
+  // rate needs as long as one at the nominal rate: requiredStillSamples * SAMPLING_PERIOD_MS.
+  bool postImpactActive;
+  bool postImpactHasStart;
+  uint32_t postImpactStartUs;   // timestamp of the first sample in the window
+  uint32_t postImpactLastUs;
+  uint32_t stillUs;
+  int consecutiveStillSamples;
+  int postImpactSamples;
+
+  // the history slot being filled
+  bool historySlotOpen;
+  uint32_t historySlotEndUs;
+  uint32_t historyAccelSq;
+  uint32_t historyGyroSq;
+  uint32_t historyDeviation;
+
+  // fixed-size history, a full buffer drops its oldest entry; the getters return references, no copies
+  CircularBuffer<uint32_t, ACCEL_BUFFER_SIZE> accelBuffer;
+  CircularBuffer<uint32_t, GYRO_BUFFER_SIZE> gyroBuffer;
+  // running mean/variance/min/max over the buffers above, updated on every push
+  WindowStats<uint32_t, ACCEL_BUFFER_SIZE> accelStats;
+  WindowStats<uint32_t, GYRO_BUFFER_SIZE> gyroStats;
+
+  void refreshSettings();
+  void addToHistory(const ImuSample &sample);
 };
 
 #endif // FALL_DETECTION_H
@@ -1,19 +1,41 @@
 #ifndef GYRO_SENSOR_H
 #define GYRO_SENSOR_H
 
-#include <Wire.h>
-#include <Adafruit_MPU6050.h>
-#include <Adafruit_Sensor.h>
-#include <CircularBuffer.hpp>
 #include "Config.h"
+#include "DeviceConfig.h"
+#include "BiasTracker.h"
+#include "ImuSample.h"
+#include "Hal.h"
 
 class GyroSensor {
 public:
-  GyroSensor();
+  GyroSensor(ImuDevice &device, Clock &clock, DeviceConfig &config);
   
   bool initialize();
-  void calibrate();
-  void process();
+  // Blocking calibration, the device has to lie still (any side up). false if it moved,
+  // the offsets are still used and the bias tracker corrects them later.
+  bool calibrate();
+
+  // Where calibrations are persisted, call before loadCalibration()
+  void setCalibrationStore(KeyValueStore *store);
+  // false = nothing usable stored, calibrate() instead
+  bool loadCalibration();
+  // Writes the current offsets if they drifted by CALIBRATION_SAVE_DELTA since the last
+  // save. Not from the sampling task, NVS writes can stall for milliseconds.
+  bool saveCalibration();
+  // offsets in raw counts, and how often the tracker has refined them since the last calibration
+  void getCalibration(float accelOffset[3], float gyroOffset[3]);
+  uint32_t getBiasUpdateCount();
+
+  int process(); // returns how many new samples were taken
+
+  // Rate profile in use. With RATE_ADAPTIVE process() switches between idle and burst
+  // by itself; setRateProfile() is for pinning one from the sampling task (or before it runs).
+  bool setRateProfile(RateProfileId profile);
+  RateProfileId getRateProfile();
+  // how long the sampling task should sleep between process() calls
+  uint32_t getPollPeriodMs();
+  uint32_t getRateSwitchCount();
   void getAccelGyroData(float &accelMagnitude, float &gyroMagnitude);
   
   float getAccelX();
@@ -23,24 +45,52 @@ public:
   float getGyroX();
   float getGyroY();
   float getGyroZ();
-  
-  CircularBuffer<float, ACCEL_BUFFER_SIZE>& getAccelBuffer();
-  CircularBuffer<float, GYRO_BUFFER_SIZE>& getGyroBuffer();
+
+  uint32_t getLastSampleTimeUs();
+  ImuSample getLastSample();
+
+  // every sample process() takes also gets pushed into this ring (producer side)
+  void setSampleSink(SampleRing *ring);
+  uint32_t getFifoOverflowCount();
+
   
 private:
-  // we use the CircularBuffer because it helps with RAM which we have limited of because lets say the buffer is full its going to remove old data and replace it with a new one and its easier to find states that happend like falling emrgencty etc. jsut in general more benefitial and as u can see we have two instance of him the private one is the acual buffer. the second one with the & they give reference to the accual buffer without having to copy them everytime they are used which would limit our memory even more.
-  Adafruit_MPU6050 mpu;
-  CircularBuffer<float, ACCEL_BUFFER_SIZE> accelBuffer;
-  CircularBuffer<float, GYRO_BUFFER_SIZE> gyroBuffer;
-  
-  float accelCalibX, accelCalibY, accelCalibZ;
-  float gyroCalibX, gyroCalibY, gyroCalibZ;
+  ImuDevice &device;
+  Clock &clock;
+  DeviceConfig &config;
+  RawImuSample fifoBurst[GYRO_FIFO_BURST_MAX]; // kept here instead of on the loop() stack
   
-  float lastAccelX, lastAccelY, lastAccelZ;
-  float lastGyroX, lastGyroY, lastGyroZ;
+  KeyValueStore *calibrationStore;
+  BiasTracker biasTracker;
+  portMUX_TYPE calibrationLock;   // the offsets change on the sampling task, get saved from loop()
+
+  // calibration offsets in raw counts
+  float accelBias[3];
+  float gyroBias[3];
+  float savedAccelBias[3];
+  float savedGyroBias[3];
+  bool calibrationSaved;
+
+  // the same offsets rounded for the fixed point path
+  int16_t accelOffset[3];
+  int16_t gyroOffset[3];
+
+  ImuSample lastSample;
+  SampleRing *sampleSink;
+
+  volatile RateProfileId rateProfile;
+  volatile uint32_t rateSwitches;
+  // burst trigger squared like FallDetection's thresholds, redone when the config changes
+  uint32_t rateConfigVersion;
+  uint32_t burstBelowSq;
+  uint32_t burstHoldUs;
+  bool burstWanted;
+  uint32_t lastBurstTriggerUs;
 
-float lastAccelMagnitude;
-  float lastGyroMagnitude;
+  void setBias(const float accel[3], const float gyro[3]);
+  void updateCountOffsets();
+  void applyRawSample(const RawImuSample &raw);
+  void refreshRateSettings();
 };
 
 #endif // GYRO_SENSOR_H
@@ -0,0 +1,118 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <Arduino.h>
+#include "ImuSample.h"
+#include "RateProfile.h"
+
+// Thin hardware interfaces. The device build wires in the ESP32 implementations
+// (Mpu6050Device, ArduinoClock, I2sAudioSink, EspHttpTransport, NvsStore), the native build the
+// simulated ones in native/, so the detection, calibration and payload code above them
+// runs unchanged on a Linux host.
+
+// 6-axis IMU, raw counts (ACCEL_LSB_PER_G / GYRO_LSB_PER_DPS)
+class ImuDevice {
+public:
+  virtual ~ImuDevice() {}
+
+  virtual bool begin(const RateProfile &profile) = 0;
+  // Switches rate on the fly. Whatever was buffered should have been read first, samples
+  // taken from here on come at the new spacing.
+  virtual bool setRateProfile(const RateProfile &profile) = 0;
+  // One reading taken right now, used by calibration
+  virtual bool readSample(RawImuSample &out, uint32_t nowUs) = 0;
+  // Everything the device collected since the last call, oldest first
+  virtual size_t readBurst(RawImuSample *out, size_t maxSamples, uint32_t nowUs) = 0;
+  // Throw away whatever is buffered
+  virtual void flush() = 0;
+  virtual uint32_t getOverflowCount() = 0;
+};
+
+class Clock {
+public:
+  virtual ~Clock() {}
+
+  virtual uint32_t millis() = 0;
+  virtual uint32_t micros() = 0;
+  virtual void delayMs(uint32_t ms) = 0;
+};
+
+// millis()/micros()/delay() from the Arduino core (or the native shim)
+class ArduinoClock : public Clock {
+public:
+  uint32_t millis() { return ::millis(); }
+  uint32_t micros() { return ::micros(); }
+  void delayMs(uint32_t ms) { ::delay(ms); }
+};
+
+// 16-bit mono PCM output
+class AudioSink {
+public:
+  virtual ~AudioSink() {}
+
+  virtual bool begin(uint32_t sampleRate) = 0;
+  virtual void end() = 0;
+  // Takes as many bytes as fit right now and returns how many, never waits
+  virtual size_t write(const uint8_t *data, size_t length) = 0;
+  // Blocks until there is room for more data or timeoutMs passed
+  virtual bool waitForSpace(uint32_t timeoutMs) = 0;
+};
+
+struct HttpHeader {
+  const char *name;
+  const char *value;
+};
+
+// A response header the caller wants back. request() fills in value, "" if it wasn't sent.
+struct HttpResponseHeader {
+  const char *name;
+  String value;
+};
+
+enum HttpStatus {
+  HTTP_STATUS_OK = 200,
+  HTTP_STATUS_CREATED = 201,
+  HTTP_STATUS_NOT_MODIFIED = 304,
+  HTTP_STATUS_UNAUTHORIZED = 401,
+  HTTP_STATUS_FORBIDDEN = 403,
+  HTTP_STATUS_REQUEST_TIMEOUT = 408,
+  HTTP_STATUS_TOO_MANY_REQUESTS = 429,
+  HTTP_STATUS_SERVER_ERROR = 500   // and everything above
+};
+
+// Network link plus one HTTP(S) connection to the API host
+class HttpTransport {
+public:
+  virtual ~HttpTransport() {}
+
+  // Brings the link up if it isn't, giving up after timeoutMs. false = offline.
+  virtual bool connect(uint32_t timeoutMs) = 0;
+  virtual bool isConnected() = 0;
+
+  // Sends one request and returns the HTTP status, or a negative transport error.
+  // body may be NULL for GET, response may be NULL to discard the body. At most
+  // HTTP_MAX_RESPONSE_HEADERS response headers can be asked for.
+  virtual int request(const char *method, const char *url,
+                      const HttpHeader *headers, size_t headerCount,
+                      const uint8_t *body, size_t bodyLength, String *response,
+                      HttpResponseHeader *responseHeaders = NULL, size_t responseHeaderCount = 0) = 0;
+  virtual String errorToString(int code) = 0;
+
+  // connection reuse stats - handshakes should stay far below requests
+  virtual uint32_t getRequestCount() = 0;
+  virtual uint32_t getHandshakeCount() = 0;
+};
+
+// Small values that have to survive a reboot (NVS on the device)
+class KeyValueStore {
+public:
+  virtual ~KeyValueStore() {}
+
+  // Copies the value into out and returns its length, 0 if there is none or it is
+  // longer than maxLength
+  virtual size_t get(const char *key, void *out, size_t maxLength) = 0;
+  virtual bool put(const char *key, const void *data, size_t length) = 0;
+  virtual bool remove(const char *key) = 0;
+};
+
+#endif // HAL_H
@@ -0,0 +1,31 @@
+#ifndef I2S_AUDIO_SINK_H
+#define I2S_AUDIO_SINK_H
+
+#include <driver/i2s.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "Config.h"
+#include "Hal.h"
+
+// The I2S amplifier. write() never waits, waitForSpace() sleeps on the driver's
+// event queue until a DMA buffer has been played out.
+class I2sAudioSink : public AudioSink {
+public:
+    I2sAudioSink(int bclk_pin = BCLK_PIN, int lrc_pin = LRC_PIN, int data_pin = DIN_PIN);
+
+    bool begin(uint32_t sample_rate);
+    void end();
+    size_t write(const uint8_t *data, size_t length);
+    bool waitForSpace(uint32_t timeout_ms);
+
+private:
+    int _bclk_pin;
+    int _lrc_pin;
+    int _data_pin;
+    bool _installed;
+    QueueHandle_t _i2s_queue;
+
+    static const i2s_port_t I2S_PORT = I2S_NUM_0;
+};
+
+#endif // I2S_AUDIO_SINK_H
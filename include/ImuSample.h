@@ -0,0 +1,37 @@
+#ifndef IMU_SAMPLE_H
+#define IMU_SAMPLE_H
+
+#include <stdint.h>
+#include <math.h>
+#include "Config.h"
+#include "SpscRing.h"
+
+// One raw 6-axis reading straight from the MPU6050 registers (big-endian counts already swapped).
+// Temperature is left out on purpose, we never use it and it costs 2 extra bytes per FIFO frame.
+struct RawImuSample {
+  uint32_t timestampUs;
+  int16_t accelX, accelY, accelZ;
+  int16_t gyroX, gyroY, gyroZ;
+};
+
+// A calibrated sample as handed from the sampling task to the fall detector.
+// Everything stays in raw sensor counts so the sampling path never touches floats;
+// squared magnitudes are compared against thresholds squared once per config change.
+// The float helpers below are for telemetry and debug output, keep them off the hot path.
+struct ImuSample {
+  uint32_t timestampUs;
+  int16_t accelX, accelY, accelZ;   // counts (ACCEL_LSB_PER_G per g), calibration offsets removed
+  int16_t gyroX, gyroY, gyroZ;      // counts (GYRO_LSB_PER_DPS per deg/s), calibration offsets removed
+  uint32_t accelMagSq;              // accelX^2 + accelY^2 + accelZ^2
+  uint32_t gyroMagSq;               // gyroX^2 + gyroY^2 + gyroZ^2
+
+  float accelMagnitude() const { return sqrtf((float)accelMagSq) / ACCEL_COUNTS_PER_MS2; } // m/s^2
+  float gyroMagnitude() const { return sqrtf((float)gyroMagSq) / GYRO_LSB_PER_DPS; }        // deg/s
+
+  static float accelToMs2(int16_t counts) { return counts / ACCEL_COUNTS_PER_MS2; }
+  static float gyroToRads(int16_t counts) { return counts * (float)(DEG_TO_RAD / GYRO_LSB_PER_DPS); }
+};
+
+typedef SpscRing<ImuSample, SAMPLE_RING_SIZE> SampleRing;
+
+#endif // IMU_SAMPLE_H
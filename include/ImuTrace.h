@@ -0,0 +1,174 @@
+#ifndef IMU_TRACE_H
+#define IMU_TRACE_H
+
+#include <Arduino.h>
+#include "Hal.h"
+#include "ImuSample.h"
+#include "SpscRing.h"
+#include "Config.h"
+
+// Binary IMU traces: raw 6-axis counts with timestamps, exactly what the device handed
+// GyroSensor, so a recording can be fed back through calibration and fall detection.
+//
+// A trace is a sequence of self-contained blocks:
+//
+//   TraceBlockHeader   sync, version, sample count, timestamp of the first sample,
+//                      CRC16 over the header and the records
+//   TraceRecord[count] microseconds since the previous sample + 6 x int16 counts
+//
+// 14 bytes per sample instead of 16, ~1.4KB/s at 100Hz. The sync word and CRC let a
+// reader pick the blocks out of a serial capture that also has the normal log text in it,
+// and skip a block that got damaged on the way, so a raw dump of the port
+// (cat /dev/ttyUSB0 > capture.imt) can be replayed as it is.
+
+#define TRACE_SYNC                0x5AA5
+#define TRACE_VERSION             1
+#define TRACE_BLOCK_SAMPLES       32     // ~320ms at 100Hz per block
+
+struct __attribute__((packed)) TraceBlockHeader {
+  uint16_t sync;
+  uint8_t version;
+  uint8_t count;
+  uint32_t firstTimestampUs;
+  uint16_t samplePeriodUs;   // nominal, for tools; the records carry the real spacing
+  uint16_t crc;              // CRC16-CCITT over the header (crc = 0) and the records
+};
+
+struct __attribute__((packed)) TraceRecord {
+  uint16_t deltaUs;          // 0 for the first sample of a block
+  int16_t accelX, accelY, accelZ;
+  int16_t gyroX, gyroY, gyroZ;
+};
+
+// Header and records back to back, so a block goes out in a single write() and log
+// lines from other tasks can only land between blocks
+struct __attribute__((packed)) TraceBlock {
+  TraceBlockHeader header;
+  TraceRecord records[TRACE_BLOCK_SAMPLES];
+};
+
+// Packs samples into blocks and queues each full block; drain() writes the queued blocks
+// to a Print (Serial, a LittleFS File, ...). add() runs on the sampling task and only
+// copies, the CRC, the write and the file sync happen in drain() on a low priority task
+// (TraceDrainTask on the device). With no output set it just drops the samples, so it
+// can stay wired in.
+class TraceWriter {
+public:
+  TraceWriter();
+
+  // maxBytes = 0 means no limit, otherwise writing stops once the trace reaches it.
+  // syncEachBlock calls output->flush() after every block, so a file survives a reset
+  // (don't use it on Serial, its flush() waits for the UART to drain).
+  // begin() and end() only while nothing is adding or draining.
+  void begin(Print *output, uint32_t samplePeriodUs, uint32_t maxBytes = 0, bool syncEachBlock = false);
+  void end();
+  bool isActive();
+
+  // producer side
+  void add(const RawImuSample &sample);
+  // Queues a partial block
+  void flush();
+
+  // consumer side - writes out every queued block, returns how many
+  size_t drain();
+
+  uint32_t getBytesWritten();
+  uint32_t getSamplesWritten();
+  uint32_t getDroppedSamples();  // queue full, output full, or over the size limit
+
+private:
+  Print *output;
+  uint16_t samplePeriodUs;
+  uint32_t maxBytes;
+  bool syncEachBlock;
+  uint32_t bytesWritten;
+  uint32_t samplesWritten;
+  uint32_t droppedSamples;        // drain() side
+  volatile uint32_t queueDrops;   // add() side
+
+  TraceBlock block;
+  uint32_t lastTimestampUs;
+  SpscRing<TraceBlock, TRACE_QUEUE_BLOCKS> queue;
+  TraceBlock outgoing;            // drain()'s copy, too big for the task stack
+
+  void write(TraceBlock &out);
+};
+
+// Pulls samples back out of a trace held in memory. Anything between blocks (log text,
+// a block with a bad CRC) is skipped over.
+class TraceReader {
+public:
+  TraceReader(const uint8_t *data, size_t length);
+
+  bool next(RawImuSample &out);
+  // Timestamp of the sample next() would return, false at the end of the trace
+  bool peekTimestamp(uint32_t &timestampUs);
+  void rewind();
+
+  uint32_t getSamplePeriodUs();   // from the last block read, 0 before the first
+  uint32_t getBlockCount();
+  uint32_t getCorruptBlocks();
+  size_t getSkippedBytes();
+
+private:
+  const uint8_t *data;
+  size_t length;
+  size_t pos;
+
+  TraceBlock block;
+  uint8_t blockIndex;
+  uint32_t blockTimestampUs;
+
+  uint32_t blockCount;
+  uint32_t corruptBlocks;
+  size_t skippedBytes;
+
+  bool loadBlock();
+};
+
+// Sits between GyroSensor and the real device and records every sample that goes past,
+// calibration readings included.
+class TracingImuDevice : public ImuDevice {
+public:
+  TracingImuDevice(ImuDevice &device, TraceWriter &writer);
+
+  bool begin(const RateProfile &profile);
+  bool setRateProfile(const RateProfile &profile);
+  bool readSample(RawImuSample &out, uint32_t nowUs);
+  size_t readBurst(RawImuSample *out, size_t maxSamples, uint32_t nowUs);
+  void flush();
+  uint32_t getOverflowCount();
+
+private:
+  ImuDevice &device;
+  TraceWriter &writer;
+};
+
+// Plays a trace back as if it were the sensor. Trace time is lined up with the clock on
+// the first read (and again after flush(), which is where calibration hands over to the
+// FIFO), after that readBurst() returns every sample that is due by nowUs.
+class TraceImuDevice : public ImuDevice {
+public:
+  TraceImuDevice(TraceReader &reader);
+
+  bool begin(const RateProfile &profile);
+  bool setRateProfile(const RateProfile &profile);
+  bool readSample(RawImuSample &out, uint32_t nowUs);
+  size_t readBurst(RawImuSample *out, size_t maxSamples, uint32_t nowUs);
+  void flush();
+  uint32_t getOverflowCount();
+
+  bool isFinished();
+  // Clock time at which the next sample becomes due (nowUs is passed in as the current
+  // time, which is the answer before the trace is lined up), false at the end of the trace
+  bool nextDueUs(uint32_t &nowUs);
+
+private:
+  TraceReader &reader;
+  bool aligned;
+  uint32_t offsetUs;       // clock time - trace time
+
+  void align(uint32_t nowUs);
+};
+
+#endif // IMU_TRACE_H
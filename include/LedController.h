@@ -0,0 +1,57 @@
+#ifndef LED_CONTROLLER_H
+#define LED_CONTROLLER_H
+
+#include <esp_timer.h>
+#include "Config.h"
+
+enum LedPatternId {
+  LED_PATTERN_OFF,
+  LED_PATTERN_ON,
+  LED_PATTERN_CALIBRATING,   // slow blink while the device has to be held still
+  LED_PATTERN_READY,         // single short blink, setup finished
+  LED_PATTERN_FREE_FALL,     // one 50ms flash
+  LED_PATTERN_FALL_DETECTED, // 1Hz blink while we wait for the alarm delay
+  LED_PATTERN_ALARM,         // fast blink until the button is pressed
+  LED_PATTERN_ERROR,         // very fast blink, something is broken
+  LED_PATTERN_COUNT
+};
+
+// One step of a pattern: hold the LED at level for durationMs (0 = hold forever)
+struct LedStep {
+  uint8_t level;
+  uint16_t durationMs;
+};
+
+struct LedPattern {
+  const LedStep *steps;
+  uint8_t stepCount;
+  bool repeat;           // loop forever, otherwise the LED goes off after the last step
+};
+
+// Plays blink patterns from an esp_timer callback so nobody has to delay() for them.
+// start() swaps the pattern immediately and returns, the timer ticks every LED_TICK_MS
+// and moves through the steps in the background.
+class LedController {
+public:
+  LedController(int pin = LED_PIN);
+
+  bool begin();
+  void start(LedPatternId pattern);
+  LedPatternId current();
+
+private:
+  int pin;
+  esp_timer_handle_t timer;
+  portMUX_TYPE lock;
+
+  // pattern state, shared between start() and the timer callback
+  const LedPattern *pattern;
+  LedPatternId patternId;
+  uint8_t step;
+  uint16_t stepElapsedMs;
+
+  static void timerCallback(void *arg);
+  void tick();
+};
+
+#endif // LED_CONTROLLER_H
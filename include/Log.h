@@ -0,0 +1,133 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include <type_traits>
+#include "Config.h"
+
+// Deferred logging. LOG_INFO(FALL, "Impact: %.2f m/s2", accel) doesn't format anything:
+// it copies the format string pointer, a timestamp and the raw arguments into a fixed
+// slot of a lock-free ring, and LogDrainTask (or Log::drain() on the host) turns the
+// records into text later, off the sampling and network paths.
+//
+// Format strings have to be literals (only the pointer is stored). %s arguments are
+// copied, so a String or a stack buffer is fine, but long ones get cut to what fits in
+// the record. Arguments past LOG_PAYLOAD_BYTES print as "?".
+//
+// Each module has its own runtime level ("log <module> <level>" on the serial console),
+// and a statement above it costs one compare; its arguments aren't even evaluated.
+
+enum LogLevel {
+  LOG_LEVEL_NONE,
+  LOG_LEVEL_ERROR,
+  LOG_LEVEL_WARN,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_DEBUG
+};
+
+enum LogModule {
+  LOG_MODULE_MAIN,
+  LOG_MODULE_SENSOR,
+  LOG_MODULE_FALL,
+  LOG_MODULE_NET,
+  LOG_MODULE_AUDIO,
+  LOG_MODULE_COUNT
+};
+
+enum LogArgType {
+  LOG_ARG_INT,
+  LOG_ARG_UINT,
+  LOG_ARG_FLOAT,
+  LOG_ARG_STRING    // followed by a length byte and the characters, no terminator
+};
+
+struct LogRecord {
+  uint32_t timestampUs;
+  const char *format;
+  uint8_t module;
+  uint8_t level;
+  uint8_t length;       // payload bytes used
+  uint8_t truncated;    // some arguments didn't fit
+  uint8_t payload[LOG_PAYLOAD_BYTES];
+};
+
+class Log {
+public:
+  static inline bool enabled(LogModule module, LogLevel level) {
+    return level <= levels[module];
+  }
+
+  static void setLevel(LogModule module, LogLevel level);
+  static LogLevel getLevel(LogModule module);
+  static const char *moduleName(LogModule module);
+  static const char *levelName(LogLevel level);
+  static bool parseModule(const char *name, LogModule &module);
+  static bool parseLevel(const char *name, LogLevel &level);
+
+  // Producer side, any task
+  template <typename... Args>
+  static void write(LogModule module, LogLevel level, const char *format, const Args &... args) {
+    uint32_t ticket;
+    LogRecord *record = reserve(ticket);
+    if (record == NULL) return;   // ring full, counted in getDroppedCount()
+
+    record->timestampUs = micros();
+    record->format = format;
+    record->module = module;
+    record->level = level;
+    record->length = 0;
+    record->truncated = 0;
+    pack(*record, args...);
+    commit(ticket);
+  }
+
+  // Consumer side, one task only. Formats up to maxRecords records into out and returns
+  // how many there were.
+  static size_t drain(Print &out, size_t maxRecords = SIZE_MAX);
+  static uint32_t getDroppedCount();
+
+  // raw argument encoding, public for the pack() overloads below
+  static void addInt(LogRecord &record, int32_t value);
+  static void addUint(LogRecord &record, uint32_t value);
+  static void addFloat(LogRecord &record, float value);
+  static void addString(LogRecord &record, const char *value);
+
+private:
+  static uint8_t levels[LOG_MODULE_COUNT];
+
+  static LogRecord *reserve(uint32_t &ticket);
+  static void commit(uint32_t ticket);
+  static void format(const LogRecord &record, Print &out);
+
+  static inline void pack(LogRecord &record) {}
+
+  template <typename T, typename... Rest>
+  static inline void pack(LogRecord &record, const T &value, const Rest &... rest) {
+    add(record, value);
+    pack(record, rest...);
+  }
+
+  template <typename T>
+  static inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+  add(LogRecord &record, T value) { addInt(record, (int32_t)value); }
+
+  template <typename T>
+  static inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+  add(LogRecord &record, T value) { addUint(record, (uint32_t)value); }
+
+  static inline void add(LogRecord &record, double value) { addFloat(record, (float)value); }
+  static inline void add(LogRecord &record, const char *value) { addString(record, value); }
+  static inline void add(LogRecord &record, const String &value) { addString(record, value.c_str()); }
+};
+
+#define LOG_AT(module, level, ...) \
+  do { \
+    if (Log::enabled(LOG_MODULE_##module, level)) Log::write(LOG_MODULE_##module, level, __VA_ARGS__); \
+  } while (0)
+
+#define LOG_ERROR(module, ...) LOG_AT(module, LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(module, ...)  LOG_AT(module, LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(module, ...)  LOG_AT(module, LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(module, ...) LOG_AT(module, LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif // LOG_H
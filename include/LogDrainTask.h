@@ -0,0 +1,27 @@
+#ifndef LOG_DRAIN_TASK_H
+#define LOG_DRAIN_TASK_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "Config.h"
+#include "Log.h"
+
+// Formats the deferred log records (Log.h) and writes them out, every
+// LOG_DRAIN_INTERVAL_MS at the lowest priority we run anything at. All the printf work
+// and the waiting on the UART happen here instead of in the task that logged.
+class LogDrainTask {
+public:
+  LogDrainTask(Print &output);
+
+  bool start();
+
+private:
+  Print &out;
+  TaskHandle_t taskHandle;
+  uint32_t reportedDrops;
+
+  static void taskEntry(void *param);
+  void run();
+};
+
+#endif // LOG_DRAIN_TASK_H
@@ -0,0 +1,34 @@
+#ifndef MPU6050_DEVICE_H
+#define MPU6050_DEVICE_H
+
+#include <Wire.h>
+#include <Adafruit_MPU6050.h>
+#include <Adafruit_Sensor.h>
+#include "Config.h"
+#include "Hal.h"
+#include "Mpu6050Fifo.h"
+
+// The real sensor: Adafruit driver for setup and single readings, our FIFO reader
+// for the bursts (GYRO_USE_FIFO), or one getEvent() per burst without it.
+class Mpu6050Device : public ImuDevice {
+public:
+  Mpu6050Device();
+
+  bool begin(const RateProfile &profile);
+  bool setRateProfile(const RateProfile &profile);
+  bool readSample(RawImuSample &out, uint32_t nowUs);
+  size_t readBurst(RawImuSample *out, size_t maxSamples, uint32_t nowUs);
+  void flush();
+  uint32_t getOverflowCount();
+
+private:
+  Adafruit_MPU6050 mpu;
+  uint8_t i2cAddress;
+
+  void applyClockAndFilter(const RateProfile &profile);
+#if GYRO_USE_FIFO
+  Mpu6050Fifo fifo;
+#endif
+};
+
+#endif // MPU6050_DEVICE_H
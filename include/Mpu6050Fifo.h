@@ -0,0 +1,61 @@
+#ifndef MPU6050_FIFO_H
+#define MPU6050_FIFO_H
+
+#include <Wire.h>
+#include "ImuSample.h"
+
+// Register map bits we need for the FIFO (MPU-6000/6050 register map rev 4.2)
+#define MPU6050_REG_SMPLRT_DIV    0x19
+#define MPU6050_REG_FIFO_EN       0x23
+#define MPU6050_REG_INT_ENABLE    0x38
+#define MPU6050_REG_INT_STATUS    0x3A
+#define MPU6050_REG_USER_CTRL     0x6A
+#define MPU6050_REG_FIFO_COUNTH   0x72
+#define MPU6050_REG_FIFO_R_W      0x74
+
+#define MPU6050_FIFO_EN_ACCEL     0x08
+#define MPU6050_FIFO_EN_XYZG      0x70   // XG | YG | ZG
+#define MPU6050_USER_CTRL_FIFO_EN    0x40
+#define MPU6050_USER_CTRL_FIFO_RESET 0x04
+#define MPU6050_INT_FIFO_OFLOW    0x10
+
+#define MPU6050_FIFO_SIZE_BYTES   1024
+#define MPU6050_FIFO_FRAME_BYTES  12     // accel XYZ + gyro XYZ, 2 bytes each, no temperature
+
+// Reads accel+gyro frames out of the MPU6050's on-chip FIFO in bursts.
+// The sensor keeps sampling at its own rate while loop() is busy, we just collect
+// everything that piled up since the last call instead of losing it.
+class Mpu6050Fifo {
+public:
+  Mpu6050Fifo();
+
+  bool begin(TwoWire *wire, uint8_t address, uint32_t samplePeriodUs);
+  // New output rate; drains nothing, so read what is buffered first. The FIFO is reset
+  // so no frame gets stamped with the wrong spacing.
+  bool setSamplePeriod(uint32_t samplePeriodUs);
+  void reset();
+
+  // Number of complete frames waiting in the FIFO
+  uint16_t available();
+
+  // Drains up to maxSamples frames into out and stamps them relative to nowUs.
+  // Returns how many samples were written.
+  size_t readBurst(RawImuSample *out, size_t maxSamples, uint32_t nowUs);
+
+  uint32_t getOverflowCount() const;
+
+private:
+  TwoWire *wire;
+  uint8_t address;
+  uint32_t samplePeriodUs;
+  uint32_t lastTimestampUs;
+  bool haveTimestamp;       // continuing a timeline, cleared on reset
+  bool stampedAny;          // lastTimestampUs is valid, kept across resets
+  uint32_t overflowCount;
+
+  bool writeRegister(uint8_t reg, uint8_t value);
+  bool readRegisters(uint8_t reg, uint8_t *buffer, size_t length);
+  bool checkOverflow();
+};
+
+#endif // MPU6050_FIFO_H
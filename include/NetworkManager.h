@@ -1,10 +1,11 @@
 #ifndef NETWORK_MANAGER_H
 #define NETWORK_MANAGER_H
 
-#include <WiFi.h>
-#include <HTTPClient.h>
-#include <ArduinoJson.h>
 #include "Config.h"
+#include "DeviceConfig.h"
+#include "Hal.h"
+#include "TelemetryBatcher.h"
+#include "TelemetryEncoder.h"
 
 // WiFi credentials - update these with your network info
 #define WIFI_SSID "Homies101"
@@ -13,29 +14,65 @@
 // API endpoints - update with your server address
 #define API_BASE_URL "https://health-monitoring-api-gaajasa6aac0b9dy.canadacentral-01.azurewebsites.net/api"
 #define API_ENDPOINT API_BASE_URL "/SensorData"
+#define API_BATCH_ENDPOINT API_BASE_URL "/SensorData/batch"
 #define REGISTER_ENDPOINT API_BASE_URL "/DeviceTokens/register"
 #define GET_TOKEN_ENDPOINT API_BASE_URL "/get-test-token"
 #define GET_DEVICE_CONFIG_ENDPOINT API_BASE_URL "/device-config/"
-// Unique device identifier
-#define DEVICE_ID "ESP32_FALL_001"
+
+// NVS keys for the cached session
+#define SESSION_TOKEN_KEY "token"
+#define SESSION_REGISTERED_KEY "registered"
 
 // Send data every 30 seconds
 //#define SEND_INTERVAL_MS 30000
 
+// What became of a telemetry or alert POST, so the caller knows whether keeping it for
+// later is any use
+enum SendResult {
+  SEND_OK,         // 200/201, the server has it
+  SEND_RETRY,      // offline, transport error, 5xx, 408/429: the same request can work later
+  SEND_REJECTED    // any other 4xx (after one new token for 401/403): it never will, drop it
+};
+
 class NetworkManager {
 public:
-  NetworkManager();
-  bool initialize(); // This will now also fetch the token and register
-  bool sendSensorData(float accel, float gyro, bool fallDetected);
+  NetworkManager(HttpTransport &transport);
+  // Token and registration are cached here so a known device skips both at boot.
+  // Call before initialize().
+  void setStore(KeyValueStore *store);
+  bool initialize(); // link, token and registration, each only if not done yet
+  bool hasSession(); // token and registered
+  SendResult sendSensorData(float accel, float gyro, bool fallDetected, uint32_t timestampMs = 0); // 0 = now
+  SendResult sendSensorBatch(const TelemetrySample *samples, size_t count); // one request for a whole window
   void reconnect();
-  bool fetchDeviceConfig();
+  bool fetchDeviceConfig(DeviceConfig &config); // true = config is current (applied or 304)
+
+  // connection reuse stats - handshakes should stay far below requests
+  uint32_t getRequestCount();
+  uint32_t getHandshakeCount();
   
 private:
   bool isConnected;
   unsigned long lastDataSendTime;
   String authToken; 
+  bool registered;
+  bool sessionLoaded;
+  KeyValueStore *store;
+
+  // WiFi and the shared keep-alive connection live behind this
+  HttpTransport &transport;
+
+  // request bodies are encoded in here, only the network task touches it
+  uint8_t payloadBuffer[TELEMETRY_PAYLOAD_BUFFER];
+
+  int postPayload(const char *url, const TelemetryWriter &writer, String *response);
+  static SendResult resultOf(int httpResponseCode);
+  bool reauthenticate();
   bool fetchAuthToken(); // New private method to get the token
   bool registerDeviceInternal(); // Renamed for clarity, called after token fetch
+  void loadSession();
+  void saveAuthToken();
+  void dropAuthToken();
 };
 
 #endif // NETWORK_MANAGER_H
@@ -0,0 +1,90 @@
+#ifndef NETWORK_WORKER_H
+#define NETWORK_WORKER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "Config.h"
+#include "NetworkManager.h"
+#include "TelemetryBatcher.h"
+#include "TelemetryStore.h"
+
+enum NetworkRequestType {
+  NET_REQUEST_BATCH,
+  NET_REQUEST_FALL_ALERT
+};
+
+enum NetworkResult {
+  NET_RESULT_SENT,    // the server has it
+  NET_RESULT_STORED,  // couldn't send, saved to flash and will be replayed later
+  NET_RESULT_FAILED   // lost: the store was full, or the server rejected the request
+};
+
+// Called on the worker task when a request finished (or gave up). Keep it short.
+typedef void (*NetworkCallback)(NetworkRequestType type, NetworkResult result, void *context);
+
+// A queued request. Copied by value into the FreeRTOS queue, so the caller's buffers
+// can be reused the moment submit returns.
+struct NetworkRequest {
+  NetworkRequestType type;
+  float accel;
+  float gyro;
+  uint16_t sampleCount;
+  TelemetrySample samples[TELEMETRY_BATCH_CAPACITY];
+};
+
+// Runs all NetworkManager calls on a background task so loop() never waits on HTTP,
+// WiFi reconnects or TLS. Requests go into a bounded queue; submit* returns right away
+// and reports false if the queue had no room. One slot is always kept free for fall
+// alerts, and alerts jump to the front of the queue.
+// With a TelemetryStore attached, anything that can't be sent is written to flash and
+// replayed in order (alerts first) as soon as a request goes through again.
+// The worker also brings the network up: WiFi, auth token and registration start with
+// the task and are retried, backing off from NETWORK_SESSION_RETRY_MS, until they work.
+// With a DeviceConfig attached, it is fetched once the session is up and then every
+// DEVICE_CONFIG_REFRESH_MS. Both only run while nothing else is waiting.
+class NetworkWorker {
+public:
+  NetworkWorker(NetworkManager &manager);
+
+  bool start();
+
+  bool submitBatch(const TelemetrySample *samples, size_t count);
+  bool submitFallAlert(float accel, float gyro);
+
+  void setCallback(NetworkCallback callback, void *context);
+  void setStore(TelemetryStore *store); // call before start()
+  void setDeviceConfig(DeviceConfig *config); // call before start()
+
+  size_t pendingCount();
+  bool isBusy();
+  uint32_t getFailedCount();
+
+private:
+  NetworkManager &networkManager;
+  QueueHandle_t queue;
+  TaskHandle_t taskHandle;
+  NetworkCallback callback;
+  void *callbackContext;
+  volatile bool busy;
+  volatile uint32_t failedCount;
+  TelemetryStore *store;
+  DeviceConfig *deviceConfig;
+  uint32_t nextConfigFetchMs;
+  uint32_t nextSessionAttemptMs;
+  uint32_t sessionRetryMs;
+
+  // the request the worker is currently handling, kept off the task stack
+  NetworkRequest current;
+  StoredRecord replayRecord;
+
+  static void taskEntry(void *param);
+  void run();
+  NetworkResult handle(const NetworkRequest &request);
+  void replayStored();
+  void refreshConfigIfDue();
+  void bringUpIfDue();
+  static TickType_t waitUntil(uint32_t dueMs, TickType_t wait);
+};
+
+#endif // NETWORK_WORKER_H
@@ -0,0 +1,26 @@
+#ifndef NVS_STORE_H
+#define NVS_STORE_H
+
+#include <Preferences.h>
+#include "Config.h"
+#include "Hal.h"
+
+// KeyValueStore on one NVS namespace. Keys are at most 15 characters. NVS does its
+// own wear levelling, but every put() is still a flash write, so callers only write
+// values that actually changed.
+class NvsStore : public KeyValueStore {
+public:
+  NvsStore();
+
+  bool begin(const char *name = NVS_NAMESPACE);
+
+  size_t get(const char *key, void *out, size_t maxLength);
+  bool put(const char *key, const void *data, size_t length);
+  bool remove(const char *key);
+
+private:
+  Preferences preferences;
+  bool opened;
+};
+
+#endif // NVS_STORE_H
@@ -0,0 +1,48 @@
+#ifndef ORIENTATION_FILTER_H
+#define ORIENTATION_FILTER_H
+
+#include "Config.h"
+#include "ImuSample.h"
+
+// Device orientation from the calibrated samples, Madgwick's gradient descent filter
+// (IMU variant, no magnetometer, so heading drifts but tilt doesn't). Each update()
+// integrates the gyro into the quaternion and pulls it towards the accelerometer's
+// gravity direction at up to beta rad/s:
+//  - ORIENTATION_BETA while moving, the gyro carries the orientation
+//  - ORIENTATION_BETA_STILL while lying still, so a new posture shows within a second
+//  - gyro only while the accelerometer is far off 1g (free fall, impacts)
+// dt comes from the sample timestamps, so any sample rate works; the first sample and
+// every one after a gap start over from the accelerometer.
+//
+// Everything is single precision, about ORIENTATION_CYCLE_BUDGET cycles per update.
+class OrientationFilter {
+public:
+  OrientationFilter();
+
+  void reset();
+  void update(const ImuSample &sample);
+  // false until the first sample
+  bool isValid();
+
+  // w, x, y, z in Madgwick's convention (the earth frame relative to the sensor frame)
+  void getQuaternion(float q[4]);
+  // Unit vector pointing up, in sensor axes
+  void getUp(float up[3]);
+  // Angle between the sensor Z axis and vertical, 0 = lying flat face up
+  float getTiltDeg();
+
+  // Remembers the current posture; getPostureChangeDeg() is how far the device has
+  // tilted away from it since, whichever way
+  void markReference();
+  float getPostureChangeDeg();
+
+private:
+  float q0, q1, q2, q3;
+  float referenceUp[3];
+  uint32_t lastUs;
+  bool valid;
+
+  void startFromAccel(const ImuSample &sample);
+};
+
+#endif // ORIENTATION_FILTER_H
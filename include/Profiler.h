@@ -0,0 +1,113 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+// Hot-path profiler. Drop a probe at the top of any block:
+//
+//   void GyroSensor::process() {
+//     PROFILE_SCOPE("gyro.process");
+//     ...
+//
+// and every pass through the block lands in a fixed-size cycle-count histogram for that
+// name. Profiler::dump() prints count, mean, p50/p90/p99 and max for every probe that has
+// run (the "prof" serial command in main.cpp).
+//
+// Probes read the CPU cycle counter on entry and exit, a few dozen cycles all told, and
+// never lock or allocate. The counter is per core, so only time code that stays on one
+// core (all our tasks are pinned). It is also 32 bits, ~17.9s at 240MHz: blocks that can
+// take that long (HTTP requests) use PROFILE_SCOPE_LONG, which also reads millis() and
+// falls back to it once the cycle count may have wrapped. Build with -DPROFILER_ENABLED=0
+// and the macros expand to nothing and Profiler.cpp compiles to two empty functions.
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED          1
+#endif
+
+// Log-linear buckets: exact below 4 cycles, then 4 per power of two (25% resolution)
+// up to 2^32 cycles, anything longer goes in the last one
+#define PROFILER_SUB_BUCKETS      4
+#define PROFILER_BUCKETS          (PROFILER_SUB_BUCKETS + 30 * PROFILER_SUB_BUCKETS)
+
+struct ProfileProbe {
+  const char *name;
+  uint32_t count;
+  uint64_t maxCycles;
+  uint64_t totalCycles;
+  uint32_t buckets[PROFILER_BUCKETS];
+  ProfileProbe *next;
+
+  explicit ProfileProbe(const char *probeName);
+
+  inline void record(uint64_t cycles) {
+    count++;
+    totalCycles += cycles;
+    if (cycles > maxCycles) maxCycles = cycles;
+    buckets[bucketFor(cycles > UINT32_MAX ? UINT32_MAX : (uint32_t)cycles)]++;
+  }
+
+  static inline uint32_t bucketFor(uint32_t cycles) {
+    if (cycles < PROFILER_SUB_BUCKETS) return cycles;
+    uint32_t octave = 31 - __builtin_clz(cycles);   // >= 2, one NSAU on the ESP32
+    uint32_t sub = (cycles >> (octave - 2)) & (PROFILER_SUB_BUCKETS - 1);
+    return PROFILER_SUB_BUCKETS + (octave - 2) * PROFILER_SUB_BUCKETS + sub;
+  }
+  // Largest cycle count that still lands in bucket
+  static uint32_t bucketUpperBound(uint32_t bucket);
+};
+
+class ProfileScope {
+public:
+  inline explicit ProfileScope(ProfileProbe &p) : probe(p), start(ESP.getCycleCount()) {}
+  inline ~ProfileScope() { probe.record(ESP.getCycleCount() - start); }
+
+private:
+  ProfileProbe &probe;
+  uint32_t start;
+};
+
+// For blocks that may outlast the 32-bit cycle counter: past half its range the
+// millis() difference is used instead, at millisecond resolution
+class ProfileLongScope {
+public:
+  inline explicit ProfileLongScope(ProfileProbe &p) : probe(p), start(ESP.getCycleCount()), startMs(millis()) {}
+  inline ~ProfileLongScope() {
+    uint32_t cycles = ESP.getCycleCount() - start;
+    uint64_t msCycles = (uint64_t)(millis() - startMs) * ESP.getCpuFreqMHz() * 1000;
+    probe.record(msCycles > UINT32_MAX / 2 ? msCycles : cycles);
+  }
+
+private:
+  ProfileProbe &probe;
+  uint32_t start;
+  uint32_t startMs;
+};
+
+class Profiler {
+public:
+  // Every probe that has run at least once, in order of first use
+  static ProfileProbe *first();
+  static void add(ProfileProbe *probe);
+
+  static void dump(Print &out);
+  static void reset();
+  // Cycle count at or below which `percent` of the calls finished (bucket resolution)
+  static uint64_t percentile(const ProfileProbe &probe, uint8_t percent);
+};
+
+#if PROFILER_ENABLED
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// The probe is a function-local static, so it is registered the first time the scope runs
+#define PROFILE_SCOPE(name) \
+  static ProfileProbe PROFILE_CONCAT(profileProbe_, __LINE__)(name); \
+  ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(PROFILE_CONCAT(profileProbe_, __LINE__))
+#define PROFILE_SCOPE_LONG(name) \
+  static ProfileProbe PROFILE_CONCAT(profileProbe_, __LINE__)(name); \
+  ProfileLongScope PROFILE_CONCAT(profileScope_, __LINE__)(PROFILE_CONCAT(profileProbe_, __LINE__))
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_SCOPE_LONG(name) do {} while (0)
+#endif
+
+#endif // PROFILER_H
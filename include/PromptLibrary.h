@@ -0,0 +1,58 @@
+#ifndef PROMPT_LIBRARY_H
+#define PROMPT_LIBRARY_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include "Config.h"
+
+// Spoken prompts, packed by tools/pack_prompts.py into the "prompts" partition
+// (see partitions.csv). IDs are the order the WAV files were given to the packer.
+enum PromptId {
+  PROMPT_FALL_DETECTED,     // "fall detected, press the button if you are OK"
+  PROMPT_HELP_CALLED,       // "help has been called"
+  PROMPT_ALARM_CANCELLED,   // "alarm cancelled"
+  PROMPT_COUNT
+};
+
+// Partition image layout, little endian:
+//   PromptImageHeader
+//   PromptImageEntry[count]
+//   PCM data, 16-bit signed mono at sampleRate, every clip 4-byte aligned
+#define PROMPT_IMAGE_MAGIC    0x504D5250  // "PRMP"
+#define PROMPT_IMAGE_VERSION  1
+
+struct PromptImageHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;
+  uint32_t sampleRate;
+  uint32_t reserved;
+};
+
+struct PromptImageEntry {
+  uint32_t offset;          // bytes from the start of the partition
+  uint32_t sampleCount;
+};
+
+// Maps the prompt partition into the address space once, clips are then plain pointers
+// into flash that can go to i2s_write() without being copied to RAM first.
+class PromptLibrary {
+public:
+  PromptLibrary();
+  ~PromptLibrary();
+
+  bool begin(uint32_t sampleRate);
+  bool isAvailable();
+
+  // Fills in the clip's samples. false if the ID isn't in the image.
+  bool getClip(uint16_t id, const int16_t **samples, uint32_t *sampleCount);
+
+private:
+  const uint8_t *mapped;
+  uint32_t mappedSize;
+  spi_flash_mmap_handle_t mapHandle;
+  const PromptImageHeader *header;
+  const PromptImageEntry *entries;
+};
+
+#endif // PROMPT_LIBRARY_H
@@ -0,0 +1,36 @@
+#ifndef RATE_PROFILE_H
+#define RATE_PROFILE_H
+
+#include <stdint.h>
+#include "Config.h"
+
+// How fast the sensor samples and how often the sampling task drains it. GyroSensor
+// idles on RATE_PROFILE_IDLE and switches to RATE_PROFILE_BURST around anything that
+// could be a fall (see RATE_ADAPTIVE in Config.h). Samples carry their own timestamps,
+// so everything downstream works on sample time and doesn't care which profile made them.
+enum RateProfileId {
+  RATE_PROFILE_IDLE,
+  RATE_PROFILE_NORMAL,    // the old fixed setup, for calibration and with RATE_ADAPTIVE 0
+  RATE_PROFILE_BURST,
+  RATE_PROFILE_COUNT
+};
+
+struct RateProfile {
+  const char *name;
+  uint32_t samplePeriodUs;  // output data rate, a whole number of ms (1kHz / divider)
+  uint16_t bandwidthHz;     // DLPF: 184, 94, 44, 21, 10 or 5. 260 (off) changes the base rate, not supported
+  uint32_t i2cClockHz;      // 400kHz needed from ~500Hz up, the FIFO moves 12 bytes per sample
+  uint32_t pollPeriodMs;    // sampling task wake-up, the FIFO holds 85 samples
+};
+
+static const RateProfile RATE_PROFILES[RATE_PROFILE_COUNT] = {
+  { "idle",   20000, 21,  100000, 40 },
+  { "normal", SAMPLING_PERIOD_MS * 1000UL, 21, 100000, SAMPLING_PERIOD_MS },
+  { "burst",  1000,  184, 400000, 10 },
+};
+
+static inline const RateProfile &getRateProfile(RateProfileId id) {
+  return RATE_PROFILES[id < RATE_PROFILE_COUNT ? id : RATE_PROFILE_NORMAL];
+}
+
+#endif // RATE_PROFILE_H
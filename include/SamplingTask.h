@@ -0,0 +1,37 @@
+#ifndef SAMPLING_TASK_H
+#define SAMPLING_TASK_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "Config.h"
+#include "GyroSensor.h"
+
+// Runs GyroSensor::process() from its own FreeRTOS task, every poll period of the rate
+// profile in use (picked up again after each call, so a profile switch applies to the
+// very next wake-up). Uses vTaskDelayUntil so the period is measured from the last
+// deadline and not from whenever we woke up, so a slow wake-up doesn't shift every
+// sample after it.
+// Samples come out the other side through the SampleRing set on the sensor.
+class SamplingTask {
+public:
+  SamplingTask(GyroSensor &sensor, SampleRing &ring);
+
+  bool start();
+  void stop();
+  bool isRunning();
+
+  // how late the task woke up compared to its deadline, worst case since start
+  uint32_t getMaxJitterUs();
+  uint32_t getDroppedSamples();
+
+private:
+  GyroSensor &gyroSensor;
+  SampleRing &sampleRing;
+  TaskHandle_t taskHandle;
+  volatile uint32_t maxJitterUs;
+
+  static void taskEntry(void *param);
+  void run();
+};
+
+#endif // SAMPLING_TASK_H
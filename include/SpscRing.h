@@ -0,0 +1,70 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Single-producer / single-consumer lock-free ring buffer.
+// One task calls push(), one other task calls pop(), nobody needs a mutex. Only uses
+// std::atomic so the same header works on the ESP32 and in a host build with std::thread.
+// Capacity has to be a power of two so wrapping is just a mask. When the ring is full
+// push() refuses the new item and counts it as dropped, the consumer is never blocked.
+template <typename T, size_t Capacity>
+class SpscRing {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+  SpscRing() : head(0), tail(0), dropped(0) {}
+
+  // producer side
+  bool push(const T &item) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= Capacity) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    items[h & (Capacity - 1)] = item;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side
+  bool pop(T &item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[t & (Capacity - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side - look at the oldest item without taking it
+  bool peek(T &item) const {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[t & (Capacity - 1)];
+    return true;
+  }
+
+  // approximate when called from the "wrong" side, exact from either side when the other is idle
+  size_t size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+
+  bool isEmpty() const { return size() == 0; }
+  constexpr size_t capacity() const { return Capacity; }
+  uint32_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+  T items[Capacity];
+  // head and tail only ever grow, unsigned wrap-around keeps h - t correct
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+  std::atomic<uint32_t> dropped;
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,50 @@
+#ifndef TELEMETRY_BATCHER_H
+#define TELEMETRY_BATCHER_H
+
+#include "Config.h"
+#include "ImuSample.h"
+
+// One point of regular (non-emergency) telemetry
+struct TelemetrySample {
+  uint32_t timestampMs;
+  float accel;  // m/s^2
+  float gyro;   // deg/s
+};
+
+// Collects telemetry into time windows so we do one HTTPS request per window instead
+// of one per 10ms sample. A window is ready when it holds batchSize samples or when
+// flushIntervalMs passed since its first sample, whichever comes first.
+// Fall alerts don't go through here, they are sent right away.
+class TelemetryBatcher {
+public:
+  TelemetryBatcher(size_t batchSize = TELEMETRY_BATCH_SIZE, uint32_t flushIntervalMs = TELEMETRY_FLUSH_INTERVAL_MS);
+
+  void configure(size_t batchSize, uint32_t flushIntervalMs);
+
+  // returns false if the window is already full (caller should flush first). The window
+  // keeps one sample per TELEMETRY_MIN_SPACING_MS slot, counted from its first sample and
+  // rounded to the nearest, so a burst at a high sensor rate doesn't fill windows any
+  // faster while samples at the nominal rate are all kept even with a few ms of jitter.
+  bool add(uint32_t timestampMs, float accel, float gyro);
+  // Same, straight from the sample stream: the magnitudes are only converted to m/s^2
+  // and deg/s (two sqrtf) for samples the window actually keeps
+  bool add(uint32_t timestampMs, const ImuSample &sample);
+  bool shouldFlush(uint32_t nowMs) const;
+  void clear();
+
+  size_t count() const;
+  const TelemetrySample *samples() const;
+
+private:
+  TelemetrySample window[TELEMETRY_BATCH_CAPACITY];
+  size_t sampleCount;
+  size_t batchSize;
+  uint32_t flushIntervalMs;
+  uint32_t windowStartMs;
+  uint32_t lastSlot;    // slot of the last sample kept
+
+  // false when the window is full; slot is NULL for a sample skipped for spacing
+  bool reserve(uint32_t timestampMs, TelemetrySample *&slot);
+};
+
+#endif // TELEMETRY_BATCHER_H
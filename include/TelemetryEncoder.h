@@ -0,0 +1,68 @@
+#ifndef TELEMETRY_ENCODER_H
+#define TELEMETRY_ENCODER_H
+
+#include "Config.h"
+#include "TelemetryBatcher.h"
+
+enum TelemetryFormat {
+  TELEMETRY_FORMAT_JSON,
+  TELEMETRY_FORMAT_CBOR   // RFC 8949, definite lengths, floats as single precision
+};
+
+#define TELEMETRY_MAX_DEPTH 6
+
+// Streams a document straight into a caller-owned buffer, either as CBOR or as JSON,
+// with the same calls for both. No heap, no intermediate String or JsonDocument.
+// CBOR needs the element count up front, so beginMap/beginArray take it (JSON ignores it).
+// If the buffer runs out, overflowed() turns true and the rest is silently skipped.
+class TelemetryWriter {
+public:
+  TelemetryWriter(uint8_t *buffer, size_t capacity, TelemetryFormat format);
+
+  void beginMap(size_t count);
+  void endMap();
+  void beginArray(size_t count);
+  void endArray();
+  void key(const char *name);
+
+  void value(float v);
+  void value(uint32_t v);
+  void value(bool v);
+  void value(const char *v);
+
+  size_t size() const;
+  bool overflowed() const;
+  const uint8_t *data() const;
+  const char *contentType() const;
+
+private:
+  uint8_t *buffer;
+  size_t capacity;
+  size_t length;
+  bool overflow;
+  TelemetryFormat format;
+
+  // JSON only: comma bookkeeping per nesting level
+  uint8_t depth;
+  bool firstInContainer[TELEMETRY_MAX_DEPTH];
+  bool expectValue;
+
+  void put(uint8_t byte);
+  void put(const void *bytes, size_t count);
+  void cborHead(uint8_t majorType, uint32_t argument);
+  void jsonSeparator();
+  void jsonOpen(char bracket);
+  void jsonClose(char bracket);
+  void jsonString(const char *text);
+};
+
+// The request bodies NetworkManager sends, built on top of TelemetryWriter so the
+// same field layout goes out in either format
+class TelemetryPayload {
+public:
+  static void sensorData(TelemetryWriter &writer, float accel, float gyro, bool fallDetected, uint32_t timestampMs);
+  static void sensorBatch(TelemetryWriter &writer, const TelemetrySample *samples, size_t count);
+  static void registration(TelemetryWriter &writer, const char *token);
+};
+
+#endif // TELEMETRY_ENCODER_H
@@ -0,0 +1,115 @@
+#ifndef TELEMETRY_STORE_H
+#define TELEMETRY_STORE_H
+
+#include <FS.h>
+#include "Config.h"
+#include "Hal.h"
+#include "TelemetryBatcher.h"
+
+#define STORE_MAX_PAYLOAD (TELEMETRY_BATCH_CAPACITY * sizeof(TelemetrySample))
+
+enum StoredRecordType {
+  STORED_BATCH = 1,
+  STORED_FALL_ALERT = 2
+};
+
+// One record read back from flash for replay
+struct StoredRecord {
+  StoredRecordType type;
+  uint32_t timestampMs;
+  float accel;
+  float gyro;
+  uint16_t sampleCount;
+  TelemetrySample samples[TELEMETRY_BATCH_CAPACITY];
+};
+
+// Append-only log split over numbered segment files (/store/t_00000012.seg ...).
+// We always write to the newest segment and replay from the oldest. A segment is
+// deleted as soon as everything in it was replayed, and when the log is full the
+// oldest segment is dropped. Because segment numbers keep counting up, every write
+// lands in a new file, so no flash block gets hammered.
+//
+// Appends are flushed (a LittleFS metadata commit) at most every flushIntervalMs, on
+// rotation, and when the reader needs the unflushed tail; 0 flushes every record.
+// The read cursor goes to the KeyValueStore whenever replay moves to a new segment and
+// every STORE_CURSOR_SAVE_RECORDS records in between, so draining a backlog costs a few
+// NVS writes rather than one per record. A reboot resumes replay from there: at most that
+// many records go out twice, the server gets nothing twice from an older segment.
+//
+// Record layout: 8 byte header (magic, type, version, payload length, crc16) + payload.
+// A torn record at the end of a segment (power loss mid-write) fails the crc and the
+// rest of that segment is skipped.
+class SegmentLog {
+public:
+  SegmentLog(const char *prefix, uint8_t maxSegments, uint32_t segmentBytes, uint32_t flushIntervalMs);
+
+  // cursorStore may be NULL, replay then restarts at the oldest segment after a reboot
+  bool begin(fs::FS &fs, KeyValueStore *cursorStore);
+  bool append(uint8_t type, const uint8_t *payload, uint16_t length);
+
+  bool hasPending();
+  // reads the oldest unsent record, payload must hold STORE_MAX_PAYLOAD bytes
+  bool peek(uint8_t &type, uint8_t *payload, uint16_t &length);
+  void consume();
+
+  uint32_t getDroppedSegments();
+
+private:
+  fs::FS *fs;
+  KeyValueStore *cursorStore;
+  const char *prefix;
+  uint8_t maxSegments;
+  uint32_t segmentBytes;
+  uint32_t flushIntervalMs;
+
+  uint32_t readSeq;      // oldest segment with unsent data
+  uint32_t readOffset;   // position of the next record inside it
+  uint32_t writeSeq;     // segment currently appended to
+  uint32_t writeSize;    // bytes already in the write segment
+  uint32_t flushedSize;  // how much of that a reader (or a reboot) can see
+  uint32_t lastFlushMs;
+  uint16_t peekedLength; // size of the record peek() returned, so consume() can skip it
+  uint16_t unsavedRecords; // consumed since the cursor was last saved
+  uint32_t droppedSegments;
+  fs::File writeFile;
+
+  void segmentPath(uint32_t seq, char *path, size_t size);
+  uint32_t segmentSize(uint32_t seq);
+  void removeSegment(uint32_t seq);
+  void advanceReadSegment();
+  bool rotate();
+  void flushWrite();
+  void saveCursor();
+  void restoreCursor();
+};
+
+// Persists telemetry windows and fall alerts while we are offline and hands them back
+// for replay once the network is up again. Alerts live in their own log and always
+// come out first.
+class TelemetryStore {
+public:
+  TelemetryStore();
+
+  // where the replay position is kept across reboots, call before begin()
+  void setCursorStore(KeyValueStore *store);
+  bool begin(fs::FS &fs);
+
+  bool appendBatch(const TelemetrySample *samples, size_t count);
+  bool appendAlert(float accel, float gyro, uint32_t timestampMs);
+
+  bool hasPending();
+  bool hasPendingBatches();
+  bool peekNext(StoredRecord &record);
+  void consumeNext();
+
+  uint32_t getDroppedSegments();
+
+private:
+  bool ready;
+  KeyValueStore *cursorStore;
+  SegmentLog alertLog;
+  SegmentLog batchLog;
+  SegmentLog *peekedLog;
+};
+
+#endif // TELEMETRY_STORE_H
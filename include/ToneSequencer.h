@@ -0,0 +1,78 @@
+#ifndef TONE_SEQUENCER_H
+#define TONE_SEQUENCER_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "DdsOscillator.h"
+
+// A pattern is a list of steps, each one a tone (or a sweep from start_hz to end_hz)
+// for duration_ms. start_hz == 0 is a rest. Durations are turned into sample counts
+// when a step starts, so timing is exact to the sample and doesn't depend on millis().
+// Steps shorter than a sample are skipped; a pattern with nothing but those is not played.
+struct ToneStep {
+    uint16_t start_hz;
+    uint16_t end_hz;
+    uint16_t duration_ms;
+    uint8_t level;            // 0-255, scales the voice volume
+};
+
+struct TonePattern {
+    const ToneStep *steps;
+    uint8_t step_count;
+    bool repeat;
+};
+
+#define TONE_PATTERN(steps, repeat) { steps, (uint8_t)(sizeof(steps) / sizeof(steps[0])), repeat }
+
+// Built-in patterns
+constexpr ToneStep TONE_PULSE_STEPS[] = {
+    { ALARM_SOUND_FREQUENCY_HZ, ALARM_SOUND_FREQUENCY_HZ, 150, 255 },
+    { 0, 0, 150, 0 }
+};
+constexpr ToneStep TONE_SIREN_STEPS[] = {
+    { 600, 1200, 500, 255 },
+    { 1200, 600, 500, 255 }
+};
+constexpr ToneStep TONE_CHIME_STEPS[] = {
+    { 1047, 1047, 150, 255 },   // C6
+    { 1319, 1319, 150, 220 },   // E6
+    { 1568, 1568, 300, 190 }    // G6
+};
+
+constexpr TonePattern TONE_PATTERN_PULSE = TONE_PATTERN(TONE_PULSE_STEPS, true);
+constexpr TonePattern TONE_PATTERN_SIREN = TONE_PATTERN(TONE_SIREN_STEPS, true);
+constexpr TonePattern TONE_PATTERN_CHIME = TONE_PATTERN(TONE_CHIME_STEPS, false);
+
+// One voice playing one pattern at a time. AudioController layers two of them (alarm in
+// the background, beeps on top) into the same buffer.
+class ToneVoice {
+public:
+    ToneVoice();
+
+    void setSampleRate(uint32_t sample_rate);
+    // false (and the voice stops) for an empty pattern or one without a step that lasts a sample
+    bool play(const TonePattern *pattern, float volume);
+    void stop();
+    bool isActive() const;
+
+    // Writes count samples into out, or adds them on top of it when mix is set.
+    // An idle voice writes silence (or leaves out alone when mixing).
+    void render(int16_t *out, int count, bool mix);
+
+private:
+    DdsOscillator _oscillator;
+    uint32_t _sample_rate;
+    const TonePattern *_pattern;
+    float _volume;
+    bool _active;
+
+    uint8_t _step;
+    uint32_t _step_samples;   // length of the current step in samples
+    uint32_t _step_pos;       // samples of the current step already rendered
+    uint8_t _empty_steps;     // steps in a row that ended without a sample
+
+    uint32_t stepSamples(const ToneStep &step) const;
+    void enterStep(uint8_t step);
+};
+
+#endif // TONE_SEQUENCER_H
@@ -0,0 +1,27 @@
+#ifndef TRACE_DRAIN_TASK_H
+#define TRACE_DRAIN_TASK_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "Config.h"
+#include "ImuTrace.h"
+
+// Writes the trace blocks TraceWriter queued on the sampling task, every
+// TRACE_DRAIN_INTERVAL_MS at the lowest priority we run anything at. The CRC, the
+// Serial/LittleFS write and the per-block file sync happen here instead of between two
+// sensor reads.
+class TraceDrainTask {
+public:
+  TraceDrainTask(TraceWriter &writer);
+
+  bool start();
+
+private:
+  TraceWriter &traceWriter;
+  TaskHandle_t taskHandle;
+
+  static void taskEntry(void *param);
+  void run();
+};
+
+#endif // TRACE_DRAIN_TASK_H
@@ -0,0 +1,125 @@
+#ifndef WINDOW_STATS_H
+#define WINDOW_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <CircularBuffer.hpp>
+
+// Running statistics over the last N values of a CircularBuffer<T, N>.
+// Push values through push(buffer, value) instead of buffer.push(value) and mean,
+// variance, min and max are always ready, each push is O(1) (amortized for min/max):
+//  - mean/variance use a sliding Welford update (running mean + sum of squared deviations),
+//    which stays accurate for big values like squared magnitudes where sum/sumSq would
+//    cancel out. Floats still drift a little when values are added and later taken out
+//    again, so every N pushes both are rebuilt from the buffer - O(N) once per window,
+//    still O(1) per push.
+//  - min/max use monotonic deques: the max deque only keeps values that could still
+//    become the maximum (each one bigger than everything pushed after it), so the front
+//    is always the current max. Same thing mirrored for min.
+template <typename T, size_t N>
+class WindowStats {
+public:
+  WindowStats() { clear(); }
+
+  void clear() {
+    runningMean = 0;
+    m2 = 0;
+    count = 0;
+    pushCount = 0;
+    minHead = minSize = 0;
+    maxHead = maxSize = 0;
+  }
+
+  void push(CircularBuffer<T, N> &buffer, T value) {
+    float v = (float)value;
+
+    if (buffer.isFull()) {
+      // the buffer is about to drop its oldest value: swap it for the new one
+      float old = (float)buffer.first();
+      float oldMean = runningMean;
+      runningMean += (v - old) / count;
+      m2 += (v - old) * (v - runningMean + old - oldMean);
+    } else {
+      count++;
+      float delta = v - runningMean;
+      runningMean += delta / count;
+      m2 += delta * (v - runningMean);
+    }
+    buffer.push(value);
+
+    uint32_t seq = pushCount++;
+
+    // drop deque fronts that slid out of the window before adding, so neither deque
+    // ever needs more than N slots (signed difference keeps this right across wrap-around)
+    uint32_t oldestSeq = pushCount - count;
+    while (maxSize > 0 && (int32_t)(maxEntries[maxHead].seq - oldestSeq) < 0) { maxHead = (maxHead + 1) % N; maxSize--; }
+    while (minSize > 0 && (int32_t)(minEntries[minHead].seq - oldestSeq) < 0) { minHead = (minHead + 1) % N; minSize--; }
+
+    pushMonotonic(maxEntries, maxHead, maxSize, value, seq, true);
+    pushMonotonic(minEntries, minHead, minSize, value, seq, false);
+
+    if (pushCount % N == 0) {
+      resync(buffer);
+    }
+  }
+
+  size_t size() const { return count; }
+  bool isFull() const { return count == N; }
+
+  float mean() const { return runningMean; }
+
+  // population variance of the window
+  float variance() const {
+    if (count == 0) return 0;
+    return m2 > 0 ? m2 / count : 0; // rounding can make it a hair negative
+  }
+
+  T min() const { return minSize > 0 ? minEntries[minHead].value : T(); }
+  T max() const { return maxSize > 0 ? maxEntries[maxHead].value : T(); }
+
+private:
+  struct Entry {
+    T value;
+    uint32_t seq;   // push number, tells us when the value leaves the window
+  };
+
+  float runningMean;
+  float m2;         // sum of squared deviations from the mean
+  size_t count;
+  uint32_t pushCount;
+
+  Entry maxEntries[N];
+  size_t maxHead, maxSize;
+  Entry minEntries[N];
+  size_t minHead, minSize;
+
+  static void pushMonotonic(Entry *entries, size_t head, size_t &size, T value, uint32_t seq, bool keepLarger) {
+    // anything at the back that the new value beats can never be the answer again
+    while (size > 0) {
+      const Entry &back = entries[(head + size - 1) % N];
+      if (keepLarger ? back.value > value : back.value < value) break;
+      size--;
+    }
+    Entry &slot = entries[(head + size) % N];
+    slot.value = value;
+    slot.seq = seq;
+    size++;
+  }
+
+  // exact two-pass recompute from what is actually in the buffer
+  void resync(CircularBuffer<T, N> &buffer) {
+    float total = 0;
+    for (size_t i = 0; i < buffer.size(); i++) {
+      total += (float)buffer[i];
+    }
+    runningMean = buffer.size() > 0 ? total / buffer.size() : 0;
+
+    m2 = 0;
+    for (size_t i = 0; i < buffer.size(); i++) {
+      float d = (float)buffer[i] - runningMean;
+      m2 += d * d;
+    }
+  }
+};
+
+#endif // WINDOW_STATS_H
@@ -0,0 +1,403 @@
+// Fall detection accuracy and latency benchmark.
+//
+// Runs the detection pipeline (DetectionRunner, same state machine as loop()) over a
+// corpus of labeled motion: scripted SimImuDevice scenarios, each repeated with
+// different sensor noise, plus any recorded traces listed in a corpus file. Scores
+// fall detections and alarms against the labels and times everything.
+//
+// The result goes to stdout as one JSON document so runs from different firmware
+// versions can be diffed or tracked by a script; a readable table goes to stderr.
+//
+//   pio run -e native_bench
+//   .pio/build/native_bench/program [--label v1.4] [--runs 5] [--corpus native/bench/corpus.txt]
+//                                   [--posture 45]
+//
+// --posture sets minPostureChangeDeg for the runs, the device default leaves the check off.
+//
+// Corpus file, one trace per line (# starts a comment), times in seconds since the
+// first sample of the trace, as printed by --replay in the native build:
+//
+//   traces/hallway.imt  falls=41.20,95.75  alarms=95.75
+
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "SimHal.h"
+#include "DetectionRunner.h"
+#include "ImuTrace.h"
+
+// a detection counts for a labeled fall if its impact sample is this close to the label
+static const uint32_t MATCH_TOLERANCE_US = 1000000UL;
+// how long after the impact the alarm may come, ALARM_DELAY_MS plus the post-impact window
+static const uint32_t ALARM_WINDOW_US = (ALARM_DELAY_MS + POST_IMPACT_WINDOW_MS + 5000UL) * 1000UL;
+static const uint32_t SCENARIO_LEAD_US = 5000000UL;   // quiet time before the motion
+static const uint32_t SCENARIO_US = 40000000UL;       // whole scenario after calibration
+
+struct Scenario {
+  const char *name;
+  SimMotion motion;
+  bool isFall;        // should be detected as a fall
+  bool expectAlarm;   // and end in an alarm
+};
+
+static const Scenario SCENARIOS[] = {
+  { "fall_stays_down", SIM_MOTION_FALL, true, true },
+  { "fall_gets_up", SIM_MOTION_FALL_GET_UP, true, false },
+  { "slow_fall", SIM_MOTION_SLOW_FALL, true, true },
+  { "sit_down", SIM_MOTION_SIT_DOWN, false, false },
+  { "jump", SIM_MOTION_JUMP, false, false },
+  { "stumble", SIM_MOTION_STUMBLE, false, false },
+  { "walk", SIM_MOTION_WALK, false, false },
+};
+
+// the settings the runs actually used, as DetectionRunner's DeviceConfig hands them out
+static DeviceSettings runSettings = DeviceConfig::defaults();
+static float postureOverrideDeg = -1;   // < 0 = the default
+
+// applies the command line overrides the way the server would, and notes what the run uses
+static void configureRunner(DetectionRunner &runner) {
+  DeviceSettings settings = runner.getConfig().get();
+  if (postureOverrideDeg >= 0) {
+    settings.minPostureChangeDeg = postureOverrideDeg;
+    runner.getConfig().apply(settings, "");
+  }
+  runSettings = runner.getConfig().get();
+}
+
+struct Label {
+  uint32_t impactUs;
+  bool expectAlarm;
+};
+
+struct Score {
+  std::string name;
+  std::string source;      // "synthetic" or the trace path
+  uint32_t runs;
+  uint32_t labeledFalls;
+  uint32_t truePositives, falsePositives, falseNegatives;
+  uint32_t alarmTruePositives, alarmFalsePositives, alarmFalseNegatives;
+  std::vector<double> impactToDetectMs;
+  std::vector<double> impactToAlarmMs;
+  uint32_t samples;
+  double processingNs;
+};
+
+static void initScore(Score &score, const std::string &name, const std::string &source) {
+  score.name = name;
+  score.source = source;
+  score.runs = 0;
+  score.labeledFalls = 0;
+  score.truePositives = score.falsePositives = score.falseNegatives = 0;
+  score.alarmTruePositives = score.alarmFalsePositives = score.alarmFalseNegatives = 0;
+  score.samples = 0;
+  score.processingNs = 0;
+}
+
+static bool within(uint32_t us, uint32_t fromUs, uint32_t toUs) {
+  return (int32_t)(us - fromUs) >= 0 && (int32_t)(toUs - us) >= 0;
+}
+
+// Matches the run's events against its labels and adds the outcome to score
+static void scoreRun(DetectionRunner &runner, const std::vector<Label> &labels, Score &score) {
+  const std::vector<DetectionEvent> &events = runner.getEvents();
+  std::vector<bool> fallUsed(events.size(), false);
+  std::vector<bool> alarmUsed(events.size(), false);
+
+  for (size_t l = 0; l < labels.size(); l++) {
+    const Label &label = labels[l];
+    score.labeledFalls++;
+
+    bool detected = false;
+    for (size_t i = 0; i < events.size() && !detected; i++) {
+      if (events[i].type == DETECTION_FALL && !fallUsed[i] &&
+          within(events[i].sampleUs, label.impactUs - MATCH_TOLERANCE_US, label.impactUs + MATCH_TOLERANCE_US)) {
+        fallUsed[i] = true;
+        detected = true;
+        score.truePositives++;
+        score.impactToDetectMs.push_back((int32_t)(events[i].decidedUs - label.impactUs) / 1000.0);
+      }
+    }
+    if (!detected) {
+      score.falseNegatives++;
+    }
+
+    if (!label.expectAlarm) continue;
+    bool alarmed = false;
+    for (size_t i = 0; i < events.size() && !alarmed; i++) {
+      if (events[i].type == DETECTION_ALARM && !alarmUsed[i] &&
+          within(events[i].decidedUs, label.impactUs, label.impactUs + ALARM_WINDOW_US)) {
+        alarmUsed[i] = true;
+        alarmed = true;
+        score.alarmTruePositives++;
+        score.impactToAlarmMs.push_back((events[i].decidedUs - label.impactUs) / 1000.0);
+      }
+    }
+    if (!alarmed) {
+      score.alarmFalseNegatives++;
+    }
+  }
+
+  for (size_t i = 0; i < events.size(); i++) {
+    if (events[i].type == DETECTION_FALL && !fallUsed[i]) score.falsePositives++;
+    if (events[i].type == DETECTION_ALARM && !alarmUsed[i]) score.alarmFalsePositives++;
+  }
+
+  score.runs++;
+  score.samples += runner.getSampleCount();
+  score.processingNs += (double)runner.getProcessingTime().count();
+}
+
+static void runScenario(const Scenario &scenario, uint32_t runs, Score &score) {
+  initScore(score, scenario.name, "synthetic");
+
+  for (uint32_t run = 0; run < runs; run++) {
+    SimClock clock;
+    SimImuDevice imu(run * 7919 + 1);   // same noise sequence every time the benchmark runs
+    DetectionRunner runner(imu, clock);
+    runner.begin();
+    configureRunner(runner);
+
+    uint32_t t0 = clock.micros();
+    uint32_t startUs = t0 + SCENARIO_LEAD_US;
+    imu.scheduleMotion(scenario.motion, startUs);
+
+    std::vector<Label> labels;
+    if (scenario.isFall) {
+      Label label = { startUs + SimImuDevice::impactOffsetUs(scenario.motion), scenario.expectAlarm };
+      labels.push_back(label);
+    }
+
+    while (clock.micros() - t0 < SCENARIO_US) {
+      runner.poll();
+    }
+    scoreRun(runner, labels, score);
+  }
+}
+
+// Parses "1.5,20.25" into impact times relative to traceStartUs
+static void parseTimes(const char *text, uint32_t traceStartUs, std::vector<uint32_t> &out) {
+  while (*text != '\0') {
+    char *end;
+    double seconds = strtod(text, &end);
+    if (end == text) break;
+    out.push_back(traceStartUs + (uint32_t)(seconds * 1e6 + 0.5));
+    text = *end == ',' ? end + 1 : end;
+  }
+}
+
+static bool runTrace(const char *line, Score &score) {
+  char path[256];
+  char fallsArg[512] = "";
+  char alarmsArg[512] = "";
+  if (sscanf(line, "%255s", path) != 1) {
+    return false;
+  }
+  const char *falls = strstr(line, "falls=");
+  const char *alarms = strstr(line, "alarms=");
+  if (falls != NULL) sscanf(falls + 6, "%511s", fallsArg);
+  if (alarms != NULL) sscanf(alarms + 7, "%511s", alarmsArg);
+
+  initScore(score, path, path);
+  std::vector<uint8_t> trace;
+  if (!simLoadFile(path, trace)) {
+    fprintf(stderr, "cannot read %s, skipped\n", path);
+    return false;
+  }
+
+  SimClock clock;
+  TraceReader reader(trace.data(), trace.size());
+  TraceImuDevice traceImu(reader);
+  DetectionRunner runner(traceImu, clock);
+  uint32_t t0 = clock.micros();
+  if (!runner.begin()) {
+    fprintf(stderr, "%s has no trace blocks, skipped\n", path);
+    return false;
+  }
+  configureRunner(runner);
+
+  std::vector<uint32_t> fallTimes, alarmTimes;
+  parseTimes(fallsArg, t0, fallTimes);
+  parseTimes(alarmsArg, t0, alarmTimes);
+  std::vector<Label> labels;
+  for (size_t i = 0; i < fallTimes.size(); i++) {
+    Label label = { fallTimes[i], false };
+    for (size_t j = 0; j < alarmTimes.size(); j++) {
+      if (alarmTimes[j] == fallTimes[i]) label.expectAlarm = true;
+    }
+    labels.push_back(label);
+  }
+
+  while (!traceImu.isFinished()) {
+    runner.poll();
+  }
+  // give a fall near the end the chance to finish its post-impact check
+  uint32_t endUs = clock.micros() + ALARM_WINDOW_US;
+  while ((int32_t)(endUs - clock.micros()) > 0) {
+    runner.poll();
+  }
+  scoreRun(runner, labels, score);
+  return true;
+}
+
+static void addScore(Score &total, const Score &score) {
+  total.runs += score.runs;
+  total.labeledFalls += score.labeledFalls;
+  total.truePositives += score.truePositives;
+  total.falsePositives += score.falsePositives;
+  total.falseNegatives += score.falseNegatives;
+  total.alarmTruePositives += score.alarmTruePositives;
+  total.alarmFalsePositives += score.alarmFalsePositives;
+  total.alarmFalseNegatives += score.alarmFalseNegatives;
+  total.impactToDetectMs.insert(total.impactToDetectMs.end(), score.impactToDetectMs.begin(), score.impactToDetectMs.end());
+  total.impactToAlarmMs.insert(total.impactToAlarmMs.end(), score.impactToAlarmMs.begin(), score.impactToAlarmMs.end());
+  total.samples += score.samples;
+  total.processingNs += score.processingNs;
+}
+
+static double ratio(uint32_t num, uint32_t den) {
+  return den > 0 ? (double)num / den : 0.0;
+}
+
+
+static double mean(const std::vector<double> &values) {
+  double sum = 0;
+  for (size_t i = 0; i < values.size(); i++) sum += values[i];
+  return values.empty() ? 0.0 : sum / values.size();
+}
+
+// a JSON string literal, quotes included; names, paths and labels come from the command line
+static void printString(const char *text) {
+  putchar('"');
+  for (const unsigned char *c = (const unsigned char *)text; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      printf("\\%c", *c);
+    } else if (*c < 0x20) {
+      printf("\\u%04x", *c);
+    } else {
+      putchar(*c);
+    }
+  }
+  putchar('"');
+}
+
+static void printLatency(const char *key, const std::vector<double> &values) {
+  if (values.empty()) {
+    printf("\"%s\":null", key);
+    return;
+  }
+  double maxValue = *std::max_element(values.begin(), values.end());
+  printf("\"%s\":{\"count\":%lu,\"mean\":%.1f,\"max\":%.1f}", key, (unsigned long)values.size(),
+         mean(values), maxValue);
+}
+
+static void printScore(const Score &score) {
+  printf("{\"name\":");
+  printString(score.name.c_str());
+  printf(",\"source\":");
+  printString(score.source.c_str());
+  printf(",\"runs\":%lu,\"labeled_falls\":%lu,", (unsigned long)score.runs, (unsigned long)score.labeledFalls);
+  printf("\"falls\":{\"tp\":%lu,\"fp\":%lu,\"fn\":%lu,\"sensitivity\":%.3f,\"precision\":%.3f},",
+         (unsigned long)score.truePositives, (unsigned long)score.falsePositives, (unsigned long)score.falseNegatives,
+         ratio(score.truePositives, score.truePositives + score.falseNegatives),
+         ratio(score.truePositives, score.truePositives + score.falsePositives));
+  printf("\"alarms\":{\"tp\":%lu,\"fp\":%lu,\"fn\":%lu},", (unsigned long)score.alarmTruePositives,
+         (unsigned long)score.alarmFalsePositives, (unsigned long)score.alarmFalseNegatives);
+  printLatency("impact_to_detect_ms", score.impactToDetectMs);
+  printf(",");
+  printLatency("impact_to_alarm_ms", score.impactToAlarmMs);
+  printf(",\"samples\":%lu,\"ns_per_sample\":%.1f}", (unsigned long)score.samples,
+         score.samples > 0 ? score.processingNs / score.samples : 0.0);
+}
+
+static void printRow(const Score &score) {
+  fprintf(stderr, "%-24s %4lu  %3lu %3lu %3lu   %3lu %3lu %3lu  %8.0f  %6.0f\n", score.name.c_str(),
+          (unsigned long)score.runs, (unsigned long)score.truePositives, (unsigned long)score.falsePositives,
+          (unsigned long)score.falseNegatives, (unsigned long)score.alarmTruePositives,
+          (unsigned long)score.alarmFalsePositives, (unsigned long)score.alarmFalseNegatives,
+          mean(score.impactToAlarmMs),
+          score.samples > 0 ? score.processingNs / score.samples : 0.0);
+}
+
+int main(int argc, char **argv) {
+  const char *label = "";
+  const char *corpusPath = NULL;
+  uint32_t runs = 5;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+      label = argv[++i];
+    } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      runs = (uint32_t)atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+      corpusPath = argv[++i];
+    } else if (strcmp(argv[i], "--posture") == 0 && i + 1 < argc) {
+      postureOverrideDeg = (float)atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--label name] [--runs n] [--corpus file] [--posture deg]\n", argv[0]);
+      return 2;
+    }
+  }
+  Serial.setQuiet(true);
+
+  std::vector<Score> scores;
+  for (size_t i = 0; i < sizeof(SCENARIOS) / sizeof(SCENARIOS[0]); i++) {
+    Score score;
+    runScenario(SCENARIOS[i], runs, score);
+    scores.push_back(score);
+  }
+
+  if (corpusPath != NULL) {
+    FILE *corpus = fopen(corpusPath, "r");
+    if (corpus == NULL) {
+      fprintf(stderr, "cannot read %s\n", corpusPath);
+      return 2;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), corpus) != NULL) {
+      char *hash = strchr(line, '#');
+      if (hash != NULL) *hash = '\0';
+      Score score;
+      if (strspn(line, " \t\r\n") != strlen(line) && runTrace(line, score)) {
+        scores.push_back(score);
+      }
+    }
+    fclose(corpus);
+  }
+
+  Score total;
+  initScore(total, "total", "all");
+  for (size_t i = 0; i < scores.size(); i++) {
+    addScore(total, scores[i]);
+  }
+
+  printf("{\"benchmark\":\"fall_detection\",\"format\":1,\"label\":");
+  printString(label);
+  // thresholds as the runs saw them, the build flags as compiled in
+  printf(",\"config\":{\"freefall_threshold\":%.2f,\"impact_threshold\":%.2f,\"inactivity_threshold\":%.2f,"
+         "\"gyro_threshold\":%.1f,\"required_still_samples\":%lu,\"alarm_delay_ms\":%lu,"
+         "\"post_impact_window_ms\":%lu,\"min_posture_change_deg\":%.1f,\"sampling_period_ms\":%d,"
+         "\"fixed_point\":%d,\"rate_adaptive\":%d},",
+         runSettings.freeFallThreshold, runSettings.impactThreshold, runSettings.inactivityThreshold,
+         runSettings.gyroThreshold, (unsigned long)runSettings.requiredStillSamples,
+         (unsigned long)runSettings.alarmDelayMs, (unsigned long)runSettings.postImpactWindowMs,
+         runSettings.minPostureChangeDeg,
+         SAMPLING_PERIOD_MS, GYRO_FIXED_POINT, RATE_ADAPTIVE);
+  printf("\"scenarios\":[");
+  for (size_t i = 0; i < scores.size(); i++) {
+    if (i > 0) printf(",");
+    printScore(scores[i]);
+  }
+  printf("],\"total\":");
+  printScore(total);
+  printf("}\n");
+
+  fprintf(stderr, "%-24s %4s  %3s %3s %3s   %3s %3s %3s  %8s  %6s\n", "scenario", "runs", "TP", "FP", "FN",
+          "aTP", "aFP", "aFN", "alarm ms", "ns/smp");
+  for (size_t i = 0; i < scores.size(); i++) {
+    printRow(scores[i]);
+  }
+  fprintf(stderr, "fall sensitivity %.3f, precision %.3f\n",
+          ratio(total.truePositives, total.truePositives + total.falseNegatives),
+          ratio(total.truePositives, total.truePositives + total.falsePositives));
+  return 0;
+}
@@ -0,0 +1,227 @@
+// Telemetry encoding benchmark: bytes on the wire and time per encode.
+//
+// Encodes the same records three ways: the ArduinoJson code sendSensorData used before
+// TelemetryWriter (JsonDocument + serializeJson into a String), TelemetryWriter as JSON,
+// and TelemetryWriter as CBOR. The records are a plain reading, a fall alert and a full
+// TELEMETRY_BATCH_SIZE window. The writer's JSON has to parse back to the same values,
+// and CBOR has to come out smaller than it, otherwise the run fails.
+//
+// The result goes to stdout as one JSON document, a readable table goes to stderr.
+//
+//   pio run -e native_encoder
+//   .pio/build/native_encoder/program [--label v1.4]
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <chrono>
+#include <vector>
+#include "TelemetryEncoder.h"
+
+static const uint32_t ITERATIONS = 2000;
+
+enum Encoder {
+  ENCODER_ARDUINOJSON,
+  ENCODER_WRITER_JSON,
+  ENCODER_WRITER_CBOR,
+  ENCODER_COUNT
+};
+
+static const char *ENCODER_NAMES[] = { "arduinojson", "writer_json", "writer_cbor" };
+
+struct Record {
+  const char *name;
+  bool fall;
+  size_t samples;   // 0 = a single reading sent with sendSensorData
+};
+
+static const Record RECORDS[] = {
+  { "reading", false, 0 },
+  { "fall", true, 0 },
+  { "batch", false, TELEMETRY_BATCH_SIZE },
+};
+
+struct Result {
+  const char *record;
+  Encoder encoder;
+  size_t bytes;
+  double nsPerEncode;
+};
+
+static TelemetrySample window[TELEMETRY_BATCH_SIZE];
+static uint8_t payload[TELEMETRY_PAYLOAD_BUFFER];
+static const float READING_ACCEL = 9.7312F;
+static const float READING_GYRO = 12.4481F;
+static const uint32_t READING_TIME = 1234567;
+
+static void makeWindow() {
+  for (size_t i = 0; i < TELEMETRY_BATCH_SIZE; i++) {
+    window[i].timestampMs = READING_TIME + i * SAMPLING_PERIOD_MS;
+    window[i].accel = 9.81F + 0.37F * sinf(i * 0.3F);
+    window[i].gyro = 4.2F + 17.9F * cosf(i * 0.17F);
+  }
+}
+
+// what NetworkManager::sendSensorData built before TelemetryWriter
+static size_t encodeArduinoJsonReading(float accel, float gyro, bool fallDetected, uint32_t timestampMs, String &out) {
+  StaticJsonDocument<768> jsonDoc;
+  jsonDoc["deviceId"] = DEVICE_ID;
+  jsonDoc["accel"] = accel;
+  jsonDoc["gyro"] = gyro;
+  jsonDoc["fallDetected"] = fallDetected;
+  jsonDoc["timestamp"] = timestampMs;
+  if (fallDetected) {
+    jsonDoc["emergencyType"] = "FALL_DETECTED";
+    jsonDoc["severity"] = "HIGH";
+    jsonDoc["requiresResponse"] = true;
+    jsonDoc["alertMessage"] = "Fall detected - immediate assistance may be required";
+    JsonObject dataJson = jsonDoc.createNestedObject("dataJson");
+    dataJson["accel"] = accel;
+    dataJson["gyro"] = gyro;
+    dataJson["deviceId"] = DEVICE_ID;
+    dataJson["detectionTime"] = timestampMs;
+  }
+  out = "";
+  return serializeJson(jsonDoc, out);
+}
+
+// the same batch layout as TelemetryPayload::sensorBatch, built the ArduinoJson way
+static size_t encodeArduinoJsonBatch(const TelemetrySample *samples, size_t count, String &out) {
+  DynamicJsonDocument jsonDoc(JSON_OBJECT_SIZE(5) + JSON_ARRAY_SIZE(TELEMETRY_BATCH_SIZE) +
+                              TELEMETRY_BATCH_SIZE * JSON_OBJECT_SIZE(3));
+  jsonDoc["deviceId"] = DEVICE_ID;
+  jsonDoc["fallDetected"] = false;
+  jsonDoc["timestamp"] = samples[0].timestampMs;
+  jsonDoc["count"] = (uint32_t)count;
+  JsonArray list = jsonDoc.createNestedArray("samples");
+  for (size_t i = 0; i < count; i++) {
+    JsonObject entry = list.createNestedObject();
+    entry["t"] = samples[i].timestampMs;
+    entry["accel"] = samples[i].accel;
+    entry["gyro"] = samples[i].gyro;
+  }
+  out = "";
+  return serializeJson(jsonDoc, out);
+}
+
+static size_t encode(const Record &record, Encoder encoder, String &text) {
+  if (encoder == ENCODER_ARDUINOJSON) {
+    if (record.samples > 0) return encodeArduinoJsonBatch(window, record.samples, text);
+    return encodeArduinoJsonReading(READING_ACCEL, READING_GYRO, record.fall, READING_TIME, text);
+  }
+  TelemetryWriter writer(payload, sizeof(payload), encoder == ENCODER_WRITER_CBOR ? TELEMETRY_FORMAT_CBOR : TELEMETRY_FORMAT_JSON);
+  if (record.samples > 0) {
+    TelemetryPayload::sensorBatch(writer, window, record.samples);
+  } else {
+    TelemetryPayload::sensorData(writer, READING_ACCEL, READING_GYRO, record.fall, READING_TIME);
+  }
+  return writer.overflowed() ? 0 : writer.size();
+}
+
+static bool sameFloat(float expected, float actual) {
+  return fabsf(expected - actual) <= 1e-5F * fabsf(expected) + 1e-6F;
+}
+
+// the writer's JSON read back has to carry what the ArduinoJson text carries
+static bool sameContent(const Record &record, const String &reference, const uint8_t *json, size_t length) {
+  DynamicJsonDocument expected(32768), actual(32768);
+  if (deserializeJson(expected, reference) || deserializeJson(actual, (const char *)json, length)) return false;
+
+  const char *keys[] = { "deviceId", "emergencyType", "severity", "alertMessage" };
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    const char *a = expected[keys[i]] | "", *b = actual[keys[i]] | "";
+    if (strcmp(a, b) != 0) return false;
+  }
+  if (expected["fallDetected"].as<bool>() != actual["fallDetected"].as<bool>()) return false;
+  if (expected["timestamp"].as<uint32_t>() != actual["timestamp"].as<uint32_t>()) return false;
+
+  if (record.samples == 0) {
+    if (!sameFloat(expected["accel"].as<float>(), actual["accel"].as<float>())) return false;
+    if (!sameFloat(expected["gyro"].as<float>(), actual["gyro"].as<float>())) return false;
+    if (record.fall && !sameFloat(expected["dataJson"]["gyro"].as<float>(), actual["dataJson"]["gyro"].as<float>())) return false;
+    return true;
+  }
+  JsonArray a = expected["samples"].as<JsonArray>(), b = actual["samples"].as<JsonArray>();
+  if (a.size() != record.samples || b.size() != record.samples) return false;
+  for (size_t i = 0; i < record.samples; i++) {
+    if (a[i]["t"].as<uint32_t>() != b[i]["t"].as<uint32_t>()) return false;
+    if (!sameFloat(a[i]["accel"].as<float>(), b[i]["accel"].as<float>())) return false;
+    if (!sameFloat(a[i]["gyro"].as<float>(), b[i]["gyro"].as<float>())) return false;
+  }
+  return true;
+}
+
+static Result measure(const Record &record, Encoder encoder) {
+  String text;
+  Result result;
+  result.record = record.name;
+  result.encoder = encoder;
+  result.bytes = encode(record, encoder, text);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < ITERATIONS; i++) {
+    encode(record, encoder, text);
+  }
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+  result.nsPerEncode = (double)elapsed.count() / ITERATIONS;
+  return result;
+}
+
+int main(int argc, char **argv) {
+  const char *label = "";
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+      label = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--label name]\n", argv[0]);
+      return 2;
+    }
+  }
+  Serial.setQuiet(true);
+  makeWindow();
+
+  std::vector<Result> results;
+  bool ok = true;
+  for (size_t r = 0; r < sizeof(RECORDS) / sizeof(RECORDS[0]); r++) {
+    const Record &record = RECORDS[r];
+    size_t bytes[ENCODER_COUNT];
+    for (int e = 0; e < ENCODER_COUNT; e++) {
+      results.push_back(measure(record, (Encoder)e));
+      bytes[e] = results.back().bytes;
+    }
+
+    String reference;
+    encode(record, ENCODER_ARDUINOJSON, reference);
+    TelemetryWriter writer(payload, sizeof(payload), TELEMETRY_FORMAT_JSON);
+    if (record.samples > 0) {
+      TelemetryPayload::sensorBatch(writer, window, record.samples);
+    } else {
+      TelemetryPayload::sensorData(writer, READING_ACCEL, READING_GYRO, record.fall, READING_TIME);
+    }
+    if (writer.overflowed() || !sameContent(record, reference, writer.data(), writer.size())) {
+      fprintf(stderr, "%s: writer JSON does not match the ArduinoJson output\n", record.name);
+      ok = false;
+    }
+    if (bytes[ENCODER_WRITER_CBOR] == 0 || bytes[ENCODER_WRITER_CBOR] >= bytes[ENCODER_WRITER_JSON]) {
+      fprintf(stderr, "%s: CBOR is not smaller than JSON\n", record.name);
+      ok = false;
+    }
+  }
+
+  printf("{\"benchmark\":\"encoder\",\"format\":1,\"label\":\"%s\",", label);
+  printf("\"config\":{\"batch_size\":%d,\"payload_buffer\":%d,\"iterations\":%lu},",
+         TELEMETRY_BATCH_SIZE, TELEMETRY_PAYLOAD_BUFFER, (unsigned long)ITERATIONS);
+  printf("\"results\":[");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    printf("%s{\"record\":\"%s\",\"encoder\":\"%s\",\"bytes\":%lu,\"ns_per_encode\":%.1f}", i > 0 ? "," : "",
+           r.record, ENCODER_NAMES[r.encoder], (unsigned long)r.bytes, r.nsPerEncode);
+  }
+  printf("],\"ok\":%s}\n", ok ? "true" : "false");
+
+  fprintf(stderr, "%-8s %-12s %7s %10s\n", "record", "encoder", "bytes", "ns/encode");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    fprintf(stderr, "%-8s %-12s %7lu %10.0f\n", r.record, ENCODER_NAMES[r.encoder], (unsigned long)r.bytes, r.nsPerEncode);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+// Sample path benchmark: squared integer magnitudes against the old float/sqrt path.
+//
+// Runs the same recorded-like raw readings through both ways GyroSensor can turn a raw
+// reading into threshold decisions (GYRO_FIXED_POINT 1 and 0): integer offsets and
+// squared magnitudes in counts^2 against squared thresholds, or float m/s^2 and deg/s
+// through sqrt against the thresholds as they are. Reports the time per sample for
+// each, and fails if they disagree on a sample further than a count from a threshold.
+//
+// The result goes to stdout as one JSON document, a readable table goes to stderr.
+//
+//   pio run -e native_magnitude
+//   .pio/build/native_magnitude/program [--label v1.4]
+
+#include <Arduino.h>
+#include <chrono>
+#include "DeviceConfig.h"
+#include "ImuSample.h"
+
+static const uint32_t SAMPLES = 4096;
+static const uint32_t PASSES = 500;
+static const int16_t ACCEL_OFFSET[3] = { 41, -27, 18 };   // as the simulated sensor's bias
+static const int16_t GYRO_OFFSET[3] = { 12, -9, 5 };
+
+enum Decision {
+  DECISION_FREE_FALL = 1,
+  DECISION_IMPACT = 2,
+  DECISION_ROTATION = 4,
+  DECISION_STILL = 8
+};
+
+static RawImuSample readings[SAMPLES];
+static uint8_t integerDecisions[SAMPLES];
+static uint8_t floatDecisions[SAMPLES];
+static float accelMagnitudes[SAMPLES];
+static float gyroMagnitudes[SAMPLES];
+
+static uint32_t rng = 1;
+
+static int16_t randomCounts(int32_t amplitude) {
+  rng = rng * 1664525UL + 1013904223UL;
+  return (int16_t)((int32_t)(rng >> 16) % (2 * amplitude + 1) - amplitude);
+}
+
+// mostly still and walking, with free falls, impacts and fast turns mixed in
+static void makeReadings() {
+  for (uint32_t i = 0; i < SAMPLES; i++) {
+    RawImuSample &r = readings[i];
+    r.timestampUs = i * 10000;
+    int32_t accel = (i % 64 < 4) ? 400 : (i % 64 < 6) ? 12000 : 4096;
+    r.accelX = (int16_t)(ACCEL_OFFSET[0] + randomCounts(accel / 3));
+    r.accelY = (int16_t)(ACCEL_OFFSET[1] + randomCounts(accel / 3));
+    r.accelZ = (int16_t)(ACCEL_OFFSET[2] + accel + randomCounts(300));
+    int32_t gyro = (i % 32 < 3) ? 30000 : 2000;
+    r.gyroX = (int16_t)(GYRO_OFFSET[0] + randomCounts(gyro));
+    r.gyroY = (int16_t)(GYRO_OFFSET[1] + randomCounts(gyro));
+    r.gyroZ = (int16_t)(GYRO_OFFSET[2] + randomCounts(gyro / 4));
+  }
+}
+
+struct Thresholds {
+  DeviceSettings settings;
+  uint32_t freeFallSq, impactSq, gyroSq, stillMinSq, stillMaxSq;
+};
+
+static uint8_t integerPath(const RawImuSample &raw, const Thresholds &t) {
+  int32_t ax = raw.accelX - ACCEL_OFFSET[0], ay = raw.accelY - ACCEL_OFFSET[1], az = raw.accelZ - ACCEL_OFFSET[2];
+  int32_t gx = raw.gyroX - GYRO_OFFSET[0], gy = raw.gyroY - GYRO_OFFSET[1], gz = raw.gyroZ - GYRO_OFFSET[2];
+  uint32_t accelSq = (uint32_t)(ax * ax) + (uint32_t)(ay * ay) + (uint32_t)(az * az);
+  uint32_t gyroSq = (uint32_t)(gx * gx) + (uint32_t)(gy * gy) + (uint32_t)(gz * gz);
+  uint8_t d = 0;
+  if (accelSq < t.freeFallSq) d |= DECISION_FREE_FALL;
+  if (accelSq > t.impactSq) d |= DECISION_IMPACT;
+  if (gyroSq > t.gyroSq) d |= DECISION_ROTATION;
+  if (accelSq > t.stillMinSq && accelSq < t.stillMaxSq) d |= DECISION_STILL;
+  return d;
+}
+
+static uint8_t floatPath(const RawImuSample &raw, const Thresholds &t, float &accelMagnitude, float &gyroMagnitude) {
+  const float accelScale = 1.0F / ACCEL_COUNTS_PER_MS2;
+  const float gyroScale = (float)DEG_TO_RAD / GYRO_LSB_PER_DPS;
+  float ax = (raw.accelX - ACCEL_OFFSET[0]) * accelScale;
+  float ay = (raw.accelY - ACCEL_OFFSET[1]) * accelScale;
+  float az = (raw.accelZ - ACCEL_OFFSET[2]) * accelScale;
+  float gx = (raw.gyroX - GYRO_OFFSET[0]) * gyroScale;
+  float gy = (raw.gyroY - GYRO_OFFSET[1]) * gyroScale;
+  float gz = (raw.gyroZ - GYRO_OFFSET[2]) * gyroScale;
+  accelMagnitude = sqrtf(ax * ax + ay * ay + az * az);
+  gyroMagnitude = sqrtf(gx * gx + gy * gy + gz * gz) * (float)RAD_TO_DEG;
+  uint8_t d = 0;
+  if (accelMagnitude < t.settings.freeFallThreshold) d |= DECISION_FREE_FALL;
+  if (accelMagnitude > t.settings.impactThreshold) d |= DECISION_IMPACT;
+  if (gyroMagnitude > t.settings.gyroThreshold) d |= DECISION_ROTATION;
+  if (fabsf(accelMagnitude - 9.8F) < t.settings.inactivityThreshold) d |= DECISION_STILL;
+  return d;
+}
+
+// within a count of a threshold the two paths may round differently
+static bool nearThreshold(float accelMagnitude, float gyroMagnitude, const DeviceSettings &s) {
+  const float accelCount = 1.0F / ACCEL_COUNTS_PER_MS2, gyroCount = 1.0F / GYRO_LSB_PER_DPS;
+  return fabsf(accelMagnitude - s.freeFallThreshold) <= accelCount ||
+         fabsf(accelMagnitude - s.impactThreshold) <= accelCount ||
+         fabsf(fabsf(accelMagnitude - 9.8F) - s.inactivityThreshold) <= accelCount ||
+         fabsf(gyroMagnitude - s.gyroThreshold) <= gyroCount;
+}
+
+int main(int argc, char **argv) {
+  const char *label = "";
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+      label = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--label name]\n", argv[0]);
+      return 2;
+    }
+  }
+  Serial.setQuiet(true);
+  makeReadings();
+
+  Thresholds t;
+  t.settings = DeviceConfig::defaults();
+  t.freeFallSq = ACCEL_SQ_COUNTS(t.settings.freeFallThreshold);
+  t.impactSq = ACCEL_SQ_COUNTS(t.settings.impactThreshold);
+  t.gyroSq = GYRO_SQ_COUNTS(t.settings.gyroThreshold);
+  t.stillMinSq = ACCEL_SQ_COUNTS(9.8F - t.settings.inactivityThreshold);
+  t.stillMaxSq = ACCEL_SQ_COUNTS(9.8F + t.settings.inactivityThreshold);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t pass = 0; pass < PASSES; pass++) {
+    for (uint32_t i = 0; i < SAMPLES; i++) integerDecisions[i] = integerPath(readings[i], t);
+  }
+  std::chrono::nanoseconds integerTime = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t pass = 0; pass < PASSES; pass++) {
+    for (uint32_t i = 0; i < SAMPLES; i++) floatDecisions[i] = floatPath(readings[i], t, accelMagnitudes[i], gyroMagnitudes[i]);
+  }
+  std::chrono::nanoseconds floatTime = std::chrono::steady_clock::now() - start;
+
+  uint32_t disagreements = 0, counted[4] = { 0, 0, 0, 0 };
+  for (uint32_t i = 0; i < SAMPLES; i++) {
+    for (int bit = 0; bit < 4; bit++) {
+      if (integerDecisions[i] & (1 << bit)) counted[bit]++;
+    }
+    if (integerDecisions[i] != floatDecisions[i] && !nearThreshold(accelMagnitudes[i], gyroMagnitudes[i], t.settings)) {
+      disagreements++;
+    }
+  }
+  double integerNs = (double)integerTime.count() / ((double)SAMPLES * PASSES);
+  double floatNs = (double)floatTime.count() / ((double)SAMPLES * PASSES);
+
+  printf("{\"benchmark\":\"magnitude\",\"format\":1,\"label\":\"%s\",", label);
+  printf("\"config\":{\"samples\":%lu,\"passes\":%lu},", (unsigned long)SAMPLES, (unsigned long)PASSES);
+  printf("\"integer_ns_per_sample\":%.2f,\"float_ns_per_sample\":%.2f,", integerNs, floatNs);
+  printf("\"free_fall\":%lu,\"impact\":%lu,\"rotation\":%lu,\"still\":%lu,\"disagreements\":%lu}\n",
+         (unsigned long)counted[0], (unsigned long)counted[1], (unsigned long)counted[2], (unsigned long)counted[3],
+         (unsigned long)disagreements);
+
+  fprintf(stderr, "%-8s %10s\n", "path", "ns/sample");
+  fprintf(stderr, "%-8s %10.2f\n", "integer", integerNs);
+  fprintf(stderr, "%-8s %10.2f\n", "float", floatNs);
+  fprintf(stderr, "decisions: %lu free fall, %lu impact, %lu rotation, %lu still; %lu disagreements\n",
+          (unsigned long)counted[0], (unsigned long)counted[1], (unsigned long)counted[2], (unsigned long)counted[3],
+          (unsigned long)disagreements);
+  // every kind of decision has to come up, or the comparison says nothing
+  bool covered = counted[0] > 0 && counted[1] > 0 && counted[2] > 0 && counted[3] > 0;
+  return disagreements == 0 && covered ? 0 : 1;
+}
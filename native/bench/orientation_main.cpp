@@ -0,0 +1,272 @@
+// Orientation filter accuracy and throughput benchmark.
+//
+// Drives OrientationFilter with synthetic rotations whose true orientation is known:
+// the angular rate is scripted, the truth quaternion is integrated from it in fine
+// steps, and the sensor readings are made from the truth (gravity in sensor axes, the
+// rate itself) quantized to counts with the same noise SimImuDevice uses. Each scenario
+// runs at 100Hz and at 1kHz and reports the tilt error (angle between the filter's up
+// vector and the true one) after the first second, the error in the posture change
+// from start to end, and the time per update.
+//
+// Fails (exit 1) when a scenario's tilt RMS or posture error is past its bound, or an
+// update costs more than ORIENTATION_CYCLE_BUDGET would allow at 240MHz. The host is
+// several times faster than the ESP32, so the time check only catches gross regressions;
+// "prof" on the device has the real cycle counts.
+//
+// The result goes to stdout as one JSON document, a readable table goes to stderr.
+//
+//   pio run -e native_orientation
+//   .pio/build/native_orientation/program [--label v1.4]
+
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#include "OrientationFilter.h"
+
+static const uint32_t SETTLE_US = 1000000UL;   // the filter starts from the accelerometer, give it a second
+static const uint32_t TRUTH_STEPS = 20;        // truth integration steps per sample
+static const int16_t ACCEL_NOISE = 20;         // counts, as SimImuDevice
+static const int16_t GYRO_NOISE = 6;
+static const double MAX_TILT_RMS_DEG = 2.0;     // a few times what every scenario gets now
+static const double MAX_POSTURE_ERROR_DEG = 2.0;
+static const double DEVICE_CPU_MHZ = 240;
+static const double BUDGET_NS = ORIENTATION_CYCLE_BUDGET * 1000.0 / DEVICE_CPU_MHZ;
+
+struct Scenario {
+  const char *name;
+  float startRollDeg;   // starting pose, about X
+  uint32_t durationUs;
+  // angular rate in sensor axes at time t, deg/s
+  void (*rate)(uint32_t tUs, float dps[3]);
+};
+
+static void holdStill(uint32_t tUs, float dps[3]) {
+  dps[0] = dps[1] = dps[2] = 0;
+}
+
+// standing up to lying on the back: 90 deg about X in one second, then still
+static void rollOver(uint32_t tUs, float dps[3]) {
+  holdStill(tUs, dps);
+  if (tUs >= 2000000UL && tUs < 3000000UL) dps[0] = 90;
+}
+
+// a fall: 0.4s tumbling at 300 deg/s about a skewed axis, then lying still
+static void tumble(uint32_t tUs, float dps[3]) {
+  holdStill(tUs, dps);
+  if (tUs >= 2000000UL && tUs < 2400000UL) {
+    dps[0] = 300 * 0.667F;
+    dps[1] = 300 * 0.667F;
+    dps[2] = 300 * 0.333F;
+  }
+}
+
+// walking sway: +-20 deg about Y at 1Hz
+static void sway(uint32_t tUs, float dps[3]) {
+  holdStill(tUs, dps);
+  dps[1] = 20 * 2 * (float)PI * cosf(2 * (float)PI * tUs / 1e6F);
+}
+
+// turning on the spot with the device tilted, heading changes but tilt must not
+static void spin(uint32_t tUs, float dps[3]) {
+  holdStill(tUs, dps);
+  dps[2] = 180;
+}
+
+static const Scenario SCENARIOS[] = {
+  { "still_tilted", 30, 10000000UL, holdStill },
+  { "roll_over", 0, 6000000UL, rollOver },
+  { "tumble", 0, 6000000UL, tumble },
+  { "sway", 0, 10000000UL, sway },
+  { "spin_tilted", 30, 10000000UL, spin },
+};
+
+static const uint32_t RATES_HZ[] = { 100, 1000 };
+
+struct Result {
+  const char *name;
+  uint32_t rateHz;
+  uint32_t updates;
+  double tiltRmsDeg;
+  double tiltMaxDeg;
+  double postureErrorDeg;   // filter's posture change minus the true one, at the end
+  double nsPerUpdate;
+};
+
+// Same kinematics and up vector as OrientationFilter, so truth and estimate share a convention
+struct Truth {
+  float q[4];
+
+  void start(float rollDeg) {
+    float half = rollDeg * (float)DEG_TO_RAD * 0.5F;
+    q[0] = cosf(half);
+    q[1] = sinf(half);
+    q[2] = q[3] = 0;
+  }
+
+  void integrate(const float dps[3], float dt) {
+    float gx = dps[0] * (float)DEG_TO_RAD, gy = dps[1] * (float)DEG_TO_RAD, gz = dps[2] * (float)DEG_TO_RAD;
+    float d0 = 0.5F * (-q[1] * gx - q[2] * gy - q[3] * gz);
+    float d1 = 0.5F * (q[0] * gx + q[2] * gz - q[3] * gy);
+    float d2 = 0.5F * (q[0] * gy - q[1] * gz + q[3] * gx);
+    float d3 = 0.5F * (q[0] * gz + q[1] * gy - q[2] * gx);
+    q[0] += d0 * dt; q[1] += d1 * dt; q[2] += d2 * dt; q[3] += d3 * dt;
+    float n = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (int i = 0; i < 4; i++) q[i] /= n;
+  }
+
+  void up(float v[3]) const {
+    v[0] = 2 * (q[1] * q[3] - q[0] * q[2]);
+    v[1] = 2 * (q[0] * q[1] + q[2] * q[3]);
+    v[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+  }
+};
+
+static uint32_t rng = 1;
+
+static int16_t noise(int16_t amplitude) {
+  rng = rng * 1664525UL + 1013904223UL;
+  return (int16_t)((int32_t)(rng >> 16) % (2 * amplitude + 1) - amplitude);
+}
+
+static int16_t toCounts(float value) {
+  return (int16_t)lroundf(value);
+}
+
+static double angleDeg(const float a[3], const float b[3]) {
+  double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  if (dot > 1) dot = 1;
+  if (dot < -1) dot = -1;
+  return acos(dot) * RAD_TO_DEG;
+}
+
+static Result runScenario(const Scenario &scenario, uint32_t rateHz) {
+  const uint32_t periodUs = 1000000UL / rateHz;
+  Truth truth;
+  truth.start(scenario.startRollDeg);
+  float startUp[3];
+  truth.up(startUp);
+
+  OrientationFilter filter;
+  std::chrono::nanoseconds elapsed(0);
+  double sumSq = 0, maxErr = 0;
+  uint32_t scored = 0, updates = 0;
+  bool referenceMarked = false;
+  rng = rateHz;
+
+  for (uint32_t t = 0; t <= scenario.durationUs; t += periodUs) {
+    // truth moves in fine steps between samples, the gyro reports the rate at the sample
+    float dps[3];
+    for (uint32_t i = 0; i < TRUTH_STEPS && t > 0; i++) {
+      scenario.rate(t - periodUs + periodUs * i / TRUTH_STEPS, dps);
+      truth.integrate(dps, periodUs * 1e-6F / TRUTH_STEPS);
+    }
+    scenario.rate(t, dps);
+    float up[3];
+    truth.up(up);
+
+    ImuSample sample;
+    sample.timestampUs = t;
+    sample.accelX = toCounts(up[0] * ACCEL_LSB_PER_G + noise(ACCEL_NOISE));
+    sample.accelY = toCounts(up[1] * ACCEL_LSB_PER_G + noise(ACCEL_NOISE));
+    sample.accelZ = toCounts(up[2] * ACCEL_LSB_PER_G + noise(ACCEL_NOISE));
+    sample.gyroX = toCounts(dps[0] * GYRO_LSB_PER_DPS + noise(GYRO_NOISE));
+    sample.gyroY = toCounts(dps[1] * GYRO_LSB_PER_DPS + noise(GYRO_NOISE));
+    sample.gyroZ = toCounts(dps[2] * GYRO_LSB_PER_DPS + noise(GYRO_NOISE));
+    sample.accelMagSq = (uint32_t)((int32_t)sample.accelX * sample.accelX) +
+                        (uint32_t)((int32_t)sample.accelY * sample.accelY) +
+                        (uint32_t)((int32_t)sample.accelZ * sample.accelZ);
+    sample.gyroMagSq = (uint32_t)((int32_t)sample.gyroX * sample.gyroX) +
+                       (uint32_t)((int32_t)sample.gyroY * sample.gyroY) +
+                       (uint32_t)((int32_t)sample.gyroZ * sample.gyroZ);
+
+    auto start = std::chrono::steady_clock::now();
+    filter.update(sample);
+    elapsed += std::chrono::steady_clock::now() - start;
+    updates++;
+
+    if (t < SETTLE_US) continue;
+    if (!referenceMarked) {
+      filter.markReference();
+      truth.up(startUp);
+      referenceMarked = true;
+    }
+    float estimate[3];
+    filter.getUp(estimate);
+    double err = angleDeg(estimate, up);
+    sumSq += err * err;
+    if (err > maxErr) maxErr = err;
+    scored++;
+  }
+
+  float endUp[3];
+  truth.up(endUp);
+  Result result;
+  result.name = scenario.name;
+  result.rateHz = rateHz;
+  result.updates = updates;
+  result.tiltRmsDeg = scored > 0 ? sqrt(sumSq / scored) : 0;
+  result.tiltMaxDeg = maxErr;
+  result.postureErrorDeg = filter.getPostureChangeDeg() - angleDeg(endUp, startUp);
+  result.nsPerUpdate = updates > 0 ? (double)elapsed.count() / updates : 0;
+  return result;
+}
+
+int main(int argc, char **argv) {
+  const char *label = "";
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+      label = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--label name]\n", argv[0]);
+      return 2;
+    }
+  }
+  Serial.setQuiet(true);
+
+  std::vector<Result> results;
+  bool ok = true;
+  for (size_t s = 0; s < sizeof(SCENARIOS) / sizeof(SCENARIOS[0]); s++) {
+    for (size_t r = 0; r < sizeof(RATES_HZ) / sizeof(RATES_HZ[0]); r++) {
+      results.push_back(runScenario(SCENARIOS[s], RATES_HZ[r]));
+      const Result &result = results.back();
+      if (result.tiltRmsDeg > MAX_TILT_RMS_DEG) {
+        fprintf(stderr, "%s at %luHz: tilt rms %.2f deg is over %.1f\n", result.name,
+                (unsigned long)result.rateHz, result.tiltRmsDeg, MAX_TILT_RMS_DEG);
+        ok = false;
+      }
+      if (fabs(result.postureErrorDeg) > MAX_POSTURE_ERROR_DEG) {
+        fprintf(stderr, "%s at %luHz: posture error %+.2f deg is over %.1f\n", result.name,
+                (unsigned long)result.rateHz, result.postureErrorDeg, MAX_POSTURE_ERROR_DEG);
+        ok = false;
+      }
+      if (result.nsPerUpdate > BUDGET_NS) {
+        fprintf(stderr, "%s at %luHz: %.0f ns per update is over the %.0f ns budget\n", result.name,
+                (unsigned long)result.rateHz, result.nsPerUpdate, BUDGET_NS);
+        ok = false;
+      }
+    }
+  }
+
+  printf("{\"benchmark\":\"orientation\",\"format\":1,\"label\":\"%s\",", label);
+  printf("\"config\":{\"beta\":%.3f,\"beta_still\":%.3f,\"accel_gate_g\":%.2f,\"cycle_budget\":%d,"
+         "\"max_tilt_rms_deg\":%.1f,\"max_posture_error_deg\":%.1f,\"budget_ns\":%.0f},",
+         ORIENTATION_BETA, ORIENTATION_BETA_STILL, ORIENTATION_ACCEL_GATE, ORIENTATION_CYCLE_BUDGET,
+         MAX_TILT_RMS_DEG, MAX_POSTURE_ERROR_DEG, BUDGET_NS);
+  printf("\"scenarios\":[");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    printf("%s{\"name\":\"%s\",\"rate_hz\":%lu,\"updates\":%lu,\"tilt_rms_deg\":%.2f,\"tilt_max_deg\":%.2f,"
+           "\"posture_error_deg\":%.2f,\"ns_per_update\":%.1f}", i > 0 ? "," : "", r.name,
+           (unsigned long)r.rateHz, (unsigned long)r.updates, r.tiltRmsDeg, r.tiltMaxDeg, r.postureErrorDeg,
+           r.nsPerUpdate);
+  }
+  printf("],\"ok\":%s}\n", ok ? "true" : "false");
+
+  fprintf(stderr, "%-16s %6s  %8s %8s %9s  %6s\n", "scenario", "rate", "tilt rms", "tilt max", "posture", "ns/upd");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    fprintf(stderr, "%-16s %4luHz  %8.2f %8.2f %+9.2f  %6.0f\n", r.name, (unsigned long)r.rateHz,
+            r.tiltRmsDeg, r.tiltMaxDeg, r.postureErrorDeg, r.nsPerUpdate);
+  }
+  return ok ? 0 : 1;
+}
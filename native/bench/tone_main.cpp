@@ -0,0 +1,164 @@
+// Tone synthesis benchmark: time per sample of the old generateToneBuffer (sin() per
+// sample on a float phase) against DdsOscillator in both modes, rendering
+// AUDIO_BUFFER_SAMPLES blocks the way the audio task does. Each result also carries the
+// pitch error measured over the first second, and the largest distance in LSB from an
+// exact sine at that pitch. A DDS mode off by more than MAX_ERROR_LSB or MAX_PITCH_PPM
+// fails the run.
+//
+// The result goes to stdout as one JSON document, a readable table goes to stderr.
+//
+//   pio run -e native_tone
+//   .pio/build/native_tone/program [--label v1.4]
+
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#include "Config.h"
+#include "DdsOscillator.h"
+
+static const uint32_t RATE = 44100;
+static const uint32_t SECONDS = 20;         // of audio per measurement
+static const int32_t MAX_ERROR_LSB = 5;
+static const double MAX_PITCH_PPM = 1000;   // 0.1%, audible starts around 0.3%
+static const float VOLUME = 1.0f;
+
+static const int FREQUENCIES[] = { 440, ALARM_SOUND_FREQUENCY_HZ, 1047, 3000 };
+
+enum Synth {
+  SYNTH_SINE,            // the code DdsOscillator replaced
+  SYNTH_DDS,
+  SYNTH_DDS_LOOP,
+  SYNTH_COUNT
+};
+
+static const char *SYNTH_NAMES[] = { "sine", "dds", "dds_loop" };
+
+struct Result {
+  int frequency;
+  Synth synth;
+  double nsPerSample;
+  double pitchErrorPpm;
+  int32_t maxErrorLsb;
+};
+
+static int16_t block[AUDIO_BUFFER_SAMPLES];
+static int16_t firstSecond[RATE];
+
+// what generateToneBuffer did before DdsOscillator, state carried between blocks
+struct SineReference {
+  float phase = 0.0f;
+
+  void render(int16_t *out, int count, int frequency, float volume) {
+    float phase_increment = 2.0f * M_PI * frequency / RATE;
+    for (int i = 0; i < count; i++) {
+      float sample = sin(phase) * volume * 32767.0f;
+      out[i] = (int16_t)sample;
+      phase += phase_increment;
+      if (phase > 2.0f * M_PI) {
+        phase -= 2.0f * M_PI;
+      }
+    }
+  }
+};
+
+// frequency from the first and last rising zero crossing, crossing times interpolated
+static double measuredFrequency(const int16_t *samples, int count) {
+  double first = -1, last = -1;
+  int cycles = -1;
+  for (int n = 1; n < count; n++) {
+    if (samples[n - 1] < 0 && samples[n] >= 0) {
+      double t = n - 1 + (double)-samples[n - 1] / (samples[n] - samples[n - 1]);
+      if (first < 0) first = t;
+      last = t;
+      cycles++;
+    }
+  }
+  return cycles > 0 ? cycles * (double)RATE / (last - first) : 0;
+}
+
+static int32_t maxErrorAgainstSine(const int16_t *samples, int count, double frequency) {
+  int32_t amplitude = (int32_t)(VOLUME * 32767.0f);
+  int32_t worst = 0;
+  for (int n = 0; n < count; n++) {
+    double reference = sin(2.0 * M_PI * frequency * n / RATE) * amplitude;
+    int32_t error = (int32_t)fabs(samples[n] - reference);
+    if (error > worst) worst = error;
+  }
+  return worst;
+}
+
+static Result measure(int frequency, Synth synth) {
+  const uint32_t blocks = SECONDS * RATE / AUDIO_BUFFER_SAMPLES;
+  SineReference sine;
+  DdsOscillator osc;
+  osc.setMode(synth == SYNTH_DDS_LOOP ? DDS_MODE_LOOP : DDS_MODE_INTERPOLATED);
+  osc.setSampleRate(RATE);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t b = 0; b < blocks; b++) {
+    if (synth == SYNTH_SINE) {
+      sine.render(block, AUDIO_BUFFER_SAMPLES, frequency, VOLUME);
+    } else {
+      // as the audio task does: setTone every block, a no-op while nothing changes
+      osc.setTone(frequency, VOLUME);
+      osc.render(block, AUDIO_BUFFER_SAMPLES);
+    }
+    uint32_t kept = b * AUDIO_BUFFER_SAMPLES;
+    if (kept < RATE) {
+      memcpy(firstSecond + kept, block, sizeof(int16_t) * min((uint32_t)AUDIO_BUFFER_SAMPLES, RATE - kept));
+    }
+  }
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+  Result result;
+  result.frequency = frequency;
+  result.synth = synth;
+  result.nsPerSample = (double)elapsed.count() / ((double)blocks * AUDIO_BUFFER_SAMPLES);
+  // the loop plays a slightly shifted pitch, the shape is compared at the pitch it plays
+  double pitch = measuredFrequency(firstSecond, RATE);
+  result.pitchErrorPpm = (pitch - frequency) / frequency * 1e6;
+  result.maxErrorLsb = maxErrorAgainstSine(firstSecond, AUDIO_BUFFER_SAMPLES, pitch);
+  return result;
+}
+
+int main(int argc, char **argv) {
+  const char *label = "";
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+      label = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--label name]\n", argv[0]);
+      return 2;
+    }
+  }
+  Serial.setQuiet(true);
+
+  std::vector<Result> results;
+  bool ok = true;
+  for (size_t f = 0; f < sizeof(FREQUENCIES) / sizeof(FREQUENCIES[0]); f++) {
+    for (int s = 0; s < SYNTH_COUNT; s++) {
+      results.push_back(measure(FREQUENCIES[f], (Synth)s));
+      const Result &r = results.back();
+      if (s != SYNTH_SINE && (r.maxErrorLsb > MAX_ERROR_LSB || fabs(r.pitchErrorPpm) > MAX_PITCH_PPM)) ok = false;
+    }
+  }
+
+  printf("{\"benchmark\":\"tone\",\"format\":1,\"label\":\"%s\",", label);
+  printf("\"config\":{\"sample_rate\":%lu,\"buffer_samples\":%d,\"seconds\":%lu,\"synth_mode\":%d},",
+         (unsigned long)RATE, AUDIO_BUFFER_SAMPLES, (unsigned long)SECONDS, AUDIO_SYNTH_MODE);
+  printf("\"results\":[");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    printf("%s{\"frequency_hz\":%d,\"synth\":\"%s\",\"ns_per_sample\":%.2f,\"pitch_error_ppm\":%.1f,\"max_error_lsb\":%ld}",
+           i > 0 ? "," : "", r.frequency, SYNTH_NAMES[r.synth], r.nsPerSample, r.pitchErrorPpm, (long)r.maxErrorLsb);
+  }
+  printf("],\"ok\":%s}\n", ok ? "true" : "false");
+
+  fprintf(stderr, "%6s %-9s %10s %10s %8s\n", "freq", "synth", "ns/sample", "pitch ppm", "max err");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    fprintf(stderr, "%6d %-9s %10.2f %+10.1f %8ld\n", r.frequency, SYNTH_NAMES[r.synth], r.nsPerSample,
+            r.pitchErrorPpm, (long)r.maxErrorLsb);
+  }
+  return ok ? 0 : 1;
+}
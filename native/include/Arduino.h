@@ -0,0 +1,148 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Just enough of the Arduino core for the portable modules to build on a Linux host
+// (pio run -e native). Time is virtual: millis()/micros() only move when delay() or
+// SimClock::advanceUs() is called, so simulations run as fast as the CPU allows.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::max;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+#define HALF_PI 1.5707963267948966192313216916398
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// no second core to race with on the host
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// advances the virtual clock behind millis()/micros()
+void nativeAdvanceTimeUs(uint32_t us);
+uint64_t nativeTimeUs();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+class String {
+public:
+  String() {}
+  String(const char *s) : value(s != NULL ? s : "") {}
+  String(const std::string &s) : value(s) {}
+  String(char c) : value(1, c) {}
+  String(int v) : value(std::to_string(v)) {}
+  String(unsigned int v) : value(std::to_string(v)) {}
+  String(long v) : value(std::to_string(v)) {}
+  String(unsigned long v) : value(std::to_string(v)) {}
+  String(float v, unsigned int decimals = 2) { format(v, decimals); }
+  String(double v, unsigned int decimals = 2) { format(v, decimals); }
+
+  const char *c_str() const { return value.c_str(); }
+  unsigned int length() const { return value.length(); }
+  bool isEmpty() const { return value.empty(); }
+
+  String &operator+=(const String &other) { value += other.value; return *this; }
+  String &operator+=(const char *other) { value += other; return *this; }
+  bool operator==(const String &other) const { return value == other.value; }
+  bool operator==(const char *other) const { return value == other; }
+  bool operator!=(const String &other) const { return value != other.value; }
+
+  friend String operator+(const String &a, const String &b) { return String(a.value + b.value); }
+  friend String operator+(const String &a, const char *b) { return String(a.value + b); }
+  friend String operator+(const char *a, const String &b) { return String(a + b.value); }
+
+private:
+  std::string value;
+
+  void format(double v, unsigned int decimals) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, v);
+    value = buffer;
+  }
+};
+
+// Byte sink, the part of the Arduino Print class the binary writers use
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (n < size && write(buffer[n]) == 1) n++;
+    return n;
+  }
+  virtual void flush() {}
+
+  size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t println(const char *s) { return print(s) + print("\n"); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+// Serial goes to stdout. setQuiet(true) drops everything, handy when profiling.
+class NativeSerial : public Print {
+public:
+  void begin(unsigned long) {}
+  void setQuiet(bool q) { quiet = q; }
+
+  size_t write(uint8_t b) { return quiet ? 0 : fwrite(&b, 1, 1, stdout); }
+  size_t write(const uint8_t *buffer, size_t size) { return quiet ? 0 : fwrite(buffer, 1, size, stdout); }
+
+  size_t print(const char *s) { return out("%s", s); }
+  size_t print(const String &s) { return out("%s", s.c_str()); }
+  size_t print(char c) { return out("%c", c); }
+  size_t print(int v) { return out("%d", v); }
+  size_t print(unsigned int v) { return out("%u", v); }
+  size_t print(long v) { return out("%ld", v); }
+  size_t print(unsigned long v) { return out("%lu", v); }
+  size_t print(double v, int decimals = 2) { return out("%.*f", decimals, v); }
+
+  size_t println() { return out("\n"); }
+  template <typename T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+private:
+  bool quiet = false;
+  size_t out(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern NativeSerial Serial;
+
+// ESP.getCycleCount() for the profiler, counts nanoseconds of real (not virtual) time
+class EspClass {
+public:
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz() { return 1000; }
+};
+
+extern EspClass ESP;
+
+#endif // NATIVE_ARDUINO_H
@@ -0,0 +1,80 @@
+#ifndef DETECTION_RUNNER_H
+#define DETECTION_RUNNER_H
+
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#include "SimHal.h"
+#include "DeviceConfig.h"
+#include "GyroSensor.h"
+#include "FallDetection.h"
+#include "LedController.h"
+
+// The sampling task and the detection half of loop() from main.cpp, driven off the
+// virtual clock: every poll() is one sampling period. Shared by the simulated session
+// and trace replay so both exercise the same state machine.
+
+enum DetectionEventType {
+  DETECTION_FALL,     // detectFall() fired
+  DETECTION_ALARM,    // post-impact check confirmed
+  DETECTION_CLEARED   // post-impact check saw movement
+};
+
+struct DetectionEvent {
+  DetectionEventType type;
+  uint32_t sampleUs;         // timestamp of the sample that decided it
+  uint32_t decidedUs;        // clock time it was decided at
+  uint32_t freeFallStartUs;  // DETECTION_FALL only
+  ImuSample sample;
+};
+
+typedef void (*DetectionEventCallback)(const DetectionEvent &event, void *context);
+typedef void (*MonitoringSampleCallback)(const ImuSample &sample, void *context);
+
+class DetectionRunner {
+public:
+  DetectionRunner(ImuDevice &device, SimClock &clock);
+
+  // Sensor init and calibration, then straight to monitoring
+  bool begin();
+  // Advance the clock one sampling period and run everything that became due
+  void poll();
+
+  void setEventCallback(DetectionEventCallback callback, void *context);
+  // Every sample seen while monitoring, before detectFall() gets it (telemetry goes here)
+  void setMonitoringCallback(MonitoringSampleCallback callback, void *context);
+
+  const std::vector<DetectionEvent> &getEvents();
+  uint32_t countEvents(DetectionEventType type);
+  uint32_t getSampleCount();
+  // Wall time spent on the samples themselves, so per-sample cost is this / getSampleCount()
+  std::chrono::nanoseconds getProcessingTime();
+
+  // Starts out with the defaults, apply() a different config to try other thresholds
+  DeviceConfig &getConfig();
+  GyroSensor &getSensor();
+  FallDetection &getFallDetection();
+
+private:
+  SimClock &clock;
+  DeviceConfig config;
+  GyroSensor gyroSensor;
+  SampleRing sampleRing;
+  LedController statusLed;
+  FallDetection fallDetection;
+
+  uint32_t fallTimestamp;
+  uint32_t sampleCount;
+  std::chrono::nanoseconds processingTime;
+  std::vector<DetectionEvent> events;
+
+  DetectionEventCallback eventCallback;
+  void *eventContext;
+  MonitoringSampleCallback monitoringCallback;
+  void *monitoringContext;
+
+  void handleSample(const ImuSample &sample);
+  void addEvent(DetectionEventType type, const ImuSample &sample);
+};
+
+#endif // DETECTION_RUNNER_H
@@ -0,0 +1,87 @@
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+// The Arduino fs::FS / fs::File API over a host directory, standing in for LittleFS.
+// It behaves like flash where that matters to the store: what a File writes stays in
+// its own buffer until flush() or close(), so other handles (and a reboot) only see
+// flushed data, and powerCut() throws away everything not flushed yet. flush() and
+// close() with data pending count as metadata commits, see getCommitCount().
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+struct FsState;
+struct FileImpl;
+
+class File {
+public:
+  File() {}
+
+  size_t write(uint8_t b) { return write(&b, 1); }
+  size_t write(const uint8_t *buffer, size_t size);
+  int read();
+  size_t read(uint8_t *buffer, size_t size);
+  bool seek(uint32_t position, SeekMode mode = SeekSet);
+  size_t position();
+  size_t size();
+  void flush();
+  void close();
+
+  const char *name();
+  bool isDirectory();
+  File openNextFile();
+
+  operator bool() const;
+
+private:
+  std::shared_ptr<FileImpl> impl;
+  friend class FS;
+};
+
+class FS {
+public:
+  // root is a host directory, created if missing; paths are relative to it
+  explicit FS(const char *root);
+
+  File open(const char *path, const char *mode = FILE_READ);
+  bool exists(const char *path);
+  bool mkdir(const char *path);
+  bool remove(const char *path);
+  bool rmdir(const char *path);
+
+  // Power loss: every open handle loses what it didn't flush and stops working
+  void powerCut();
+  uint32_t getCommitCount();
+  // Deletes everything under the root
+  void format();
+
+private:
+  std::string root;
+  std::shared_ptr<FsState> state;
+
+  std::string hostPath(const char *path);
+  static File openIn(const std::string &root, const std::shared_ptr<FsState> &state,
+                     const char *path, const char *mode);
+  friend class File;
+};
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
+
+#endif // NATIVE_FS_H
@@ -0,0 +1,200 @@
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+#include <Arduino.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "Hal.h"
+#include "Mpu6050Fifo.h"
+
+// Simulated hardware for the native build, see Hal.h for the interfaces.
+
+// The virtual clock behind the native millis()/micros()
+class SimClock : public Clock {
+public:
+  uint32_t millis() { return ::millis(); }
+  uint32_t micros() { return ::micros(); }
+  void delayMs(uint32_t ms) { ::delay(ms); }
+  void advanceUs(uint32_t us) { nativeAdvanceTimeUs(us); }
+};
+
+// Scripted movements for SimImuDevice. Each one leaves the wearer in its final pose
+// until a later one starts.
+enum SimMotion {
+  SIM_MOTION_FALL,          // free fall (300ms), impact, then lying on the side
+  SIM_MOTION_FALL_GET_UP,   // same, but moving about again 3s later
+  SIM_MOTION_SLOW_FALL,     // sliding down a wall: long partial free fall, soft impact
+  SIM_MOTION_SIT_DOWN,      // dropping into a chair
+  SIM_MOTION_JUMP,          // short real free fall, hard landing, walks off
+  SIM_MOTION_STUMBLE,       // dip and catch, walks on
+  SIM_MOTION_WALK,          // 10s of walking
+  SIM_MOTION_ROLL_OVER      // turning 90 degrees about X in 1s, then lying with gravity on Y
+};
+
+// MPU6050 stand-in. Produces a sample every profile period of virtual time: lying flat
+// and still with a fixed bias and some noise, plus any motions scheduled with
+// scheduleMotion().
+class SimImuDevice : public ImuDevice {
+public:
+  SimImuDevice(uint32_t seed = 1);
+
+  bool begin(const RateProfile &profile);
+  bool setRateProfile(const RateProfile &profile);
+  bool readSample(RawImuSample &out, uint32_t nowUs);
+  size_t readBurst(RawImuSample *out, size_t maxSamples, uint32_t nowUs);
+  void flush();
+  uint32_t getOverflowCount();
+
+  void scheduleMotion(SimMotion motion, uint32_t startUs);
+  // Shorthand for SIM_MOTION_FALL / SIM_MOTION_FALL_GET_UP
+  void scheduleFall(uint32_t startUs, bool getUp);
+  // When the impact of a motion that has one lands, relative to its start
+  static uint32_t impactOffsetUs(SimMotion motion);
+  void setNoise(int16_t accelCounts, int16_t gyroCounts);
+
+  // bias the calibration has to find, in counts
+  static const int16_t ACCEL_BIAS[3];
+  static const int16_t GYRO_BIAS[3];
+
+private:
+  uint32_t rng;
+  uint32_t periodUs;
+  uint32_t nextSampleUs;
+  bool started;
+  int16_t accelNoise;
+  int16_t gyroNoise;
+
+  struct Motion {
+    SimMotion type;
+    uint32_t startUs;
+  };
+  std::vector<Motion> motions;
+
+  int16_t noise(int16_t amplitude);
+  static void walk(uint32_t sinceUs, uint32_t periodUs, float centerG, float swingG,
+                   int32_t &accel, int32_t &gyro);
+  void generate(RawImuSample &out, uint32_t tUs);
+};
+
+// MPU6050 register map behind the native Wire, for testing Mpu6050Fifo: the registers
+// it programs, the FIFO byte queue with FIFO_COUNT and FIFO_R_W, and the overflow flag
+// in INT_STATUS (clears on read). Frames only go in while USER_CTRL has the FIFO on,
+// with the parts FIFO_EN selects; past 1024 bytes the oldest are dropped, as on the chip.
+class SimMpu6050 : public I2cDevice {
+public:
+  static const uint8_t ADDRESS = 0x68;
+
+  SimMpu6050();
+
+  void writeRegisters(uint8_t reg, const uint8_t *data, size_t length);
+  void readRegisters(uint8_t reg, uint8_t *out, size_t length);
+
+  // what the sensor would sample next
+  void pushFrame(const RawImuSample &sample);
+  // loose bytes, e.g. to leave a partial frame in the FIFO
+  void pushBytes(const uint8_t *data, size_t length);
+  uint8_t getRegister(uint8_t reg);
+  size_t getFifoBytes();
+  uint32_t getFifoResetCount();
+
+private:
+  uint8_t registers[128];
+  std::deque<uint8_t> fifo;
+  uint32_t fifoResets;
+};
+
+// Collects what would have gone to the amplifier
+class SimAudioSink : public AudioSink {
+public:
+  SimAudioSink(size_t captureSamples = 0);
+
+  bool begin(uint32_t sampleRate);
+  void end();
+  size_t write(const uint8_t *data, size_t length);
+  bool waitForSpace(uint32_t timeoutMs);
+
+  uint64_t getSamplesWritten();
+  const std::vector<int16_t> &getCapture();
+
+private:
+  size_t captureLimit;
+  uint64_t samplesWritten;
+  std::vector<int16_t> capture;
+};
+
+// Answers like the API server would, and keeps what was sent. The device config comes
+// with an ETag and is a 304 when the request already has it.
+class SimHttpTransport : public HttpTransport {
+public:
+  SimHttpTransport();
+
+  bool connect(uint32_t timeoutMs);
+  bool isConnected();
+  int request(const char *method, const char *url,
+              const HttpHeader *headers, size_t headerCount,
+              const uint8_t *body, size_t bodyLength, String *response,
+              HttpResponseHeader *responseHeaders, size_t responseHeaderCount);
+  String errorToString(int code);
+  uint32_t getRequestCount();
+  uint32_t getHandshakeCount();
+
+  // offline = every request fails with a transport error and closes the connection
+  void setOnline(bool online);
+  // the server closing the idle keep-alive connection: the next request handshakes again
+  void dropConnection();
+  void setStatusCode(int code);
+  // what GET /device-config returns, the ETag changes with every call
+  void setDeviceConfig(const char *json);
+  uint64_t getBytesSent();
+
+private:
+  bool online;
+  bool connected;
+  String openHost;      // host of the open keep-alive connection, empty = none
+  int statusCode;
+  uint32_t requestCount;
+  uint32_t handshakeCount;
+  uint64_t bytesSent;
+  String deviceConfig;
+  String deviceConfigEtag;
+  uint32_t deviceConfigRevision;
+};
+
+// NVS stand-in, lives as long as the object
+class SimKeyValueStore : public KeyValueStore {
+public:
+  SimKeyValueStore();
+
+  size_t get(const char *key, void *out, size_t maxLength);
+  bool put(const char *key, const void *data, size_t length);
+  bool remove(const char *key);
+
+  uint32_t getPutCount();
+
+private:
+  std::map<std::string, std::vector<uint8_t> > values;
+  uint32_t putCount;
+};
+
+// A host file as a Print, stands in for the LittleFS File traces get recorded into
+class FilePrint : public Print {
+public:
+  FilePrint();
+  ~FilePrint();
+
+  bool open(const char *path);
+  void close();
+  size_t write(uint8_t b);
+  size_t write(const uint8_t *buffer, size_t size);
+  void flush();
+
+private:
+  FILE *file;
+};
+
+// Whole file into memory, false if it can't be read
+bool simLoadFile(const char *path, std::vector<uint8_t> &out);
+
+#endif // SIM_HAL_H
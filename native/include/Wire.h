@@ -0,0 +1,53 @@
+#ifndef NATIVE_WIRE_H
+#define NATIVE_WIRE_H
+
+// The part of the Arduino TwoWire API the register-level drivers use, for the host
+// build. Transactions go to an I2cDevice attached at an address (SimMpu6050 in
+// SimHal.h); nothing attached there NACKs like an empty bus would.
+
+#include <Arduino.h>
+#include <vector>
+
+// A register-map peripheral on the simulated bus. The first byte of a write sets the
+// register pointer, the rest are written from there; reads start at the pointer.
+class I2cDevice {
+public:
+  virtual ~I2cDevice() {}
+  virtual void writeRegisters(uint8_t reg, const uint8_t *data, size_t length) = 0;
+  virtual void readRegisters(uint8_t reg, uint8_t *out, size_t length) = 0;
+};
+
+class TwoWire {
+public:
+  TwoWire();
+
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+  bool setClock(uint32_t frequency);
+  void attach(uint8_t address, I2cDevice *device);
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t value);
+  size_t write(const uint8_t *data, size_t length);
+  // 0 = ok, 2 = address NACK, as the Arduino core
+  uint8_t endTransmission(bool sendStop = true);
+
+  size_t requestFrom(uint8_t address, size_t length, bool sendStop = true);
+  int available();
+  int read();
+
+  uint32_t getClock();
+
+private:
+  uint8_t deviceAddress;
+  I2cDevice *device;
+  uint8_t txAddress;
+  uint8_t registerPointer;
+  std::vector<uint8_t> txBuffer;
+  std::vector<uint8_t> rxBuffer;
+  size_t rxIndex;
+  uint32_t clockHz;
+};
+
+extern TwoWire Wire;
+
+#endif // NATIVE_WIRE_H
@@ -0,0 +1,78 @@
+#include <Arduino.h>
+#include <chrono>
+
+NativeSerial Serial;
+EspClass ESP;
+
+static uint64_t virtualTimeUs = 0;
+static uint8_t pinLevels[64];
+
+uint32_t millis() {
+  return (uint32_t)(virtualTimeUs / 1000);
+}
+
+uint32_t micros() {
+  return (uint32_t)virtualTimeUs;
+}
+
+void delay(uint32_t ms) {
+  virtualTimeUs += (uint64_t)ms * 1000;
+}
+
+void delayMicroseconds(uint32_t us) {
+  virtualTimeUs += us;
+}
+
+void nativeAdvanceTimeUs(uint32_t us) {
+  virtualTimeUs += us;
+}
+
+uint64_t nativeTimeUs() {
+  return virtualTimeUs;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < sizeof(pinLevels)) {
+    pinLevels[pin] = value;
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < sizeof(pinLevels) ? pinLevels[pin] : LOW;
+}
+
+size_t NativeSerial::printf(const char *format, ...) {
+  if (quiet) return 0;
+  va_list args;
+  va_start(args, format);
+  int n = vprintf(format, args);
+  va_end(args);
+  return n > 0 ? n : 0;
+}
+
+size_t NativeSerial::out(const char *format, ...) {
+  if (quiet) return 0;
+  va_list args;
+  va_start(args, format);
+  int n = vprintf(format, args);
+  va_end(args);
+  return n > 0 ? n : 0;
+}
+
+size_t Print::printf(const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (n <= 0) return 0;
+  return write((const uint8_t *)buffer, min((size_t)n, sizeof(buffer) - 1));
+}
+
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
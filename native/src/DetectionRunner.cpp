@@ -0,0 +1,137 @@
+#include "DetectionRunner.h"
+#include "Log.h"
+
+DetectionRunner::DetectionRunner(ImuDevice &device, SimClock &simClock)
+  : clock(simClock), gyroSensor(device, simClock, config), fallDetection(gyroSensor, statusLed, config) {
+  fallTimestamp = 0;
+  sampleCount = 0;
+  processingTime = std::chrono::nanoseconds(0);
+  eventCallback = NULL;
+  eventContext = NULL;
+  monitoringCallback = NULL;
+  monitoringContext = NULL;
+}
+
+bool DetectionRunner::begin() {
+  if (!gyroSensor.initialize()) {
+    return false;
+  }
+  fallDetection.setState(STATE_CALIBRATING);
+  gyroSensor.calibrate();
+  gyroSensor.setSampleSink(&sampleRing);
+  fallDetection.setState(STATE_MONITORING);
+  return true;
+}
+
+void DetectionRunner::poll() {
+  // the sampling task's wake-up, whatever rate profile the sensor is on
+  clock.advanceUs(gyroSensor.getPollPeriodMs() * 1000UL);
+  gyroSensor.process();
+
+  ImuSample sample;
+  while (sampleRing.pop(sample)) {
+    sampleCount++;
+    auto start = std::chrono::steady_clock::now();
+    handleSample(sample);
+    processingTime += std::chrono::steady_clock::now() - start;
+  }
+
+  if (fallDetection.getState() == STATE_FALL_DETECTED && fallTimestamp != 0 &&
+      clock.millis() - fallTimestamp >= fallDetection.getAlarmDelayMs()) {
+    fallDetection.beginPostImpactCheck();
+    fallTimestamp = 0;
+  }
+
+  // what LogDrainTask would print on the device
+  Log::drain(Serial);
+}
+
+void DetectionRunner::handleSample(const ImuSample &sample) {
+  fallDetection.updateOrientation(sample);
+
+  if (fallDetection.getState() == STATE_FALL_DETECTED && fallDetection.isPostImpactCheckActive()) {
+    PostImpactResult result = fallDetection.updatePostImpactCheck(sample);
+    if (result == POST_IMPACT_CONFIRMED) {
+      fallDetection.triggerAlarm();
+      addEvent(DETECTION_ALARM, sample);
+      // nobody presses the button off-device, cancel right away
+      fallDetection.cancelAlarm();
+      fallDetection.setState(STATE_MONITORING);
+    } else if (result == POST_IMPACT_CLEARED) {
+      addEvent(DETECTION_CLEARED, sample);
+      fallDetection.cancelAlarm();
+      fallDetection.setState(STATE_MONITORING);
+    }
+    return;
+  }
+
+  if (fallDetection.getState() != STATE_MONITORING) {
+    return;
+  }
+
+  if (monitoringCallback != NULL) {
+    monitoringCallback(sample, monitoringContext);
+  }
+
+  if (fallDetection.detectFall(sample)) {
+    fallTimestamp = clock.millis();
+    fallDetection.setState(STATE_FALL_DETECTED);
+    addEvent(DETECTION_FALL, sample);
+  }
+}
+
+void DetectionRunner::addEvent(DetectionEventType type, const ImuSample &sample) {
+  DetectionEvent event;
+  event.type = type;
+  event.sampleUs = sample.timestampUs;
+  event.decidedUs = clock.micros();
+  event.freeFallStartUs = type == DETECTION_FALL ? fallDetection.getFreeFallStartUs() : 0;
+  event.sample = sample;
+  events.push_back(event);
+
+  if (eventCallback != NULL) {
+    eventCallback(event, eventContext);
+  }
+}
+
+void DetectionRunner::setEventCallback(DetectionEventCallback callback, void *context) {
+  eventCallback = callback;
+  eventContext = context;
+}
+
+void DetectionRunner::setMonitoringCallback(MonitoringSampleCallback callback, void *context) {
+  monitoringCallback = callback;
+  monitoringContext = context;
+}
+
+const std::vector<DetectionEvent> &DetectionRunner::getEvents() {
+  return events;
+}
+
+uint32_t DetectionRunner::countEvents(DetectionEventType type) {
+  uint32_t count = 0;
+  for (size_t i = 0; i < events.size(); i++) {
+    if (events[i].type == type) count++;
+  }
+  return count;
+}
+
+uint32_t DetectionRunner::getSampleCount() {
+  return sampleCount;
+}
+
+std::chrono::nanoseconds DetectionRunner::getProcessingTime() {
+  return processingTime;
+}
+
+DeviceConfig &DetectionRunner::getConfig() {
+  return config;
+}
+
+GyroSensor &DetectionRunner::getSensor() {
+  return gyroSensor;
+}
+
+FallDetection &DetectionRunner::getFallDetection() {
+  return fallDetection;
+}
@@ -0,0 +1,218 @@
+#include <FS.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace stdfs = std::filesystem;
+
+namespace fs {
+
+struct FsState {
+  uint32_t generation = 0;   // bumped by powerCut(), older handles are dead
+  uint32_t commits = 0;
+};
+
+struct FileImpl {
+  std::shared_ptr<FsState> state;
+  uint32_t generation = 0;
+  std::string root;
+  std::string path;          // as opened, e.g. /store/t_00000001.seg
+  std::string hostPath;
+  bool open = false;
+  bool writable = false;
+  std::vector<uint8_t> data; // committed contents plus anything written since
+  size_t committed = 0;
+  size_t pos = 0;
+  bool directory = false;
+  std::vector<std::string> entries;
+  size_t nextEntry = 0;
+
+  bool alive() const { return open && state->generation == generation; }
+
+  void commit() {
+    if (!alive() || !writable || data.size() == committed) return;
+    std::ofstream out(hostPath, std::ios::binary | std::ios::trunc);
+    out.write((const char *)data.data(), data.size());
+    committed = data.size();
+    state->commits++;
+  }
+
+  ~FileImpl() {
+    commit(); // a File going out of scope closes it, as on the device
+  }
+};
+
+static bool loadFile(const std::string &hostPath, std::vector<uint8_t> &out) {
+  std::ifstream in(hostPath, std::ios::binary);
+  if (!in) return false;
+  out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return true;
+}
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+  if (!impl || !impl->alive() || !impl->writable) return 0;
+  if (impl->pos + size > impl->data.size()) impl->data.resize(impl->pos + size);
+  memcpy(&impl->data[impl->pos], buffer, size);
+  impl->pos += size;
+  return size;
+}
+
+int File::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+size_t File::read(uint8_t *buffer, size_t size) {
+  if (!impl || !impl->alive() || impl->directory) return 0;
+  size_t n = impl->pos < impl->data.size() ? std::min(size, impl->data.size() - impl->pos) : 0;
+  if (n > 0) memcpy(buffer, &impl->data[impl->pos], n);
+  impl->pos += n;
+  return n;
+}
+
+bool File::seek(uint32_t position, SeekMode mode) {
+  if (!impl || !impl->alive()) return false;
+  size_t base = mode == SeekCur ? impl->pos : (mode == SeekEnd ? impl->data.size() : 0);
+  if (base + position > impl->data.size()) return false;
+  impl->pos = base + position;
+  return true;
+}
+
+size_t File::position() {
+  return impl ? impl->pos : 0;
+}
+
+size_t File::size() {
+  return impl && impl->alive() ? impl->data.size() : 0;
+}
+
+void File::flush() {
+  if (impl) impl->commit();
+}
+
+void File::close() {
+  if (!impl) return;
+  impl->commit();
+  impl->open = false;
+  impl.reset();
+}
+
+const char *File::name() {
+  return impl ? impl->path.c_str() : "";
+}
+
+bool File::isDirectory() {
+  return impl && impl->directory;
+}
+
+File File::openNextFile() {
+  File next;
+  if (!impl || !impl->alive() || !impl->directory) return next;
+  while (impl->nextEntry < impl->entries.size()) {
+    std::string child = impl->path;
+    if (child.empty() || child[child.size() - 1] != '/') child += "/";
+    child += impl->entries[impl->nextEntry++];
+
+    next = FS::openIn(impl->root, impl->state, child.c_str(), FILE_READ);
+    if (next) break;
+  }
+  return next;
+}
+
+File::operator bool() const {
+  return impl && impl->alive();
+}
+
+FS::FS(const char *rootDir) : root(rootDir), state(std::make_shared<FsState>()) {
+  std::error_code ec;
+  stdfs::create_directories(root, ec);
+}
+
+static std::string toHostPath(const std::string &root, const char *path) {
+  std::string p = path != NULL ? path : "";
+  while (!p.empty() && p[0] == '/') p.erase(0, 1);
+  return p.empty() ? root : root + "/" + p;
+}
+
+std::string FS::hostPath(const char *path) {
+  return toHostPath(root, path);
+}
+
+File FS::open(const char *path, const char *mode) {
+  return openIn(root, state, path, mode);
+}
+
+File FS::openIn(const std::string &root, const std::shared_ptr<FsState> &state,
+                const char *path, const char *mode) {
+  File file;
+  std::shared_ptr<FileImpl> impl = std::make_shared<FileImpl>();
+  impl->state = state;
+  impl->generation = state->generation;
+  impl->root = root;
+  impl->path = path;
+  impl->hostPath = toHostPath(root, path);
+
+  std::error_code ec;
+  if (stdfs::is_directory(impl->hostPath, ec)) {
+    impl->directory = true;
+    for (const stdfs::directory_entry &entry : stdfs::directory_iterator(impl->hostPath, ec)) {
+      impl->entries.push_back(entry.path().filename().string());
+    }
+    std::sort(impl->entries.begin(), impl->entries.end());
+  } else if (strcmp(mode, FILE_READ) == 0) {
+    if (!loadFile(impl->hostPath, impl->data)) return file;
+    impl->committed = impl->data.size();
+  } else {
+    impl->writable = true;
+    if (strcmp(mode, FILE_APPEND) == 0) loadFile(impl->hostPath, impl->data);
+    std::ofstream create(impl->hostPath, std::ios::binary | std::ios::app);
+    if (!create) return file;
+    if (strcmp(mode, FILE_WRITE) == 0) {
+      create.close();
+      std::ofstream truncate(impl->hostPath, std::ios::binary | std::ios::trunc);
+    }
+    impl->committed = impl->data.size();
+    impl->pos = impl->data.size();
+  }
+  impl->open = true;
+  file.impl = impl;
+  return file;
+}
+
+bool FS::exists(const char *path) {
+  std::error_code ec;
+  return stdfs::exists(hostPath(path), ec);
+}
+
+bool FS::mkdir(const char *path) {
+  std::error_code ec;
+  stdfs::create_directory(hostPath(path), ec);
+  return stdfs::is_directory(hostPath(path), ec);
+}
+
+bool FS::remove(const char *path) {
+  std::error_code ec;
+  return stdfs::is_regular_file(hostPath(path), ec) && stdfs::remove(hostPath(path), ec);
+}
+
+bool FS::rmdir(const char *path) {
+  std::error_code ec;
+  return stdfs::is_directory(hostPath(path), ec) && stdfs::remove(hostPath(path), ec);
+}
+
+void FS::powerCut() {
+  state->generation++;
+}
+
+uint32_t FS::getCommitCount() {
+  return state->commits;
+}
+
+void FS::format() {
+  std::error_code ec;
+  for (const stdfs::directory_entry &entry : stdfs::directory_iterator(root, ec)) {
+    stdfs::remove_all(entry.path(), ec);
+  }
+}
+
+} // namespace fs
@@ -0,0 +1,539 @@
+#include "SimHal.h"
+
+// ---- SimImuDevice ----
+
+const int16_t SimImuDevice::ACCEL_BIAS[3] = { 41, -27, 18 };
+const int16_t SimImuDevice::GYRO_BIAS[3] = { 12, -9, 5 };
+
+static const uint32_t FREE_FALL_US = 300000;
+static const uint32_t IMPACT_US = 40000;
+static const uint32_t GET_UP_AFTER_US = 3000000;
+static const uint32_t SLOW_FALL_US = 600000;
+static const uint32_t SOFT_IMPACT_US = 60000;
+static const uint32_t SIT_DOWN_US = 250000;
+static const uint32_t SEAT_CONTACT_US = 120000;
+static const uint32_t JUMP_US = 200000;
+static const uint32_t LANDING_US = 60000;
+static const uint32_t STUMBLE_US = 120000;
+static const uint32_t CATCH_US = 80000;
+static const uint32_t WALK_US = 10000000;
+static const uint32_t WALK_ON_US = 4000000;   // after a jump or stumble
+static const uint32_t ROLL_OVER_US = 1000000;
+
+SimImuDevice::SimImuDevice(uint32_t seed) {
+  rng = seed != 0 ? seed : 1;
+  periodUs = SAMPLING_PERIOD_MS * 1000UL;
+  nextSampleUs = 0;
+  started = false;
+  accelNoise = 20;
+  gyroNoise = 6;
+}
+
+bool SimImuDevice::begin(const RateProfile &profile) {
+  periodUs = profile.samplePeriodUs;
+  nextSampleUs = micros();
+  started = true;
+  return true;
+}
+
+// the next sample comes one new period after the last one handed out
+bool SimImuDevice::setRateProfile(const RateProfile &profile) {
+  nextSampleUs = nextSampleUs - periodUs + profile.samplePeriodUs;
+  periodUs = profile.samplePeriodUs;
+  return true;
+}
+
+bool SimImuDevice::readSample(RawImuSample &out, uint32_t nowUs) {
+  generate(out, nowUs);
+  return true;
+}
+
+size_t SimImuDevice::readBurst(RawImuSample *out, size_t maxSamples, uint32_t nowUs) {
+  size_t count = 0;
+  // everything that would have piled up in the FIFO since last time
+  while (started && count < maxSamples && (int32_t)(nowUs - nextSampleUs) >= 0) {
+    generate(out[count++], nextSampleUs);
+    nextSampleUs += periodUs;
+  }
+  return count;
+}
+
+void SimImuDevice::flush() {
+  nextSampleUs = micros();
+}
+
+uint32_t SimImuDevice::getOverflowCount() {
+  return 0;
+}
+
+void SimImuDevice::scheduleMotion(SimMotion motion, uint32_t startUs) {
+  Motion m = { motion, startUs };
+  motions.push_back(m);
+}
+
+void SimImuDevice::scheduleFall(uint32_t startUs, bool getUp) {
+  scheduleMotion(getUp ? SIM_MOTION_FALL_GET_UP : SIM_MOTION_FALL, startUs);
+}
+
+uint32_t SimImuDevice::impactOffsetUs(SimMotion motion) {
+  switch (motion) {
+    case SIM_MOTION_FALL:
+    case SIM_MOTION_FALL_GET_UP: return FREE_FALL_US;
+    case SIM_MOTION_SLOW_FALL: return SLOW_FALL_US;
+    case SIM_MOTION_SIT_DOWN: return SIT_DOWN_US;
+    case SIM_MOTION_JUMP: return JUMP_US;
+    case SIM_MOTION_STUMBLE: return STUMBLE_US;
+    default: return 0;
+  }
+}
+
+void SimImuDevice::setNoise(int16_t accelCounts, int16_t gyroCounts) {
+  accelNoise = accelCounts;
+  gyroNoise = gyroCounts;
+}
+
+int16_t SimImuDevice::noise(int16_t amplitude) {
+  if (amplitude == 0) return 0;
+  rng = rng * 1664525UL + 1013904223UL;
+  return (int16_t)((int32_t)(rng >> 16) % (2 * amplitude + 1) - amplitude);
+}
+
+// one axis bobbing around centerG by swingG once per periodUs, the matching rotation on another
+void SimImuDevice::walk(uint32_t sinceUs, uint32_t periodUs, float centerG, float swingG,
+                        int32_t &accel, int32_t &gyro) {
+  float phase = (float)(sinceUs % periodUs) / periodUs * 2.0F * (float)PI;
+  accel = (int32_t)(ACCEL_LSB_PER_G * (centerG + swingG * sinf(phase)));
+  gyro = (int32_t)(60 * GYRO_LSB_PER_DPS * cosf(phase));
+}
+
+void SimImuDevice::generate(RawImuSample &out, uint32_t tUs) {
+  const int16_t ONE_G = (int16_t)ACCEL_LSB_PER_G;
+  int32_t accel[3] = { 0, 0, ONE_G };     // flat on a table
+  int32_t gyro[3] = { 0, 0, 0 };
+  int16_t accelAmp = accelNoise;
+  int16_t gyroAmp = gyroNoise;
+
+  for (size_t i = 0; i < motions.size(); i++) {
+    uint32_t since = tUs - motions[i].startUs;
+    if ((int32_t)since < 0) {
+      continue;
+    }
+    // start from the resting pose, the motion overrides what it moves
+    accel[0] = 0; accel[1] = 0; accel[2] = ONE_G;
+    gyro[0] = 0; gyro[1] = 0; gyro[2] = 0;
+
+    switch (motions[i].type) {
+      case SIM_MOTION_FALL:
+      case SIM_MOTION_FALL_GET_UP:
+        if (since < FREE_FALL_US) {
+          accel[2] = ONE_G / 10;
+          gyro[0] = (int32_t)(300 * GYRO_LSB_PER_DPS);  // tumbling
+        } else if (since < FREE_FALL_US + IMPACT_US) {
+          accel[0] = 4 * ONE_G; accel[1] = ONE_G; accel[2] = -ONE_G;
+          gyro[1] = (int32_t)(200 * GYRO_LSB_PER_DPS);
+        } else {
+          // lying on the side
+          accel[0] = ONE_G; accel[2] = 0;
+          if (motions[i].type == SIM_MOTION_FALL_GET_UP && since > FREE_FALL_US + IMPACT_US + GET_UP_AFTER_US) {
+            // moving about at 2Hz, 0.85g - 1.35g: clearly not still, but never low enough
+            // to look like another free fall
+            walk(since, 500000UL, 1.1F, 0.25F, accel[0], gyro[2]);
+          }
+        }
+        break;
+
+      case SIM_MOTION_SLOW_FALL:
+        if (since < SLOW_FALL_US) {
+          accel[2] = (int32_t)(ONE_G * 0.6F);
+          gyro[1] = (int32_t)(90 * GYRO_LSB_PER_DPS);
+        } else if (since < SLOW_FALL_US + SOFT_IMPACT_US) {
+          accel[0] = (int32_t)(ONE_G * 1.2F); accel[2] = ONE_G;
+        } else {
+          accel[0] = ONE_G; accel[2] = 0;
+        }
+        break;
+
+      case SIM_MOTION_SIT_DOWN:
+        if (since < SIT_DOWN_US) {
+          accel[2] = (int32_t)(ONE_G * 0.7F);
+          gyro[1] = (int32_t)(40 * GYRO_LSB_PER_DPS);
+        } else if (since < SIT_DOWN_US + SEAT_CONTACT_US) {
+          accel[2] = (int32_t)(ONE_G * 1.6F);
+        }
+        // then sitting still, upright
+        break;
+
+      case SIM_MOTION_JUMP:
+        if (since < JUMP_US) {
+          accel[2] = ONE_G / 20;
+        } else if (since < JUMP_US + LANDING_US) {
+          accel[2] = 3 * ONE_G;
+        } else if (since < JUMP_US + LANDING_US + WALK_ON_US) {
+          walk(since, 550000UL, 1.05F, 0.3F, accel[2], gyro[0]);
+        }
+        break;
+
+      case SIM_MOTION_STUMBLE:
+        if (since < STUMBLE_US) {
+          accel[2] = ONE_G / 2;
+          gyro[0] = (int32_t)(120 * GYRO_LSB_PER_DPS);
+        } else if (since < STUMBLE_US + CATCH_US) {
+          accel[2] = (int32_t)(ONE_G * 1.7F);
+        } else if (since < STUMBLE_US + CATCH_US + WALK_ON_US) {
+          walk(since, 550000UL, 1.05F, 0.3F, accel[2], gyro[0]);
+        }
+        break;
+
+      case SIM_MOTION_WALK:
+        if (since < WALK_US) {
+          // heel strikes dip to ~0.75g, which is what makes walking hard on a
+          // free-fall threshold
+          walk(since, 550000UL, 1.05F, 0.3F, accel[2], gyro[0]);
+        }
+        break;
+
+      case SIM_MOTION_ROLL_OVER: {
+        // gravity turns from Z onto Y at a steady 90 deg/s, 1g all the way
+        float angle = since < ROLL_OVER_US ? (float)since / ROLL_OVER_US * (float)HALF_PI : (float)HALF_PI;
+        accel[1] = (int32_t)(ONE_G * sinf(angle));
+        accel[2] = (int32_t)(ONE_G * cosf(angle));
+        if (since < ROLL_OVER_US) {
+          gyro[0] = (int32_t)(90 * GYRO_LSB_PER_DPS);
+        }
+        break;
+      }
+    }
+  }
+
+  out.timestampUs = tUs;
+  out.accelX = (int16_t)(accel[0] + ACCEL_BIAS[0] + noise(accelAmp));
+  out.accelY = (int16_t)(accel[1] + ACCEL_BIAS[1] + noise(accelAmp));
+  out.accelZ = (int16_t)(accel[2] + ACCEL_BIAS[2] + noise(accelAmp));
+  out.gyroX = (int16_t)(gyro[0] + GYRO_BIAS[0] + noise(gyroAmp));
+  out.gyroY = (int16_t)(gyro[1] + GYRO_BIAS[1] + noise(gyroAmp));
+  out.gyroZ = (int16_t)(gyro[2] + GYRO_BIAS[2] + noise(gyroAmp));
+}
+
+// ---- SimMpu6050 ----
+
+SimMpu6050::SimMpu6050() {
+  memset(registers, 0, sizeof(registers));
+  registers[0x75] = ADDRESS; // WHO_AM_I
+  fifoResets = 0;
+}
+
+void SimMpu6050::writeRegisters(uint8_t reg, const uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++, reg++) {
+    uint8_t value = data[i];
+    if (reg == MPU6050_REG_FIFO_R_W) {
+      reg--; // doesn't auto-increment
+      continue;
+    }
+    if (reg == MPU6050_REG_USER_CTRL && (value & MPU6050_USER_CTRL_FIFO_RESET)) {
+      fifo.clear();
+      fifoResets++;
+      value &= ~MPU6050_USER_CTRL_FIFO_RESET; // self-clearing
+    }
+    if (reg < sizeof(registers)) registers[reg] = value;
+  }
+}
+
+void SimMpu6050::readRegisters(uint8_t reg, uint8_t *out, size_t length) {
+  for (size_t i = 0; i < length; i++, reg++) {
+    switch (reg) {
+      case MPU6050_REG_FIFO_R_W:
+        out[i] = 0;
+        if (!fifo.empty()) {
+          out[i] = fifo.front();
+          fifo.pop_front();
+        }
+        reg--; // a burst keeps reading the FIFO
+        break;
+      case MPU6050_REG_FIFO_COUNTH:
+        out[i] = (uint8_t)(fifo.size() >> 8);
+        break;
+      case MPU6050_REG_FIFO_COUNTH + 1:
+        out[i] = (uint8_t)(fifo.size() & 0xFF);
+        break;
+      case MPU6050_REG_INT_STATUS:
+        out[i] = registers[reg];
+        registers[reg] = 0;
+        break;
+      default:
+        out[i] = reg < sizeof(registers) ? registers[reg] : 0;
+        break;
+    }
+  }
+}
+
+void SimMpu6050::pushFrame(const RawImuSample &sample) {
+  if (!(registers[MPU6050_REG_USER_CTRL] & MPU6050_USER_CTRL_FIFO_EN)) return;
+
+  uint8_t frame[MPU6050_FIFO_FRAME_BYTES];
+  size_t length = 0;
+  const int16_t accel[3] = { sample.accelX, sample.accelY, sample.accelZ };
+  const int16_t gyro[3] = { sample.gyroX, sample.gyroY, sample.gyroZ };
+  uint8_t enabled = registers[MPU6050_REG_FIFO_EN];
+  for (int axis = 0; axis < 3 && (enabled & MPU6050_FIFO_EN_ACCEL); axis++) {
+    frame[length++] = (uint8_t)((uint16_t)accel[axis] >> 8);
+    frame[length++] = (uint8_t)(accel[axis] & 0xFF);
+  }
+  for (int axis = 0; axis < 3; axis++) {
+    if (!(enabled & (0x40 >> axis))) continue; // XG_FIFO_EN, YG, ZG
+    frame[length++] = (uint8_t)((uint16_t)gyro[axis] >> 8);
+    frame[length++] = (uint8_t)(gyro[axis] & 0xFF);
+  }
+  pushBytes(frame, length);
+}
+
+void SimMpu6050::pushBytes(const uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (fifo.size() >= MPU6050_FIFO_SIZE_BYTES) {
+      fifo.pop_front();
+      registers[MPU6050_REG_INT_STATUS] |= MPU6050_INT_FIFO_OFLOW;
+    }
+    fifo.push_back(data[i]);
+  }
+}
+
+uint8_t SimMpu6050::getRegister(uint8_t reg) {
+  return reg < sizeof(registers) ? registers[reg] : 0;
+}
+
+size_t SimMpu6050::getFifoBytes() {
+  return fifo.size();
+}
+
+uint32_t SimMpu6050::getFifoResetCount() {
+  return fifoResets;
+}
+
+// ---- SimAudioSink ----
+
+SimAudioSink::SimAudioSink(size_t captureSamples) {
+  captureLimit = captureSamples;
+  samplesWritten = 0;
+}
+
+bool SimAudioSink::begin(uint32_t sampleRate) {
+  return true;
+}
+
+void SimAudioSink::end() {
+}
+
+size_t SimAudioSink::write(const uint8_t *data, size_t length) {
+  size_t samples = length / sizeof(int16_t);
+  const int16_t *pcm = (const int16_t *)data;
+  for (size_t i = 0; i < samples && capture.size() < captureLimit; i++) {
+    capture.push_back(pcm[i]);
+  }
+  samplesWritten += samples;
+  return samples * sizeof(int16_t);
+}
+
+bool SimAudioSink::waitForSpace(uint32_t timeoutMs) {
+  return true; // never full
+}
+
+uint64_t SimAudioSink::getSamplesWritten() {
+  return samplesWritten;
+}
+
+const std::vector<int16_t> &SimAudioSink::getCapture() {
+  return capture;
+}
+
+// ---- SimHttpTransport ----
+
+SimHttpTransport::SimHttpTransport() {
+  online = true;
+  connected = false;
+  statusCode = HTTP_STATUS_OK;
+  requestCount = 0;
+  handshakeCount = 0;
+  bytesSent = 0;
+  deviceConfigRevision = 0;
+  setDeviceConfig("{}");
+}
+
+bool SimHttpTransport::connect(uint32_t timeoutMs) {
+  connected = online;
+  return connected;
+}
+
+bool SimHttpTransport::isConnected() {
+  return connected && online;
+}
+
+int SimHttpTransport::request(const char *method, const char *url,
+                              const HttpHeader *headers, size_t headerCount,
+                              const uint8_t *body, size_t bodyLength, String *response,
+                              HttpResponseHeader *responseHeaders, size_t responseHeaderCount) {
+  requestCount++;
+  if (!online) {
+    connected = false;
+    openHost = "";
+    return -1; // HTTPC_ERROR_CONNECTION_REFUSED
+  }
+  // like HTTPClient with reuse on: the open connection serves any URL on the same host,
+  // anything else closes it and opens (and handshakes) a new one
+  const char *hostStart = strstr(url, "://");
+  hostStart = hostStart != NULL ? hostStart + 3 : url;
+  String host(std::string(hostStart, strcspn(hostStart, "/")));
+  if (host != openHost) {
+    handshakeCount++;
+    openHost = host;
+  }
+
+  bytesSent += bodyLength;
+  for (size_t i = 0; i < responseHeaderCount; i++) {
+    responseHeaders[i].value = "";
+  }
+
+  if (strstr(url, "device-config") != NULL && statusCode == HTTP_STATUS_OK) {
+    for (size_t i = 0; i < responseHeaderCount; i++) {
+      if (strcasecmp(responseHeaders[i].name, "ETag") == 0) {
+        responseHeaders[i].value = deviceConfigEtag;
+      }
+    }
+    for (size_t i = 0; i < headerCount; i++) {
+      if (strcasecmp(headers[i].name, "If-None-Match") == 0 && deviceConfigEtag == headers[i].value) {
+        if (response != NULL) *response = "";
+        return HTTP_STATUS_NOT_MODIFIED;
+      }
+    }
+  }
+
+  if (response != NULL) {
+    if (strstr(url, "get-test-token") != NULL) {
+      *response = "sim-token";
+    } else if (strstr(url, "device-config") != NULL) {
+      *response = deviceConfig;
+    } else {
+      *response = "";
+    }
+  }
+  return statusCode;
+}
+
+String SimHttpTransport::errorToString(int code) {
+  return code < 0 ? "connection refused" : "";
+}
+
+uint32_t SimHttpTransport::getRequestCount() {
+  return requestCount;
+}
+
+uint32_t SimHttpTransport::getHandshakeCount() {
+  return handshakeCount;
+}
+
+void SimHttpTransport::setOnline(bool isOnline) {
+  online = isOnline;
+  if (!online) {
+    connected = false;
+    openHost = "";
+  }
+}
+
+void SimHttpTransport::dropConnection() {
+  openHost = "";
+}
+
+void SimHttpTransport::setStatusCode(int code) {
+  statusCode = code;
+}
+
+void SimHttpTransport::setDeviceConfig(const char *json) {
+  deviceConfig = json;
+  deviceConfigRevision++;
+  deviceConfigEtag = "\"sim-" + String(deviceConfigRevision) + "\"";
+}
+
+uint64_t SimHttpTransport::getBytesSent() {
+  return bytesSent;
+}
+
+// ---- SimKeyValueStore ----
+
+SimKeyValueStore::SimKeyValueStore() {
+  putCount = 0;
+}
+
+size_t SimKeyValueStore::get(const char *key, void *out, size_t maxLength) {
+  std::map<std::string, std::vector<uint8_t> >::iterator it = values.find(key);
+  if (it == values.end() || it->second.empty() || it->second.size() > maxLength) {
+    return 0;
+  }
+  memcpy(out, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+bool SimKeyValueStore::put(const char *key, const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  values[key].assign(bytes, bytes + length);
+  putCount++;
+  return true;
+}
+
+bool SimKeyValueStore::remove(const char *key) {
+  values.erase(key);
+  return true;
+}
+
+uint32_t SimKeyValueStore::getPutCount() {
+  return putCount;
+}
+
+// ---- FilePrint ----
+
+FilePrint::FilePrint() {
+  file = NULL;
+}
+
+FilePrint::~FilePrint() {
+  close();
+}
+
+bool FilePrint::open(const char *path) {
+  close();
+  file = fopen(path, "wb");
+  return file != NULL;
+}
+
+void FilePrint::close() {
+  if (file != NULL) {
+    fclose(file);
+    file = NULL;
+  }
+}
+
+size_t FilePrint::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t FilePrint::write(const uint8_t *buffer, size_t size) {
+  return file != NULL ? fwrite(buffer, 1, size, file) : 0;
+}
+
+void FilePrint::flush() {
+  if (file != NULL) {
+    fflush(file);
+  }
+}
+
+bool simLoadFile(const char *path, std::vector<uint8_t> &out) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  out.clear();
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    out.insert(out.end(), buffer, buffer + n);
+  }
+  fclose(file);
+  return true;
+}
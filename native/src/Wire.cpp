@@ -0,0 +1,75 @@
+#include <Wire.h>
+
+TwoWire Wire;
+
+TwoWire::TwoWire() {
+  deviceAddress = 0;
+  device = NULL;
+  txAddress = 0;
+  registerPointer = 0;
+  rxIndex = 0;
+  clockHz = 100000;
+}
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+  if (frequency != 0) clockHz = frequency;
+  return true;
+}
+
+bool TwoWire::setClock(uint32_t frequency) {
+  clockHz = frequency;
+  return true;
+}
+
+void TwoWire::attach(uint8_t address, I2cDevice *i2cDevice) {
+  deviceAddress = address;
+  device = i2cDevice;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  txAddress = address;
+  txBuffer.clear();
+}
+
+size_t TwoWire::write(uint8_t value) {
+  txBuffer.push_back(value);
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t length) {
+  txBuffer.insert(txBuffer.end(), data, data + length);
+  return length;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  if (device == NULL || txAddress != deviceAddress) return 2;
+  if (txBuffer.empty()) return 0;
+
+  registerPointer = txBuffer[0];
+  if (txBuffer.size() > 1) {
+    device->writeRegisters(registerPointer, &txBuffer[1], txBuffer.size() - 1);
+  }
+  return 0;
+}
+
+size_t TwoWire::requestFrom(uint8_t address, size_t length, bool sendStop) {
+  rxBuffer.clear();
+  rxIndex = 0;
+  if (device == NULL || address != deviceAddress || length == 0) return 0;
+
+  rxBuffer.resize(length);
+  device->readRegisters(registerPointer, &rxBuffer[0], length);
+  return length;
+}
+
+int TwoWire::available() {
+  return (int)(rxBuffer.size() - rxIndex);
+}
+
+int TwoWire::read() {
+  return rxIndex < rxBuffer.size() ? rxBuffer[rxIndex++] : -1;
+}
+
+uint32_t TwoWire::getClock() {
+  return clockHz;
+}
@@ -0,0 +1,243 @@
+// Host-side runs of the sensing pipeline.
+//
+// Simulated session against SimHal: calibration, two simulated falls (one where the
+// wearer gets up again), fall detection, telemetry batching and payload building through
+// NetworkManager, a conditional device config fetch and background bias tracking, which
+// has to find the simulated sensor bias on every axis: the wearer lies flat, on the side
+// after the first fall and rolls onto Y at the end.
+// Prints what happened and how long the portable code took in real time.
+// --record writes the raw sensor stream out as an IMU trace (see ImuTrace.h).
+//
+// Trace replay: feeds a recorded trace (a .imt file, or a raw serial capture with
+// TRACE_CAPTURE_SERIAL output in it) through calibration and fall detection as fast as
+// the CPU allows, and reports when each fall was caught and how long it took.
+//
+//   pio run -e native
+//   .pio/build/native/program [--verbose] [--profile] [--record trace.imt]
+//   .pio/build/native/program --replay trace.imt [--verbose]
+
+#include <Arduino.h>
+#include <chrono>
+#include "SimHal.h"
+#include "DetectionRunner.h"
+#include "ImuTrace.h"
+#include "Profiler.h"
+#include "NetworkManager.h"
+#include "TelemetryBatcher.h"
+
+static const uint32_t RUN_SECONDS = 120;
+// how close the tracked offsets have to end up to the simulated sensor bias, in counts
+static const float ACCEL_BIAS_TOLERANCE = 5.0F;
+static const float GYRO_BIAS_TOLERANCE = 1.0F;
+
+struct SessionContext {
+  NetworkManager *networkManager;
+  TelemetryBatcher *telemetryBatcher;
+  uint32_t batches;
+};
+
+static void onMonitoringSample(const ImuSample &sample, void *context) {
+  SessionContext *session = (SessionContext *)context;
+  TelemetryBatcher &batcher = *session->telemetryBatcher;
+  uint32_t timestampMs = sample.timestampUs / 1000;
+  if (!batcher.add(timestampMs, sample)) {
+    session->networkManager->sendSensorBatch(batcher.samples(), batcher.count());
+    session->batches++;
+    batcher.clear();
+    batcher.add(timestampMs, sample);
+  }
+}
+
+static void onSessionEvent(const DetectionEvent &event, void *context) {
+  SessionContext *session = (SessionContext *)context;
+  if (event.type == DETECTION_ALARM) {
+    session->networkManager->sendSensorData(event.sample.accelMagnitude(), event.sample.gyroMagnitude(), true);
+  }
+}
+
+static int runSimulation(const char *recordPath) {
+  SimClock clock;
+  SimImuDevice simImu;
+  SimHttpTransport http;
+
+  // optionally record what the sensor produced, exactly as the device would
+  FilePrint traceFile;
+  TraceWriter traceWriter;
+  TracingImuDevice tracedImu(simImu, traceWriter);
+  if (recordPath != NULL) {
+    if (!traceFile.open(recordPath)) {
+      printf("cannot write %s\n", recordPath);
+      return 2;
+    }
+    traceWriter.begin(&traceFile, SAMPLING_PERIOD_MS * 1000UL);
+  }
+
+  DetectionRunner runner(tracedImu, clock);
+  NetworkManager networkManager(http);
+  TelemetryBatcher telemetryBatcher;
+  SessionContext session = { &networkManager, &telemetryBatcher, 0 };
+  runner.setMonitoringCallback(onMonitoringSample, &session);
+  runner.setEventCallback(onSessionEvent, &session);
+
+  runner.begin();
+  networkManager.initialize();
+
+  // the boot-time config fetch and one refresh: the whole document, then only a 304
+  SimKeyValueStore nvs;
+  runner.getConfig().setStore(&nvs);
+  bool configCurrent = networkManager.fetchDeviceConfig(runner.getConfig()) &&
+                       networkManager.fetchDeviceConfig(runner.getConfig());
+
+  uint32_t t0 = clock.micros();
+  simImu.scheduleFall(t0 + 30000000UL, false);  // stays down -> alarm
+  simImu.scheduleFall(t0 + 70000000UL, true);   // gets up again -> no alarm
+  // lying down on the other axis: the bias tracker has now seen gravity along all three
+  simImu.scheduleMotion(SIM_MOTION_ROLL_OVER, t0 + 95000000UL);
+
+  auto wallStart = std::chrono::steady_clock::now();
+  while (clock.micros() - t0 < RUN_SECONDS * 1000000UL) {
+    runner.poll();
+    traceWriter.drain();   // TraceDrainTask's job on the device
+  }
+  auto wall = std::chrono::steady_clock::now() - wallStart;
+  double wallMs = std::chrono::duration<double, std::milli>(wall).count();
+
+  traceWriter.end();
+  traceFile.close();
+
+  uint32_t samples = runner.getSampleCount();
+  uint32_t falls = runner.countEvents(DETECTION_FALL);
+  uint32_t alarms = runner.countEvents(DETECTION_ALARM);
+  uint32_t cleared = runner.countEvents(DETECTION_CLEARED);
+
+  printf("simulated %lu s, %lu samples in %.1f ms (%.0fx real time)\n",
+         (unsigned long)RUN_SECONDS, (unsigned long)samples, wallMs, RUN_SECONDS * 1000.0 / wallMs);
+  printf("per sample: %.0f ns (detection, post-impact check, batching, payload encoding)\n",
+         samples > 0 ? (double)runner.getProcessingTime().count() / samples : 0.0);
+  printf("falls detected: %lu, alarms: %lu, cleared: %lu (expected 2, 1, 1)\n",
+         (unsigned long)falls, (unsigned long)alarms, (unsigned long)cleared);
+  printf("batches: %lu, requests: %lu, bytes sent: %llu\n",
+         (unsigned long)session.batches, (unsigned long)http.getRequestCount(), (unsigned long long)http.getBytesSent());
+  printf("device config: %s, ETag %s, %lu NVS writes\n", configCurrent ? "current" : "fetch failed",
+         runner.getConfig().getEtag().c_str(), (unsigned long)nvs.getPutCount());
+  float accelOffset[3], gyroOffset[3];
+  runner.getSensor().getCalibration(accelOffset, gyroOffset);
+  const int16_t *accelBias = SimImuDevice::ACCEL_BIAS;
+  const int16_t *gyroBias = SimImuDevice::GYRO_BIAS;
+  bool biasFound = true;
+  for (int i = 0; i < 3; i++) {
+    biasFound = biasFound && fabsf(accelOffset[i] - accelBias[i]) <= ACCEL_BIAS_TOLERANCE &&
+                fabsf(gyroOffset[i] - gyroBias[i]) <= GYRO_BIAS_TOLERANCE;
+  }
+  printf("calibration after %lu still windows: accel %.0f %.0f %.0f, gyro %.1f %.1f %.1f counts (sensor bias %d %d %d, %d %d %d)%s\n",
+         (unsigned long)runner.getSensor().getBiasUpdateCount(), accelOffset[0], accelOffset[1], accelOffset[2],
+         gyroOffset[0], gyroOffset[1], gyroOffset[2], accelBias[0], accelBias[1], accelBias[2],
+         gyroBias[0], gyroBias[1], gyroBias[2], biasFound ? "" : " NOT FOUND");
+  printf("rate profile: %s, %lu switches\n", getRateProfile(runner.getSensor().getRateProfile()).name,
+         (unsigned long)runner.getSensor().getRateSwitchCount());
+  if (recordPath != NULL) {
+    printf("trace: %lu samples, %lu bytes -> %s\n", (unsigned long)traceWriter.getSamplesWritten(),
+           (unsigned long)traceWriter.getBytesWritten(), recordPath);
+  }
+
+  return (falls == 2 && alarms == 1 && cleared == 1 && biasFound) ? 0 : 1;
+}
+
+static int runReplay(const char *tracePath) {
+  std::vector<uint8_t> trace;
+  if (!simLoadFile(tracePath, trace)) {
+    printf("cannot read %s\n", tracePath);
+    return 2;
+  }
+
+  SimClock clock;
+  TraceReader reader(trace.data(), trace.size());
+  TraceImuDevice traceImu(reader);
+  DetectionRunner runner(traceImu, clock);
+
+  uint32_t t0 = clock.micros();
+  if (!runner.begin()) {
+    printf("%s: no trace blocks found\n", tracePath);
+    return 2;
+  }
+
+  auto wallStart = std::chrono::steady_clock::now();
+  while (!traceImu.isFinished()) {
+    // skip over gaps in the recording instead of polling through them
+    const uint32_t pollUs = runner.getSensor().getPollPeriodMs() * 1000UL;
+    uint32_t dueUs = clock.micros();
+    if (traceImu.nextDueUs(dueUs) && (int32_t)(dueUs - clock.micros()) > (int32_t)pollUs) {
+      clock.advanceUs(dueUs - clock.micros() - pollUs);
+    }
+    runner.poll();
+  }
+  // let a fall near the end of the trace get as far as its post-impact check
+  runner.poll();
+  auto wall = std::chrono::steady_clock::now() - wallStart;
+  double wallMs = std::chrono::duration<double, std::milli>(wall).count();
+  double spanS = (clock.micros() - t0) / 1e6;
+
+  printf("%s: %lu blocks, %lu corrupt, %lu bytes skipped\n", tracePath,
+         (unsigned long)reader.getBlockCount(), (unsigned long)reader.getCorruptBlocks(),
+         (unsigned long)reader.getSkippedBytes());
+  printf("replayed %.1f s, %lu samples in %.1f ms (%.0fx real time), %.0f ns per sample\n",
+         spanS, (unsigned long)runner.getSampleCount(), wallMs, spanS * 1000.0 / wallMs,
+         runner.getSampleCount() > 0 ? (double)runner.getProcessingTime().count() / runner.getSampleCount() : 0.0);
+
+  // latency is split into what the algorithm needs (free fall until the impact sample)
+  // and what the pipeline adds (impact sample until the FIFO burst reached detectFall)
+  uint32_t fallUs = 0;
+  const std::vector<DetectionEvent> &events = runner.getEvents();
+  for (size_t i = 0; i < events.size(); i++) {
+    const DetectionEvent &event = events[i];
+    double atS = (event.sampleUs - t0) / 1e6;
+    switch (event.type) {
+      case DETECTION_FALL:
+        fallUs = event.decidedUs;
+        printf("%9.3f s  fall     free fall -> impact %.0f ms, impact -> detected %.1f ms, peak %.1f m/s2\n",
+               atS, (event.sampleUs - event.freeFallStartUs) / 1000.0,
+               (event.decidedUs - event.sampleUs) / 1000.0, event.sample.accelMagnitude());
+        break;
+      case DETECTION_ALARM:
+        printf("%9.3f s  alarm    %.2f s after detection\n", atS, (event.decidedUs - fallUs) / 1e6);
+        break;
+      case DETECTION_CLEARED:
+        printf("%9.3f s  cleared  %.2f s after detection\n", atS, (event.decidedUs - fallUs) / 1e6);
+        break;
+    }
+  }
+  printf("falls detected: %lu, alarms: %lu, cleared: %lu\n",
+         (unsigned long)runner.countEvents(DETECTION_FALL), (unsigned long)runner.countEvents(DETECTION_ALARM),
+         (unsigned long)runner.countEvents(DETECTION_CLEARED));
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  bool verbose = false;
+  bool profile = false;
+  const char *recordPath = NULL;
+  const char *replayPath = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--verbose") == 0) {
+      verbose = true;
+    } else if (strcmp(argv[i], "--profile") == 0) {
+      profile = true;
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      recordPath = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replayPath = argv[++i];
+    } else {
+      printf("usage: %s [--verbose] [--profile] [--record trace.imt | --replay trace.imt]\n", argv[0]);
+      return 2;
+    }
+  }
+  Serial.setQuiet(!verbose);
+
+  int result = replayPath != NULL ? runReplay(replayPath) : runSimulation(recordPath);
+  if (profile) {
+    // probe times are host nanoseconds here, only useful relative to each other
+    Serial.setQuiet(false);
+    Profiler::dump(Serial);
+  }
+  return result;
+}
@@ -1,29 +1,45 @@
 #include "AudioController.h"
-#include <math.h>
+#include "Profiler.h"
 
-AudioController::AudioController(int bclk_pin, int lrc_pin, int data_pin)
-    : _bclk_pin(bclk_pin)
-    , _lrc_pin(lrc_pin)
-    , _data_pin(data_pin)
-    , _sample_rate(44100)
+AudioController::AudioController(AudioSink &sink, DeviceConfig &config)
+    : _sink(sink)
+    , _config(config)
+    , _sample_rate(AUDIO_SAMPLE_RATE)
     , _initialized(false)
-    , _tone_playing(false)
     , _volume(0.1f)
     , _frequency_hz(440)
-    , _phase(0.0f)
-    , _beep_playing(false)
-    , _beep_start_time(0)
-    , _beep_duration(0)
-    , _beep_frequency(1000)
-    , _beep_volume(0.2f)
+    , _prompt_request_pending(false)
+    , _prompt_request_samples(NULL)
+    , _prompt_request_length(0)
+    , _prompt_samples(NULL)
+    , _prompt_length(0)
+    , _prompt_pos(0)
+    , _task(NULL)
+    , _lock(portMUX_INITIALIZER_UNLOCKED)
+    , _write_ptr(NULL)
+    , _write_len(0)
+    , _write_offset(0)
 {
     memset(_audio_buffer, 0, sizeof(_audio_buffer));
+    memset(&_alarm_request, 0, sizeof(_alarm_request));
+    memset(&_beep_request, 0, sizeof(_beep_request));
+
+    // same shape as TONE_PATTERN_PULSE, the frequency is filled in by playTone()
+    _tone_steps[0] = TONE_PULSE_STEPS[0];
+    _tone_steps[1] = TONE_PULSE_STEPS[1];
+    _tone_pattern = TONE_PATTERN(_tone_steps, true);
+    _beep_steps[0] = { 1000, 1000, 200, 255 };
+    _beep_pattern = TONE_PATTERN(_beep_steps, false);
 }
 
 AudioController::~AudioController() {
     if (_initialized) {
         stopTone();
-        i2s_driver_uninstall(I2S_PORT);
+        if (_task != NULL) {
+            vTaskDelete(_task);
+            _task = NULL;
+        }
+        _sink.end();
         _initialized = false;
         Serial.println("AudioController stopped");
     }
@@ -35,77 +51,92 @@ bool AudioController::begin(uint32_t sample_rate) {
     }
     
     _sample_rate = sample_rate;
+    _alarm_voice.setSampleRate(sample_rate);
+    _beep_voice.setSampleRate(sample_rate);
     
-    if (setupI2S()) {
-        _initialized = true;
-        Serial.println("AudioController initialized successfully");
-        return true;
-    }
-    
-    Serial.println("AudioController initialization failed");
-    return false;
-}
-
-bool AudioController::setupI2S() {
-    // I2S configuration
-    i2s_config_t i2s_config = {
-        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX),
-        .sample_rate = _sample_rate,
-        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
-        .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
-        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
-        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 8,
-        .dma_buf_len = BUFFER_SIZE,
-        .use_apll = false,
-        .tx_desc_auto_clear = true,
-        .fixed_mclk = 0
-    };
-
-    // I2S pin configuration
-    i2s_pin_config_t pin_config = {
-        .bck_io_num = _bclk_pin,
-        .ws_io_num = _lrc_pin,
-        .data_out_num = _data_pin,
-        .data_in_num = I2S_PIN_NO_CHANGE
-    };
-
-    // Install I2S driver
-    esp_err_t result = i2s_driver_install(I2S_PORT, &i2s_config, 0, NULL);
-    if (result != ESP_OK) {
-        Serial.printf("Error installing I2S driver: %d\n", result);
+    if (!_sink.begin(sample_rate)) {
+        Serial.println("AudioController initialization failed");
         return false;
     }
 
-    // Set I2S pins
-    result = i2s_set_pin(I2S_PORT, &pin_config);
-    if (result != ESP_OK) {
-        Serial.printf("Error setting I2S pins: %d\n", result);
-        i2s_driver_uninstall(I2S_PORT);
+    // optional, tones work without it
+    _prompts.begin(sample_rate);
+
+    BaseType_t result = xTaskCreatePinnedToCore(audioTaskEntry, "audio", AUDIO_TASK_STACK, this,
+                                                AUDIO_TASK_PRIORITY, &_task, AUDIO_TASK_CORE);
+    if (result != pdPASS) {
+        Serial.println("AudioController: failed to start audio task");
+        _task = NULL;
+        _sink.end();
         return false;
     }
 
+    _initialized = true;
+    Serial.println("AudioController initialized successfully");
     return true;
 }
 
 void AudioController::playTone(int frequency_hz, float volume) {
     if (!_initialized) return;
     
+    portENTER_CRITICAL(&_lock);
     _frequency_hz = frequency_hz;
     _volume = constrain(volume, 0.0f, 1.0f);
-    _tone_playing = true;
-    _phase = 0.0f;
+    _alarm_request.pattern = &_tone_pattern;
+    _alarm_request.frequency_hz = constrain(frequency_hz, 20, 20000);
+    _alarm_request.volume = _volume;
+    _alarm_request.pending = true;
+    portEXIT_CRITICAL(&_lock);
+}
+
+void AudioController::playAlarm() {
+    DeviceSettings settings = _config.get();
+    playTone((int)settings.alarmFrequencyHz, settings.alarmVolume);
+}
+
+void AudioController::playPattern(const TonePattern &pattern, float volume) {
+    if (!_initialized) return;
+
+    portENTER_CRITICAL(&_lock);
+    _volume = constrain(volume, 0.0f, 1.0f);
+    _alarm_request.pattern = &pattern;
+    _alarm_request.volume = _volume;
+    _alarm_request.pending = true;
+    portEXIT_CRITICAL(&_lock);
 }
 
 void AudioController::stopTone() {
-    _tone_playing = false;
-    _beep_playing = false;
-    memset(_audio_buffer, 0, sizeof(_audio_buffer)); // clear audio buffer
-    
-    if (_initialized) {
-        size_t bytes_written;
-        i2s_write(I2S_PORT, _audio_buffer, sizeof(_audio_buffer), &bytes_written, 100);
+    // the task stops writing, auto-clear then fills the DMA buffers with silence
+    portENTER_CRITICAL(&_lock);
+    _alarm_request.pattern = NULL;
+    _alarm_request.pending = true;
+    _beep_request.pattern = NULL;
+    _beep_request.pending = true;
+    _prompt_request_samples = NULL;
+    _prompt_request_pending = true;
+    portEXIT_CRITICAL(&_lock);
+}
+
+bool AudioController::playPrompt(PromptId id) {
+    if (!_initialized) return false;
+
+    // the index is read-only flash, fine to look it up from the caller's task
+    const int16_t *samples;
+    uint32_t length;
+    if (!_prompts.getClip(id, &samples, &length)) {
+        return false;
     }
+
+    portENTER_CRITICAL(&_lock);
+    _prompt_request_samples = samples;
+    _prompt_request_length = length;
+    _prompt_request_pending = true;
+    portEXIT_CRITICAL(&_lock);
+    return true;
+}
+
+bool AudioController::isPromptPlaying() const {
+    return _prompt_samples != NULL || _prompt_request_pending;
 }
 
 int AudioController::getFrequency() const {
@@ -121,64 +152,116 @@ bool AudioController::isInitialized() const {
 }
 
 void AudioController::update() {
-    if (!_initialized) return;
-    
-    // Handle beep timing
-    if (_beep_playing) {
-        if (millis() - _beep_start_time >= _beep_duration) {
-            stopTone();
-            return;
-        }
-        generateToneBuffer();
-        playAudioBuffer();
+    // nothing to do, see audioTask()
+}
+
+void AudioController::audioTaskEntry(void *param) {
+    static_cast<AudioController *>(param)->audioTask();
+}
+
+void AudioController::audioTask() {
+    // one DMA buffer worth of time, in case the driver goes quiet while we're idle
+    const uint32_t idleTimeoutMs = BUFFER_SIZE * 1000 / _sample_rate + 1;
+
+    while (true) {
+        // A timeout just means nothing happened, try anyway so a new tone starts promptly
+        _sink.waitForSpace(idleTimeoutMs);
+        fillDmaBuffers();
     }
-    
-    // Generate and play audio if needed
-    if (_tone_playing) {
-        if ((millis() % 300) < 150) {
-            generateToneBuffer();
-            playAudioBuffer();
-        } else {
-            memset(_audio_buffer, 0, sizeof(_audio_buffer));
-            playAudioBuffer();
+}
+
+void AudioController::fillDmaBuffers() {
+    // write until the driver is full, never wait for it
+    while (true) {
+        if (_write_ptr == NULL) {
+            if (!nextBlock()) {
+                return; // nothing playing
+            }
+            _write_offset = 0;
+        }
+
+        _write_offset += _sink.write(_write_ptr + _write_offset, _write_len - _write_offset);
+        if (_write_offset < _write_len) {
+            return; // DMA is full, the rest goes out on the next TX_DONE
         }
+        _write_ptr = NULL;
     }
 }
 
-void AudioController::generateToneBuffer() {
-    int current_frequency = _beep_playing ? _beep_frequency : _frequency_hz;
-    float current_volume = _beep_playing ? _beep_volume : _volume;
-    
-    float phase_increment = 2.0f * M_PI * current_frequency / _sample_rate;;
-    
-    for (int i = 0; i < BUFFER_SIZE; i++) {
-        float sample = sin(_phase) * current_volume * 32767.0f;
-        _audio_buffer[i] = (int16_t)sample;
-        
-        _phase += phase_increment;
-        if (_phase > 2.0f * M_PI) {
-            _phase -= 2.0f * M_PI;
+bool AudioController::nextBlock() {
+    PROFILE_SCOPE("audio.nextBlock");
+    // pick up whatever the API asked for since the last buffer
+    portENTER_CRITICAL(&_lock);
+    VoiceRequest alarm_request = _alarm_request;
+    VoiceRequest beep_request = _beep_request;
+    _alarm_request.pending = false;
+    _beep_request.pending = false;
+    bool prompt_pending = _prompt_request_pending;
+    const int16_t *prompt_samples = _prompt_request_samples;
+    uint32_t prompt_length = _prompt_request_length;
+    _prompt_request_pending = false;
+    portEXIT_CRITICAL(&_lock);
+
+    applyRequest(alarm_request, _alarm_voice);
+    applyRequest(beep_request, _beep_voice);
+    if (prompt_pending) {
+        _prompt_samples = prompt_samples;
+        _prompt_length = prompt_length;
+        _prompt_pos = 0;
+    }
+
+    if (_prompt_samples != NULL) {
+        // hand the driver the mapped flash directly, the only copy is into the DMA buffer
+        uint32_t chunk = min((uint32_t)BUFFER_SIZE, _prompt_length - _prompt_pos);
+        _write_ptr = (const uint8_t *)(_prompt_samples + _prompt_pos);
+        _write_len = chunk * sizeof(int16_t);
+        _prompt_pos += chunk;
+        if (_prompt_pos >= _prompt_length) {
+            _prompt_samples = NULL;
         }
+        return chunk > 0;
+    }
+
+    if (!_alarm_voice.isActive() && !_beep_voice.isActive()) {
+        return false;
     }
+
+    // one pass: background writes the buffer, the beep is added on top
+    _alarm_voice.render(_audio_buffer, BUFFER_SIZE, false);
+    _beep_voice.render(_audio_buffer, BUFFER_SIZE, true);
+    _write_ptr = (const uint8_t *)_audio_buffer;
+    _write_len = sizeof(_audio_buffer);
+    return true;
 }
 
-void AudioController::playAudioBuffer() {
-    size_t bytes_written;
-    esp_err_t result = i2s_write(I2S_PORT, _audio_buffer, sizeof(_audio_buffer), &bytes_written, portMAX_DELAY);
-    
-    if (result != ESP_OK) {
-        Serial.printf("Error writing to I2S: %d\n", result);
+void AudioController::applyRequest(VoiceRequest &request, ToneVoice &voice) {
+    if (!request.pending) return;
+
+    if (request.pattern == NULL) {
+        voice.stop();
+        return;
     }
+
+    // the tone/beep patterns are ours to edit, nobody else is rendering them right now
+    if (request.pattern == &_tone_pattern) {
+        _tone_steps[0].start_hz = request.frequency_hz;
+        _tone_steps[0].end_hz = request.frequency_hz;
+    } else if (request.pattern == &_beep_pattern) {
+        _beep_steps[0].start_hz = request.frequency_hz;
+        _beep_steps[0].end_hz = request.frequency_hz;
+        _beep_steps[0].duration_ms = request.duration_ms;
+    }
+    voice.play(request.pattern, request.volume);
 }
 
 void AudioController::playBeep(int frequency_hz, uint32_t duration_ms, float volume) {
     if (!_initialized) return;
     
-    _beep_frequency = constrain(frequency_hz, 20, 20000);
-    _beep_duration = duration_ms;
-    _beep_volume = constrain(volume, 0.0f, 1.0f);
-    _beep_start_time = millis();
-    _beep_playing = true;
-    _tone_playing = true;  // Enable audio generation
-    _phase = 0.0f;
-}
\ No newline at end of file
+    portENTER_CRITICAL(&_lock);
+    _beep_request.pattern = &_beep_pattern;
+    _beep_request.frequency_hz = constrain(frequency_hz, 20, 20000);
+    _beep_request.duration_ms = min(duration_ms, (uint32_t)UINT16_MAX);
+    _beep_request.volume = constrain(volume, 0.0f, 1.0f);
+    _beep_request.pending = true;
+    portEXIT_CRITICAL(&_lock);
+}
@@ -0,0 +1,116 @@
+#include "../include/BiasTracker.h"
+
+void StillnessWindow::clear() {
+  count = 0;
+  startUs = 0;
+  for (int i = 0; i < 3; i++) {
+    accelSum[i] = gyroSum[i] = 0;
+    accelMin[i] = gyroMin[i] = INT16_MAX;
+    accelMax[i] = gyroMax[i] = INT16_MIN;
+  }
+}
+
+void StillnessWindow::add(const RawImuSample &raw) {
+  const int16_t accel[3] = { raw.accelX, raw.accelY, raw.accelZ };
+  const int16_t gyro[3] = { raw.gyroX, raw.gyroY, raw.gyroZ };
+  if (count == 0) startUs = raw.timestampUs;
+  for (int i = 0; i < 3; i++) {
+    accelSum[i] += accel[i];
+    gyroSum[i] += gyro[i];
+    if (accel[i] < accelMin[i]) accelMin[i] = accel[i];
+    if (accel[i] > accelMax[i]) accelMax[i] = accel[i];
+    if (gyro[i] < gyroMin[i]) gyroMin[i] = gyro[i];
+    if (gyro[i] > gyroMax[i]) gyroMax[i] = gyro[i];
+  }
+  count++;
+}
+
+bool StillnessWindow::isStill() const {
+  if (count == 0) return false;
+  for (int i = 0; i < 3; i++) {
+    if ((int32_t)accelMax[i] - accelMin[i] > BIAS_STILL_ACCEL_SPAN) return false;
+    if ((int32_t)gyroMax[i] - gyroMin[i] > BIAS_STILL_GYRO_SPAN) return false;
+  }
+  return true;
+}
+
+void StillnessWindow::mean(float accel[3], float gyro[3]) const {
+  for (int i = 0; i < 3; i++) {
+    accel[i] = count > 0 ? (float)accelSum[i] / count : 0;
+    gyro[i] = count > 0 ? (float)gyroSum[i] / count : 0;
+  }
+}
+
+BiasTracker::BiasTracker() {
+  const float zero[3] = { 0, 0, 0 };
+  reset(zero, zero);
+}
+
+void BiasTracker::reset(const float accel[3], const float gyro[3]) {
+  for (int i = 0; i < 3; i++) {
+    accelOffset[i] = accel[i];
+    gyroOffset[i] = gyro[i];
+  }
+  updates = 0;
+  window.clear();
+}
+
+bool BiasTracker::add(const RawImuSample &raw) {
+  // the first sample past the window closes it and starts the next one
+  bool updated = false;
+  if (window.count > 0 && raw.timestampUs - window.startUs >= BIAS_WINDOW_US) {
+    updated = window.isStill() && update();
+    window.clear();
+  }
+  window.add(raw);
+  return updated;
+}
+
+bool BiasTracker::update() {
+  float accel[3], gyro[3];
+  window.mean(accel, gyro);
+
+  // still by the spans, but turning steadily: neither mean can be trusted
+  for (int i = 0; i < 3; i++) {
+    if (fabsf(gyro[i] - gyroOffset[i]) > BIAS_MAX_GYRO_STEP) return false;
+  }
+  for (int i = 0; i < 3; i++) {
+    gyroOffset[i] += BIAS_GYRO_GAIN * (gyro[i] - gyroOffset[i]);
+  }
+
+  // one gradient step of the sphere fit |mean - offset| = 1g
+  float v[3] = { accel[0] - accelOffset[0], accel[1] - accelOffset[1], accel[2] - accelOffset[2] };
+  float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  float error = length - ACCEL_LSB_PER_G;
+  if (length > 0 && fabsf(error) <= BIAS_MAX_GRAVITY_ERROR) {
+    for (int i = 0; i < 3; i++) {
+      accelOffset[i] += BIAS_ACCEL_GAIN * error * v[i] / length;
+    }
+  }
+
+  updates++;
+  return true;
+}
+
+void BiasTracker::getOffsets(float accel[3], float gyro[3]) const {
+  for (int i = 0; i < 3; i++) {
+    accel[i] = accelOffset[i];
+    gyro[i] = gyroOffset[i];
+  }
+}
+
+uint32_t BiasTracker::getUpdateCount() const {
+  return updates;
+}
+
+void BiasTracker::estimate(const StillnessWindow &window, float accel[3], float gyro[3]) {
+  window.mean(accel, gyro);
+
+  // only the part along gravity can be told apart from a tilt with one orientation,
+  // the rest is left to the tracker
+  float length = sqrtf(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+  float excess = length > 0 ? 1.0F - ACCEL_LSB_PER_G / length : 0;
+  for (int i = 0; i < 3; i++) {
+    accel[i] *= excess;
+  }
+}
@@ -0,0 +1,36 @@
+#include "../include/BootTimeline.h"
+#include <esp_timer.h>
+
+// written once each, a 32-bit store is atomic on the ESP32
+static volatile uint32_t reachedUs[BOOT_MILESTONE_COUNT];
+
+static const char *MILESTONE_NAMES[BOOT_MILESTONE_COUNT] = {
+  "sensor ready", "calibrated", "monitoring", "setup done", "wifi connected", "session ready", "config current"
+};
+
+void BootTimeline::mark(BootMilestone milestone) {
+  if (milestone < BOOT_MILESTONE_COUNT && reachedUs[milestone] == 0) {
+    // never 0 once set, even for a mark in the first microsecond
+    uint32_t nowUs = (uint32_t)esp_timer_get_time();
+    reachedUs[milestone] = nowUs != 0 ? nowUs : 1;
+  }
+}
+
+uint32_t BootTimeline::getMs(BootMilestone milestone) {
+  if (milestone >= BOOT_MILESTONE_COUNT || reachedUs[milestone] == 0) {
+    return 0;
+  }
+  uint32_t ms = reachedUs[milestone] / 1000;
+  return ms != 0 ? ms : 1;
+}
+
+void BootTimeline::report(Print &out) {
+  for (int i = 0; i < BOOT_MILESTONE_COUNT; i++) {
+    uint32_t ms = getMs((BootMilestone)i);
+    if (ms != 0) {
+      out.printf("%-16s %6lu ms\n", MILESTONE_NAMES[i], (unsigned long)ms);
+    } else {
+      out.printf("%-16s      -\n", MILESTONE_NAMES[i]);
+    }
+  }
+}
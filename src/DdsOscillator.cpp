@@ -0,0 +1,178 @@
+#include "../include/DdsOscillator.h"
+#include <math.h>
+
+int16_t DdsOscillator::_sine_table[DdsOscillator::SINE_TABLE_SIZE + 1];
+bool DdsOscillator::_sine_table_ready = false;
+
+DdsOscillator::DdsOscillator()
+    : _mode(DDS_MODE_INTERPOLATED)
+    , _sample_rate(44100)
+    , _frequency_hz(440)
+    , _amplitude(0)
+    , _phase(0)
+    , _phase_increment(0)
+    , _loop_length(0)
+    , _loop_pos(0)
+    , _loop_dirty(true)
+{
+    buildSineTable();
+}
+
+void DdsOscillator::buildSineTable() {
+    if (_sine_table_ready) return;
+
+    // 257 sinf() calls once at startup instead of 1024 sin() per buffer
+    for (int i = 0; i <= SINE_TABLE_SIZE; i++) {
+        _sine_table[i] = (int16_t)lrintf(sinf(2.0f * (float)M_PI * i / SINE_TABLE_SIZE) * 32767.0f);
+    }
+    _sine_table_ready = true;
+}
+
+void DdsOscillator::setMode(DdsMode mode) {
+    if (mode == _mode) return;
+    _mode = mode;
+    _loop_dirty = true;
+}
+
+void DdsOscillator::setSampleRate(uint32_t sample_rate) {
+    _sample_rate = sample_rate;
+    setTone(_frequency_hz, _amplitude / 32767.0f);
+}
+
+void DdsOscillator::setTone(int frequency_hz, float volume) {
+    int32_t amplitude = (int32_t)(constrain(volume, 0.0f, 1.0f) * 32767.0f);
+    if (frequency_hz == _frequency_hz && amplitude == _amplitude && _phase_increment != 0) {
+        return; // nothing changed, keep the loop table
+    }
+
+    _frequency_hz = frequency_hz;
+    _amplitude = amplitude;
+    // phase step per sample as a fraction of 2^32
+    _phase_increment = (uint32_t)(((uint64_t)frequency_hz << 32) / _sample_rate);
+    _loop_dirty = true;
+}
+
+void DdsOscillator::resetPhase() {
+    _phase = 0;
+    _loop_pos = 0;
+}
+
+DdsMode DdsOscillator::getMode() const {
+    return _mode;
+}
+
+static inline int16_t saturate16(int32_t value) {
+    if (value > 32767) return 32767;
+    if (value < -32768) return -32768;
+    return (int16_t)value;
+}
+
+void DdsOscillator::render(int16_t *out, int count) {
+    renderInto(out, count, false);
+}
+
+void DdsOscillator::mix(int16_t *out, int count) {
+    renderInto(out, count, true);
+}
+
+void DdsOscillator::renderInto(int16_t *out, int count, bool add) {
+    if (_mode == DDS_MODE_INTERPOLATED) {
+        renderInterpolated(out, count, add);
+        return;
+    }
+    if (_mode == DDS_MODE_SINE) {
+        renderSine(out, count, add);
+        return;
+    }
+
+    if (_loop_dirty) {
+        buildLoopTable();
+    }
+    if (_loop_length == 0) {
+        // below ~43Hz a period doesn't fit the table, synthesize per sample instead
+        renderInterpolated(out, count, add);
+        return;
+    }
+
+    // copy out of the loop table, wrapping as often as needed
+    while (count > 0) {
+        int chunk = _loop_length - _loop_pos;
+        if (chunk > count) chunk = count;
+        if (add) {
+            for (int i = 0; i < chunk; i++) {
+                out[i] = saturate16((int32_t)out[i] + _loop_table[_loop_pos + i]);
+            }
+        } else {
+            memcpy(out, &_loop_table[_loop_pos], chunk * sizeof(int16_t));
+        }
+        out += chunk;
+        count -= chunk;
+        _loop_pos += chunk;
+        if (_loop_pos >= _loop_length) {
+            _loop_pos = 0;
+        }
+    }
+}
+
+void DdsOscillator::renderInterpolated(int16_t *out, int count, bool add) {
+    const int FRAC_BITS = 32 - SINE_TABLE_BITS;
+    for (int i = 0; i < count; i++) {
+        uint32_t index = _phase >> FRAC_BITS;
+        // top 16 bits of the fraction are plenty for the interpolation
+        int32_t frac = (int32_t)((_phase >> (FRAC_BITS - 16)) & 0xFFFF);
+        int32_t a = _sine_table[index];
+        int32_t b = _sine_table[index + 1];
+        int32_t sample = a + (((b - a) * frac) >> 16);
+        sample = (sample * _amplitude) >> 15;
+        out[i] = add ? saturate16((int32_t)out[i] + sample) : (int16_t)sample;
+        _phase += _phase_increment;
+    }
+}
+
+void DdsOscillator::renderSine(int16_t *out, int count, bool add) {
+    // same phase accumulator, so switching modes doesn't jump
+    const float PHASE_TO_RAD = 2.0f * (float)M_PI / 4294967296.0f;
+    for (int i = 0; i < count; i++) {
+        int32_t sample = (int32_t)lrintf(sinf(_phase * PHASE_TO_RAD) * _amplitude);
+        out[i] = add ? saturate16((int32_t)out[i] + sample) : (int16_t)sample;
+        _phase += _phase_increment;
+    }
+}
+
+void DdsOscillator::buildLoopTable() {
+    // One period is rarely a whole number of samples (44100 / 880 = 50.1), so look for the
+    // number of periods that comes closest to a whole number of samples and fits the table.
+    // The pitch error is then (error / length), well below anything audible.
+    int best_length = 0;
+    float best_error = 1.0f;
+    if (_frequency_hz > 0) {
+        float samples_per_period = (float)_sample_rate / _frequency_hz;
+        for (int periods = 1; periods * samples_per_period <= LOOP_TABLE_MAX; periods++) {
+            float exact = periods * samples_per_period;
+            int length = (int)lrintf(exact);
+            float error = fabsf(exact - length) / exact;
+            if (length > 0 && error < best_error) {
+                best_error = error;
+                best_length = length;
+            }
+        }
+    }
+
+    _loop_dirty = false;
+    _loop_length = best_length;
+    if (best_length == 0) {
+        return;
+    }
+
+    // render it with the phase step that closes the loop exactly
+    uint32_t saved_increment = _phase_increment;
+    int periods = (int)lrintf((float)best_length * _frequency_hz / _sample_rate);
+    _phase_increment = (uint32_t)(((uint64_t)periods << 32) / best_length);
+    _phase = 0;
+    renderInterpolated(_loop_table, best_length, false);
+    _phase_increment = saved_increment;
+
+    if (_loop_pos >= _loop_length) {
+        _loop_pos = 0;
+    }
+}
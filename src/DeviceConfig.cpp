@@ -0,0 +1,205 @@
+#include "../include/DeviceConfig.h"
+#include "../include/Log.h"
+#include <ArduinoJson.h>
+
+// What goes into NVS. Bump the layout whenever DeviceSettings changes. The defaults the
+// config was built from are kept too: the server leaves out keys to mean "default", so
+// after a firmware update with new defaults the stored ETag no longer describes what we
+// would get, and the next fetch has to be a full one.
+static const uint32_t STORED_CONFIG_LAYOUT = 2;
+static const char *STORED_CONFIG_KEY = "config";
+
+struct StoredDeviceConfig {
+  uint32_t layout;
+  DeviceSettings settings;
+  DeviceSettings defaults;
+  char etag[DEVICE_CONFIG_ETAG_MAX];
+};
+
+DeviceConfig::DeviceConfig() {
+  store = NULL;
+  lock = portMUX_INITIALIZER_UNLOCKED;
+  settings = defaults();
+  etag[0] = '\0';
+  version = 0;
+}
+
+DeviceSettings DeviceConfig::defaults() {
+  DeviceSettings s;
+  s.freeFallThreshold = FREEFALL_THRESHOLD;
+  s.impactThreshold = IMPACT_THRESHOLD;
+  s.inactivityThreshold = INACTIVITY_THRESHOLD;
+  s.gyroThreshold = GYRO_THRESHOLD;
+  s.postImpactWindowMs = POST_IMPACT_WINDOW_MS;
+  s.alarmDelayMs = ALARM_DELAY_MS;
+  s.requiredStillSamples = REQUIRED_STILL_SAMPLES;
+  s.calibrationSamples = CALIBRATION_SAMPLES;
+  s.alarmFrequencyHz = ALARM_SOUND_FREQUENCY_HZ;
+  s.alarmVolume = ALARM_SOUND_VOLUME;
+  s.minPostureChangeDeg = FALL_MIN_POSTURE_CHANGE_DEG;
+  return s;
+}
+
+void DeviceConfig::setStore(KeyValueStore *kvStore) {
+  store = kvStore;
+}
+
+bool DeviceConfig::load() {
+  StoredDeviceConfig stored;
+  if (store == NULL || store->get(STORED_CONFIG_KEY, &stored, sizeof(stored)) != sizeof(stored) ||
+      stored.layout != STORED_CONFIG_LAYOUT) {
+    return false;
+  }
+  if (!validate(stored.settings)) {
+    LOG_WARN(MAIN, "Stored device config is invalid, using defaults");
+    return false;
+  }
+
+  DeviceSettings current = defaults();
+  stored.etag[DEVICE_CONFIG_ETAG_MAX - 1] = '\0';
+  if (memcmp(&stored.defaults, &current, sizeof(current)) != 0) {
+    stored.etag[0] = '\0';
+  }
+
+  portENTER_CRITICAL(&lock);
+  settings = stored.settings;
+  strcpy(etag, stored.etag);
+  version++;
+  portEXIT_CRITICAL(&lock);
+  return true;
+}
+
+DeviceSettings DeviceConfig::get() {
+  portENTER_CRITICAL(&lock);
+  DeviceSettings copy = settings;
+  portEXIT_CRITICAL(&lock);
+  return copy;
+}
+
+uint32_t DeviceConfig::getVersion() {
+  return version;
+}
+
+String DeviceConfig::getEtag() {
+  char copy[DEVICE_CONFIG_ETAG_MAX];
+  portENTER_CRITICAL(&lock);
+  strcpy(copy, etag);
+  portEXIT_CRITICAL(&lock);
+  return String(copy);
+}
+
+// A key sent with the wrong type ("8.5" as a string, a negative or fractional count)
+// fails instead of quietly leaving the default in place
+static bool readFloat(JsonVariant value, float &field) {
+  if (value.isNull()) return true;
+  if (!value.is<float>()) return false;
+  field = value.as<float>();
+  return true;
+}
+
+static bool readCount(JsonVariant value, uint32_t &field) {
+  if (value.isNull()) return true;
+  if (!value.is<uint32_t>()) return false;
+  field = value.as<uint32_t>();
+  return true;
+}
+
+#define READ_KEY(reader, key, field) \
+  if (!reader(doc[key], field)) { \
+    LOG_WARN(NET, "Device config: " key " has the wrong type"); \
+    return false; \
+  }
+
+bool DeviceConfig::parse(const char *json, size_t length, DeviceSettings &out) {
+  StaticJsonDocument<1024> doc;
+  DeserializationError error = deserializeJson(doc, json, length);
+  if (error) {
+    LOG_WARN(NET, "Device config JSON error: %s", error.c_str());
+    return false;
+  }
+  if (!doc.is<JsonObject>()) {
+    LOG_WARN(NET, "Device config is not a JSON object");
+    return false;
+  }
+
+  DeviceSettings s = defaults();
+  READ_KEY(readFloat, "freeFallThreshold", s.freeFallThreshold);
+  READ_KEY(readFloat, "fallDetectionSensitivity", s.impactThreshold);
+  READ_KEY(readFloat, "impactThreshold", s.impactThreshold);
+  READ_KEY(readFloat, "inactivityThreshold", s.inactivityThreshold);
+  READ_KEY(readFloat, "gyroThreshold", s.gyroThreshold);
+  READ_KEY(readCount, "postImpactWindowMs", s.postImpactWindowMs);
+  READ_KEY(readCount, "alarmDelayMs", s.alarmDelayMs);
+  READ_KEY(readCount, "requiredStillSamples", s.requiredStillSamples);
+  READ_KEY(readCount, "calibrationSamples", s.calibrationSamples);
+  READ_KEY(readCount, "alarmFrequencyHz", s.alarmFrequencyHz);
+  READ_KEY(readFloat, "alarmVolume", s.alarmVolume);
+  READ_KEY(readFloat, "minPostureChangeDeg", s.minPostureChangeDeg);
+
+  if (!validate(s)) {
+    return false;
+  }
+  out = s;
+  return true;
+}
+
+// written so that NaN fails too
+#define CHECK_RANGE(field, lo, hi) \
+  if (!(settings.field >= (lo) && settings.field <= (hi))) { \
+    LOG_WARN(NET, "Device config: " #field " out of range"); \
+    return false; \
+  }
+
+bool DeviceConfig::validate(const DeviceSettings &settings) {
+  CHECK_RANGE(freeFallThreshold, 0.5F, 9.8F);
+  CHECK_RANGE(impactThreshold, 1.0F, 78.0F);        // squared counts have to fit in 32 bits
+  CHECK_RANGE(inactivityThreshold, 0.1F, 9.8F);     // 9.8 - t is squared for the lower bound
+  CHECK_RANGE(gyroThreshold, 10.0F, 500.0F);        // sensor range
+  CHECK_RANGE(postImpactWindowMs, 500UL, 30000UL);
+  CHECK_RANGE(alarmDelayMs, 0UL, 120000UL);
+  CHECK_RANGE(requiredStillSamples, 1UL, 3000UL);
+  CHECK_RANGE(calibrationSamples, 10UL, 200UL);     // has to fit in calibrate()'s 5s timeout
+  CHECK_RANGE(alarmFrequencyHz, 100UL, 8000UL);
+  CHECK_RANGE(alarmVolume, 0.0F, 1.0F);
+  CHECK_RANGE(minPostureChangeDeg, 0.0F, 180.0F);
+
+  // a stillness run longer than the window could never confirm an emergency
+  if (settings.requiredStillSamples * SAMPLING_PERIOD_MS > settings.postImpactWindowMs) {
+    LOG_WARN(NET, "Device config: requiredStillSamples don't fit in postImpactWindowMs");
+    return false;
+  }
+  return true;
+}
+
+bool DeviceConfig::apply(const DeviceSettings &newSettings, const char *newEtag) {
+  if (!validate(newSettings)) {
+    return false;
+  }
+  if (newEtag == NULL || strlen(newEtag) >= DEVICE_CONFIG_ETAG_MAX) {
+    newEtag = "";
+  }
+
+  portENTER_CRITICAL(&lock);
+  bool changed = memcmp(&settings, &newSettings, sizeof(settings)) != 0;
+  bool etagChanged = strcmp(etag, newEtag) != 0;
+  settings = newSettings;
+  strcpy(etag, newEtag);
+  if (changed) {
+    version++;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  // every put is a flash write, skip it when the server sent back what we have
+  if ((changed || etagChanged) && store != NULL) {
+    StoredDeviceConfig stored;
+    memset(&stored, 0, sizeof(stored));
+    stored.layout = STORED_CONFIG_LAYOUT;
+    stored.settings = newSettings;
+    stored.defaults = defaults();
+    strcpy(stored.etag, newEtag);
+    if (!store->put(STORED_CONFIG_KEY, &stored, sizeof(stored))) {
+      LOG_WARN(MAIN, "Device config could not be saved, applies until reboot");
+    }
+  }
+  return true;
+}
@@ -0,0 +1,184 @@
+#include "../include/EspHttpTransport.h"
+#include "../include/BootTimeline.h"
+#include "../include/Log.h"
+
+EspHttpTransport::EspHttpTransport(const char *wifiSsid, const char *wifiPassword) {
+  ssid = wifiSsid;
+  password = wifiPassword;
+  wifiStarted = false;
+  clientConfigured = false;
+  requestCount = 0;
+  handshakeCount = 0;
+  store = NULL;
+}
+
+void EspHttpTransport::setStore(KeyValueStore *kvStore) {
+  store = kvStore;
+}
+
+// Polls often so we return as soon as the link is up, not on the next half second
+bool EspHttpTransport::waitForLink(uint32_t timeoutMs) {
+  unsigned long start = millis();
+  while (WiFi.status() != WL_CONNECTED && millis() - start < timeoutMs) {
+    delay(WIFI_POLL_MS);
+  }
+  return WiFi.status() == WL_CONNECTED;
+}
+
+bool EspHttpTransport::connect(uint32_t timeoutMs) {
+  if (WiFi.status() == WL_CONNECTED) {
+    return true;
+  }
+
+  unsigned long start = millis();
+  if (!wifiStarted) {
+    LOG_INFO(NET, "Initializing WiFi connection...");
+    // the credentials are compiled in, don't rewrite them to flash on every boot
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+    wifiStarted = true;
+  } else {
+    LOG_INFO(NET, "Reconnecting to WiFi...");
+    WiFi.disconnect();
+  }
+
+  // With the access point we used last time, WiFi.begin() skips the scan of all
+  // channels. If it moved, give up on it quickly and do the full scan after all.
+  WifiAccessPoint cached;
+  bool connected = false;
+  if (store != NULL && store->get(WIFI_CACHE_KEY, &cached, sizeof(cached)) == sizeof(cached)) {
+    WiFi.begin(ssid, password, cached.channel, cached.bssid);
+    connected = waitForLink(timeoutMs < WIFI_CACHED_CONNECT_MS ? timeoutMs : WIFI_CACHED_CONNECT_MS);
+    if (!connected) {
+      store->remove(WIFI_CACHE_KEY);
+      WiFi.disconnect();
+    }
+  }
+  if (!connected) {
+    uint32_t elapsed = millis() - start;
+    WiFi.begin(ssid, password);
+    connected = elapsed < timeoutMs && waitForLink(timeoutMs - elapsed);
+  }
+
+  // whatever socket we had belonged to the old link
+  closeConnection();
+
+  if (connected) {
+    LOG_INFO(NET, "WiFi connected in %lu ms, IP address: %s", (unsigned long)(millis() - start),
+             WiFi.localIP().toString());
+    BootTimeline::mark(BOOT_WIFI_CONNECTED);
+    rememberAccessPoint();
+    return true;
+  }
+
+  LOG_WARN(NET, "WiFi connection failed!");
+  return false;
+}
+
+// only written when it changed, so a normal boot doesn't touch the flash
+void EspHttpTransport::rememberAccessPoint() {
+  if (store == NULL) {
+    return;
+  }
+  WifiAccessPoint current;
+  memset(&current, 0, sizeof(current));
+  current.channel = WiFi.channel();
+  memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+
+  WifiAccessPoint cached;
+  if (store->get(WIFI_CACHE_KEY, &cached, sizeof(cached)) != sizeof(cached) ||
+      memcmp(&cached, &current, sizeof(current)) != 0) {
+    store->put(WIFI_CACHE_KEY, &current, sizeof(current));
+  }
+}
+
+bool EspHttpTransport::isConnected() {
+  return WiFi.status() == WL_CONNECTED;
+}
+
+// All endpoints live on the same host, so every request goes through one WiFiClientSecure
+// and one HTTPClient that stay alive between calls. With reuse on, http.end() leaves the
+// TLS connection open if the server answered with keep-alive, and the next begin() on the
+// same host just sends the request without a new handshake. TLS session resumption is
+// deliberately not used: the connection is only lost on a transport error or when the
+// server times it out, rare enough that a full handshake then is cheaper than keeping a
+// session cache (and the ticket lifetime it depends on) in sync with WiFiClientSecure.
+int EspHttpTransport::request(const char *method, const char *url,
+                              const HttpHeader *headers, size_t headerCount,
+                              const uint8_t *body, size_t bodyLength, String *response,
+                              HttpResponseHeader *responseHeaders, size_t responseHeaderCount) {
+  if (!clientConfigured) {
+    secureClient.setInsecure(); // Insecure HTTPS (accepts all certificates)
+    secureClient.setHandshakeTimeout(10);
+    clientConfigured = true;
+  }
+
+  if (!secureClient.connected()) {
+    handshakeCount++; // HTTPClient will have to open (and handshake) a new connection
+  }
+  requestCount++;
+
+  http.begin(secureClient, url);
+  http.setReuse(true);
+  http.setTimeout(15000); // Increase timeout for Azure
+  http.setConnectTimeout(10000);
+
+  for (size_t i = 0; i < headerCount; i++) {
+    http.addHeader(headers[i].name, headers[i].value);
+  }
+
+  // HTTPClient only keeps the response headers it was told about beforehand. Set the
+  // list on every request, also when it is empty, so the last caller's doesn't linger.
+  const char *collect[HTTP_MAX_RESPONSE_HEADERS];
+  if (responseHeaderCount > HTTP_MAX_RESPONSE_HEADERS) {
+    responseHeaderCount = HTTP_MAX_RESPONSE_HEADERS;
+  }
+  for (size_t i = 0; i < responseHeaderCount; i++) {
+    collect[i] = responseHeaders[i].name;
+    responseHeaders[i].value = "";
+  }
+  http.collectHeaders(collect, responseHeaderCount);
+
+  int httpResponseCode = http.sendRequest(method, (uint8_t *)body, bodyLength);
+
+  if (httpResponseCode > 0) {
+    for (size_t i = 0; i < responseHeaderCount; i++) {
+      responseHeaders[i].value = http.header(responseHeaders[i].name);
+    }
+
+    // read the body either way so the connection can be reused. A 304 never has one,
+    // and without a Content-Length HTTPClient would wait for the socket to close.
+    String payload;
+    if (httpResponseCode != HTTP_STATUS_NOT_MODIFIED) {
+      payload = http.getString();
+    }
+    if (response != NULL) {
+      *response = payload;
+    }
+  }
+
+  http.end();
+
+  // on a transport error we don't know what state the stream is in, drop it and
+  // let the next request open a clean one
+  if (httpResponseCode < 0) {
+    closeConnection();
+  }
+  return httpResponseCode;
+}
+
+String EspHttpTransport::errorToString(int code) {
+  return HTTPClient::errorToString(code);
+}
+
+void EspHttpTransport::closeConnection() {
+  secureClient.stop();
+}
+
+uint32_t EspHttpTransport::getRequestCount() {
+  return requestCount;
+}
+
+uint32_t EspHttpTransport::getHandshakeCount() {
+  return handshakeCount;
+}
@@ -1,74 +1,106 @@
 #include "../include/FallDetection.h"
+#include "../include/Profiler.h"
+#include "../include/Log.h"
 
-FallDetection::FallDetection(GyroSensor &sensor) : gyroSensor(sensor) {
+FallDetection::FallDetection(GyroSensor &sensor, LedController &statusLed, DeviceConfig &deviceConfig)
+  : gyroSensor(sensor), led(statusLed), config(deviceConfig) {
   currentState = STATE_INIT;
   fallDetected = false;
   fallTimestamp = 0;
+  postImpactActive = false;
+  postImpactHasStart = false;
+  postImpactStartUs = 0;
+  postImpactLastUs = 0;
+  stillUs = 0;
+  consecutiveStillSamples = 0;
+  postImpactSamples = 0;
+  inFreeFall = false;
+  freeFallStartUs = 0;
+  lastDebugUs = 0;
+  historySlotOpen = false;
+  historySlotEndUs = 0;
+  historyAccelSq = historyGyroSq = historyDeviation = 0;
+  configVersion = config.getVersion() - 1; // forces the first refresh
+  refreshSettings();
 }
 
-bool FallDetection::detectFall() {
-  static bool inFreeFall = false;
-  static unsigned long freeFallStartTime = 0;
-  static unsigned long lastDebugTime = 0;
-  static float minAccel = 100.0;
-  static float maxAccel = 0.0;
-  static unsigned long lastResetTime = 0;
-  float accelMagnitude, gyroMagnitude;  
-  
-  
-  gyroSensor.getAccelGyroData(accelMagnitude, gyroMagnitude);
-
-  
-  // reset min/max values every 3 seconds
-  if (millis() - lastResetTime > 3000) {
-    minAccel = 100.0;
-    maxAccel = 0.0;
-    lastResetTime = millis();
+// One volatile read per sample while the config stays the same
+void FallDetection::refreshSettings() {
+  uint32_t version = config.getVersion();
+  if (version == configVersion) {
+    return;
   }
+  configVersion = version;
+  settings = config.get();
+
+  freeFallThresholdSq = ACCEL_SQ_COUNTS(settings.freeFallThreshold);
+  impactThresholdSq = ACCEL_SQ_COUNTS(settings.impactThreshold);
+  gyroThresholdSq = GYRO_SQ_COUNTS(settings.gyroThreshold);
+  stillAccelMinSq = ACCEL_SQ_COUNTS(9.8F - settings.inactivityThreshold);
+  stillAccelMaxSq = ACCEL_SQ_COUNTS(9.8F + settings.inactivityThreshold);
+}
+
+void FallDetection::updateOrientation(const ImuSample &sample) {
+  orientation.update(sample);
+}
+
+OrientationFilter &FallDetection::getOrientation() {
+  return orientation;
+}
+
+bool FallDetection::detectFall(const ImuSample &sample) {
+  PROFILE_SCOPE("fall.detect");
+  refreshSettings();
+
+  // everything below compares squared counts against the squared thresholds, the float
+  // magnitudes are only worked out when something gets printed
+  uint32_t accelMagSq = sample.accelMagSq;
+
+  // keep the pre-impact window (and its stats) up to date
+  addToHistory(sample);
   
-  // track min/max values for debugging
-  if (accelMagnitude < minAccel) minAccel = accelMagnitude;
-  if (accelMagnitude > maxAccel) maxAccel = accelMagnitude;
-  
-  // debug output
-  if (millis() - lastDebugTime > 500) {
-    lastDebugTime = millis();
-    Serial.printf("Fall Detection Debug | Current: %.2f | Min: %.2f | Max: %.2f | FF Threshold: %.2f | Impact Threshold: %.2f | State: %s\n", 
-                 accelMagnitude, 
-                 minAccel, 
-                 maxAccel, 
-                 FREEFALL_THRESHOLD, 
-                 IMPACT_THRESHOLD,
+  // debug output - min/max/RMS over the pre-impact window
+  if (sample.timestampUs - lastDebugUs > 500000UL) {
+    lastDebugUs = sample.timestampUs;
+    LOG_DEBUG(FALL, "Fall Detection Debug | Current: %.2f | Min: %.2f | Max: %.2f | RMS: %.2f | FF Threshold: %.2f | Impact Threshold: %.2f | State: %s", 
+                 sample.accelMagnitude(), 
+                 sqrtf((float)accelStats.min()) / ACCEL_COUNTS_PER_MS2, 
+                 sqrtf((float)accelStats.max()) / ACCEL_COUNTS_PER_MS2, 
+                 sqrtf(accelStats.mean()) / ACCEL_COUNTS_PER_MS2, 
+                 settings.freeFallThreshold,
+                 settings.impactThreshold,
                  inFreeFall ? "IN FREE-FALL" : "normal");
   }
   
   // If not in free-fall, check for free-fall condition
   if (!inFreeFall) {
-    if (accelMagnitude < FREEFALL_THRESHOLD) {
+    if (accelMagSq < freeFallThresholdSq) {
       // maybe remove this part if it needs too much work?
-      if (gyroMagnitude > GYRO_THRESHOLD){
-        Serial.printf("Significant rotation detected: %.2f deg/s\n", gyroMagnitude);
+      if (sample.gyroMagSq > gyroThresholdSq){
+        LOG_INFO(FALL, "Significant rotation detected: %.2f deg/s", sample.gyroMagnitude());
       }
       inFreeFall = true;
-      freeFallStartTime = millis();
-      Serial.printf("\n!!! FREE-FALL DETECTED !!! Acceleration: %.2f m/s²\n", accelMagnitude);
-      digitalWrite(LED_PIN, HIGH);
-      delay(50);
-      digitalWrite(LED_PIN, LOW);
+      freeFallStartUs = sample.timestampUs;
+      // the posture before the fall, what the post-impact check compares against
+      orientation.markReference();
+      LOG_INFO(FALL, "\n!!! FREE-FALL DETECTED !!! Acceleration: %.2f m/s²", sample.accelMagnitude());
+      led.start(LED_PATTERN_FREE_FALL);
     }
   }
   // If in free-fall, check for impact or timeout
   else {
-    if (accelMagnitude > IMPACT_THRESHOLD) {
-      Serial.printf("\n!!! IMPACT DETECTED !!! Acceleration: %.2f m/s²\n", accelMagnitude);
-      Serial.println("FALL SEQUENCE COMPLETE - DETECTED BOTH FREE-FALL AND IMPACT");
+    if (accelMagSq > impactThresholdSq) {
+      LOG_INFO(FALL, "\n!!! IMPACT DETECTED !!! Acceleration: %.2f m/s²", sample.accelMagnitude());
+      LOG_INFO(FALL, "FALL SEQUENCE COMPLETE - DETECTED BOTH FREE-FALL AND IMPACT");
+      LOG_INFO(FALL, "Tilt %.0f deg, %.0f deg from the posture before the fall",
+               orientation.getTiltDeg(), orientation.getPostureChangeDeg());
       inFreeFall = false; // Reset for next detection
       return true;
     }
     
     // check for timeout (free-fall window expired)
-    if (millis() - freeFallStartTime > 1000) {
-      Serial.println("Free-fall timeout - no impact detected within time window");
+    if (sample.timestampUs - freeFallStartUs > 1000000UL) {
+      LOG_INFO(FALL, "Free-fall timeout - no impact detected within time window");
       inFreeFall = false;
     }
   }
@@ -76,68 +108,153 @@ bool FallDetection::detectFall() {
   return false;
 }
 
-bool FallDetection::detectInactivityAfterImpact() {
-  Serial.println("Monitoring post-fall movement patterns...");
+void FallDetection::addToHistory(const ImuSample &sample) {
+  static const uint32_t ONE_G_SQ = (uint32_t)(ACCEL_LSB_PER_G * ACCEL_LSB_PER_G);
+  uint32_t deviation = sample.accelMagSq > ONE_G_SQ ? sample.accelMagSq - ONE_G_SQ : ONE_G_SQ - sample.accelMagSq;
+
+  static const uint32_t SLOT_US = SAMPLING_PERIOD_MS * 1000UL;
+  bool slotStarts = !historySlotOpen;
+  if (!historySlotOpen) {
+    historySlotOpen = true;
+    historySlotEndUs = sample.timestampUs + SLOT_US;
+  } else if ((int32_t)(sample.timestampUs - historySlotEndUs) >= 0) {
+    // slots stay on a fixed grid; the ones no sample fell in (every other one at the idle
+    // rate, or a gap) repeat the slot before them, so the buffer covers its full time span
+    uint32_t skipped = (sample.timestampUs - historySlotEndUs) / SLOT_US;
+    for (uint32_t i = 0; i <= skipped && i < ACCEL_BUFFER_SIZE; i++) {
+      accelStats.push(accelBuffer, historyAccelSq);
+      gyroStats.push(gyroBuffer, historyGyroSq);
+    }
+    historySlotEndUs += (skipped + 1) * SLOT_US;
+    slotStarts = true;
+  }
+  if (slotStarts) {
+    historyAccelSq = sample.accelMagSq;
+    historyGyroSq = sample.gyroMagSq;
+    historyDeviation = deviation;
+    return;
+  }
+  if (deviation > historyDeviation) {
+    historyDeviation = deviation;
+    historyAccelSq = sample.accelMagSq;
+  }
+  if (sample.gyroMagSq > historyGyroSq) {
+    historyGyroSq = sample.gyroMagSq;
+  }
+}
+
+void FallDetection::beginPostImpactCheck() {
+  LOG_INFO(FALL, "Monitoring post-fall movement patterns...");
+  refreshSettings(); // the window doesn't change once it is running
   
-  unsigned long startTime = millis();
-  int consecutiveStillSamples = 0;
-  int totalSamples = 0;
+  postImpactActive = true;
+  postImpactHasStart = false;
+  stillUs = 0;
+  consecutiveStillSamples = 0;
+  postImpactSamples = 0;
+}
+
+PostImpactResult FallDetection::updatePostImpactCheck(const ImuSample &sample) {
+  if (!postImpactActive) {
+    return POST_IMPACT_CLEARED;
+  }
+
+  // the window is measured in sample time, not millis(), so it only depends on the data
+  if (!postImpactHasStart) {
+    postImpactStartUs = sample.timestampUs;
+    postImpactLastUs = sample.timestampUs - SAMPLING_PERIOD_MS * 1000UL;
+    postImpactHasStart = true;
+  }
+  // each sample stands for the time since the one before, at most the slowest profile's
+  // period so a gap in the stream doesn't count as stillness
+  const uint32_t maxSampleUs = getRateProfile(RATE_PROFILE_IDLE).samplePeriodUs;
+  uint32_t sampleUs = sample.timestampUs - postImpactLastUs;
+  if (sampleUs > maxSampleUs) sampleUs = maxSampleUs;
+  postImpactLastUs = sample.timestampUs;
+  postImpactSamples++;
   
   // check for a period of stillness (medical emergency sign)
-  while (millis() - startTime < POST_IMPACT_WINDOW_MS) {
-    float accelMagnitude, gyroMagnitude;
-    gyroSensor.process();
-    gyroSensor.getAccelGyroData(accelMagnitude, gyroMagnitude);
-    totalSamples++;
-    
-    // calculate dynamic acceleration (removing gravity component)
-    float dynamicAccel = abs(accelMagnitude - 9.8); // Remove gravity magnitude
-    
-    if (dynamicAccel < INACTIVITY_THRESHOLD) {
-      consecutiveStillSamples++;
-      if (consecutiveStillSamples % 10 == 0) {
-        Serial.printf("Still samples: %d/%d\n", consecutiveStillSamples, REQUIRED_STILL_SAMPLES);
-      }
-    } else {
-      Serial.printf("Movement detected: %.2f (threshold: %.2f)\n", dynamicAccel, INACTIVITY_THRESHOLD);
-      consecutiveStillSamples = 0; 
-    }
-    
-    
-    if (consecutiveStillSamples >= REQUIRED_STILL_SAMPLES) {
-      Serial.printf("EMERGENCY CONFIRMED: %d consecutive still samples detected\n", consecutiveStillSamples);
-      return true;
+  // still means the magnitude is within inactivityThreshold of gravity, checked on
+  // the squared value so no sqrt is needed
+  const uint32_t requiredStillUs = settings.requiredStillSamples * SAMPLING_PERIOD_MS * 1000UL;
+  if (sample.accelMagSq > stillAccelMinSq && sample.accelMagSq < stillAccelMaxSq) {
+    consecutiveStillSamples++;
+    stillUs += sampleUs;
+    if (consecutiveStillSamples % 10 == 0) {
+      LOG_DEBUG(FALL, "Still for %lu/%lu ms", (unsigned long)(stillUs / 1000), (unsigned long)(requiredStillUs / 1000));
     }
-    
-    delay(10);
+  } else {
+    LOG_DEBUG(FALL, "Movement detected: %.2f (threshold: %.2f)",
+              fabsf(sample.accelMagnitude() - 9.8F), settings.inactivityThreshold); // gravity removed
+    consecutiveStillSamples = 0; 
+    stillUs = 0;
   }
   
-  Serial.printf("Inactivity check complete - movement detected (%d still samples, needed %d)\n", 
-               consecutiveStillSamples, REQUIRED_STILL_SAMPLES);
-  return false;
+  if (stillUs >= requiredStillUs) {
+    postImpactActive = false;
+    // still, but the same way up as before the fall: sat down or landed on their feet
+    float postureChange = orientation.getPostureChangeDeg();
+    if (settings.minPostureChangeDeg > 0 && postureChange < settings.minPostureChangeDeg) {
+      LOG_INFO(FALL, "Still but only %.0f deg from the posture before the fall - not an emergency", postureChange);
+      return POST_IMPACT_CLEARED;
+    }
+    LOG_WARN(FALL, "EMERGENCY CONFIRMED: still for %lu ms (%d samples)", (unsigned long)(stillUs / 1000),
+             consecutiveStillSamples);
+    return POST_IMPACT_CONFIRMED;
+  }
+
+  if (sample.timestampUs - postImpactStartUs >= settings.postImpactWindowMs * 1000UL) {
+    LOG_INFO(FALL, "Inactivity check complete - movement detected (still for %lu ms, needed %lu, %d samples seen)", 
+                 (unsigned long)(stillUs / 1000), (unsigned long)(requiredStillUs / 1000), postImpactSamples);
+    postImpactActive = false;
+    return POST_IMPACT_CLEARED;
+  }
+
+  return POST_IMPACT_PENDING;
+}
+
+uint32_t FallDetection::getAlarmDelayMs() {
+  return settings.alarmDelayMs;
+}
+
+uint32_t FallDetection::getFreeFallStartUs() {
+  return freeFallStartUs;
+}
+
+bool FallDetection::isPostImpactCheckActive() {
+  return postImpactActive;
 }
 
 void FallDetection::triggerAlarm() {
-  Serial.println("\n!!! MEDICAL EMERGENCY ALARM ACTIVATED !!!");
-  Serial.println("Turn on RED LED and alert caregivers");
+  LOG_WARN(FALL, "\n!!! MEDICAL EMERGENCY ALARM ACTIVATED !!!");
+  LOG_WARN(FALL, "Turn on RED LED and alert caregivers");
   
-  // Quick visual feedback with rapid blinks
-  for (int i = 0; i < 10; i++) {
-    digitalWrite(LED_PIN, HIGH);
-    delay(100);
-    digitalWrite(LED_PIN, LOW);
-    delay(100);
-  }
-  
-  
-  digitalWrite(LED_PIN, HIGH);
+  // keeps blinking on the LED timer until cancelAlarm()
+  led.start(LED_PATTERN_ALARM);
 }
 
 void FallDetection::cancelAlarm() {
-  digitalWrite(LED_PIN, LOW);
+  led.start(LED_PATTERN_OFF);
   fallDetected = false;
+  postImpactActive = false;
   
-  Serial.println("Alarm canceled - returning to normal monitoring");
+  LOG_INFO(FALL, "Alarm canceled - returning to normal monitoring");
+}
+
+CircularBuffer<uint32_t, ACCEL_BUFFER_SIZE>& FallDetection::getAccelBuffer() {
+  return accelBuffer;
+}
+
+CircularBuffer<uint32_t, GYRO_BUFFER_SIZE>& FallDetection::getGyroBuffer() {
+  return gyroBuffer;
+}
+
+const WindowStats<uint32_t, ACCEL_BUFFER_SIZE>& FallDetection::getAccelStats() {
+  return accelStats;
+}
+
+const WindowStats<uint32_t, GYRO_BUFFER_SIZE>& FallDetection::getGyroStats() {
+  return gyroStats;
 }
 
 SystemState FallDetection::getState() {
@@ -149,7 +266,7 @@ void FallDetection::setState(SystemState state) {
     "INIT", "CALIBRATING", "MONITORING", "FALL_DETECTED", "ALARM_ACTIVE"
   };
   
-  Serial.printf("State changing: %s -> %s\n", 
+  LOG_INFO(FALL, "State changing: %s -> %s", 
                stateNames[currentState], stateNames[state]);
   
   currentState = state;
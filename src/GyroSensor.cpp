@@ -1,68 +1,56 @@
 #include "../include/GyroSensor.h"
+#include "../include/Profiler.h"
+#include "../include/Log.h"
 
-GyroSensor::GyroSensor() {
-  accelCalibX = accelCalibY = accelCalibZ = 0;
-  gyroCalibX = gyroCalibY = gyroCalibZ = 0;
-  
-  lastAccelX = lastAccelY = lastAccelZ = 0;
-  lastGyroX = lastGyroY = lastGyroZ = 0;
+// NVS layout of the calibration, offsets in raw counts
+struct StoredCalibration {
+  uint32_t layout;
+  float accelOffset[3];
+  float gyroOffset[3];
+};
+
+static const uint32_t CALIBRATION_LAYOUT = 1;
+static const char *CALIBRATION_KEY = "calibration";
+
+GyroSensor::GyroSensor(ImuDevice &imuDevice, Clock &systemClock, DeviceConfig &deviceConfig)
+  : device(imuDevice), clock(systemClock), config(deviceConfig) {
+  calibrationStore = NULL;
+  calibrationLock = portMUX_INITIALIZER_UNLOCKED;
+  calibrationSaved = false;
+
+  const float zero[3] = { 0, 0, 0 };
+  setBias(zero, zero);
+
+  memset(&lastSample, 0, sizeof(lastSample));
+  sampleSink = NULL;
+
+  rateProfile = RATE_PROFILE_NORMAL;
+  rateSwitches = 0;
+  burstWanted = false;
+  lastBurstTriggerUs = 0;
+  rateConfigVersion = config.getVersion() - 1; // forces the first refresh
+  refreshRateSettings();
 }
 
+// calibration runs on the normal profile, process() picks the adaptive one from there
 bool GyroSensor::initialize() {
-  
-  Wire.begin(SDA_PIN, SCL_PIN);
-  
-  
-  if (!mpu.begin(0x68, &Wire)) {
-    Serial.println("Failed to find MPU6050 at address 0x68, trying 0x69...");
-    
-    if (!mpu.begin(0x69, &Wire)) {
-      Serial.println("Could not find a valid MPU6050 sensor!");
-      return false;
-    } else {
-      Serial.println("MPU6050 found at address 0x69");
-    }
-  } else {
-    Serial.println("MPU6050 found at address 0x68");
-  }
-  
-  // edit the sensor settings
-  mpu.setAccelerometerRange(MPU6050_RANGE_8_G);
-  mpu.setGyroRange(MPU6050_RANGE_500_DEG);
-  mpu.setFilterBandwidth(MPU6050_BAND_21_HZ);
-  
-  delay(100); 
-  return true;
+  rateProfile = RATE_PROFILE_NORMAL;
+  return device.begin(::getRateProfile(RATE_PROFILE_NORMAL));
 }
 
-void GyroSensor::calibrate() {
-  accelCalibX = accelCalibY = accelCalibZ = 0;
-  gyroCalibX = gyroCalibY = gyroCalibZ = 0;
-  int calibrationSamples = 0;
+bool GyroSensor::calibrate() {
+  StillnessWindow window;
+  window.clear();
   
-  unsigned long startTime = millis();
-  const int totalSamples = 100;
+  unsigned long startTime = clock.millis();
+  const uint32_t totalSamples = config.get().calibrationSamples;
   
-  
-  while (calibrationSamples < totalSamples && millis() - startTime < 5000) {
-    sensors_event_t a, g, temp;
-    if (mpu.getEvent(&a, &g, &temp)) {
-      accelCalibX += a.acceleration.x;
-      accelCalibY += a.acceleration.y;
-      accelCalibZ += a.acceleration.z - 9.8; // remove gravity component from Z
-      
-      gyroCalibX += g.gyro.x;
-      gyroCalibY += g.gyro.y;
-      gyroCalibZ += g.gyro.z;
-      
-      calibrationSamples++;
-      
-      
-      if (calibrationSamples % 10 == 0) {
-        digitalWrite(LED_PIN, !digitalRead(LED_PIN));
-      }
-      delay(20);
+  while (window.count < totalSamples && clock.millis() - startTime < 5000) {
+    RawImuSample raw;
+    if (device.readSample(raw, clock.micros())) {
+      window.add(raw);
     }
+    clock.delayMs(SAMPLING_PERIOD_MS); // a new reading every output period, no point waiting longer
   }
   
   // Calculate average offsets
@@ -71,66 +59,279 @@ void GyroSensor::calibrate() {
    * MEMS (Micro-Electro-Mechanical Systems) sensors like the MPU6050 have inherent manufacturing imperfections that cause them to report slightly inaccurate values even when perfectly still. 
    * So we use the offest to take the avrage error values
    */
-  if (calibrationSamples > 0) {
-    accelCalibX /= calibrationSamples;
-    accelCalibY /= calibrationSamples;
-    accelCalibZ /= calibrationSamples;
-    gyroCalibX /= calibrationSamples;
-    gyroCalibY /= calibrationSamples;
-    gyroCalibZ /= calibrationSamples;
+  if (window.count == 0) {
+    Serial.println("Calibration failed - no readings");
+    return false;
   }
-  
-  Serial.println("Calibration complete!");
+  float accel[3], gyro[3];
+  BiasTracker::estimate(window, accel, gyro);
+  setBias(accel, gyro);
+  biasTracker.reset(accel, gyro);
+
+  // the FIFO kept filling while we were taking single readings, throw that away
+  device.flush();
+
+  bool still = window.isStill();
+  Serial.println(still ? "Calibration complete!" : "Device moved during calibration - offsets will be refined once it is still");
   Serial.printf("Accel offsets: X: %.3f, Y: %.3f, Z: %.3f\n", 
-                accelCalibX, accelCalibY, accelCalibZ);
+                accel[0] / ACCEL_COUNTS_PER_MS2, accel[1] / ACCEL_COUNTS_PER_MS2, accel[2] / ACCEL_COUNTS_PER_MS2);
   Serial.printf("Gyro offsets: X: %.3f, Y: %.3f, Z: %.3f\n",
-                gyroCalibX, gyroCalibY, gyroCalibZ);
+                gyro[0] * (float)DEG_TO_RAD / GYRO_LSB_PER_DPS, gyro[1] * (float)DEG_TO_RAD / GYRO_LSB_PER_DPS,
+                gyro[2] * (float)DEG_TO_RAD / GYRO_LSB_PER_DPS);
+  return still;
 }
 
-void GyroSensor::process() {
-  sensors_event_t a, g, temp;
-  
-  if (mpu.getEvent(&a, &g, &temp)) {
-    // store raw data with calibration offsets applied
-    lastAccelX = a.acceleration.x - accelCalibX;
-    lastAccelY = a.acceleration.y - accelCalibY;
-    lastAccelZ = a.acceleration.z - accelCalibZ;
-    
-    lastGyroX = g.gyro.x - gyroCalibX;
-    lastGyroY = g.gyro.y - gyroCalibY;
-    lastGyroZ = g.gyro.z - gyroCalibZ;
-    
-   
+void GyroSensor::setCalibrationStore(KeyValueStore *store) {
+  calibrationStore = store;
+}
+
+// anything outside these is a corrupt blob or another sensor, calibrate again
+static bool plausibleCalibration(const StoredCalibration &stored) {
+  for (int i = 0; i < 3; i++) {
+    if (!isfinite(stored.accelOffset[i]) || fabsf(stored.accelOffset[i]) > ACCEL_LSB_PER_G / 2) return false;
+    if (!isfinite(stored.gyroOffset[i]) || fabsf(stored.gyroOffset[i]) > 30 * GYRO_LSB_PER_DPS) return false;
+  }
+  return true;
+}
+
+bool GyroSensor::loadCalibration() {
+  if (calibrationStore == NULL) {
+    return false;
+  }
+  StoredCalibration stored;
+  if (calibrationStore->get(CALIBRATION_KEY, &stored, sizeof(stored)) != sizeof(stored) ||
+      stored.layout != CALIBRATION_LAYOUT || !plausibleCalibration(stored)) {
+    return false;
+  }
+
+  setBias(stored.accelOffset, stored.gyroOffset);
+  biasTracker.reset(stored.accelOffset, stored.gyroOffset);
+  for (int i = 0; i < 3; i++) {
+    savedAccelBias[i] = stored.accelOffset[i];
+    savedGyroBias[i] = stored.gyroOffset[i];
+  }
+  calibrationSaved = true;
+  device.flush();
+  return true;
+}
+
+bool GyroSensor::saveCalibration() {
+  if (calibrationStore == NULL) {
+    return false;
+  }
+  StoredCalibration stored;
+  stored.layout = CALIBRATION_LAYOUT;
+  getCalibration(stored.accelOffset, stored.gyroOffset);
+
+  bool changed = !calibrationSaved;
+  for (int i = 0; i < 3 && !changed; i++) {
+    changed = fabsf(stored.accelOffset[i] - savedAccelBias[i]) >= CALIBRATION_SAVE_DELTA ||
+              fabsf(stored.gyroOffset[i] - savedGyroBias[i]) >= CALIBRATION_SAVE_DELTA;
+  }
+  if (!changed || !calibrationStore->put(CALIBRATION_KEY, &stored, sizeof(stored))) {
+    return false;
+  }
+  for (int i = 0; i < 3; i++) {
+    savedAccelBias[i] = stored.accelOffset[i];
+    savedGyroBias[i] = stored.gyroOffset[i];
+  }
+  calibrationSaved = true;
+  return true;
+}
+
+void GyroSensor::getCalibration(float accel[3], float gyro[3]) {
+  portENTER_CRITICAL(&calibrationLock);
+  for (int i = 0; i < 3; i++) {
+    accel[i] = accelBias[i];
+    gyro[i] = gyroBias[i];
+  }
+  portEXIT_CRITICAL(&calibrationLock);
+}
+
+uint32_t GyroSensor::getBiasUpdateCount() {
+  return biasTracker.getUpdateCount();
+}
+
+void GyroSensor::setBias(const float accel[3], const float gyro[3]) {
+  portENTER_CRITICAL(&calibrationLock);
+  for (int i = 0; i < 3; i++) {
+    accelBias[i] = accel[i];
+    gyroBias[i] = gyro[i];
+  }
+  portEXIT_CRITICAL(&calibrationLock);
+  updateCountOffsets();
+}
+
+int GyroSensor::process() {
+  PROFILE_SCOPE("gyro.process");
+#if RATE_ADAPTIVE
+  refreshRateSettings();
+#endif
+
+  size_t count = device.readBurst(fifoBurst, GYRO_FIFO_BURST_MAX, clock.micros());
+  for (size_t i = 0; i < count; i++) {
+    applyRawSample(fifoBurst[i]);
+  }
+
+#if RATE_ADAPTIVE
+  // switch right after a drain, so nothing taken at the old rate is left buffered
+  RateProfileId wanted = burstWanted ? RATE_PROFILE_BURST : RATE_PROFILE_IDLE;
+  if (wanted != rateProfile) {
+    setRateProfile(wanted);
+  }
+#endif
+  return (int)count;
+}
+
+bool GyroSensor::setRateProfile(RateProfileId profile) {
+  if (!device.setRateProfile(::getRateProfile(profile))) {
+    LOG_WARN(SENSOR, "Rate profile %s failed", ::getRateProfile(profile).name);
+    return false;
+  }
+  rateProfile = profile;
+  rateSwitches++;
+  LOG_DEBUG(SENSOR, "Rate profile %s", ::getRateProfile(profile).name);
+  return true;
+}
+
+RateProfileId GyroSensor::getRateProfile() {
+  return rateProfile;
+}
+
+uint32_t GyroSensor::getPollPeriodMs() {
+  return ::getRateProfile(rateProfile).pollPeriodMs;
+}
+
+uint32_t GyroSensor::getRateSwitchCount() {
+  return rateSwitches;
+}
+
+// Burst starts within RATE_BURST_MARGIN of the free-fall threshold and lasts until
+// postImpactWindowMs went by without another such sample. One volatile read per
+// process() while the config stays the same.
+void GyroSensor::refreshRateSettings() {
+  uint32_t version = config.getVersion();
+  if (version == rateConfigVersion) {
+    return;
+  }
+  rateConfigVersion = version;
+  DeviceSettings settings = config.get();
+  burstBelowSq = ACCEL_SQ_COUNTS(settings.freeFallThreshold + RATE_BURST_MARGIN);
+  burstHoldUs = settings.postImpactWindowMs * 1000UL;
+}
+
+void GyroSensor::updateCountOffsets() {
+  for (int i = 0; i < 3; i++) {
+    accelOffset[i] = (int16_t)lroundf(accelBias[i]);
+    gyroOffset[i] = (int16_t)lroundf(gyroBias[i]);
+  }
+}
+
+// subtracting an offset can push a reading just past the int16 range, clamp it back
+static inline int16_t clampCounts(int32_t v) {
+  if (v > 32767) return 32767;
+  if (v < -32768) return -32768;
+  return (int16_t)v;
+}
+
+void GyroSensor::applyRawSample(const RawImuSample &raw) {
+#if BIAS_TRACKING
+  if (biasTracker.add(raw)) {
+    float accel[3], gyro[3];
+    biasTracker.getOffsets(accel, gyro);
+    setBias(accel, gyro);
+  }
+#endif
+
+  ImuSample sample;
+  sample.timestampUs = raw.timestampUs;
+
+#if GYRO_FIXED_POINT
+  // calibration is just an integer subtract per axis
+  sample.accelX = clampCounts((int32_t)raw.accelX - accelOffset[0]);
+  sample.accelY = clampCounts((int32_t)raw.accelY - accelOffset[1]);
+  sample.accelZ = clampCounts((int32_t)raw.accelZ - accelOffset[2]);
+  sample.gyroX = clampCounts((int32_t)raw.gyroX - gyroOffset[0]);
+  sample.gyroY = clampCounts((int32_t)raw.gyroY - gyroOffset[1]);
+  sample.gyroZ = clampCounts((int32_t)raw.gyroZ - gyroOffset[2]);
+
+  // 3 * 32768^2 still fits in 32 bits unsigned, and there is no need for the sqrt since
+  // the thresholds are squared at compile time
+  sample.accelMagSq = (uint32_t)((int32_t)sample.accelX * sample.accelX) +
+                      (uint32_t)((int32_t)sample.accelY * sample.accelY) +
+                      (uint32_t)((int32_t)sample.accelZ * sample.accelZ);
+  sample.gyroMagSq = (uint32_t)((int32_t)sample.gyroX * sample.gyroX) +
+                     (uint32_t)((int32_t)sample.gyroY * sample.gyroY) +
+                     (uint32_t)((int32_t)sample.gyroZ * sample.gyroZ);
+#else
+  // reference float path: convert to m/s^2 and rad/s and apply the float offsets
+  const float accelScale = 1.0F / ACCEL_COUNTS_PER_MS2;
+  const float gyroScale = (float)DEG_TO_RAD / GYRO_LSB_PER_DPS;
+
+  float ax = (raw.accelX - accelBias[0]) * accelScale;
+  float ay = (raw.accelY - accelBias[1]) * accelScale;
+  float az = (raw.accelZ - accelBias[2]) * accelScale;
+  float gx = (raw.gyroX - gyroBias[0]) * gyroScale;
+  float gy = (raw.gyroY - gyroBias[1]) * gyroScale;
+  float gz = (raw.gyroZ - gyroBias[2]) * gyroScale;
+
   // This is calculating the total acceleration magnitude using the 3D Pythagorean theorem. Since accelerometers measure along three separate axes (X, Y, Z), we need to combine them to get the overall acceleration
-    lastAccelMagnitude = sqrt(lastAccelX*lastAccelX + lastAccelY*lastAccelY + lastAccelZ*lastAccelZ);
+  float accelMagnitude = sqrt(ax*ax + ay*ay + az*az);
 
   // This calculates the total rotational velocity magnitude, again by combining all three axes, and then converts it to degrees per second
-    lastGyroMagnitude = sqrt(lastGyroX*lastGyroX + lastGyroY*lastGyroY + lastGyroZ*lastGyroZ) * RAD_TO_DEG;
-    
-    // store in circular buffers
-    accelBuffer.push(lastAccelMagnitude);
-    gyroBuffer.push(lastGyroMagnitude);
+  float gyroMagnitude = sqrt(gx*gx + gy*gy + gz*gz) * RAD_TO_DEG;
+
+  sample.accelX = clampCounts(lroundf(ax * ACCEL_COUNTS_PER_MS2));
+  sample.accelY = clampCounts(lroundf(ay * ACCEL_COUNTS_PER_MS2));
+  sample.accelZ = clampCounts(lroundf(az * ACCEL_COUNTS_PER_MS2));
+  sample.gyroX = clampCounts(lroundf(gx * (float)RAD_TO_DEG * GYRO_LSB_PER_DPS));
+  sample.gyroY = clampCounts(lroundf(gy * (float)RAD_TO_DEG * GYRO_LSB_PER_DPS));
+  sample.gyroZ = clampCounts(lroundf(gz * (float)RAD_TO_DEG * GYRO_LSB_PER_DPS));
+  sample.accelMagSq = (uint32_t)(accelMagnitude * ACCEL_COUNTS_PER_MS2 * accelMagnitude * ACCEL_COUNTS_PER_MS2);
+  sample.gyroMagSq = (uint32_t)(gyroMagnitude * GYRO_LSB_PER_DPS * gyroMagnitude * GYRO_LSB_PER_DPS);
+#endif
+
+  lastSample = sample;
+
+#if RATE_ADAPTIVE
+  if (sample.accelMagSq < burstBelowSq) {
+    burstWanted = true;
+    lastBurstTriggerUs = sample.timestampUs;
+  } else if (burstWanted && sample.timestampUs - lastBurstTriggerUs > burstHoldUs) {
+    burstWanted = false;
+  }
+#endif
+
+  if (sampleSink != NULL) {
+    sampleSink->push(sample);
   }
 }
 
 void GyroSensor::getAccelGyroData(float &accelMagnitude, float &gyroMagnitude) {
 
-  accelMagnitude = lastAccelMagnitude;
-  gyroMagnitude = lastGyroMagnitude;
+  accelMagnitude = lastSample.accelMagnitude();
+  gyroMagnitude = lastSample.gyroMagnitude();
 }
 
-float GyroSensor::getAccelX() { return lastAccelX; }
-float GyroSensor::getAccelY() { return lastAccelY; }
-float GyroSensor::getAccelZ() { return lastAccelZ; }
+// floats are only worked out when somebody asks
+float GyroSensor::getAccelX() { return ImuSample::accelToMs2(lastSample.accelX); }
+float GyroSensor::getAccelY() { return ImuSample::accelToMs2(lastSample.accelY); }
+float GyroSensor::getAccelZ() { return ImuSample::accelToMs2(lastSample.accelZ); }
+
+float GyroSensor::getGyroX() { return ImuSample::gyroToRads(lastSample.gyroX); }
+float GyroSensor::getGyroY() { return ImuSample::gyroToRads(lastSample.gyroY); }
+float GyroSensor::getGyroZ() { return ImuSample::gyroToRads(lastSample.gyroZ); }
 
-float GyroSensor::getGyroX() { return lastGyroX; }
-float GyroSensor::getGyroY() { return lastGyroY; }
-float GyroSensor::getGyroZ() { return lastGyroZ; }
+uint32_t GyroSensor::getLastSampleTimeUs() { return lastSample.timestampUs; }
+
+ImuSample GyroSensor::getLastSample() {
+  return lastSample;
+}
 
-CircularBuffer<float, ACCEL_BUFFER_SIZE>& GyroSensor::getAccelBuffer() {
-  return accelBuffer;
+void GyroSensor::setSampleSink(SampleRing *ring) {
+  sampleSink = ring;
 }
 
-CircularBuffer<float, GYRO_BUFFER_SIZE>& GyroSensor::getGyroBuffer() {
-  return gyroBuffer;
+uint32_t GyroSensor::getFifoOverflowCount() {
+  return device.getOverflowCount();
 }
@@ -0,0 +1,85 @@
+#include "../include/I2sAudioSink.h"
+
+I2sAudioSink::I2sAudioSink(int bclk_pin, int lrc_pin, int data_pin)
+    : _bclk_pin(bclk_pin)
+    , _lrc_pin(lrc_pin)
+    , _data_pin(data_pin)
+    , _installed(false)
+    , _i2s_queue(NULL)
+{
+}
+
+bool I2sAudioSink::begin(uint32_t sample_rate) {
+    if (_installed) {
+        return true;
+    }
+
+    // I2S configuration
+    i2s_config_t i2s_config = {
+        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX),
+        .sample_rate = sample_rate,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+        .dma_buf_count = AUDIO_DMA_BUFFER_COUNT,
+        .dma_buf_len = AUDIO_BUFFER_SAMPLES,   // one DMA buffer = one AudioController buffer
+        .use_apll = false,
+        .tx_desc_auto_clear = true,            // plays silence when we have nothing to send
+        .fixed_mclk = 0
+    };
+
+    // I2S pin configuration
+    i2s_pin_config_t pin_config = {
+        .bck_io_num = _bclk_pin,
+        .ws_io_num = _lrc_pin,
+        .data_out_num = _data_pin,
+        .data_in_num = I2S_PIN_NO_CHANGE
+    };
+
+    // Install I2S driver, with an event queue so we hear about free DMA buffers
+    esp_err_t result = i2s_driver_install(I2S_PORT, &i2s_config, AUDIO_EVENT_QUEUE_LENGTH, &_i2s_queue);
+    if (result != ESP_OK) {
+        Serial.printf("Error installing I2S driver: %d\n", result);
+        return false;
+    }
+
+    // Set I2S pins
+    result = i2s_set_pin(I2S_PORT, &pin_config);
+    if (result != ESP_OK) {
+        Serial.printf("Error setting I2S pins: %d\n", result);
+        i2s_driver_uninstall(I2S_PORT);
+        return false;
+    }
+
+    _installed = true;
+    return true;
+}
+
+void I2sAudioSink::end() {
+    if (_installed) {
+        i2s_driver_uninstall(I2S_PORT);
+        _installed = false;
+        _i2s_queue = NULL;
+    }
+}
+
+size_t I2sAudioSink::write(const uint8_t *data, size_t length) {
+    size_t bytes_written = 0;
+    esp_err_t result = i2s_write(I2S_PORT, data, length, &bytes_written, 0);
+    if (result != ESP_OK && result != ESP_ERR_TIMEOUT) {
+        Serial.printf("Error writing to I2S: %d\n", result);
+    }
+    return bytes_written;
+}
+
+bool I2sAudioSink::waitForSpace(uint32_t timeout_ms) {
+    // TX_DONE means the DMA engine finished a buffer and there's room for another one
+    i2s_event_t event;
+    while (xQueueReceive(_i2s_queue, &event, pdMS_TO_TICKS(timeout_ms)) == pdTRUE) {
+        if (event.type == I2S_EVENT_TX_DONE) {
+            return true;
+        }
+    }
+    return false;
+}
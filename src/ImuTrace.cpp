@@ -0,0 +1,337 @@
+#include "../include/ImuTrace.h"
+
+// CRC-16/CCITT-FALSE, bitwise like TelemetryStore's, but resumable so the header and the
+// records can be run through it one after the other
+static uint16_t crc16(uint16_t crc, const uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static uint16_t blockCrc(const TraceBlock &block) {
+  TraceBlockHeader header = block.header;
+  header.crc = 0;
+  uint16_t crc = crc16(0xFFFF, (const uint8_t *)&header, sizeof(header));
+  return crc16(crc, (const uint8_t *)block.records, block.header.count * sizeof(TraceRecord));
+}
+
+// ---- TraceWriter ----
+
+TraceWriter::TraceWriter() {
+  output = NULL;
+  samplePeriodUs = 0;
+  maxBytes = 0;
+  syncEachBlock = false;
+  bytesWritten = samplesWritten = droppedSamples = 0;
+  queueDrops = 0;
+  memset(&block, 0, sizeof(block));
+  memset(&outgoing, 0, sizeof(outgoing));
+  lastTimestampUs = 0;
+}
+
+void TraceWriter::begin(Print *out, uint32_t periodUs, uint32_t limitBytes, bool sync) {
+  output = out;
+  samplePeriodUs = periodUs > UINT16_MAX ? UINT16_MAX : (uint16_t)periodUs;
+  maxBytes = limitBytes;
+  syncEachBlock = sync;
+  bytesWritten = samplesWritten = droppedSamples = 0;
+  queueDrops = 0;
+  block.header.count = 0;
+  while (queue.pop(outgoing)) {
+  }
+}
+
+void TraceWriter::end() {
+  flush();
+  drain();
+  output = NULL;
+}
+
+bool TraceWriter::isActive() {
+  return output != NULL;
+}
+
+void TraceWriter::add(const RawImuSample &sample) {
+  if (output == NULL) return;
+
+  // a gap too long for the 16-bit delta (FIFO reset, stalled task) starts a new block,
+  // which carries a full timestamp again
+  if (block.header.count > 0 && sample.timestampUs - lastTimestampUs > UINT16_MAX) {
+    flush();
+  }
+
+  TraceRecord &record = block.records[block.header.count];
+  if (block.header.count == 0) {
+    block.header.firstTimestampUs = sample.timestampUs;
+    record.deltaUs = 0;
+  } else {
+    record.deltaUs = (uint16_t)(sample.timestampUs - lastTimestampUs);
+  }
+  record.accelX = sample.accelX;
+  record.accelY = sample.accelY;
+  record.accelZ = sample.accelZ;
+  record.gyroX = sample.gyroX;
+  record.gyroY = sample.gyroY;
+  record.gyroZ = sample.gyroZ;
+  lastTimestampUs = sample.timestampUs;
+
+  if (++block.header.count == TRACE_BLOCK_SAMPLES) {
+    flush();
+  }
+}
+
+void TraceWriter::flush() {
+  uint8_t count = block.header.count;
+  if (output == NULL || count == 0) return;
+
+  // the trace task fell behind (a slow flash erase), losing the block beats stalling sampling
+  if (!queue.push(block)) {
+    queueDrops += count;
+  }
+  block.header.count = 0;
+}
+
+size_t TraceWriter::drain() {
+  size_t blocks = 0;
+  while (queue.pop(outgoing)) {
+    write(outgoing);
+    blocks++;
+  }
+  return blocks;
+}
+
+void TraceWriter::write(TraceBlock &out) {
+  uint8_t count = out.header.count;
+  if (output == NULL) return;
+
+  size_t length = sizeof(TraceBlockHeader) + count * sizeof(TraceRecord);
+  if (maxBytes > 0 && bytesWritten + length > maxBytes) {
+    droppedSamples += count;
+    return;
+  }
+
+  out.header.sync = TRACE_SYNC;
+  out.header.version = TRACE_VERSION;
+  out.header.samplePeriodUs = samplePeriodUs;
+  out.header.crc = blockCrc(out);
+
+  size_t written = output->write((const uint8_t *)&out, length);
+  if (syncEachBlock) {
+    output->flush();
+  }
+  bytesWritten += written;
+  if (written == length) {
+    samplesWritten += count;
+  } else {
+    // a torn block fails its CRC on the reading side, count it as lost here too
+    droppedSamples += count;
+  }
+}
+
+uint32_t TraceWriter::getBytesWritten() { return bytesWritten; }
+uint32_t TraceWriter::getSamplesWritten() { return samplesWritten; }
+uint32_t TraceWriter::getDroppedSamples() { return droppedSamples + queueDrops; }
+
+// ---- TraceReader ----
+
+TraceReader::TraceReader(const uint8_t *traceData, size_t traceLength) {
+  data = traceData;
+  length = traceLength;
+  rewind();
+}
+
+void TraceReader::rewind() {
+  pos = 0;
+  memset(&block, 0, sizeof(block));
+  blockIndex = 0;
+  blockTimestampUs = 0;
+  blockCount = corruptBlocks = 0;
+  skippedBytes = 0;
+}
+
+bool TraceReader::loadBlock() {
+  const uint8_t sync0 = TRACE_SYNC & 0xFF;
+  const uint8_t sync1 = TRACE_SYNC >> 8;
+
+  while (pos + sizeof(TraceBlockHeader) <= length) {
+    if (data[pos] != sync0 || data[pos + 1] != sync1) {
+      pos++;
+      skippedBytes++;
+      continue;
+    }
+
+    TraceBlockHeader header;
+    memcpy(&header, data + pos, sizeof(header));
+    size_t recordBytes = header.count * sizeof(TraceRecord);
+    if (header.version != TRACE_VERSION || header.count == 0 || header.count > TRACE_BLOCK_SAMPLES ||
+        pos + sizeof(header) + recordBytes > length) {
+      // sync pattern inside log text or a truncated tail, keep looking one byte on
+      pos++;
+      skippedBytes++;
+      continue;
+    }
+
+    block.header = header;
+    memcpy(block.records, data + pos + sizeof(header), recordBytes);
+    if (blockCrc(block) != header.crc) {
+      corruptBlocks++;
+      pos++;
+      skippedBytes++;
+      continue;
+    }
+
+    pos += sizeof(header) + recordBytes;
+    blockIndex = 0;
+    blockTimestampUs = header.firstTimestampUs;
+    blockCount++;
+    return true;
+  }
+
+  skippedBytes += length - pos;
+  pos = length;
+  return false;
+}
+
+bool TraceReader::peekTimestamp(uint32_t &timestampUs) {
+  if (blockIndex >= block.header.count && !loadBlock()) {
+    return false;
+  }
+  timestampUs = blockTimestampUs + block.records[blockIndex].deltaUs;
+  return true;
+}
+
+bool TraceReader::next(RawImuSample &out) {
+  if (!peekTimestamp(out.timestampUs)) {
+    return false;
+  }
+
+  const TraceRecord &record = block.records[blockIndex++];
+  blockTimestampUs = out.timestampUs;
+  out.accelX = record.accelX;
+  out.accelY = record.accelY;
+  out.accelZ = record.accelZ;
+  out.gyroX = record.gyroX;
+  out.gyroY = record.gyroY;
+  out.gyroZ = record.gyroZ;
+  return true;
+}
+
+uint32_t TraceReader::getSamplePeriodUs() { return block.header.samplePeriodUs; }
+uint32_t TraceReader::getBlockCount() { return blockCount; }
+uint32_t TraceReader::getCorruptBlocks() { return corruptBlocks; }
+size_t TraceReader::getSkippedBytes() { return skippedBytes; }
+
+// ---- TracingImuDevice ----
+
+TracingImuDevice::TracingImuDevice(ImuDevice &imuDevice, TraceWriter &traceWriter)
+  : device(imuDevice), writer(traceWriter) {
+}
+
+bool TracingImuDevice::begin(const RateProfile &profile) {
+  return device.begin(profile);
+}
+
+// the records carry their own spacing, nothing to tell the writer
+bool TracingImuDevice::setRateProfile(const RateProfile &profile) {
+  return device.setRateProfile(profile);
+}
+
+bool TracingImuDevice::readSample(RawImuSample &out, uint32_t nowUs) {
+  if (!device.readSample(out, nowUs)) {
+    return false;
+  }
+  writer.add(out);
+  return true;
+}
+
+size_t TracingImuDevice::readBurst(RawImuSample *out, size_t maxSamples, uint32_t nowUs) {
+  size_t count = device.readBurst(out, maxSamples, nowUs);
+  for (size_t i = 0; i < count; i++) {
+    writer.add(out[i]);
+  }
+  return count;
+}
+
+void TracingImuDevice::flush() {
+  device.flush();
+}
+
+uint32_t TracingImuDevice::getOverflowCount() {
+  return device.getOverflowCount();
+}
+
+// ---- TraceImuDevice ----
+
+TraceImuDevice::TraceImuDevice(TraceReader &traceReader) : reader(traceReader) {
+  aligned = false;
+  offsetUs = 0;
+}
+
+bool TraceImuDevice::begin(const RateProfile &profile) {
+  uint32_t timestampUs;
+  return reader.peekTimestamp(timestampUs);
+}
+
+// plays back at whatever rates were recorded
+bool TraceImuDevice::setRateProfile(const RateProfile &profile) {
+  return true;
+}
+
+void TraceImuDevice::align(uint32_t nowUs) {
+  uint32_t timestampUs;
+  if (!aligned && reader.peekTimestamp(timestampUs)) {
+    offsetUs = nowUs - timestampUs;
+    aligned = true;
+  }
+}
+
+bool TraceImuDevice::readSample(RawImuSample &out, uint32_t nowUs) {
+  // calibration readings were recorded one per call, so hand them back one per call
+  align(nowUs);
+  if (!reader.next(out)) {
+    return false;
+  }
+  out.timestampUs += offsetUs;
+  return true;
+}
+
+size_t TraceImuDevice::readBurst(RawImuSample *out, size_t maxSamples, uint32_t nowUs) {
+  align(nowUs);
+
+  size_t count = 0;
+  uint32_t timestampUs;
+  while (count < maxSamples && reader.peekTimestamp(timestampUs) &&
+         (int32_t)(nowUs - (timestampUs + offsetUs)) >= 0) {
+    reader.next(out[count]);
+    out[count].timestampUs += offsetUs;
+    count++;
+  }
+  return count;
+}
+
+void TraceImuDevice::flush() {
+  // whatever was recorded after the FIFO reset starts right away on replay too
+  aligned = false;
+}
+
+uint32_t TraceImuDevice::getOverflowCount() {
+  return 0;
+}
+
+bool TraceImuDevice::isFinished() {
+  uint32_t timestampUs;
+  return !reader.peekTimestamp(timestampUs);
+}
+
+bool TraceImuDevice::nextDueUs(uint32_t &nowUs) {
+  uint32_t timestampUs;
+  if (!reader.peekTimestamp(timestampUs)) {
+    return false;
+  }
+  nowUs = aligned ? timestampUs + offsetUs : nowUs;
+  return true;
+}
@@ -0,0 +1,101 @@
+#include "../include/LedController.h"
+
+// Pattern table. Durations should be multiples of LED_TICK_MS.
+static const LedStep OFF_STEPS[] = { {LOW, 0} };
+static const LedStep ON_STEPS[] = { {HIGH, 0} };
+static const LedStep CALIBRATING_STEPS[] = { {HIGH, 200}, {LOW, 200} };
+static const LedStep READY_STEPS[] = { {HIGH, 100} };
+static const LedStep FREE_FALL_STEPS[] = { {HIGH, 50} };
+static const LedStep FALL_DETECTED_STEPS[] = { {HIGH, 500}, {LOW, 500} };
+static const LedStep ALARM_STEPS[] = { {HIGH, 150}, {LOW, 150} };
+static const LedStep ERROR_STEPS[] = { {HIGH, 100}, {LOW, 100} };
+
+#define LED_STEPS(s) s, (uint8_t)(sizeof(s) / sizeof(s[0]))
+
+static const LedPattern PATTERNS[LED_PATTERN_COUNT] = {
+  { LED_STEPS(OFF_STEPS), false },
+  { LED_STEPS(ON_STEPS), false },
+  { LED_STEPS(CALIBRATING_STEPS), true },
+  { LED_STEPS(READY_STEPS), false },
+  { LED_STEPS(FREE_FALL_STEPS), false },
+  { LED_STEPS(FALL_DETECTED_STEPS), true },
+  { LED_STEPS(ALARM_STEPS), true },
+  { LED_STEPS(ERROR_STEPS), true },
+};
+
+LedController::LedController(int ledPin) {
+  pin = ledPin;
+  timer = NULL;
+  lock = portMUX_INITIALIZER_UNLOCKED;
+  pattern = &PATTERNS[LED_PATTERN_OFF];
+  patternId = LED_PATTERN_OFF;
+  step = 0;
+  stepElapsedMs = 0;
+}
+
+bool LedController::begin() {
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
+
+  esp_timer_create_args_t args = {};
+  args.callback = timerCallback;
+  args.arg = this;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "led";
+
+  if (esp_timer_create(&args, &timer) != ESP_OK) {
+    Serial.println("LedController: failed to create timer");
+    return false;
+  }
+  if (esp_timer_start_periodic(timer, LED_TICK_MS * 1000ULL) != ESP_OK) {
+    Serial.println("LedController: failed to start timer");
+    return false;
+  }
+  return true;
+}
+
+void LedController::start(LedPatternId id) {
+  if (id >= LED_PATTERN_COUNT) return;
+
+  portENTER_CRITICAL(&lock);
+  pattern = &PATTERNS[id];
+  patternId = id;
+  step = 0;
+  stepElapsedMs = 0;
+  // first step shows right away instead of on the next tick. Written under the lock so a
+  // tick running on the other core can't put the old pattern's level back afterwards.
+  digitalWrite(pin, pattern->steps[0].level);
+  portEXIT_CRITICAL(&lock);
+}
+
+LedPatternId LedController::current() {
+  return patternId;
+}
+
+void LedController::timerCallback(void *arg) {
+  static_cast<LedController *>(arg)->tick();
+}
+
+void LedController::tick() {
+  portENTER_CRITICAL(&lock);
+  const LedStep &currentStep = pattern->steps[step];
+  if (currentStep.durationMs != 0) {
+    stepElapsedMs += LED_TICK_MS;
+    if (stepElapsedMs >= currentStep.durationMs) {
+      stepElapsedMs = 0;
+      step++;
+      if (step >= pattern->stepCount) {
+        if (pattern->repeat) {
+          step = 0;
+        } else {
+          // one-shot pattern done, park on "off"
+          pattern = &PATTERNS[LED_PATTERN_OFF];
+          patternId = LED_PATTERN_OFF;
+          step = 0;
+        }
+      }
+      digitalWrite(pin, pattern->steps[step].level);
+    }
+  }
+  portEXIT_CRITICAL(&lock);
+}
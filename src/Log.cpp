@@ -0,0 +1,255 @@
+#include "../include/Log.h"
+#include <atomic>
+
+// Bounded multi-producer ring (Vyukov): every slot carries a sequence number saying
+// whose turn it is, so producers on both cores only race on one compare-and-swap of the
+// write position and never wait for each other or for the drain task. A full ring drops
+// the new record rather than blocking the caller.
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two");
+
+struct LogSlot {
+  std::atomic<uint32_t> sequence;
+  LogRecord record;
+};
+
+static struct LogRing {
+  LogSlot slots[LOG_RING_SIZE];
+  std::atomic<uint32_t> writePos;
+  uint32_t readPos;   // drain task only
+  std::atomic<uint32_t> dropped;
+
+  LogRing() : writePos(0), readPos(0), dropped(0) {
+    for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+} ring;
+
+uint8_t Log::levels[LOG_MODULE_COUNT] = {
+  LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL
+};
+
+static const char *MODULE_NAMES[LOG_MODULE_COUNT] = { "main", "sensor", "fall", "net", "audio" };
+static const char *LEVEL_NAMES[] = { "none", "error", "warn", "info", "debug" };
+
+LogRecord *Log::reserve(uint32_t &ticket) {
+  uint32_t pos = ring.writePos.load(std::memory_order_relaxed);
+  while (true) {
+    LogSlot &slot = ring.slots[pos & (LOG_RING_SIZE - 1)];
+    int32_t diff = (int32_t)(slot.sequence.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      // free slot, claim it unless another producer got there first
+      if (ring.writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        ticket = pos;
+        return &slot.record;
+      }
+    } else if (diff < 0) {
+      // the drain task hasn't emptied this slot from the last lap yet
+      ring.dropped.fetch_add(1, std::memory_order_relaxed);
+      return NULL;
+    } else {
+      pos = ring.writePos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void Log::commit(uint32_t ticket) {
+  ring.slots[ticket & (LOG_RING_SIZE - 1)].sequence.store(ticket + 1, std::memory_order_release);
+}
+
+size_t Log::drain(Print &out, size_t maxRecords) {
+  size_t count = 0;
+  while (count < maxRecords) {
+    LogSlot &slot = ring.slots[ring.readPos & (LOG_RING_SIZE - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != ring.readPos + 1) {
+      break;   // empty, or a producer is still filling it in
+    }
+    format(slot.record, out);
+    slot.sequence.store(ring.readPos + LOG_RING_SIZE, std::memory_order_release);
+    ring.readPos++;
+    count++;
+  }
+  return count;
+}
+
+uint32_t Log::getDroppedCount() {
+  return ring.dropped.load(std::memory_order_relaxed);
+}
+
+// ---- argument encoding ----
+
+static bool reservePayload(LogRecord &record, size_t bytes) {
+  if (record.truncated || record.length + bytes > LOG_PAYLOAD_BYTES) {
+    record.truncated = 1;
+    return false;
+  }
+  return true;
+}
+
+static void addWord(LogRecord &record, LogArgType type, const void *value) {
+  if (!reservePayload(record, 5)) return;
+  record.payload[record.length] = type;
+  memcpy(record.payload + record.length + 1, value, 4);
+  record.length += 5;
+}
+
+void Log::addInt(LogRecord &record, int32_t value) { addWord(record, LOG_ARG_INT, &value); }
+void Log::addUint(LogRecord &record, uint32_t value) { addWord(record, LOG_ARG_UINT, &value); }
+void Log::addFloat(LogRecord &record, float value) { addWord(record, LOG_ARG_FLOAT, &value); }
+
+void Log::addString(LogRecord &record, const char *value) {
+  if (value == NULL) value = "(null)";
+  if (!reservePayload(record, 2)) return;
+  // take as much of the string as still fits, it is the one place a copy can grow
+  size_t room = LOG_PAYLOAD_BYTES - record.length - 2;
+  size_t length = strnlen(value, room);
+  record.payload[record.length] = LOG_ARG_STRING;
+  record.payload[record.length + 1] = (uint8_t)length;
+  memcpy(record.payload + record.length + 2, value, length);
+  record.length += 2 + length;
+}
+
+// ---- formatting, drain side ----
+
+struct LogArgReader {
+  const LogRecord &record;
+  size_t pos;
+
+  explicit LogArgReader(const LogRecord &r) : record(r), pos(0) {}
+
+  bool next(LogArgType &type, uint32_t &word, char *text, size_t textSize) {
+    if (pos >= record.length) return false;
+    type = (LogArgType)record.payload[pos];
+    if (type == LOG_ARG_STRING) {
+      size_t length = record.payload[pos + 1];
+      size_t copy = length < textSize - 1 ? length : textSize - 1;
+      memcpy(text, record.payload + pos + 2, copy);
+      text[copy] = '\0';
+      pos += 2 + length;
+    } else {
+      memcpy(&word, record.payload + pos + 1, 4);
+      pos += 5;
+    }
+    return true;
+  }
+};
+
+void Log::format(const LogRecord &record, Print &out) {
+  char line[LOG_LINE_BYTES];
+  size_t length = 0;
+  const char *f = record.format;
+
+  // leading blank lines go before the prefix, not after it
+  while (*f == '\n') {
+    out.write((const uint8_t *)"\n", 1);
+    f++;
+  }
+  length += snprintf(line, sizeof(line), "[%lu.%03lu %s] ", (unsigned long)(record.timestampUs / 1000000UL),
+                     (unsigned long)(record.timestampUs / 1000UL % 1000UL), MODULE_NAMES[record.module]);
+
+  LogArgReader args(record);
+  while (*f != '\0' && length < sizeof(line) - 1) {
+    if (*f != '%') {
+      line[length++] = *f++;
+      continue;
+    }
+    if (f[1] == '%') {
+      line[length++] = '%';
+      f += 2;
+      continue;
+    }
+
+    // copy the conversion spec without its length modifiers, the argument type comes
+    // from the record and is passed at its natural width
+    char spec[16];
+    size_t specLength = 0;
+    spec[specLength++] = *f++;
+    while (*f != '\0' && strchr("diouxXcsfFeEgGp", *f) == NULL) {
+      if (strchr("hlLqjzt", *f) == NULL && specLength < sizeof(spec) - 2) {
+        spec[specLength++] = *f;
+      }
+      f++;
+    }
+    if (*f == '\0') break;
+    char conversion = *f++;
+    spec[specLength++] = conversion;
+    spec[specLength] = '\0';
+
+    LogArgType type;
+    uint32_t word = 0;
+    char text[LOG_PAYLOAD_BYTES];
+    size_t room = sizeof(line) - length;
+    int n;
+    if (!args.next(type, word, text, sizeof(text))) {
+      n = snprintf(line + length, room, "?");
+    } else if (conversion == 's') {
+      n = snprintf(line + length, room, spec, type == LOG_ARG_STRING ? text : "?");
+    } else {
+      float f32;
+      memcpy(&f32, &word, sizeof(f32));
+      double asDouble = type == LOG_ARG_FLOAT ? f32 : type == LOG_ARG_INT ? (double)(int32_t)word : (double)word;
+      int32_t asInt = type == LOG_ARG_FLOAT ? (int32_t)f32 : (int32_t)word;
+
+      if (strchr("fFeEgG", conversion) != NULL) {
+        n = snprintf(line + length, room, spec, asDouble);
+      } else if (conversion == 'd' || conversion == 'i' || conversion == 'c') {
+        n = snprintf(line + length, room, spec, (int)asInt);
+      } else if (conversion == 'p') {
+        n = snprintf(line + length, room, "0x%08lx", (unsigned long)word);
+      } else {
+        n = snprintf(line + length, room, spec, (unsigned int)asInt);
+      }
+    }
+    if (n > 0) {
+      length += (size_t)n < room ? (size_t)n : room - 1;
+    }
+  }
+  if (record.truncated && length < sizeof(line) - 4) {
+    memcpy(line + length, " ...", 4);
+    length += 4;
+  }
+
+  if (length > 0 && line[length - 1] != '\n') {
+    if (length == sizeof(line) - 1) length--;
+    line[length++] = '\n';
+  }
+  out.write((const uint8_t *)line, length);
+}
+
+// ---- levels ----
+
+void Log::setLevel(LogModule module, LogLevel level) {
+  if (module < LOG_MODULE_COUNT) levels[module] = level;
+}
+
+LogLevel Log::getLevel(LogModule module) {
+  return module < LOG_MODULE_COUNT ? (LogLevel)levels[module] : LOG_LEVEL_NONE;
+}
+
+const char *Log::moduleName(LogModule module) {
+  return module < LOG_MODULE_COUNT ? MODULE_NAMES[module] : "?";
+}
+
+const char *Log::levelName(LogLevel level) {
+  return level <= LOG_LEVEL_DEBUG ? LEVEL_NAMES[level] : "?";
+}
+
+bool Log::parseModule(const char *name, LogModule &module) {
+  for (int i = 0; i < LOG_MODULE_COUNT; i++) {
+    if (strcmp(name, MODULE_NAMES[i]) == 0) {
+      module = (LogModule)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Log::parseLevel(const char *name, LogLevel &level) {
+  for (int i = 0; i <= LOG_LEVEL_DEBUG; i++) {
+    if (strcmp(name, LEVEL_NAMES[i]) == 0) {
+      level = (LogLevel)i;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,41 @@
+#include "../include/LogDrainTask.h"
+
+LogDrainTask::LogDrainTask(Print &output) : out(output) {
+  taskHandle = NULL;
+  reportedDrops = 0;
+}
+
+bool LogDrainTask::start() {
+  if (taskHandle != NULL) {
+    return true;
+  }
+
+  BaseType_t result = xTaskCreatePinnedToCore(taskEntry, "log", LOG_TASK_STACK, this,
+                                              LOG_TASK_PRIORITY, &taskHandle, LOG_TASK_CORE);
+  if (result != pdPASS) {
+    taskHandle = NULL;
+    return false;
+  }
+  return true;
+}
+
+void LogDrainTask::taskEntry(void *param) {
+  static_cast<LogDrainTask *>(param)->run();
+}
+
+void LogDrainTask::run() {
+  while (true) {
+    Log::drain(out);
+
+    // say so when the ring overflowed, otherwise missing lines are a mystery
+    uint32_t dropped = Log::getDroppedCount();
+    if (dropped != reportedDrops) {
+      char line[48];
+      int n = snprintf(line, sizeof(line), "[log] %lu records dropped\n", (unsigned long)(dropped - reportedDrops));
+      out.write((const uint8_t *)line, n);
+      reportedDrops = dropped;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+  }
+}
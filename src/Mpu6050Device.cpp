@@ -0,0 +1,107 @@
+#include "../include/Mpu6050Device.h"
+
+Mpu6050Device::Mpu6050Device() {
+  i2cAddress = 0x68;
+}
+
+// the DLPF settings the Adafruit driver knows, narrowest one that still passes bandwidthHz
+static mpu6050_bandwidth_t filterBandwidth(uint16_t bandwidthHz) {
+  if (bandwidthHz <= 5) return MPU6050_BAND_5_HZ;
+  if (bandwidthHz <= 10) return MPU6050_BAND_10_HZ;
+  if (bandwidthHz <= 21) return MPU6050_BAND_21_HZ;
+  if (bandwidthHz <= 44) return MPU6050_BAND_44_HZ;
+  if (bandwidthHz <= 94) return MPU6050_BAND_94_HZ;
+  return MPU6050_BAND_184_HZ;
+}
+
+void Mpu6050Device::applyClockAndFilter(const RateProfile &profile) {
+  Wire.setClock(profile.i2cClockHz);
+  mpu.setFilterBandwidth(filterBandwidth(profile.bandwidthHz));
+}
+
+bool Mpu6050Device::begin(const RateProfile &profile) {
+  
+  Wire.begin(SDA_PIN, SCL_PIN);
+  
+  
+  if (!mpu.begin(0x68, &Wire)) {
+    Serial.println("Failed to find MPU6050 at address 0x68, trying 0x69...");
+    
+    if (!mpu.begin(0x69, &Wire)) {
+      Serial.println("Could not find a valid MPU6050 sensor!");
+      return false;
+    } else {
+      Serial.println("MPU6050 found at address 0x69");
+      i2cAddress = 0x69;
+    }
+  } else {
+    Serial.println("MPU6050 found at address 0x68");
+  }
+  
+  // edit the sensor settings
+  mpu.setAccelerometerRange(MPU6050_RANGE_8_G);
+  mpu.setGyroRange(MPU6050_RANGE_500_DEG);
+  applyClockAndFilter(profile);
+
+#if GYRO_USE_FIFO
+  if (!fifo.begin(&Wire, i2cAddress, profile.samplePeriodUs)) {
+    Serial.println("Failed to set up MPU6050 FIFO!");
+    return false;
+  }
+  Serial.println("MPU6050 FIFO burst mode enabled");
+#endif
+  
+  delay(MPU6050_SETTLE_MS); // gyro start-up, before calibration reads anything
+  return true;
+}
+
+bool Mpu6050Device::setRateProfile(const RateProfile &profile) {
+  applyClockAndFilter(profile);
+#if GYRO_USE_FIFO
+  return fifo.setSamplePeriod(profile.samplePeriodUs);
+#else
+  return true; // one reading per poll, the poll period is the rate
+#endif
+}
+
+bool Mpu6050Device::readSample(RawImuSample &out, uint32_t nowUs) {
+  sensors_event_t a, g, temp;
+  if (!mpu.getEvent(&a, &g, &temp)) {
+    return false;
+  }
+
+  // the Adafruit driver already gave us floats, turn them back into counts
+  out.timestampUs = nowUs;
+  out.accelX = (int16_t)lroundf(a.acceleration.x * ACCEL_COUNTS_PER_MS2);
+  out.accelY = (int16_t)lroundf(a.acceleration.y * ACCEL_COUNTS_PER_MS2);
+  out.accelZ = (int16_t)lroundf(a.acceleration.z * ACCEL_COUNTS_PER_MS2);
+  out.gyroX = (int16_t)lroundf(g.gyro.x * (float)RAD_TO_DEG * GYRO_LSB_PER_DPS);
+  out.gyroY = (int16_t)lroundf(g.gyro.y * (float)RAD_TO_DEG * GYRO_LSB_PER_DPS);
+  out.gyroZ = (int16_t)lroundf(g.gyro.z * (float)RAD_TO_DEG * GYRO_LSB_PER_DPS);
+  return true;
+}
+
+size_t Mpu6050Device::readBurst(RawImuSample *out, size_t maxSamples, uint32_t nowUs) {
+#if GYRO_USE_FIFO
+  return fifo.readBurst(out, maxSamples, nowUs);
+#else
+  if (maxSamples == 0) {
+    return 0;
+  }
+  return readSample(out[0], nowUs) ? 1 : 0;
+#endif
+}
+
+void Mpu6050Device::flush() {
+#if GYRO_USE_FIFO
+  fifo.reset();
+#endif
+}
+
+uint32_t Mpu6050Device::getOverflowCount() {
+#if GYRO_USE_FIFO
+  return fifo.getOverflowCount();
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,159 @@
+#include "../include/Mpu6050Fifo.h"
+#include "../include/Log.h"
+
+// The ESP32 Wire driver can only move 128 bytes per transaction, so we read the FIFO
+// in chunks of whole frames that fit into that.
+static const size_t FIFO_FRAMES_PER_READ = 120 / MPU6050_FIFO_FRAME_BYTES;
+
+Mpu6050Fifo::Mpu6050Fifo() {
+  wire = NULL;
+  address = 0;
+  samplePeriodUs = 0;
+  lastTimestampUs = 0;
+  haveTimestamp = false;
+  stampedAny = false;
+  overflowCount = 0;
+}
+
+bool Mpu6050Fifo::begin(TwoWire *wireBus, uint8_t i2cAddress, uint32_t periodUs) {
+  wire = wireBus;
+  address = i2cAddress;
+
+  if (!setSamplePeriod(periodUs)) return false;
+
+  // only the overflow interrupt, so INT_STATUS tells us when we lost data
+  if (!writeRegister(MPU6050_REG_INT_ENABLE, MPU6050_INT_FIFO_OFLOW)) return false;
+
+  // accel + gyro go in the FIFO, temperature stays out
+  if (!writeRegister(MPU6050_REG_FIFO_EN, MPU6050_FIFO_EN_ACCEL | MPU6050_FIFO_EN_XYZG)) return false;
+
+  reset();
+  return true;
+}
+
+bool Mpu6050Fifo::setSamplePeriod(uint32_t periodUs) {
+  // With the DLPF on (anything other than 260Hz) the gyro output rate is 1kHz,
+  // so the divider gives us sample rate = 1kHz / (1 + div)
+  uint32_t divider = periodUs / 1000;
+  if (divider > 0) divider--;
+  if (divider > 255) divider = 255;
+
+  if (!writeRegister(MPU6050_REG_SMPLRT_DIV, (uint8_t)divider)) return false;
+  samplePeriodUs = (divider + 1) * 1000UL;
+
+  // frames still in there were taken at the old rate
+  if (stampedAny) reset();
+  return true;
+}
+
+void Mpu6050Fifo::reset() {
+  writeRegister(MPU6050_REG_USER_CTRL, MPU6050_USER_CTRL_FIFO_RESET);
+  writeRegister(MPU6050_REG_USER_CTRL, MPU6050_USER_CTRL_FIFO_EN);
+
+  // clear a stale overflow flag so it doesn't get counted on the next read
+  uint8_t status;
+  readRegisters(MPU6050_REG_INT_STATUS, &status, 1);
+  haveTimestamp = false;
+}
+
+uint16_t Mpu6050Fifo::available() {
+  uint8_t countBytes[2];
+  if (!readRegisters(MPU6050_REG_FIFO_COUNTH, countBytes, 2)) return 0;
+
+  uint16_t byteCount = ((uint16_t)countBytes[0] << 8) | countBytes[1];
+  return byteCount / MPU6050_FIFO_FRAME_BYTES;
+}
+
+size_t Mpu6050Fifo::readBurst(RawImuSample *out, size_t maxSamples, uint32_t nowUs) {
+  if (wire == NULL) return 0;
+
+  // if the FIFO filled up, the oldest bytes got overwritten and frames are no longer
+  // aligned to 12 bytes, so everything in there is garbage. Start over.
+  if (checkOverflow()) {
+    overflowCount++;
+    LOG_WARN(SENSOR, "MPU6050 FIFO overflow (%lu total) - resetting", (unsigned long)overflowCount);
+    reset();
+    return 0;
+  }
+
+  size_t pending = available();
+  if (pending > maxSamples) pending = maxSamples;
+  if (pending == 0) return 0;
+
+  // The newest frame was taken at roughly nowUs, older ones one period apart before that.
+  // If we are already tracking a timeline we just continue it so timestamps stay evenly spaced,
+  // but snap back to the wall clock if the two drift more than a period apart.
+  uint32_t anchoredFirstUs = nowUs - (uint32_t)(pending - 1) * samplePeriodUs;
+  uint32_t firstUs = anchoredFirstUs;
+  if (haveTimestamp) {
+    uint32_t continuedUs = lastTimestampUs + samplePeriodUs;
+    int32_t drift = (int32_t)(continuedUs - anchoredFirstUs);
+    if (drift <= (int32_t)samplePeriodUs && drift >= -(int32_t)samplePeriodUs) {
+      firstUs = continuedUs;
+    }
+  } else if (stampedAny && (int32_t)(firstUs - lastTimestampUs) <= 0) {
+    // first frames after a reset (rate change): never older than the last ones handed out
+    firstUs = lastTimestampUs + samplePeriodUs;
+  }
+
+  uint8_t frames[FIFO_FRAMES_PER_READ * MPU6050_FIFO_FRAME_BYTES];
+  size_t done = 0;
+
+  while (done < pending) {
+    size_t chunk = pending - done;
+    if (chunk > FIFO_FRAMES_PER_READ) chunk = FIFO_FRAMES_PER_READ;
+
+    if (!readRegisters(MPU6050_REG_FIFO_R_W, frames, chunk * MPU6050_FIFO_FRAME_BYTES)) {
+      break;
+    }
+
+    for (size_t i = 0; i < chunk; i++) {
+      const uint8_t *f = &frames[i * MPU6050_FIFO_FRAME_BYTES];
+      RawImuSample &s = out[done + i];
+      s.accelX = (int16_t)((f[0] << 8) | f[1]);
+      s.accelY = (int16_t)((f[2] << 8) | f[3]);
+      s.accelZ = (int16_t)((f[4] << 8) | f[5]);
+      s.gyroX  = (int16_t)((f[6] << 8) | f[7]);
+      s.gyroY  = (int16_t)((f[8] << 8) | f[9]);
+      s.gyroZ  = (int16_t)((f[10] << 8) | f[11]);
+      s.timestampUs = firstUs + (uint32_t)(done + i) * samplePeriodUs;
+    }
+    done += chunk;
+  }
+
+  if (done > 0) {
+    lastTimestampUs = out[done - 1].timestampUs;
+    haveTimestamp = true;
+    stampedAny = true;
+  }
+  return done;
+}
+
+uint32_t Mpu6050Fifo::getOverflowCount() const {
+  return overflowCount;
+}
+
+bool Mpu6050Fifo::writeRegister(uint8_t reg, uint8_t value) {
+  wire->beginTransmission(address);
+  wire->write(reg);
+  wire->write(value);
+  return wire->endTransmission() == 0;
+}
+
+bool Mpu6050Fifo::readRegisters(uint8_t reg, uint8_t *buffer, size_t length) {
+  wire->beginTransmission(address);
+  wire->write(reg);
+  if (wire->endTransmission(false) != 0) return false;
+
+  if (wire->requestFrom(address, length) != length) return false;
+  for (size_t i = 0; i < length; i++) {
+    buffer[i] = wire->read();
+  }
+  return true;
+}
+
+bool Mpu6050Fifo::checkOverflow() {
+  uint8_t status = 0;
+  if (!readRegisters(MPU6050_REG_INT_STATUS, &status, 1)) return false;
+  return (status & MPU6050_INT_FIFO_OFLOW) != 0;
+}
@@ -1,339 +1,415 @@
 #include "../include/NetworkManager.h"
-#include <WiFiClientSecure.h>
+#include "../include/Profiler.h"
+#include "../include/Log.h"
 
-NetworkManager::NetworkManager() {
+NetworkManager::NetworkManager(HttpTransport &httpTransport) : transport(httpTransport) {
   isConnected = false;
   lastDataSendTime = 0;
   authToken = ""; // Initialize authToken
+  registered = false;
+  sessionLoaded = false;
+  store = NULL;
+}
+
+uint32_t NetworkManager::getRequestCount() {
+  return transport.getRequestCount();
+}
+
+uint32_t NetworkManager::getHandshakeCount() {
+  return transport.getHandshakeCount();
+}
+
+// Every POST carries the same two headers, the body comes straight out of payloadBuffer
+int NetworkManager::postPayload(const char *url, const TelemetryWriter &writer, String *response) {
+  String authorization = "Bearer " + authToken;
+  HttpHeader headers[] = {
+    { "Content-Type", writer.contentType() },
+    { "Authorization", authorization.c_str() }
+  };
+  return transport.request("POST", url, headers, 2, writer.data(), writer.size(), response);
 }
 
 // ---- NEW METHOD IMPLEMENTATION ----
 bool NetworkManager::fetchAuthToken() {
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("FetchAuthToken: WiFi not connected.");
+  if (!transport.isConnected()) {
+    LOG_WARN(NET, "FetchAuthToken: WiFi not connected.");
     return false;
   }
 
-  // Switch to WiFiClientSecure
-  WiFiClientSecure *client = new WiFiClientSecure;
-  client->setInsecure(); // Insecure HTTPS (accepts all certificates)
-
-  HTTPClient http;
-  // Use client for HTTPS connection
-  http.begin(*client, GET_TOKEN_ENDPOINT); 
-
-  http.setTimeout(15000);
-  http.setConnectTimeout(10000);
+  LOG_INFO(NET, "Fetching auth token from: " GET_TOKEN_ENDPOINT);
   
-  Serial.print("Fetching auth token from: ");
-  Serial.println(GET_TOKEN_ENDPOINT);
-  
-  int httpResponseCode = http.GET();
-  Serial.print("HTTP Response Code: ");
-  Serial.println(httpResponseCode);
-
-  if (httpResponseCode == 200) {
-    authToken = http.getString();
-    Serial.print("Auth token received: ");
-    Serial.println(authToken);
-    http.end();
-    delete client;
-    return (authToken.length() > 0);
+  String response;
+  int httpResponseCode = transport.request("GET", GET_TOKEN_ENDPOINT, NULL, 0, NULL, 0, &response);
+
+  if (httpResponseCode == HTTP_STATUS_OK && response.length() > 0) {
+    authToken = response;
+    LOG_INFO(NET, "Auth token received (%u characters)", (unsigned)authToken.length());
+    saveAuthToken();
+    return true;
   } else if (httpResponseCode > 0) {
-    Serial.print("Server error. HTTP Code: ");
-    Serial.println(httpResponseCode);
-    String response = http.getString();
-    Serial.print("Response: ");
-    Serial.println(response);
+    LOG_ERROR(NET, "Server error. HTTP Code: %d Response: %s", httpResponseCode, response);
   } else {
-    Serial.print("Connection error. HTTP Code: ");
-    Serial.println(httpResponseCode);
-    Serial.print("Error details: ");
-    Serial.println(http.errorToString(httpResponseCode).c_str());
+    LOG_ERROR(NET, "Connection error. HTTP Code: %d (%s)", httpResponseCode, transport.errorToString(httpResponseCode));
   }
-  http.end();
-  delete client;
   return false;
 }
 // ---- END NEW METHOD ----
 
+void NetworkManager::setStore(KeyValueStore *kvStore) {
+  store = kvStore;
+}
+
+// Token and registration from the last time this device got them, read once per boot
+// before the first request needs a token. Only the network task calls this, so the
+// buffer can be static instead of 1KB of its stack.
+void NetworkManager::loadSession() {
+  static char token[AUTH_TOKEN_MAX + 1];
+  if (sessionLoaded || store == NULL || !authToken.isEmpty()) {
+    return;
+  }
+  sessionLoaded = true;
+  size_t length = store->get(SESSION_TOKEN_KEY, token, AUTH_TOKEN_MAX);
+  if (length == 0) {
+    return;
+  }
+  token[length] = '\0';
+  authToken = token;
+
+  uint8_t flag = 0;
+  registered = store->get(SESSION_REGISTERED_KEY, &flag, sizeof(flag)) == sizeof(flag) && flag == 1;
+  LOG_INFO(NET, "Auth token restored from NVS%s", registered ? ", device already registered" : "");
+}
+
+// A new token has to be registered again. The flag goes first, so a reset in between
+// can only cost an extra registration, never skip one.
+void NetworkManager::saveAuthToken() {
+  registered = false;
+  if (store == NULL) {
+    return;
+  }
+  store->remove(SESSION_REGISTERED_KEY);
+  if (authToken.length() > AUTH_TOKEN_MAX || !store->put(SESSION_TOKEN_KEY, authToken.c_str(), authToken.length())) {
+    store->remove(SESSION_TOKEN_KEY);
+  }
+}
+
+// The server turned the token down, fetch (and register) a new one next time
+void NetworkManager::dropAuthToken() {
+  authToken = "";
+  registered = false;
+  if (store != NULL) {
+    store->remove(SESSION_REGISTERED_KEY);
+    store->remove(SESSION_TOKEN_KEY);
+  }
+}
+
+bool NetworkManager::hasSession() {
+  return !authToken.isEmpty() && registered;
+}
+
+// Safe to call again: whatever is already done (link up, token, registration) is skipped
 bool NetworkManager::initialize() {
-  Serial.println("Initializing WiFi connection...");
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
+  if (!transport.connect(NETWORK_CONNECT_TIMEOUT_MS)) {
+    isConnected = false;
+    return false;
   }
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi connected!");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-    isConnected = true;
-
-    Serial.println("Attempting to fetch authentication token...");
-    if (fetchAuthToken()) {
-      Serial.println("Auth token fetched successfully. Attempting to register device...");
-      if (registerDeviceInternal()) {
-        Serial.println("Device registered successfully.");
-        return true;
-      } else {
-        Serial.println("Device registration failed after fetching token.");
-        return false;
-      }
-    } else {
-      Serial.println("Failed to fetch auth token. Cannot proceed with registration.");
-      return false;
-    }
-  } else {
-    Serial.println("\nWiFi connection failed!");
-    isConnected = false; 
+  isConnected = true;
+
+  loadSession();
+  if (authToken.isEmpty() && !fetchAuthToken()) {
+    LOG_ERROR(NET, "Failed to fetch auth token. Cannot proceed with registration.");
     return false;
   }
+  if (registered) {
+    return true;
+  }
+
+  if (registerDeviceInternal()) {
+    LOG_INFO(NET, "Device registered successfully.");
+    return true;
+  }
+  LOG_ERROR(NET, "Device registration failed.");
+  return false;
 }
 
 void NetworkManager::reconnect() {
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("Reconnecting to WiFi...");
-    WiFi.disconnect();
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-    
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 10) {
-      delay(500);
-      Serial.print(".");
-      attempts++;
-    }
-    
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.println("\nWiFi reconnected!");
-      isConnected = true;
-    } else {
-      isConnected = false;
-    }
+  if (!transport.isConnected()) {
+    isConnected = transport.connect(5000);
+  }
+}
+
+// Only transport errors and answers that say "not now" are worth keeping the data for.
+// Any other 4xx comes back exactly the same on every replay.
+SendResult NetworkManager::resultOf(int httpResponseCode) {
+  if (httpResponseCode == HTTP_STATUS_OK || httpResponseCode == HTTP_STATUS_CREATED) {
+    return SEND_OK;
+  }
+  if (httpResponseCode <= 0 || httpResponseCode >= HTTP_STATUS_SERVER_ERROR ||
+      httpResponseCode == HTTP_STATUS_REQUEST_TIMEOUT || httpResponseCode == HTTP_STATUS_TOO_MANY_REQUESTS) {
+    return SEND_RETRY;
   }
+  return SEND_REJECTED;
+}
+
+// The server turned the token down: get a new one and register it, true = send again
+bool NetworkManager::reauthenticate() {
+  dropAuthToken();
+  return fetchAuthToken() && registerDeviceInternal();
 }
 
-bool NetworkManager::sendSensorData(float accel, float gyro, bool fallDetected) {
+SendResult NetworkManager::sendSensorData(float accel, float gyro, bool fallDetected, uint32_t timestampMs) {
+  PROFILE_SCOPE_LONG("net.sendData");
   // Record time since last transmission for debugging
   unsigned long now = millis();
+  // replayed records keep the time they actually happened
+  unsigned long eventTime = timestampMs != 0 ? timestampMs : now;
   unsigned long elapsed = now - lastDataSendTime;
   
   // Show transmission frequency info
   if (fallDetected) {
-    Serial.println("FALL DETECTED - Sending emergency data immediately!");
+    LOG_WARN(NET, "FALL DETECTED - Sending emergency data immediately!");
   } else {
-    Serial.print("Sending data - Time since last transmission: ");
-    Serial.print(elapsed);
-    Serial.println(" ms");
+    LOG_DEBUG(NET, "Sending data - Time since last transmission: %lu ms", elapsed);
   }
   
-  if (WiFi.status() != WL_CONNECTED) {
+  if (!transport.isConnected()) {
     reconnect();
-    if (WiFi.status() != WL_CONNECTED) {
-      Serial.println("SendSensorData: WiFi not connected.");
-      return false;
+    if (!transport.isConnected()) {
+      LOG_WARN(NET, "SendSensorData: WiFi not connected.");
+      return SEND_RETRY;
     }
   }
 
+  loadSession();
   if (authToken.isEmpty()) {
-    Serial.println("SendSensorData: Auth token is missing. Attempting to fetch...");
+    LOG_INFO(NET, "SendSensorData: Auth token is missing. Attempting to fetch...");
     if (!fetchAuthToken()) {
-      Serial.println("SendSensorData: Failed to re-fetch auth token.");
-      return false;
+      LOG_ERROR(NET, "SendSensorData: Failed to re-fetch auth token.");
+      return SEND_RETRY;
     }
   }
 
-  // Create client and http objects
-  WiFiClientSecure *client = new WiFiClientSecure;
-  client->setInsecure();
+  // a second attempt only after a refused token was replaced
+  for (int attempt = 0; ; attempt++) {
+    // Encode straight into the preallocated buffer, no JsonDocument or String. Again on
+    // the second attempt: the registration in between used the same buffer.
+    TelemetryWriter writer(payloadBuffer, sizeof(payloadBuffer), TELEMETRY_FORMAT);
+    TelemetryPayload::sensorData(writer, accel, gyro, fallDetected, eventTime);
+    if (writer.overflowed()) {
+      LOG_ERROR(NET, "SendSensorData: payload buffer too small");
+      return SEND_REJECTED;
+    }
 
-  HTTPClient http;
-  http.begin(*client, API_ENDPOINT);
-  http.setTimeout(15000); // Increase timeout for Azure
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Authorization", "Bearer " + authToken);
+    LOG_DEBUG(NET, "Payload size: %u bytes (%s)", (unsigned)writer.size(), writer.contentType());
+    // Goes out over the shared keep-alive connection
+    String response;
+    int httpResponseCode = postPayload(API_ENDPOINT, writer, &response);
 
-  // Build JSON payload
+    if (httpResponseCode <= 0) {
+      LOG_ERROR(NET, "Error on sending POST: %d (%s)", httpResponseCode, transport.errorToString(httpResponseCode));
+      return SEND_RETRY;
+    }
+    if (fallDetected) {
+      LOG_WARN(NET, "EMERGENCY DATA SENT! HTTP Response code: %d", httpResponseCode);
+    } else {
+      LOG_INFO(NET, "Data sent. HTTP Response code: %d", httpResponseCode);
+    }
+    // only the start of the body fits in a log record
+    LOG_DEBUG(NET, "Server Response: %s", response);
+    // Update last send time
+    lastDataSendTime = now;
 
-  Serial.print("Creating JSON with fallDetected = ");
-  Serial.println(fallDetected ? "true" : "false");
-  StaticJsonDocument<768> jsonDoc;
-  jsonDoc["deviceId"] = DEVICE_ID;
-  jsonDoc["accel"] = accel;
-  jsonDoc["gyro"] = gyro;
-  jsonDoc["fallDetected"] = fallDetected;
-  jsonDoc["timestamp"] = now;  // Use the timestamp we captured at the start
+    bool authRefused = httpResponseCode == HTTP_STATUS_UNAUTHORIZED || httpResponseCode == HTTP_STATUS_FORBIDDEN;
+    if (authRefused && attempt == 0) {
+      LOG_WARN(NET, "SendSensorData: token refused (HTTP %d), authenticating again", httpResponseCode);
+      if (!reauthenticate()) {
+        return SEND_RETRY;
+      }
+      continue;
+    }
+    if (authRefused) {
+      // refused with a fresh token too: an account problem, not this record's fault
+      dropAuthToken();
+      return SEND_RETRY;
+    }
+    SendResult result = resultOf(httpResponseCode);
+    if (result == SEND_REJECTED) {
+      LOG_ERROR(NET, "SendSensorData: server rejected the data (HTTP %d), dropping it", httpResponseCode);
+    }
+    return result;
+  }
+}
+
+SendResult NetworkManager::sendSensorBatch(const TelemetrySample *samples, size_t count) {
+  PROFILE_SCOPE_LONG("net.sendBatch");
+  if (count == 0) {
+    return SEND_OK;
+  }
 
+  unsigned long now = millis();
 
-  if(fallDetected) {
-  jsonDoc["emergencyType"] = "FALL_DETECTED";
-  jsonDoc["severity"] = "HIGH";
-  jsonDoc["requiresResponse"] = true;
-  jsonDoc["alertMessage"] = "Fall detected - immediate assistance may be required";
+  if (!transport.isConnected()) {
+    reconnect();
+    if (!transport.isConnected()) {
+      LOG_WARN(NET, "SendSensorBatch: WiFi not connected.");
+      return SEND_RETRY;
+    }
+  }
 
-    JsonObject dataJson = jsonDoc.createNestedObject("dataJson");
-  dataJson["accel"] = accel;
-  dataJson["gyro"] = gyro;
-  dataJson["deviceId"] = DEVICE_ID;
-  dataJson["detectionTime"] = now;
-  
+  loadSession();
+  if (authToken.isEmpty()) {
+    LOG_INFO(NET, "SendSensorBatch: Auth token is missing. Attempting to fetch...");
+    if (!fetchAuthToken()) {
+      LOG_ERROR(NET, "SendSensorBatch: Failed to re-fetch auth token.");
+      return SEND_RETRY;
+    }
   }
-  String jsonString;
-  serializeJson(jsonDoc, jsonString);
 
+  for (int attempt = 0; ; attempt++) {
+    // the whole window is encoded in place, one array of {t, accel, gyro}
+    TelemetryWriter writer(payloadBuffer, sizeof(payloadBuffer), TELEMETRY_FORMAT);
+    TelemetryPayload::sensorBatch(writer, samples, count);
+    if (writer.overflowed()) {
+      LOG_ERROR(NET, "SendSensorBatch: payload buffer too small for this batch");
+      return SEND_REJECTED;
+    }
 
-   Serial.print("JSON payload size: ");
-  Serial.println(jsonString.length());
-  Serial.print("JSON content: ");
-  Serial.println(jsonString);
-  // Send the data
-  int httpResponseCode = http.POST(jsonString);
+    LOG_DEBUG(NET, "Sending batch of %u samples (%u bytes %s) - %lu ms since last transmission",
+              (unsigned)count, (unsigned)writer.size(), writer.contentType(), now - lastDataSendTime);
 
-  if (httpResponseCode > 0) {
-    String response = http.getString();
-    if (fallDetected) {
-      Serial.print("EMERGENCY DATA SENT! HTTP Response code: ");
-    } else {
-      Serial.print("Data sent. HTTP Response code: ");
+    int httpResponseCode = postPayload(API_BATCH_ENDPOINT, writer, NULL);
+
+    if (httpResponseCode <= 0) {
+      LOG_ERROR(NET, "Error on sending batch POST: %d (%s)", httpResponseCode, transport.errorToString(httpResponseCode));
+      return SEND_RETRY;
     }
-    Serial.println(httpResponseCode);
-    
-    Serial.println("Server Response: " + response);
-    // Update last send time
+    LOG_DEBUG(NET, "Batch sent. HTTP Response code: %d (%lu requests, %lu TLS handshakes so far)",
+              httpResponseCode, (unsigned long)getRequestCount(), (unsigned long)getHandshakeCount());
     lastDataSendTime = now;
-    http.end();
-    delete client;
-    return (httpResponseCode == 200 || httpResponseCode == 201);
-  } else {
-    Serial.println("Error on sending POST: " + String(httpResponseCode));
-    Serial.print("sendSensorData: HTTPC error: ");
-    Serial.println(http.errorToString(httpResponseCode).c_str());
-    if (httpResponseCode == HTTP_CODE_UNAUTHORIZED || httpResponseCode == HTTP_CODE_FORBIDDEN) {
-      authToken = "";
+
+    bool authRefused = httpResponseCode == HTTP_STATUS_UNAUTHORIZED || httpResponseCode == HTTP_STATUS_FORBIDDEN;
+    if (authRefused && attempt == 0) {
+      LOG_WARN(NET, "SendSensorBatch: token refused (HTTP %d), authenticating again", httpResponseCode);
+      if (!reauthenticate()) {
+        return SEND_RETRY;
+      }
+      continue;
     }
-    http.end();
-    delete client;
-    return false;
+    if (authRefused) {
+      // refused with a fresh token too: an account problem, not this record's fault
+      dropAuthToken();
+      return SEND_RETRY;
+    }
+    SendResult result = resultOf(httpResponseCode);
+    if (result == SEND_REJECTED) {
+      LOG_ERROR(NET, "SendSensorBatch: server rejected the batch (HTTP %d), dropping it", httpResponseCode);
+    }
+    return result;
   }
 }
 
 bool NetworkManager::registerDeviceInternal() {
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("RegisterDeviceInternal: WiFi not connected.");
+  if (!transport.isConnected()) {
+    LOG_WARN(NET, "RegisterDeviceInternal: WiFi not connected.");
     return false; 
   }
   if (authToken.isEmpty()) {
-    Serial.println("RegisterDeviceInternal: Auth token is missing.");
+    LOG_WARN(NET, "RegisterDeviceInternal: Auth token is missing.");
     return false;
   }
 
-  WiFiClientSecure *client = new WiFiClientSecure;
-  client->setInsecure();
-
-  HTTPClient http;
-  http.begin(*client, REGISTER_ENDPOINT);
-  http.setTimeout(15000); // Increase timeout for Azure
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Authorization", "Bearer " + authToken);
-
-  StaticJsonDocument<768> jsonDoc;
-  jsonDoc["deviceId"] = DEVICE_ID;
-  jsonDoc["platform"] = "ESP32";
-  jsonDoc["deviceName"] = "ESP32";
-  jsonDoc["token"] = authToken;
-
-  String jsonString;
-  serializeJson(jsonDoc, jsonString);
+  TelemetryWriter writer(payloadBuffer, sizeof(payloadBuffer), TELEMETRY_FORMAT);
+  TelemetryPayload::registration(writer, authToken.c_str());
+  if (writer.overflowed()) {
+    LOG_ERROR(NET, "RegisterDeviceInternal: payload buffer too small");
+    return false;
+  }
 
-  Serial.print("Registering device with payload: ");
-  Serial.println(jsonString);
+  LOG_INFO(NET, "Registering device (%u byte payload)", (unsigned)writer.size());
 
-  int httpResponseCode = http.POST(jsonString);
+  String response;
+  int httpResponseCode = postPayload(REGISTER_ENDPOINT, writer, &response);
 
   if (httpResponseCode > 0) {
-    Serial.println("Device registration HTTP Response code: " + String(httpResponseCode));
-    Serial.println("Response: " + http.getString());
-    http.end();
-    delete client;
-    return (httpResponseCode == HTTP_CODE_OK || httpResponseCode == HTTP_CODE_CREATED);
-  } else {
-    Serial.println("Error on device registration: " + String(httpResponseCode));
-    Serial.print("registerDeviceInternal: HTTPC error: ");
-    Serial.println(http.errorToString(httpResponseCode).c_str());
-    if (httpResponseCode == HTTP_CODE_UNAUTHORIZED || httpResponseCode == HTTP_CODE_FORBIDDEN) {
-      authToken = "";
+    LOG_INFO(NET, "Device registration HTTP Response code: %d", httpResponseCode);
+    LOG_DEBUG(NET, "Response: %s", response);
+    if (httpResponseCode == HTTP_STATUS_UNAUTHORIZED || httpResponseCode == HTTP_STATUS_FORBIDDEN) {
+      dropAuthToken();
+      return false;
+    }
+    if (httpResponseCode != HTTP_STATUS_OK && httpResponseCode != HTTP_STATUS_CREATED) {
+      return false;
+    }
+    // remembered for this token, later boots go straight to sending
+    registered = true;
+    uint8_t flag = 1;
+    if (store != NULL) {
+      store->put(SESSION_REGISTERED_KEY, &flag, sizeof(flag));
     }
-    http.end();
-    delete client;
+    return true;
+  } else {
+    LOG_ERROR(NET, "Error on device registration: %d (%s)", httpResponseCode, transport.errorToString(httpResponseCode));
     return false;
   }
 }
 
-
-
-bool NetworkManager::fetchDeviceConfig() {
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("FetchDeviceConfig: WiFi not connected.");
+// Conditional GET: with the ETag of the config we have, an unchanged config comes back
+// as an empty 304 and nothing is parsed or written to flash
+bool NetworkManager::fetchDeviceConfig(DeviceConfig &config) {
+  if (!transport.isConnected()) {
+    LOG_WARN(NET, "FetchDeviceConfig: WiFi not connected.");
     return false;
   }
 
+  loadSession();
   if (authToken.isEmpty()) {
-    Serial.println("FetchDeviceConfig: Auth token is missing. Attempting to fetch...");
+    LOG_INFO(NET, "FetchDeviceConfig: Auth token is missing. Attempting to fetch...");
     if (!fetchAuthToken()) {
-      Serial.println("FetchDeviceConfig: Failed to fetch auth token.");
+      LOG_ERROR(NET, "FetchDeviceConfig: Failed to fetch auth token.");
       return false;
     }
   }
 
-  // Create secure client
-  WiFiClientSecure *client = new WiFiClientSecure;
-  client->setInsecure(); // Accept any certificate
-
-  HTTPClient http;
-  
   String configUrl = String(GET_DEVICE_CONFIG_ENDPOINT) + DEVICE_ID;
-  Serial.print("Fetching device configuration from: ");
-  Serial.println(configUrl);
-  
-  http.begin(*client, configUrl);
-  http.addHeader("Authorization", "Bearer " + authToken);
-  http.setTimeout(15000); // Increase timeout for Azure
-  
-  int httpResponseCode = http.GET();
-  
-  if (httpResponseCode == 200) {
-    String response = http.getString();
-    Serial.println("Device configuration received:");
-    Serial.println(response);
-    
-    // Parse configuration
-    StaticJsonDocument<1024> configDoc;
-    DeserializationError error = deserializeJson(configDoc, response);
-    
-    if (!error) {
-      // Apply configuration settings
-      // Example: float fallThreshold = configDoc["fallDetectionSensitivity"];
-      http.end();
-      delete client;
-      return true;
-    } else {
-      Serial.print("JSON parsing error: ");
-      Serial.println(error.c_str());
+  String authorization = "Bearer " + authToken;
+  String etag = config.getEtag();
+  HttpHeader headers[] = {
+    { "Authorization", authorization.c_str() },
+    { "If-None-Match", etag.c_str() }
+  };
+  HttpResponseHeader responseHeaders[] = {
+    { "ETag", String() }
+  };
+  String response;
+  int httpResponseCode = transport.request("GET", configUrl.c_str(), headers, etag.isEmpty() ? 1 : 2, NULL, 0,
+                                           &response, responseHeaders, 1);
+
+  if (httpResponseCode == HTTP_STATUS_NOT_MODIFIED) {
+    LOG_DEBUG(NET, "Device configuration unchanged (%s)", etag);
+    return true;
+  }
+
+  if (httpResponseCode == HTTP_STATUS_OK) {
+    DeviceSettings settings;
+    if (!DeviceConfig::parse(response.c_str(), response.length(), settings)) {
+      LOG_ERROR(NET, "Device configuration rejected, keeping the current one");
+      return false;
     }
+    uint32_t version = config.getVersion();
+    config.apply(settings, responseHeaders[0].value.c_str());
+    LOG_INFO(NET, "Device configuration %s (%u bytes, ETag %s)",
+             config.getVersion() != version ? "applied" : "unchanged",
+             (unsigned)response.length(), responseHeaders[0].value);
+    return true;
+  }
+
+  if (httpResponseCode == HTTP_STATUS_UNAUTHORIZED || httpResponseCode == HTTP_STATUS_FORBIDDEN) {
+    dropAuthToken();
+  }
+  if (httpResponseCode > 0) {
+    LOG_ERROR(NET, "Error fetching configuration. HTTP Code: %d", httpResponseCode);
   } else {
-    Serial.print("Error fetching configuration. HTTP Code: ");
-    Serial.println(httpResponseCode);
-    if (httpResponseCode > 0) {
-      String response = http.getString();
-      Serial.println(response);
-    }
+    LOG_ERROR(NET, "Error fetching configuration: %d (%s)", httpResponseCode, transport.errorToString(httpResponseCode));
   }
-  
-  http.end();
-  delete client;
   return false;
-}
\ No newline at end of file
+}
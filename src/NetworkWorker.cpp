@@ -0,0 +1,284 @@
+#include "../include/NetworkWorker.h"
+#include "../include/BootTimeline.h"
+#include "../include/Log.h"
+
+NetworkWorker::NetworkWorker(NetworkManager &manager) : networkManager(manager) {
+  queue = NULL;
+  taskHandle = NULL;
+  callback = NULL;
+  callbackContext = NULL;
+  busy = false;
+  failedCount = 0;
+  store = NULL;
+  deviceConfig = NULL;
+  nextConfigFetchMs = 0;
+  nextSessionAttemptMs = 0;
+  sessionRetryMs = NETWORK_SESSION_RETRY_MS;
+}
+
+bool NetworkWorker::start() {
+  if (taskHandle != NULL) {
+    return true;
+  }
+
+  queue = xQueueCreate(NETWORK_QUEUE_LENGTH, sizeof(NetworkRequest));
+  if (queue == NULL) {
+    LOG_ERROR(NET, "NetworkWorker: could not allocate request queue");
+    return false;
+  }
+
+  BaseType_t result = xTaskCreatePinnedToCore(taskEntry, "network", NETWORK_TASK_STACK, this,
+                                              NETWORK_TASK_PRIORITY, &taskHandle, NETWORK_TASK_CORE);
+  if (result != pdPASS) {
+    LOG_ERROR(NET, "NetworkWorker: failed to start task");
+    taskHandle = NULL;
+    return false;
+  }
+
+  // session bring-up and the first config refresh as soon as the task runs
+  nextSessionAttemptMs = millis();
+  nextConfigFetchMs = millis();
+  LOG_INFO(NET, "Network worker started");
+  return true;
+}
+
+bool NetworkWorker::submitBatch(const TelemetrySample *samples, size_t count) {
+  if (queue == NULL || count == 0) {
+    return false;
+  }
+
+  // leave the last slot for a fall alert
+  if (uxQueueSpacesAvailable(queue) <= 1) {
+    return false;
+  }
+
+  // build the request in a static so loop() doesn't need 1KB+ of stack for it.
+  // Only loop() submits, so there is no second writer.
+  static NetworkRequest request;
+  if (count > TELEMETRY_BATCH_CAPACITY) count = TELEMETRY_BATCH_CAPACITY;
+  request.type = NET_REQUEST_BATCH;
+  request.accel = 0;
+  request.gyro = 0;
+  request.sampleCount = count;
+  memcpy(request.samples, samples, count * sizeof(TelemetrySample));
+
+  return xQueueSend(queue, &request, 0) == pdTRUE;
+}
+
+bool NetworkWorker::submitFallAlert(float accel, float gyro) {
+  if (queue == NULL) {
+    return false;
+  }
+
+  static NetworkRequest request;
+  request.type = NET_REQUEST_FALL_ALERT;
+  request.accel = accel;
+  request.gyro = gyro;
+  request.sampleCount = 0;
+
+  // alerts go before any telemetry that is still waiting
+  return xQueueSendToFront(queue, &request, 0) == pdTRUE;
+}
+
+void NetworkWorker::setCallback(NetworkCallback cb, void *context) {
+  callback = cb;
+  callbackContext = context;
+}
+
+void NetworkWorker::setStore(TelemetryStore *telemetryStore) {
+  store = telemetryStore;
+}
+
+void NetworkWorker::setDeviceConfig(DeviceConfig *config) {
+  deviceConfig = config;
+}
+
+size_t NetworkWorker::pendingCount() {
+  if (queue == NULL) {
+    return 0;
+  }
+  return uxQueueMessagesWaiting(queue);
+}
+
+bool NetworkWorker::isBusy() {
+  return busy;
+}
+
+uint32_t NetworkWorker::getFailedCount() {
+  return failedCount;
+}
+
+void NetworkWorker::taskEntry(void *param) {
+  static_cast<NetworkWorker *>(param)->run();
+}
+
+void NetworkWorker::run() {
+  while (true) {
+    bringUpIfDue();
+    refreshConfigIfDue();
+
+    // with a backlog in flash, wake up now and then to retry it even if nobody submits
+    TickType_t wait = (store != NULL && store->hasPending()) ? pdMS_TO_TICKS(NETWORK_REPLAY_INTERVAL_MS) : portMAX_DELAY;
+    if (!networkManager.hasSession()) {
+      wait = waitUntil(nextSessionAttemptMs, wait);
+    } else if (deviceConfig != NULL) {
+      wait = waitUntil(nextConfigFetchMs, wait);
+    }
+
+    if (xQueueReceive(queue, &current, wait) != pdTRUE) {
+      busy = true;
+      replayStored();
+      busy = false;
+      continue;
+    }
+
+    busy = true;
+    NetworkResult result = handle(current);
+
+    // a request just went through, so the link is up - good moment to catch up
+    if (result != NET_RESULT_FAILED && store != NULL && store->hasPending()) {
+      replayStored();
+    }
+    busy = false;
+
+    if (result == NET_RESULT_FAILED) {
+      failedCount++;
+    }
+    if (callback != NULL) {
+      callback(current.type, result, callbackContext);
+    }
+  }
+}
+
+NetworkResult NetworkWorker::handle(const NetworkRequest &request) {
+  if (request.type == NET_REQUEST_FALL_ALERT) {
+    uint32_t alertTimeMs = millis();
+
+    // an alert is worth waiting for, we are not blocking anyone here
+    for (int attempt = 0; attempt < NETWORK_ALERT_RETRIES; attempt++) {
+      SendResult sent = networkManager.sendSensorData(request.accel, request.gyro, true, alertTimeMs);
+      if (sent == SEND_OK) {
+        return NET_RESULT_SENT;
+      }
+      if (sent == SEND_REJECTED) {
+        // not kept in flash, where it would block the replay; loop() offers it again
+        return NET_RESULT_FAILED;
+      }
+      LOG_WARN(NET, "NetworkWorker: fall alert attempt %d failed, retrying", attempt + 1);
+      vTaskDelay(pdMS_TO_TICKS(NETWORK_ALERT_RETRY_DELAY_MS));
+    }
+
+    if (store != NULL && store->appendAlert(request.accel, request.gyro, alertTimeMs)) {
+      LOG_WARN(NET, "NetworkWorker: fall alert saved to flash for later");
+      return NET_RESULT_STORED;
+    }
+    return NET_RESULT_FAILED;
+  }
+
+  // older windows are still waiting in flash, queue behind them so the server gets
+  // everything in order
+  if (store != NULL && store->hasPendingBatches()) {
+    return store->appendBatch(request.samples, request.sampleCount) ? NET_RESULT_STORED : NET_RESULT_FAILED;
+  }
+
+  SendResult sent = networkManager.sendSensorBatch(request.samples, request.sampleCount);
+  if (sent == SEND_OK) {
+    return NET_RESULT_SENT;
+  }
+  if (sent == SEND_REJECTED) {
+    return NET_RESULT_FAILED;
+  }
+
+  if (store != NULL && store->appendBatch(request.samples, request.sampleCount)) {
+    return NET_RESULT_STORED;
+  }
+  return NET_RESULT_FAILED;
+}
+
+void NetworkWorker::replayStored() {
+  if (store == NULL) {
+    return;
+  }
+
+  uint32_t replayed = 0;
+  uint32_t rejected = 0;
+
+  // back to back over the kept-alive connection, but give way as soon as something
+  // new is queued so a fresh alert is never stuck behind the backlog
+  while (store->hasPending() && uxQueueMessagesWaiting(queue) == 0) {
+    if (!store->peekNext(replayRecord)) {
+      break;
+    }
+
+    SendResult sent;
+    if (replayRecord.type == STORED_FALL_ALERT) {
+      sent = networkManager.sendSensorData(replayRecord.accel, replayRecord.gyro, true, replayRecord.timestampMs);
+    } else {
+      sent = networkManager.sendSensorBatch(replayRecord.samples, replayRecord.sampleCount);
+    }
+
+    if (sent == SEND_RETRY) {
+      break;
+    }
+    // a rejected record is dropped too, else it would sit at the head of the log for good
+    store->consumeNext();
+    if (sent == SEND_OK) {
+      replayed++;
+    } else {
+      rejected++;
+    }
+  }
+
+  if (rejected > 0) {
+    LOG_WARN(NET, "NetworkWorker: server rejected %lu stored records, dropped", (unsigned long)rejected);
+  }
+  if (replayed > 0) {
+    LOG_INFO(NET, "NetworkWorker: replayed %lu stored records%s", (unsigned long)replayed,
+             store->hasPending() ? ", more left" : "");
+  }
+}
+
+// How long the queue wait may be so we are back by dueMs
+TickType_t NetworkWorker::waitUntil(uint32_t dueMs, TickType_t wait) {
+  int32_t remainingMs = (int32_t)(dueMs - millis());
+  TickType_t untilDue = remainingMs > 0 ? pdMS_TO_TICKS(remainingMs) : 0;
+  return untilDue < wait ? untilDue : wait;
+}
+
+// WiFi, auth token and registration, done here so setup() never waits for them. A known
+// device has the token and registration in NVS and only needs the link. Queued requests
+// go first, they bring the link up themselves if they have to.
+void NetworkWorker::bringUpIfDue() {
+  if (networkManager.hasSession() || uxQueueMessagesWaiting(queue) > 0 ||
+      (int32_t)(millis() - nextSessionAttemptMs) < 0) {
+    return;
+  }
+
+  busy = true;
+  bool ready = networkManager.initialize();
+  busy = false;
+  if (ready) {
+    BootTimeline::mark(BOOT_SESSION_READY);
+    LOG_INFO(NET, "Network session ready %lu ms after boot", (unsigned long)BootTimeline::getMs(BOOT_SESSION_READY));
+  } else {
+    // backs off so a server that keeps refusing the registration isn't asked every 30s
+    nextSessionAttemptMs = millis() + sessionRetryMs;
+    if (sessionRetryMs < NETWORK_SESSION_RETRY_MAX_MS) sessionRetryMs *= 2;
+  }
+}
+
+void NetworkWorker::refreshConfigIfDue() {
+  // the least urgent thing we do, so only when nothing is queued
+  if (deviceConfig == NULL || !networkManager.hasSession() || uxQueueMessagesWaiting(queue) > 0 ||
+      (int32_t)(millis() - nextConfigFetchMs) < 0) {
+    return;
+  }
+
+  busy = true;
+  bool current = networkManager.fetchDeviceConfig(*deviceConfig);
+  busy = false;
+  if (current) {
+    BootTimeline::mark(BOOT_CONFIG_CURRENT);
+  }
+  nextConfigFetchMs = millis() + (current ? DEVICE_CONFIG_REFRESH_MS : DEVICE_CONFIG_RETRY_MS);
+}
@@ -0,0 +1,37 @@
+#include "../include/NvsStore.h"
+
+NvsStore::NvsStore() {
+  opened = false;
+}
+
+bool NvsStore::begin(const char *name) {
+  if (!opened) {
+    opened = preferences.begin(name, false);
+  }
+  return opened;
+}
+
+size_t NvsStore::get(const char *key, void *out, size_t maxLength) {
+  if (!opened || !preferences.isKey(key)) {
+    return 0;
+  }
+  size_t length = preferences.getBytesLength(key);
+  if (length == 0 || length > maxLength) {
+    return 0;
+  }
+  return preferences.getBytes(key, out, length);
+}
+
+bool NvsStore::put(const char *key, const void *data, size_t length) {
+  if (!opened) {
+    return false;
+  }
+  return preferences.putBytes(key, data, length) == length;
+}
+
+bool NvsStore::remove(const char *key) {
+  if (!opened) {
+    return false;
+  }
+  return !preferences.isKey(key) || preferences.remove(key);
+}
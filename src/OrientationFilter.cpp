@@ -0,0 +1,154 @@
+#include "../include/OrientationFilter.h"
+#include "../include/Profiler.h"
+
+// the gates compared on the squared magnitudes ImuSample already carries
+static const uint32_t GATE_MIN_SQ = (uint32_t)((1.0F - ORIENTATION_ACCEL_GATE) * ACCEL_LSB_PER_G *
+                                               (1.0F - ORIENTATION_ACCEL_GATE) * ACCEL_LSB_PER_G);
+static const uint32_t GATE_MAX_SQ = (uint32_t)((1.0F + ORIENTATION_ACCEL_GATE) * ACCEL_LSB_PER_G *
+                                               (1.0F + ORIENTATION_ACCEL_GATE) * ACCEL_LSB_PER_G);
+static const uint32_t STILL_GYRO_SQ = GYRO_SQ_COUNTS(ORIENTATION_STILL_DPS);
+
+static inline float angleBetweenDeg(const float a[3], const float b[3]) {
+  float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  if (dot > 1.0F) dot = 1.0F;
+  if (dot < -1.0F) dot = -1.0F;
+  return acosf(dot) * (float)RAD_TO_DEG;
+}
+
+OrientationFilter::OrientationFilter() {
+  reset();
+}
+
+void OrientationFilter::reset() {
+  q0 = 1.0F;
+  q1 = q2 = q3 = 0.0F;
+  referenceUp[0] = referenceUp[1] = 0.0F;
+  referenceUp[2] = 1.0F;
+  lastUs = 0;
+  valid = false;
+}
+
+bool OrientationFilter::isValid() {
+  return valid;
+}
+
+// roll and pitch straight from gravity, heading 0
+void OrientationFilter::startFromAccel(const ImuSample &sample) {
+  float ax = sample.accelX, ay = sample.accelY, az = sample.accelZ;
+  if (sample.accelMagSq == 0) {
+    q0 = 1.0F;
+    q1 = q2 = q3 = 0.0F;
+  } else {
+    float roll = atan2f(ay, az);
+    float pitch = atan2f(-ax, sqrtf(ay * ay + az * az));
+    float cr = cosf(roll * 0.5F), sr = sinf(roll * 0.5F);
+    float cp = cosf(pitch * 0.5F), sp = sinf(pitch * 0.5F);
+    q0 = cr * cp;
+    q1 = sr * cp;
+    q2 = cr * sp;
+    q3 = -sr * sp;
+  }
+  if (!valid) {
+    getUp(referenceUp);
+  }
+  lastUs = sample.timestampUs;
+  valid = true;
+}
+
+void OrientationFilter::update(const ImuSample &sample) {
+  PROFILE_SCOPE("orientation.update");
+
+  uint32_t elapsedUs = sample.timestampUs - lastUs;
+  if (!valid || elapsedUs > ORIENTATION_MAX_GAP_US) {
+    startFromAccel(sample);
+    return;
+  }
+  if (elapsedUs == 0) {
+    return;
+  }
+  lastUs = sample.timestampUs;
+  float dt = elapsedUs * 1e-6F;
+
+  const float gyroScale = (float)DEG_TO_RAD / GYRO_LSB_PER_DPS;
+  float gx = sample.gyroX * gyroScale;
+  float gy = sample.gyroY * gyroScale;
+  float gz = sample.gyroZ * gyroScale;
+
+  // rate of change from the gyro
+  float qDot0 = 0.5F * (-q1 * gx - q2 * gy - q3 * gz);
+  float qDot1 = 0.5F * (q0 * gx + q2 * gz - q3 * gy);
+  float qDot2 = 0.5F * (q0 * gy - q1 * gz + q3 * gx);
+  float qDot3 = 0.5F * (q0 * gz + q1 * gy - q2 * gx);
+
+  if (sample.accelMagSq > GATE_MIN_SQ && sample.accelMagSq < GATE_MAX_SQ) {
+    float beta = sample.gyroMagSq < STILL_GYRO_SQ ? ORIENTATION_BETA_STILL : ORIENTATION_BETA;
+
+    // accel only gives a direction, counts are as good as g once normalized
+    float recipNorm = 1.0F / sqrtf((float)sample.accelMagSq);
+    float ax = sample.accelX * recipNorm;
+    float ay = sample.accelY * recipNorm;
+    float az = sample.accelZ * recipNorm;
+
+    // gradient of the error between measured and estimated gravity
+    float _2q0 = 2.0F * q0, _2q1 = 2.0F * q1, _2q2 = 2.0F * q2, _2q3 = 2.0F * q3;
+    float _4q0 = 4.0F * q0, _4q1 = 4.0F * q1, _4q2 = 4.0F * q2;
+    float _8q1 = 8.0F * q1, _8q2 = 8.0F * q2;
+    float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+    float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+    float s1 = _4q1 * q3q3 - _2q3 * ax + 4.0F * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+    float s2 = 4.0F * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+    float s3 = 4.0F * q1q1 * q3 - _2q1 * ax + 4.0F * q2q2 * q3 - _2q2 * ay;
+    float sNormSq = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+
+    // zero when the estimate already matches the measurement exactly
+    if (sNormSq > 0.0F) {
+      float step = beta / sqrtf(sNormSq);
+      qDot0 -= step * s0;
+      qDot1 -= step * s1;
+      qDot2 -= step * s2;
+      qDot3 -= step * s3;
+    }
+  }
+
+  q0 += qDot0 * dt;
+  q1 += qDot1 * dt;
+  q2 += qDot2 * dt;
+  q3 += qDot3 * dt;
+
+  float recipNorm = 1.0F / sqrtf(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+  q0 *= recipNorm;
+  q1 *= recipNorm;
+  q2 *= recipNorm;
+  q3 *= recipNorm;
+}
+
+void OrientationFilter::getQuaternion(float q[4]) {
+  q[0] = q0;
+  q[1] = q1;
+  q[2] = q2;
+  q[3] = q3;
+}
+
+void OrientationFilter::getUp(float up[3]) {
+  up[0] = 2.0F * (q1 * q3 - q0 * q2);
+  up[1] = 2.0F * (q0 * q1 + q2 * q3);
+  up[2] = q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3;
+}
+
+float OrientationFilter::getTiltDeg() {
+  const float sensorZ[3] = { 0.0F, 0.0F, 1.0F };
+  float up[3];
+  getUp(up);
+  return angleBetweenDeg(up, sensorZ);
+}
+
+void OrientationFilter::markReference() {
+  getUp(referenceUp);
+}
+
+float OrientationFilter::getPostureChangeDeg() {
+  float up[3];
+  getUp(up);
+  return angleBetweenDeg(up, referenceUp);
+}
@@ -0,0 +1,98 @@
+#include "../include/Profiler.h"
+
+#if PROFILER_ENABLED
+
+static ProfileProbe *probeList = NULL;
+static ProfileProbe *probeListTail = NULL;
+static portMUX_TYPE probeListLock = portMUX_INITIALIZER_UNLOCKED;
+
+ProfileProbe::ProfileProbe(const char *probeName) {
+  name = probeName;
+  count = 0;
+  maxCycles = 0;
+  totalCycles = 0;
+  memset(buckets, 0, sizeof(buckets));
+  next = NULL;
+  Profiler::add(this);
+}
+
+uint32_t ProfileProbe::bucketUpperBound(uint32_t bucket) {
+  if (bucket < PROFILER_SUB_BUCKETS) return bucket;
+  uint32_t octave = (bucket - PROFILER_SUB_BUCKETS) / PROFILER_SUB_BUCKETS + 2;
+  uint32_t sub = (bucket - PROFILER_SUB_BUCKETS) % PROFILER_SUB_BUCKETS;
+  uint64_t upper = ((uint64_t)(PROFILER_SUB_BUCKETS + sub + 1) << (octave - 2)) - 1;
+  return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+}
+
+ProfileProbe *Profiler::first() {
+  return probeList;
+}
+
+void Profiler::add(ProfileProbe *probe) {
+  // probes can register from any task, appending keeps the dump in first-use order
+  portENTER_CRITICAL(&probeListLock);
+  if (probeListTail == NULL) {
+    probeList = probe;
+  } else {
+    probeListTail->next = probe;
+  }
+  probeListTail = probe;
+  portEXIT_CRITICAL(&probeListLock);
+}
+
+uint64_t Profiler::percentile(const ProfileProbe &probe, uint8_t percent) {
+  if (probe.count == 0) return 0;
+
+  // rank of the call we are after, rounded up so p99 of 10 calls is the slowest one
+  uint64_t rank = ((uint64_t)probe.count * percent + 99) / 100;
+  if (rank == 0) rank = 1;
+
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < PROFILER_BUCKETS; i++) {
+    seen += probe.buckets[i];
+    if (seen >= rank) {
+      // the last bucket has no upper bound, the calls in it went past 2^32 cycles
+      uint64_t upper = i + 1 < PROFILER_BUCKETS ? ProfileProbe::bucketUpperBound(i) : probe.maxCycles;
+      return upper < probe.maxCycles ? upper : probe.maxCycles;
+    }
+  }
+  return probe.maxCycles;
+}
+
+void Profiler::dump(Print &out) {
+  // the probes keep counting while we print, so a line can be a few calls out of date
+  const float cyclesPerUs = ESP.getCpuFreqMHz();
+  out.printf("%-20s %10s %9s %9s %9s %9s %9s  (us, %u MHz)\n", "probe", "calls", "mean", "p50", "p90", "p99", "max",
+             (unsigned)ESP.getCpuFreqMHz());
+  for (ProfileProbe *probe = first(); probe != NULL; probe = probe->next) {
+    uint32_t count = probe->count;
+    float mean = count > 0 ? (float)probe->totalCycles / count : 0.0F;
+    out.printf("%-20s %10lu %9.2f %9.2f %9.2f %9.2f %9.2f\n", probe->name, (unsigned long)count,
+               mean / cyclesPerUs,
+               percentile(*probe, 50) / cyclesPerUs,
+               percentile(*probe, 90) / cyclesPerUs,
+               percentile(*probe, 99) / cyclesPerUs,
+               probe->maxCycles / cyclesPerUs);
+  }
+}
+
+void Profiler::reset() {
+  for (ProfileProbe *probe = first(); probe != NULL; probe = probe->next) {
+    probe->count = 0;
+    probe->maxCycles = 0;
+    probe->totalCycles = 0;
+    memset(probe->buckets, 0, sizeof(probe->buckets));
+  }
+}
+
+#else
+
+// the serial "prof" commands still work, there just is nothing to show
+void Profiler::dump(Print &out) {
+  out.printf("profiler compiled out (PROFILER_ENABLED=0)\n");
+}
+
+void Profiler::reset() {
+}
+
+#endif
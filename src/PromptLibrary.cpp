@@ -0,0 +1,83 @@
+#include "../include/PromptLibrary.h"
+
+PromptLibrary::PromptLibrary() {
+  mapped = NULL;
+  mappedSize = 0;
+  mapHandle = 0;
+  header = NULL;
+  entries = NULL;
+}
+
+PromptLibrary::~PromptLibrary() {
+  if (mapped != NULL) {
+    spi_flash_munmap(mapHandle);
+  }
+}
+
+bool PromptLibrary::begin(uint32_t sampleRate) {
+  if (mapped != NULL) {
+    return true;
+  }
+
+  const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                              (esp_partition_subtype_t)PROMPT_PARTITION_SUBTYPE,
+                                                              PROMPT_PARTITION_LABEL);
+  if (partition == NULL) {
+    Serial.println("PromptLibrary: no prompt partition");
+    return false;
+  }
+
+  const void *ptr = NULL;
+  esp_err_t result = esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &ptr, &mapHandle);
+  if (result != ESP_OK) {
+    Serial.printf("PromptLibrary: mmap failed: %d\n", result);
+    return false;
+  }
+
+  const PromptImageHeader *h = (const PromptImageHeader *)ptr;
+  // an erased partition reads back as 0xFF, that's the usual "not flashed yet" case
+  if (h->magic != PROMPT_IMAGE_MAGIC || h->version != PROMPT_IMAGE_VERSION) {
+    Serial.println("PromptLibrary: partition holds no prompt image");
+    spi_flash_munmap(mapHandle);
+    return false;
+  }
+  if (h->sampleRate != sampleRate) {
+    // no resampling on the device, repack the prompts at the I2S rate instead
+    Serial.printf("PromptLibrary: prompts are %lu Hz, audio runs at %lu Hz\n",
+                  (unsigned long)h->sampleRate, (unsigned long)sampleRate);
+    spi_flash_munmap(mapHandle);
+    return false;
+  }
+  if (sizeof(PromptImageHeader) + h->count * sizeof(PromptImageEntry) > partition->size) {
+    Serial.println("PromptLibrary: corrupt prompt index");
+    spi_flash_munmap(mapHandle);
+    return false;
+  }
+
+  mapped = (const uint8_t *)ptr;
+  mappedSize = partition->size;
+  header = h;
+  entries = (const PromptImageEntry *)(mapped + sizeof(PromptImageHeader));
+  Serial.printf("PromptLibrary: %d prompts mapped\n", header->count);
+  return true;
+}
+
+bool PromptLibrary::isAvailable() {
+  return mapped != NULL;
+}
+
+bool PromptLibrary::getClip(uint16_t id, const int16_t **samples, uint32_t *sampleCount) {
+  if (mapped == NULL || id >= header->count) {
+    return false;
+  }
+
+  const PromptImageEntry &entry = entries[id];
+  if (entry.offset % 4 != 0 || entry.offset > mappedSize ||
+      entry.sampleCount > (mappedSize - entry.offset) / sizeof(int16_t)) {
+    return false; // packer bug or a truncated image, don't read past the partition
+  }
+
+  *samples = (const int16_t *)(mapped + entry.offset);
+  *sampleCount = entry.sampleCount;
+  return true;
+}
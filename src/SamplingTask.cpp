@@ -0,0 +1,77 @@
+#include "../include/SamplingTask.h"
+
+SamplingTask::SamplingTask(GyroSensor &sensor, SampleRing &ring)
+  : gyroSensor(sensor), sampleRing(ring) {
+  taskHandle = NULL;
+  maxJitterUs = 0;
+}
+
+bool SamplingTask::start() {
+  if (taskHandle != NULL) {
+    return true;
+  }
+
+  gyroSensor.setSampleSink(&sampleRing);
+
+  BaseType_t result = xTaskCreatePinnedToCore(taskEntry, "sampling", SAMPLING_TASK_STACK, this,
+                                              SAMPLING_TASK_PRIORITY, &taskHandle, SAMPLING_TASK_CORE);
+  if (result != pdPASS) {
+    Serial.println("Failed to start sampling task!");
+    gyroSensor.setSampleSink(NULL);
+    taskHandle = NULL;
+    return false;
+  }
+
+  Serial.printf("Sampling task started on core %d every %lu ms\n", SAMPLING_TASK_CORE,
+                (unsigned long)gyroSensor.getPollPeriodMs());
+  return true;
+}
+
+void SamplingTask::stop() {
+  if (taskHandle == NULL) {
+    return;
+  }
+  vTaskDelete(taskHandle);
+  taskHandle = NULL;
+  gyroSensor.setSampleSink(NULL);
+}
+
+bool SamplingTask::isRunning() {
+  return taskHandle != NULL;
+}
+
+uint32_t SamplingTask::getMaxJitterUs() {
+  return maxJitterUs;
+}
+
+uint32_t SamplingTask::getDroppedSamples() {
+  return sampleRing.droppedCount();
+}
+
+void SamplingTask::taskEntry(void *param) {
+  static_cast<SamplingTask *>(param)->run();
+}
+
+void SamplingTask::run() {
+  TickType_t lastWake = xTaskGetTickCount();
+  uint32_t expectedUs = micros();
+
+  while (true) {
+    uint32_t periodMs = gyroSensor.getPollPeriodMs();
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(periodMs));
+    expectedUs += periodMs * 1000UL;
+
+    uint32_t nowUs = micros();
+    int32_t lateUs = (int32_t)(nowUs - expectedUs);
+    if (lateUs > (int32_t)maxJitterUs) {
+      maxJitterUs = lateUs;
+    }
+    // vTaskDelayUntil skips ahead when we miss a whole period, and tick vs micros()
+    // rounding can make us look early, re-anchor in both cases instead of drifting
+    if (lateUs < 0 || lateUs > (int32_t)(periodMs * 1000UL)) {
+      expectedUs = nowUs;
+    }
+
+    gyroSensor.process();
+  }
+}
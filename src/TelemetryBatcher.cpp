@@ -0,0 +1,81 @@
+#include "../include/TelemetryBatcher.h"
+
+TelemetryBatcher::TelemetryBatcher(size_t size, uint32_t intervalMs) {
+  sampleCount = 0;
+  windowStartMs = 0;
+  lastSlot = 0;
+  configure(size, intervalMs);
+}
+
+void TelemetryBatcher::configure(size_t size, uint32_t intervalMs) {
+  // the window storage is fixed, so clamp instead of overflowing it
+  if (size == 0) size = 1;
+  if (size > TELEMETRY_BATCH_CAPACITY) size = TELEMETRY_BATCH_CAPACITY;
+  batchSize = size;
+  flushIntervalMs = intervalMs;
+}
+
+bool TelemetryBatcher::add(uint32_t timestampMs, float accel, float gyro) {
+  TelemetrySample *slot;
+  if (!reserve(timestampMs, slot)) {
+    return false;
+  }
+  if (slot != NULL) {
+    slot->accel = accel;
+    slot->gyro = gyro;
+  }
+  return true;
+}
+
+bool TelemetryBatcher::add(uint32_t timestampMs, const ImuSample &sample) {
+  TelemetrySample *slot;
+  if (!reserve(timestampMs, slot)) {
+    return false;
+  }
+  if (slot != NULL) {
+    slot->accel = sample.accelMagnitude();
+    slot->gyro = sample.gyroMagnitude();
+  }
+  return true;
+}
+
+bool TelemetryBatcher::reserve(uint32_t timestampMs, TelemetrySample *&slot) {
+  slot = NULL;
+  if (sampleCount >= batchSize) {
+    return false;
+  }
+
+  if (sampleCount == 0) {
+    windowStartMs = timestampMs;
+    lastSlot = 0;
+  } else {
+    uint32_t slotIndex = (timestampMs - windowStartMs + TELEMETRY_MIN_SPACING_MS / 2) / TELEMETRY_MIN_SPACING_MS;
+    if (slotIndex <= lastSlot) {
+      return true;
+    }
+    lastSlot = slotIndex;
+  }
+
+  slot = &window[sampleCount++];
+  slot->timestampMs = timestampMs;
+  return true;
+}
+
+bool TelemetryBatcher::shouldFlush(uint32_t nowMs) const {
+  if (sampleCount == 0) {
+    return false;
+  }
+  return sampleCount >= batchSize || nowMs - windowStartMs >= flushIntervalMs;
+}
+
+void TelemetryBatcher::clear() {
+  sampleCount = 0;
+}
+
+size_t TelemetryBatcher::count() const {
+  return sampleCount;
+}
+
+const TelemetrySample *TelemetryBatcher::samples() const {
+  return window;
+}
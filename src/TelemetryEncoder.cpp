@@ -0,0 +1,257 @@
+#include "../include/TelemetryEncoder.h"
+
+TelemetryWriter::TelemetryWriter(uint8_t *out, size_t size, TelemetryFormat outputFormat) {
+  buffer = out;
+  capacity = size;
+  length = 0;
+  overflow = false;
+  format = outputFormat;
+  depth = 0;
+  firstInContainer[0] = true;
+  expectValue = false;
+}
+
+void TelemetryWriter::beginMap(size_t count) {
+  if (format == TELEMETRY_FORMAT_CBOR) {
+    cborHead(5, count);
+  } else {
+    jsonOpen('{');
+  }
+}
+
+void TelemetryWriter::endMap() {
+  if (format == TELEMETRY_FORMAT_JSON) {
+    jsonClose('}');
+  }
+}
+
+void TelemetryWriter::beginArray(size_t count) {
+  if (format == TELEMETRY_FORMAT_CBOR) {
+    cborHead(4, count);
+  } else {
+    jsonOpen('[');
+  }
+}
+
+void TelemetryWriter::endArray() {
+  if (format == TELEMETRY_FORMAT_JSON) {
+    jsonClose(']');
+  }
+}
+
+void TelemetryWriter::key(const char *name) {
+  if (format == TELEMETRY_FORMAT_CBOR) {
+    size_t n = strlen(name);
+    cborHead(3, n);
+    put(name, n);
+  } else {
+    jsonSeparator();
+    jsonString(name);
+    put(':');
+    expectValue = true;
+  }
+}
+
+void TelemetryWriter::value(float v) {
+  if (format == TELEMETRY_FORMAT_CBOR) {
+    // major type 7, additional info 26 = IEEE 754 single, big-endian on the wire
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    put(0xFA);
+    put((uint8_t)(bits >> 24));
+    put((uint8_t)(bits >> 16));
+    put((uint8_t)(bits >> 8));
+    put((uint8_t)bits);
+  } else {
+    jsonSeparator();
+    char text[16];
+    // JSON has no NaN/Infinity, same as ArduinoJson we send null instead
+    int n = isfinite(v) ? snprintf(text, sizeof(text), "%.6g", v) : snprintf(text, sizeof(text), "null");
+    put(text, n);
+  }
+}
+
+void TelemetryWriter::value(uint32_t v) {
+  if (format == TELEMETRY_FORMAT_CBOR) {
+    cborHead(0, v);
+  } else {
+    jsonSeparator();
+    char text[12];
+    int n = snprintf(text, sizeof(text), "%lu", (unsigned long)v);
+    put(text, n);
+  }
+}
+
+void TelemetryWriter::value(bool v) {
+  if (format == TELEMETRY_FORMAT_CBOR) {
+    put(v ? 0xF5 : 0xF4);
+  } else {
+    jsonSeparator();
+    if (v) put("true", 4); else put("false", 5);
+  }
+}
+
+void TelemetryWriter::value(const char *v) {
+  if (format == TELEMETRY_FORMAT_CBOR) {
+    size_t n = strlen(v);
+    cborHead(3, n);
+    put(v, n);
+  } else {
+    jsonSeparator();
+    jsonString(v);
+  }
+}
+
+size_t TelemetryWriter::size() const {
+  return length;
+}
+
+bool TelemetryWriter::overflowed() const {
+  return overflow;
+}
+
+const uint8_t *TelemetryWriter::data() const {
+  return buffer;
+}
+
+const char *TelemetryWriter::contentType() const {
+  return format == TELEMETRY_FORMAT_CBOR ? "application/cbor" : "application/json";
+}
+
+void TelemetryWriter::put(uint8_t byte) {
+  if (length >= capacity) {
+    overflow = true;
+    return;
+  }
+  buffer[length++] = byte;
+}
+
+void TelemetryWriter::put(const void *bytes, size_t count) {
+  if (length + count > capacity) {
+    overflow = true;
+    return;
+  }
+  memcpy(buffer + length, bytes, count);
+  length += count;
+}
+
+// CBOR initial byte + argument in the shortest form that fits
+void TelemetryWriter::cborHead(uint8_t majorType, uint32_t argument) {
+  uint8_t type = majorType << 5;
+  if (argument < 24) {
+    put(type | argument);
+  } else if (argument <= 0xFF) {
+    put(type | 24);
+    put((uint8_t)argument);
+  } else if (argument <= 0xFFFF) {
+    put(type | 25);
+    put((uint8_t)(argument >> 8));
+    put((uint8_t)argument);
+  } else {
+    put(type | 26);
+    put((uint8_t)(argument >> 24));
+    put((uint8_t)(argument >> 16));
+    put((uint8_t)(argument >> 8));
+    put((uint8_t)argument);
+  }
+}
+
+void TelemetryWriter::jsonSeparator() {
+  // a value right after its key needs no comma
+  if (expectValue) {
+    expectValue = false;
+    return;
+  }
+  if (!firstInContainer[depth]) {
+    put(',');
+  }
+  firstInContainer[depth] = false;
+}
+
+void TelemetryWriter::jsonOpen(char bracket) {
+  jsonSeparator();
+  put(bracket);
+  if (depth + 1 < TELEMETRY_MAX_DEPTH) {
+    depth++;
+  } else {
+    overflow = true;
+  }
+  firstInContainer[depth] = true;
+}
+
+void TelemetryWriter::jsonClose(char bracket) {
+  put(bracket);
+  if (depth > 0) depth--;
+}
+
+void TelemetryWriter::jsonString(const char *text) {
+  put('"');
+  for (const char *c = text; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      put('\\');
+      put(*c);
+    } else if ((uint8_t)*c < 0x20) {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+      put(escaped, 6);
+    } else {
+      put(*c);
+    }
+  }
+  put('"');
+}
+
+void TelemetryPayload::sensorData(TelemetryWriter &w, float accel, float gyro, bool fallDetected, uint32_t timestampMs) {
+  w.beginMap(fallDetected ? 10 : 5);
+  w.key("deviceId");  w.value(DEVICE_ID);
+  w.key("accel");     w.value(accel);
+  w.key("gyro");      w.value(gyro);
+  w.key("fallDetected"); w.value(fallDetected);
+  w.key("timestamp"); w.value(timestampMs);
+
+  if (fallDetected) {
+    w.key("emergencyType");    w.value("FALL_DETECTED");
+    w.key("severity");         w.value("HIGH");
+    w.key("requiresResponse"); w.value(true);
+    w.key("alertMessage");     w.value("Fall detected - immediate assistance may be required");
+
+    // the server's alert handler still reads these from dataJson
+    w.key("dataJson");
+    w.beginMap(4);
+    w.key("accel");    w.value(accel);
+    w.key("gyro");     w.value(gyro);
+    w.key("deviceId"); w.value(DEVICE_ID);
+    w.key("detectionTime"); w.value(timestampMs);
+    w.endMap();
+  }
+  w.endMap();
+}
+
+void TelemetryPayload::sensorBatch(TelemetryWriter &w, const TelemetrySample *samples, size_t count) {
+  w.beginMap(5);
+  w.key("deviceId");     w.value(DEVICE_ID);
+  w.key("fallDetected"); w.value(false);
+  w.key("timestamp");    w.value(count > 0 ? samples[0].timestampMs : (uint32_t)0);
+  w.key("count");        w.value((uint32_t)count);
+
+  w.key("samples");
+  w.beginArray(count);
+  for (size_t i = 0; i < count; i++) {
+    w.beginMap(3);
+    w.key("t");     w.value(samples[i].timestampMs);
+    w.key("accel"); w.value(samples[i].accel);
+    w.key("gyro");  w.value(samples[i].gyro);
+    w.endMap();
+  }
+  w.endArray();
+  w.endMap();
+}
+
+void TelemetryPayload::registration(TelemetryWriter &w, const char *token) {
+  w.beginMap(4);
+  w.key("deviceId");   w.value(DEVICE_ID);
+  w.key("platform");   w.value("ESP32");
+  w.key("deviceName"); w.value("ESP32");
+  w.key("token");      w.value(token);
+  w.endMap();
+}
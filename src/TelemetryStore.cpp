@@ -0,0 +1,378 @@
+#include "../include/TelemetryStore.h"
+#include "../include/Log.h"
+
+#define STORE_DIR           "/store"
+#define STORE_RECORD_MAGIC  0xA55A
+#define STORE_RECORD_VERSION 1
+
+struct RecordHeader {
+  uint16_t magic;
+  uint8_t type;
+  uint8_t version;
+  uint16_t length;
+  uint16_t crc;
+};
+
+// replay position, in the KeyValueStore under "store_<prefix>"
+struct StoredCursor {
+  uint32_t seq;
+  uint32_t offset;
+};
+
+struct AlertPayload {
+  uint32_t timestampMs;
+  float accel;
+  float gyro;
+};
+
+// CRC-16/CCITT-FALSE, bitwise - records are small and this only runs on append/replay
+static uint16_t crc16(const uint8_t *data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+SegmentLog::SegmentLog(const char *logPrefix, uint8_t segments, uint32_t bytes, uint32_t flushMs) {
+  fs = NULL;
+  cursorStore = NULL;
+  prefix = logPrefix;
+  maxSegments = segments;
+  segmentBytes = bytes;
+  flushIntervalMs = flushMs;
+  readSeq = writeSeq = 0;
+  readOffset = writeSize = 0;
+  flushedSize = 0;
+  lastFlushMs = 0;
+  peekedLength = 0;
+  unsavedRecords = 0;
+  droppedSegments = 0;
+}
+
+bool SegmentLog::begin(fs::FS &fileSystem, KeyValueStore *store) {
+  fs = &fileSystem;
+  cursorStore = store;
+
+  // find the oldest and newest segment this log left behind before the reboot
+  size_t prefixLength = strlen(prefix);
+  bool found = false;
+  uint32_t lowest = 0, highest = 0;
+
+  File dir = fs->open(STORE_DIR);
+  if (dir && dir.isDirectory()) {
+    File entry = dir.openNextFile();
+    while (entry) {
+      // older cores return the full path from name(), newer ones just the file name
+      const char *name = entry.name();
+      const char *slash = strrchr(name, '/');
+      if (slash != NULL) name = slash + 1;
+
+      if (strncmp(name, prefix, prefixLength) == 0 && name[prefixLength] == '_') {
+        uint32_t seq = strtoul(name + prefixLength + 1, NULL, 10);
+        if (!found || seq < lowest) lowest = seq;
+        if (!found || seq > highest) highest = seq;
+        found = true;
+      }
+      entry = dir.openNextFile();
+    }
+  }
+
+  readOffset = 0;
+  if (found) {
+    readSeq = lowest;
+    writeSeq = highest;
+    writeSize = flushedSize = segmentSize(writeSeq);
+    restoreCursor();
+    if (hasPending()) {
+      LOG_INFO(NET, "Store %s: segments %lu..%lu waiting for replay, from offset %lu", prefix,
+               (unsigned long)readSeq, (unsigned long)writeSeq, (unsigned long)readOffset);
+    }
+  }
+  // also when empty: numbering starts over, an old cursor must not match a new segment
+  saveCursor();
+  return true;
+}
+
+bool SegmentLog::append(uint8_t type, const uint8_t *payload, uint16_t length) {
+  if (fs == NULL) return false;
+
+  uint32_t recordBytes = sizeof(RecordHeader) + length;
+  if (writeSize > 0 && writeSize + recordBytes > segmentBytes) {
+    if (!rotate()) return false;
+  }
+
+  if (!writeFile) {
+    char path[32];
+    segmentPath(writeSeq, path, sizeof(path));
+    writeFile = fs->open(path, FILE_APPEND);
+    if (!writeFile) {
+      LOG_ERROR(NET, "Store %s: cannot open %s", prefix, path);
+      return false;
+    }
+  }
+
+  RecordHeader header;
+  header.magic = STORE_RECORD_MAGIC;
+  header.type = type;
+  header.version = STORE_RECORD_VERSION;
+  header.length = length;
+  header.crc = crc16(payload, length);
+
+  size_t written = writeFile.write((const uint8_t *)&header, sizeof(header));
+  written += writeFile.write(payload, length);
+  writeSize += written;
+
+  // every flush rewrites the file's metadata block, so not one per record
+  if (flushIntervalMs == 0 || millis() - lastFlushMs >= flushIntervalMs) {
+    flushWrite();
+  }
+  return written == recordBytes;
+}
+
+bool SegmentLog::hasPending() {
+  return readSeq < writeSeq || readOffset < writeSize;
+}
+
+bool SegmentLog::peek(uint8_t &type, uint8_t *payload, uint16_t &length) {
+  while (hasPending()) {
+    // another handle only sees what the writer flushed
+    if (readSeq == writeSeq && readOffset >= flushedSize) {
+      flushWrite();
+    }
+
+    char path[32];
+    segmentPath(readSeq, path, sizeof(path));
+    File file = fs->open(path, FILE_READ);
+
+    RecordHeader header;
+    bool valid = file && file.seek(readOffset) &&
+                 file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+                 header.magic == STORE_RECORD_MAGIC &&
+                 header.version == STORE_RECORD_VERSION &&
+                 header.length <= STORE_MAX_PAYLOAD &&
+                 file.read(payload, header.length) == header.length &&
+                 crc16(payload, header.length) == header.crc;
+
+    if (valid) {
+      type = header.type;
+      length = header.length;
+      peekedLength = sizeof(header) + header.length;
+      return true;
+    }
+
+    // missing file or torn/corrupt record, nothing after it can be trusted
+    LOG_WARN(NET, "Store %s: skipping rest of segment %lu at offset %lu", prefix,
+             (unsigned long)readSeq, (unsigned long)readOffset);
+    advanceReadSegment();
+  }
+  return false;
+}
+
+void SegmentLog::consume() {
+  if (peekedLength == 0) return;
+
+  readOffset += peekedLength;
+  peekedLength = 0;
+
+  uint32_t size = readSeq == writeSeq ? writeSize : segmentSize(readSeq);
+  if (readOffset >= size) {
+    advanceReadSegment();
+  } else if (++unsavedRecords >= STORE_CURSOR_SAVE_RECORDS) {
+    saveCursor();
+  }
+}
+
+uint32_t SegmentLog::getDroppedSegments() {
+  return droppedSegments;
+}
+
+void SegmentLog::segmentPath(uint32_t seq, char *path, size_t size) {
+  snprintf(path, size, STORE_DIR "/%s_%08lu.seg", prefix, (unsigned long)seq);
+}
+
+uint32_t SegmentLog::segmentSize(uint32_t seq) {
+  char path[32];
+  segmentPath(seq, path, sizeof(path));
+  File file = fs->open(path, FILE_READ);
+  return file ? file.size() : 0;
+}
+
+void SegmentLog::removeSegment(uint32_t seq) {
+  char path[32];
+  segmentPath(seq, path, sizeof(path));
+  fs->remove(path);
+}
+
+void SegmentLog::advanceReadSegment() {
+  if (readSeq == writeSeq) {
+    // everything replayed - start the next append in a fresh segment
+    if (writeFile) writeFile.close();
+    removeSegment(readSeq);
+    writeSeq++;
+    writeSize = flushedSize = 0;
+    readSeq = writeSeq;
+  } else {
+    removeSegment(readSeq);
+    readSeq++;
+  }
+  readOffset = 0;
+  peekedLength = 0;
+  saveCursor();
+}
+
+bool SegmentLog::rotate() {
+  if (writeFile) writeFile.close(); // flushes
+  writeSeq++;
+  writeSize = flushedSize = 0;
+
+  // out of space: drop the oldest segment, recent data is worth more
+  if (writeSeq - readSeq >= maxSegments) {
+    removeSegment(readSeq);
+    readSeq++;
+    readOffset = 0;
+    peekedLength = 0;
+    droppedSegments++;
+    saveCursor();
+    LOG_WARN(NET, "Store %s: full, dropped oldest segment", prefix);
+  }
+  return true;
+}
+
+void SegmentLog::flushWrite() {
+  if (writeFile && flushedSize < writeSize) {
+    writeFile.flush();
+  }
+  flushedSize = writeSize;
+  lastFlushMs = millis();
+}
+
+// Called on segment changes and every STORE_CURSOR_SAVE_RECORDS records, not per record
+void SegmentLog::saveCursor() {
+  unsavedRecords = 0;
+  if (cursorStore == NULL) return;
+
+  char key[16];
+  snprintf(key, sizeof(key), "store_%s", prefix);
+  StoredCursor cursor = { readSeq, readOffset };
+  StoredCursor saved;
+  if (cursorStore->get(key, &saved, sizeof(saved)) == sizeof(saved) &&
+      saved.seq == cursor.seq && saved.offset == cursor.offset) {
+    return;
+  }
+  cursorStore->put(key, &cursor, sizeof(cursor));
+}
+
+// Segments before the saved one were replayed completely (the cursor only moves past a
+// segment once all of it went out), the reset just came before they were deleted.
+void SegmentLog::restoreCursor() {
+  if (cursorStore == NULL) return;
+
+  char key[16];
+  snprintf(key, sizeof(key), "store_%s", prefix);
+  StoredCursor cursor;
+  if (cursorStore->get(key, &cursor, sizeof(cursor)) != sizeof(cursor) ||
+      cursor.seq < readSeq || cursor.seq > writeSeq) {
+    return;
+  }
+
+  while (readSeq < cursor.seq) {
+    removeSegment(readSeq);
+    readSeq++;
+  }
+  readOffset = cursor.offset;
+  uint32_t size = readSeq == writeSeq ? writeSize : segmentSize(readSeq);
+  if (readOffset >= size) {
+    advanceReadSegment();
+  }
+}
+
+// alerts are rare and the one thing that must survive a reset, so they are flushed each time
+TelemetryStore::TelemetryStore()
+  : alertLog("a", STORE_ALERT_SEGMENTS, STORE_ALERT_SEGMENT_BYTES, 0),
+    batchLog("t", STORE_BATCH_SEGMENTS, STORE_BATCH_SEGMENT_BYTES, STORE_FLUSH_INTERVAL_MS) {
+  ready = false;
+  cursorStore = NULL;
+  peekedLog = NULL;
+}
+
+void TelemetryStore::setCursorStore(KeyValueStore *store) {
+  cursorStore = store;
+}
+
+bool TelemetryStore::begin(fs::FS &fs) {
+  if (!fs.exists(STORE_DIR) && !fs.mkdir(STORE_DIR)) {
+    LOG_ERROR(NET, "TelemetryStore: cannot create " STORE_DIR);
+    return false;
+  }
+  ready = alertLog.begin(fs, cursorStore) && batchLog.begin(fs, cursorStore);
+  return ready;
+}
+
+bool TelemetryStore::appendBatch(const TelemetrySample *samples, size_t count) {
+  if (!ready || count == 0) return false;
+  if (count > TELEMETRY_BATCH_CAPACITY) count = TELEMETRY_BATCH_CAPACITY;
+  return batchLog.append(STORED_BATCH, (const uint8_t *)samples, count * sizeof(TelemetrySample));
+}
+
+bool TelemetryStore::appendAlert(float accel, float gyro, uint32_t timestampMs) {
+  if (!ready) return false;
+  AlertPayload payload;
+  payload.timestampMs = timestampMs;
+  payload.accel = accel;
+  payload.gyro = gyro;
+  return alertLog.append(STORED_FALL_ALERT, (const uint8_t *)&payload, sizeof(payload));
+}
+
+bool TelemetryStore::hasPending() {
+  return ready && (alertLog.hasPending() || batchLog.hasPending());
+}
+
+bool TelemetryStore::hasPendingBatches() {
+  return ready && batchLog.hasPending();
+}
+
+bool TelemetryStore::peekNext(StoredRecord &record) {
+  if (!ready) return false;
+
+  uint8_t type;
+  uint16_t length;
+
+  // emergencies first, then telemetry in the order it was recorded
+  peekedLog = alertLog.hasPending() ? &alertLog : &batchLog;
+  if (!peekedLog->peek(type, (uint8_t *)record.samples, length)) {
+    if (peekedLog == &batchLog) return false;
+    peekedLog = &batchLog;
+    if (!peekedLog->peek(type, (uint8_t *)record.samples, length)) return false;
+  }
+
+  record.type = (StoredRecordType)type;
+  if (record.type == STORED_FALL_ALERT && length == sizeof(AlertPayload)) {
+    AlertPayload payload;
+    memcpy(&payload, record.samples, sizeof(payload));
+    record.timestampMs = payload.timestampMs;
+    record.accel = payload.accel;
+    record.gyro = payload.gyro;
+    record.sampleCount = 0;
+  } else {
+    record.type = STORED_BATCH;
+    record.sampleCount = length / sizeof(TelemetrySample);
+    record.timestampMs = record.sampleCount > 0 ? record.samples[0].timestampMs : 0;
+    record.accel = record.gyro = 0;
+  }
+  return true;
+}
+
+void TelemetryStore::consumeNext() {
+  if (peekedLog != NULL) {
+    peekedLog->consume();
+    peekedLog = NULL;
+  }
+}
+
+uint32_t TelemetryStore::getDroppedSegments() {
+  return alertLog.getDroppedSegments() + batchLog.getDroppedSegments();
+}
@@ -0,0 +1,135 @@
+#include "../include/ToneSequencer.h"
+
+// sweeps retune this often, ~0.7ms at 44.1kHz, smooth enough to sound continuous
+static const int SWEEP_BLOCK = 32;
+
+ToneVoice::ToneVoice()
+    : _sample_rate(44100)
+    , _pattern(NULL)
+    , _volume(0.0f)
+    , _active(false)
+    , _step(0)
+    , _step_samples(0)
+    , _step_pos(0)
+    , _empty_steps(0)
+{
+}
+
+void ToneVoice::setSampleRate(uint32_t sample_rate) {
+    _sample_rate = sample_rate;
+    _oscillator.setSampleRate(sample_rate);
+}
+
+bool ToneVoice::play(const TonePattern *pattern, float volume) {
+    bool audible = false;
+    for (uint8_t i = 0; pattern != NULL && i < pattern->step_count; i++) {
+        if (stepSamples(pattern->steps[i]) > 0) {
+            audible = true;
+        }
+    }
+    if (!audible) {
+        // a repeating pattern of zero-length steps would never render a sample
+        stop();
+        return false;
+    }
+    _pattern = pattern;
+    _volume = constrain(volume, 0.0f, 1.0f);
+    _active = true;
+    _empty_steps = 0;
+    _oscillator.resetPhase();
+    enterStep(0);
+    return true;
+}
+
+void ToneVoice::stop() {
+    _active = false;
+    _pattern = NULL;
+}
+
+bool ToneVoice::isActive() const {
+    return _active;
+}
+
+uint32_t ToneVoice::stepSamples(const ToneStep &step) const {
+    return (uint32_t)((uint64_t)step.duration_ms * _sample_rate / 1000);
+}
+
+void ToneVoice::enterStep(uint8_t step) {
+    _step = step;
+    _step_pos = 0;
+    const ToneStep &s = _pattern->steps[step];
+    _step_samples = stepSamples(s);
+
+    if (s.start_hz != 0 && _step_samples > 0) {
+#if AUDIO_SYNTH_MODE == AUDIO_SYNTH_SINE
+        _oscillator.setMode(DDS_MODE_SINE);
+#else
+        // a sweep changes frequency every block, which would rebuild the loop table
+        // every time - synthesize it per sample instead
+        _oscillator.setMode(s.start_hz == s.end_hz && AUDIO_SYNTH_MODE == AUDIO_SYNTH_DDS_LOOP
+                            ? DDS_MODE_LOOP : DDS_MODE_INTERPOLATED);
+#endif
+        _oscillator.setTone(s.start_hz, _volume * s.level / 255.0f);
+    }
+}
+
+void ToneVoice::render(int16_t *out, int count, bool mix) {
+    while (count > 0) {
+        if (!_active) {
+            if (!mix) {
+                memset(out, 0, count * sizeof(int16_t));
+            }
+            return;
+        }
+
+        // step boundaries land on exact samples, even in the middle of a buffer
+        if (_step_pos >= _step_samples) {
+            // a whole cycle of steps without a sample (the sample rate changed under a
+            // pattern of very short steps) would spin here forever
+            _empty_steps = _step_samples == 0 ? _empty_steps + 1 : 0;
+            if (_empty_steps >= _pattern->step_count) {
+                stop();
+                continue;
+            }
+            uint8_t next = _step + 1;
+            if (next >= _pattern->step_count) {
+                if (!_pattern->repeat) {
+                    stop();
+                    continue;
+                }
+                next = 0;
+            }
+            enterStep(next);
+            continue;
+        }
+
+        const ToneStep &s = _pattern->steps[_step];
+        int chunk = count;
+        if ((uint32_t)chunk > _step_samples - _step_pos) {
+            chunk = _step_samples - _step_pos;
+        }
+
+        if (s.start_hz == 0) {
+            // rest
+            if (!mix) {
+                memset(out, 0, chunk * sizeof(int16_t));
+            }
+        } else {
+            if (s.start_hz != s.end_hz) {
+                if (chunk > SWEEP_BLOCK) chunk = SWEEP_BLOCK;
+                int32_t span = (int32_t)s.end_hz - s.start_hz;
+                int frequency = s.start_hz + (int)((int64_t)span * _step_pos / _step_samples);
+                _oscillator.setTone(frequency, _volume * s.level / 255.0f);
+            }
+            if (mix) {
+                _oscillator.mix(out, chunk);
+            } else {
+                _oscillator.render(out, chunk);
+            }
+        }
+
+        out += chunk;
+        count -= chunk;
+        _step_pos += chunk;
+    }
+}
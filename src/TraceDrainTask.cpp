@@ -0,0 +1,30 @@
+#include "../include/TraceDrainTask.h"
+
+TraceDrainTask::TraceDrainTask(TraceWriter &writer) : traceWriter(writer) {
+  taskHandle = NULL;
+}
+
+bool TraceDrainTask::start() {
+  if (taskHandle != NULL) {
+    return true;
+  }
+
+  BaseType_t result = xTaskCreatePinnedToCore(taskEntry, "trace", TRACE_TASK_STACK, this,
+                                              TRACE_TASK_PRIORITY, &taskHandle, TRACE_TASK_CORE);
+  if (result != pdPASS) {
+    taskHandle = NULL;
+    return false;
+  }
+  return true;
+}
+
+void TraceDrainTask::taskEntry(void *param) {
+  static_cast<TraceDrainTask *>(param)->run();
+}
+
+void TraceDrainTask::run() {
+  while (true) {
+    traceWriter.drain();
+    vTaskDelay(pdMS_TO_TICKS(TRACE_DRAIN_INTERVAL_MS));
+  }
+}
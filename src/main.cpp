@@ -5,91 +5,311 @@
 #include "../include/FallDetection.h"
 #include "../include/NetworkManager.h"  // Add this line
 #include "AudioController.h"
+#include "../include/SamplingTask.h"
+#include "../include/TelemetryBatcher.h"
+#include "../include/NetworkWorker.h"
+#include "../include/TelemetryStore.h"
+#include "../include/LedController.h"
+#include "../include/Mpu6050Device.h"
+#include "../include/EspHttpTransport.h"
+#include "../include/I2sAudioSink.h"
+#include "../include/ImuTrace.h"
+#include "../include/Profiler.h"
+#include "../include/LogDrainTask.h"
+#include "../include/TraceDrainTask.h"
+#include "../include/NvsStore.h"
+#include "../include/DeviceConfig.h"
+#include "../include/BootTimeline.h"
+#include <LittleFS.h>
 
-GyroSensor gyroSensor;
+// hardware behind the Hal.h interfaces
+ArduinoClock systemClock;
+Mpu6050Device imuDevice;
+EspHttpTransport httpTransport(WIFI_SSID, WIFI_PASSWORD);
+I2sAudioSink audioSink;
+NvsStore nvsStore;
+
+// thresholds and alarm settings, the last config the server sent comes back from NVS
+DeviceConfig deviceConfig;
+
+// the sensor stream passes through the trace recorder, which drops everything unless
+// TRACE_CAPTURE gives it somewhere to write
+TraceWriter traceWriter;
+TracingImuDevice tracedImu(imuDevice, traceWriter);
+TraceDrainTask traceDrainTask(traceWriter);
+#if TRACE_CAPTURE == TRACE_CAPTURE_FLASH
+File traceFile;
+#endif
+
+GyroSensor gyroSensor(tracedImu, systemClock, deviceConfig);
+SampleRing sampleRing;
+SamplingTask samplingTask(gyroSensor, sampleRing);
 Button button;
 FallDetection *fallDetection = NULL;
-NetworkManager networkManager;  // Add this line
-AudioController speaker;
+NetworkManager networkManager(httpTransport);
+NetworkWorker networkWorker(networkManager);
+TelemetryStore telemetryStore;
+AudioController speaker(audioSink, deviceConfig);
+TelemetryBatcher telemetryBatcher;
+LedController statusLed;
+LogDrainTask logDrainTask(Serial);
 
-unsigned long lastSampleTime = 0;
+ImuSample latestSample = {};
 unsigned long lastDebugOutput = 0;
+unsigned long lastCalibrationSave = 0;
 unsigned long fallTimestamp = 0;
-bool fallReported = false;  // Track if fall has been reported to server
+volatile bool alertPending = false;  // a fall alert still has to go to the network task (set again by it on failure)
+unsigned long lastAlertSubmit = 0;
 
-void setup() {
-  Serial.begin(115200);
-  delay(1000);
-  
-  pinMode(LED_PIN, OUTPUT);
-  
-  // Visual startup sequence - triple blink
-  for (int i = 0; i < 3; i++) {
-    digitalWrite(LED_PIN, HIGH);
-    delay(200);
-    digitalWrite(LED_PIN, LOW);
-    delay(200);
+// Sample timestamps come from micros(), which wraps every ~71 minutes. Telemetry and
+// the server work in millis(), so convert by age rather than dividing the raw value.
+static uint32_t sampleTimeMs(const ImuSample &s) {
+  return millis() - (micros() - s.timestampUs) / 1000;
+}
+
+// Runs on the network task, so only flip flags here
+static void onNetworkResult(NetworkRequestType type, NetworkResult result, void *context) {
+  // a stored alert will be replayed by the worker, only a lost one needs resubmitting
+  if (type == NET_REQUEST_FALL_ALERT && result == NET_RESULT_SENT) {
+    speaker.playPrompt(PROMPT_HELP_CALLED); // thread safe, only posts a request
   }
+  if (type == NET_REQUEST_FALL_ALERT && result == NET_RESULT_FAILED) {
+    LOG_ERROR(MAIN, "Fall alert could not be delivered!");
+    alertPending = true; // let loop() try again
+  }
+}
+
+// Cleared before the attempt, so a failure the network task reports in the meantime
+// isn't overwritten
+static void submitFallAlert() {
+  lastAlertSubmit = millis();
+  alertPending = false;
+  if (!networkWorker.submitFallAlert(latestSample.accelMagnitude(), latestSample.gyroMagnitude())) {
+    alertPending = true;
+    LOG_WARN(NET, "Network queue full - fall alert retried in %d ms", NETWORK_ALERT_RESUBMIT_MS);
+  }
+}
+
+static void raiseAlarm() {
+  fallDetection->triggerAlarm();
+  fallDetection->setState(STATE_ALARM_ACTIVE);
+  speaker.playAlarm(); // Sound alarm
   
+  // Send fall alert to server immediately
+  submitFallAlert();
+}
+
+// The network task starts first so WiFi can associate while we calibrate. Every request
+// goes through it, so loop() never waits on HTTP.
+static void startNetwork() {
+  httpTransport.setStore(&nvsStore);
+  networkManager.setStore(&nvsStore);
+  networkWorker.setCallback(onNetworkResult, NULL);
+  networkWorker.setDeviceConfig(&deviceConfig);
+
+  // offline backlog lives in flash so an outage (or a reboot during one) loses nothing
+  telemetryStore.setCursorStore(&nvsStore);
+  if (LittleFS.begin(true) && telemetryStore.begin(LittleFS)) {
+    networkWorker.setStore(&telemetryStore);
+  } else {
+    Serial.println("Offline store unavailable - data sent while offline will be lost");
+  }
+
+  if (!networkWorker.start()) {
+    Serial.println("Network worker failed to start!");
+  }
+}
+
+// Sensor, calibration and the sampling task, the part of startup nothing can skip
+static void startMonitoring() {
+  // start recording before initialize() so the calibration readings are in the trace
+#if TRACE_CAPTURE == TRACE_CAPTURE_SERIAL
+  traceWriter.begin(&Serial, SAMPLING_PERIOD_MS * 1000UL);
+#elif TRACE_CAPTURE == TRACE_CAPTURE_FLASH
+  if (LittleFS.begin(true) && (traceFile = LittleFS.open(TRACE_FILE_PATH, FILE_WRITE))) {
+    traceWriter.begin(&traceFile, SAMPLING_PERIOD_MS * 1000UL, TRACE_FILE_MAX_BYTES, true);
+  } else {
+    Serial.println("Trace file unavailable - not recording");
+  }
+#endif
+  // the sampling side only queues blocks, this task writes them out
+  if (traceWriter.isActive() && !traceDrainTask.start()) {
+    Serial.println("Trace task failed to start - not recording");
+    traceWriter.end();
+  }
+
   Serial.println("Initializing MPU6050 sensor...");
   if (!gyroSensor.initialize()) {
     Serial.println("Failed to initialize MPU6050!");
     // Error indicator - rapid LED blinking
+    statusLed.start(LED_PATTERN_ERROR);
     while (1) {
-      digitalWrite(LED_PIN, HIGH);
-      delay(100);
-      digitalWrite(LED_PIN, LOW);
-      delay(100);
+      delay(1000);
     }
   }
+  BootTimeline::mark(BOOT_SENSOR_READY);
   
   button.initialize();
   
-  fallDetection = new FallDetection(gyroSensor);
-  
-  Serial.println("Calibrating sensor - keep device still...");
-  fallDetection->setState(STATE_CALIBRATING);
-  digitalWrite(LED_PIN, HIGH); 
+  fallDetection = new FallDetection(gyroSensor, statusLed, deviceConfig);
   
-  gyroSensor.calibrate();
-  
-  digitalWrite(LED_PIN, LOW); 
+  // after the first boot the stored offsets are good enough to start with, the bias
+  // tracker keeps refining them whenever the device lies still
+  gyroSensor.setCalibrationStore(&nvsStore);
+  if (gyroSensor.loadCalibration()) {
+    Serial.println("Calibration restored");
+  } else {
+    Serial.println("Calibrating sensor - keep device still...");
+    fallDetection->setState(STATE_CALIBRATING);
+    statusLed.start(LED_PATTERN_CALIBRATING);
+
+    // only keep it if the device really was still, otherwise measure again next boot
+    if (gyroSensor.calibrate()) {
+      gyroSensor.saveCalibration();
+    }
+    statusLed.start(LED_PATTERN_OFF);
+  }
+  BootTimeline::mark(BOOT_CALIBRATED);
+
+  // from here on only the sampling task talks to the sensor
+  if (!samplingTask.start()) {
+    Serial.println("Sampling task failed to start!");
+  }
+
   fallDetection->setState(STATE_MONITORING);
-  Serial.println("System ready and monitoring for falls");
-  
-  if(speaker.begin()) {
-    Serial.println("Speaker ready!");
+  BootTimeline::mark(BOOT_MONITORING);
+  Serial.printf("System ready and monitoring for falls (%lu ms after boot)\n",
+                (unsigned long)BootTimeline::getMs(BOOT_MONITORING));
+}
+
+// "log" lists the module levels, "log <module> <level>" sets one
+static void handleLogCommand(char *args) {
+  char *moduleName = strtok(args, " ");
+  char *levelName = strtok(NULL, " ");
+  LogModule module;
+  LogLevel level;
+
+  if (moduleName == NULL) {
+    for (int i = 0; i < LOG_MODULE_COUNT; i++) {
+      Serial.printf("%-8s %s\n", Log::moduleName((LogModule)i), Log::levelName(Log::getLevel((LogModule)i)));
+    }
+    Serial.printf("%lu records dropped\n", (unsigned long)Log::getDroppedCount());
+  } else if (levelName != NULL && Log::parseModule(moduleName, module) && Log::parseLevel(levelName, level)) {
+    Log::setLevel(module, level);
+    Serial.printf("Log level %s = %s\n", moduleName, levelName);
   } else {
-    Serial.println("ERROR setting up speaker!");
+    Serial.println("Usage: log [main|sensor|fall|net|audio none|error|warn|info|debug]");
+  }
+}
+
+static void printCalibration() {
+  float accel[3], gyro[3];
+  gyroSensor.getCalibration(accel, gyro);
+  Serial.printf("Accel offsets: X: %.1f, Y: %.1f, Z: %.1f counts\n", accel[0], accel[1], accel[2]);
+  Serial.printf("Gyro offsets: X: %.1f, Y: %.1f, Z: %.1f counts\n", gyro[0], gyro[1], gyro[2]);
+  Serial.printf("%lu still windows since boot\n", (unsigned long)gyroSensor.getBiasUpdateCount());
+}
+
+// Line commands on the serial console:
+//   prof        - per-probe latency percentiles (Profiler.h)
+//   prof reset  - start the histograms over
+//   log ...     - per-module log levels, see handleLogCommand()
+//   boot        - when each startup step finished (BootTimeline.h)
+//   cal         - current calibration offsets
+//   rate        - sensor rate profile in use (RateProfile.h)
+static void handleSerialCommands() {
+  static char line[32];
+  static size_t length = 0;
+
+  while (Serial.available() > 0) {
+    char c = (char)Serial.read();
+    if (c == '\r') continue;
+    if (c != '\n') {
+      if (length < sizeof(line) - 1) line[length++] = c;
+      continue;
+    }
+    line[length] = '\0';
+    length = 0;
+
+    if (strcmp(line, "prof") == 0) {
+      Profiler::dump(Serial);
+    } else if (strcmp(line, "prof reset") == 0) {
+      Profiler::reset();
+      Serial.println("Profiler reset");
+    } else if (strcmp(line, "boot") == 0) {
+      BootTimeline::report(Serial);
+    } else if (strcmp(line, "cal") == 0) {
+      printCalibration();
+    } else if (strcmp(line, "rate") == 0) {
+      const RateProfile &profile = getRateProfile(gyroSensor.getRateProfile());
+      Serial.printf("Rate profile %s: %lu Hz, DLPF %u Hz, I2C %lu kHz, poll every %lu ms, %lu switches\n",
+                    profile.name, (unsigned long)(1000000UL / profile.samplePeriodUs), profile.bandwidthHz,
+                    (unsigned long)(profile.i2cClockHz / 1000), (unsigned long)profile.pollPeriodMs,
+                    (unsigned long)gyroSensor.getRateSwitchCount());
+    } else if (strncmp(line, "log", 3) == 0 && (line[3] == '\0' || line[3] == ' ')) {
+      handleLogCommand(line + 3);
+    } else if (line[0] != '\0') {
+      Serial.printf("Unknown command: %s\n", line);
+    }
+  }
+}
+
+// Startup runs the shortest path to monitoring in the foreground and leaves everything
+// slow to the background: the network task brings up WiFi, the auth token and the
+// registration (both cached in NVS after the first boot) while we calibrate, and the
+// speaker only starts once the sampling task is running. "boot" on the serial console
+// shows how long each step took.
+void setup() {
+  Serial.begin(115200);
+
+  // everything logged with LOG_* is printed from here, at idle priority
+  if (!logDrainTask.start()) {
+    Serial.println("Log task failed to start - deferred log output lost");
   }
   
-  // Initialize WiFi, fetch token, and register device
-  // The initialize() method now handles token fetching and internal registration
-  if (!networkManager.initialize()) { // This line now does everything needed
-    Serial.println("Network initialization failed! Check WiFi and server.");
-    // You might want to add an error indicator here too, like LED blinking
+  // all blinking from here on runs off the LED timer, nothing below waits for it
+  if (!statusLed.begin()) {
+    Serial.println("LED timer failed to start!");
   }
 
+  // no network needed for the config, the server's latest is refreshed in the background
+  deviceConfig.setStore(&nvsStore);
+  if (!nvsStore.begin()) {
+    Serial.println("NVS unavailable - device config won't survive a reboot");
+  } else if (deviceConfig.load()) {
+    Serial.printf("Device configuration restored (ETag %s)\n", deviceConfig.getEtag().c_str());
+  } else {
+    Serial.println("Using default configuration values");
+  }
 
-   if (networkManager.fetchDeviceConfig()) {
-      Serial.println("Device configuration loaded successfully");
-    } else {
-      Serial.println("Using default configuration values");
-    }
-  // ---- REMOVE THE LINE BELOW ----
-  // networkManager.registerDeviceInternal(); // THIS LINE WAS CAUSING THE ERROR
-  // ---- END REMOVAL ----
+  startNetwork();
+  startMonitoring();
   
-  digitalWrite(LED_PIN, HIGH);
-  delay(100);
-  digitalWrite(LED_PIN, LOW);
+  if(speaker.begin()) {
+    Serial.println("Speaker ready!");
+  } else {
+    Serial.println("ERROR setting up speaker!");
+  }
+  
+  statusLed.start(LED_PATTERN_READY);
+  BootTimeline::mark(BOOT_SETUP_DONE);
 }
 
 void loop() {
-  speaker.update(); // might need relocation
+  // audio runs on its own task now, no speaker.update() needed here
+
+  handleSerialCommands();
+
+  // the bias tracker moves the offsets a little at a time, keep the stored ones close
+  if (millis() - lastCalibrationSave >= CALIBRATION_SAVE_INTERVAL_MS) {
+    lastCalibrationSave = millis();
+    if (gyroSensor.saveCalibration()) {
+      LOG_INFO(MAIN, "Calibration saved (%lu tracker updates)", (unsigned long)gyroSensor.getBiasUpdateCount());
+    }
+  }
 
   if (button.isPressed()) {
-    Serial.println("Button pressed");
+    LOG_INFO(MAIN, "Button pressed");
     
     // Cancel alarm if in alarm state
     if (fallDetection->getState() == STATE_FALL_DETECTED || 
@@ -97,82 +317,97 @@ void loop() {
       fallDetection->cancelAlarm();
       fallDetection->setState(STATE_MONITORING);
       fallTimestamp = 0;
-      fallReported = false;  // Reset fall reported flag
+      alertPending = false;  // nothing left to send for this fall
       speaker.stopTone(); // stop alarm
-      speaker.playBeep(350, 500, ALARM_SOUND_VOLUME);
+      if (!speaker.playPrompt(PROMPT_ALARM_CANCELLED)) {
+        speaker.playBeep(350, 500, deviceConfig.get().alarmVolume);
+      }
     }
     
     button.clearPressFlag();
   }
   
+  // Drain everything the sampling task produced since last time. This happens in every
+  // state so the ring never fills up with stale samples while we wait for the alarm delay.
+  ImuSample sample;
+  while (sampleRing.pop(sample)) {
+    latestSample = sample;
+    fallDetection->updateOrientation(sample);
+
+    // post-impact check gets one sample at a time, same stream as everything else
+    if (fallDetection->getState() == STATE_FALL_DETECTED && fallDetection->isPostImpactCheckActive()) {
+      PostImpactResult result = fallDetection->updatePostImpactCheck(sample);
+      if (result == POST_IMPACT_CONFIRMED) {
+        raiseAlarm();
+      } else if (result == POST_IMPACT_CLEARED) {
+        // False alarm, return to monitoring
+        LOG_INFO(FALL, "Movement detected after fall - likely not an emergency");
+        fallDetection->cancelAlarm();
+        fallDetection->setState(STATE_MONITORING);
+        fallTimestamp = 0;
+      }
+      continue;
+    }
+
+    if (fallDetection->getState() != STATE_MONITORING) {
+      continue;
+    }
+
+    // regular telemetry is collected into windows and uploaded below
+    // (only the samples it keeps are converted to m/s^2 and deg/s)
+    uint32_t timestampMs = sampleTimeMs(sample);
+    if (!telemetryBatcher.add(timestampMs, sample)) {
+      networkWorker.submitBatch(telemetryBatcher.samples(), telemetryBatcher.count());
+      telemetryBatcher.clear();
+      telemetryBatcher.add(timestampMs, sample);
+    }
+
+    if (fallDetection->detectFall(sample)) {
+      LOG_WARN(FALL, "POTENTIAL FALL DETECTED - Monitoring for inactivity");
+      statusLed.start(LED_PATTERN_FALL_DETECTED);
+      speaker.playPrompt(PROMPT_FALL_DETECTED); // "press the button if you are OK"
+      fallTimestamp = millis();
+      fallDetection->setState(STATE_FALL_DETECTED);
+    }
+  }
+
   // Main state machine
   switch (fallDetection->getState()) {
     case STATE_MONITORING:
-      // Sample sensor at regular intervals
-      if (millis() - lastSampleTime >= SAMPLING_PERIOD_MS) {
-        lastSampleTime = millis();
-        gyroSensor.process();
-        
-        // Detect falls
-        if (fallDetection->detectFall()) {
-          Serial.println("POTENTIAL FALL DETECTED - Monitoring for inactivity");
-          digitalWrite(LED_PIN, HIGH); 
-          fallTimestamp = millis();
-          fallDetection->setState(STATE_FALL_DETECTED);
+      // Send the telemetry window once it is full or old enough
+      if (telemetryBatcher.shouldFlush(millis())) {
+        if (!networkWorker.submitBatch(telemetryBatcher.samples(), telemetryBatcher.count())) {
+          LOG_WARN(NET, "Network queue full - telemetry window dropped");
         }
-        
-        // Send regular sensor updates to server
-        float accelMagnitude, gyroMagnitude;
-        gyroSensor.getAccelGyroData(accelMagnitude, gyroMagnitude);
-        networkManager.sendSensorData(accelMagnitude, gyroMagnitude, false);
+        telemetryBatcher.clear();
       }
       
       // Debug output every second
       if (millis() - lastDebugOutput >= 1000) {
         lastDebugOutput = millis();
-        float accelMagnitude, gyroMagnitude;
-        gyroSensor.getAccelGyroData(accelMagnitude, gyroMagnitude);
         
-        Serial.print("Accel: ");
-        Serial.print(accelMagnitude);
-        Serial.print(" m/s²  |  Gyro: ");
-        Serial.print(gyroMagnitude);
-        Serial.println(" deg/s");
+        LOG_DEBUG(MAIN, "Accel: %.2f m/s²  |  Gyro: %.2f deg/s  |  Tilt: %.0f deg  |  Max jitter: %lu us  |  Dropped: %lu",
+                  latestSample.accelMagnitude(), latestSample.gyroMagnitude(), fallDetection->getOrientation().getTiltDeg(),
+                  (unsigned long)samplingTask.getMaxJitterUs(), (unsigned long)samplingTask.getDroppedSamples());
       }
       break;
       
     case STATE_FALL_DETECTED:
-      // Check if alarm delay has passed
-      if (fallTimestamp > 0 && millis() - fallTimestamp >= ALARM_DELAY_MS) {
-        // Check for post-fall inactivity (medical emergency)
-        if (fallDetection->detectInactivityAfterImpact()) {
-          fallDetection->triggerAlarm();
-          fallDetection->setState(STATE_ALARM_ACTIVE);
-          speaker.playTone(ALARM_SOUND_FREQUENCY_HZ, ALARM_SOUND_VOLUME); // Sound alarm
-          
-          // Send fall alert to server immediately
-          if (!fallReported) {
-            float accelMagnitude, gyroMagnitude;
-            gyroSensor.getAccelGyroData(accelMagnitude, gyroMagnitude);
-            networkManager.sendSensorData(accelMagnitude, gyroMagnitude, true);
-            fallReported = true;  // Mark as reported
-          }
-        } else {
-          // False alarm, return to monitoring
-          Serial.println("Movement detected after fall - likely not an emergency");
-          fallDetection->cancelAlarm();
-          fallDetection->setState(STATE_MONITORING);
-          fallTimestamp = 0;
-        }
+      // Once the alarm delay has passed, start checking for post-fall inactivity
+      // (medical emergency). The samples are fed to it in the drain loop above.
+      if (fallTimestamp > 0 && millis() - fallTimestamp >= fallDetection->getAlarmDelayMs() &&
+          !fallDetection->isPostImpactCheckActive()) {
+        fallDetection->beginPostImpactCheck();
+        fallTimestamp = 0; // only start it once
       }
-      
-      // LED blink pattern for fall detection
-      digitalWrite(LED_PIN, (millis() % 1000) < 500);
       break;
       
     case STATE_ALARM_ACTIVE:
-      // Visual alarm - LED rapid blinking
-      digitalWrite(LED_PIN, (millis() % 300) < 150);
+      // alert didn't make it into the queue (or the worker gave up), try again now and
+      // then rather than on every pass
+      if (alertPending && millis() - lastAlertSubmit >= NETWORK_ALERT_RESUBMIT_MS) {
+        submitFallAlert();
+      }
       break;
       
     default:
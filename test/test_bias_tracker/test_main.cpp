@@ -0,0 +1,67 @@
+// BiasTracker windows are BIAS_WINDOW_US of sample time: the idle, normal and burst rates
+// all refine the offsets once per window by the same amount, and a window that moved is
+// skipped whatever its sample count.
+
+#include <unity.h>
+#include "BiasTracker.h"
+
+static const int16_t GYRO_BIAS[3] = { 12, -9, 5 };
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static RawImuSample stillSample(uint32_t timestampUs) {
+  RawImuSample s;
+  s.timestampUs = timestampUs;
+  s.accelX = 0;
+  s.accelY = 0;
+  s.accelZ = (int16_t)ACCEL_LSB_PER_G;
+  s.gyroX = GYRO_BIAS[0];
+  s.gyroY = GYRO_BIAS[1];
+  s.gyroZ = GYRO_BIAS[2];
+  return s;
+}
+
+// 3.5s lying still: three windows close, at any rate
+static void test_windows_follow_sample_time(void) {
+  const uint32_t periodsUs[] = { 20000, 10000, 1000 };
+  float first[3] = { 0, 0, 0 };
+  for (size_t p = 0; p < sizeof(periodsUs) / sizeof(periodsUs[0]); p++) {
+    BiasTracker tracker;
+    uint32_t updates = 0;
+    for (uint32_t t = 0; t < 3500000UL; t += periodsUs[p]) {
+      if (tracker.add(stillSample(1000000UL + t))) updates++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, updates);
+    TEST_ASSERT_EQUAL_UINT32(3, tracker.getUpdateCount());
+
+    float accel[3], gyro[3];
+    tracker.getOffsets(accel, gyro);
+    for (int i = 0; i < 3; i++) {
+      if (p == 0) first[i] = gyro[i];
+      TEST_ASSERT_FLOAT_WITHIN(0.001F, first[i], gyro[i]);
+    }
+  }
+  // three windows at BIAS_GYRO_GAIN
+  float share = 1.0F - (1.0F - BIAS_GYRO_GAIN) * (1.0F - BIAS_GYRO_GAIN) * (1.0F - BIAS_GYRO_GAIN);
+  TEST_ASSERT_FLOAT_WITHIN(0.001F, share * GYRO_BIAS[0], first[0]);
+}
+
+// a bump in the middle of a burst-rate window throws that window away, the next one counts
+static void test_moving_window_is_skipped(void) {
+  BiasTracker tracker;
+  uint32_t updates = 0;
+  for (uint32_t t = 0; t < 2500000UL; t += 1000) {
+    RawImuSample s = stillSample(t);
+    if (t == 500000UL) s.accelX = 2 * BIAS_STILL_ACCEL_SPAN;
+    if (tracker.add(s)) updates++;
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, updates);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_windows_follow_sample_time);
+  RUN_TEST(test_moving_window_is_skipped);
+  return UNITY_END();
+}
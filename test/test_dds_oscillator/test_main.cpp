@@ -0,0 +1,182 @@
+// DdsOscillator PCM against a float sine reference: sample error, pitch, phase continuity
+// across buffers, loop mode and saturating mix.
+
+#include <unity.h>
+#include "DdsOscillator.h"
+
+static const uint32_t RATE = 44100;
+// table interpolation (~2.5 LSB at 256 entries) plus the table rounding and the two
+// fixed-point shifts rounding down
+static const int32_t MAX_ERROR_LSB = 5;
+static int16_t pcm[RATE];
+static int16_t other[RATE];
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// largest distance between the DDS output and the float sine with the same amplitude
+static int32_t maxErrorAgainstSine(const int16_t *samples, int count, double frequency, float volume) {
+  int32_t amplitude = (int32_t)(volume * 32767.0f);
+  int32_t worst = 0;
+  for (int n = 0; n < count; n++) {
+    double reference = sin(2.0 * M_PI * frequency * n / RATE) * amplitude;
+    int32_t error = (int32_t)fabs(samples[n] - reference);
+    if (error > worst) worst = error;
+  }
+  return worst;
+}
+
+// frequency from the first and last rising zero crossing, crossing times interpolated
+static double measuredFrequency(const int16_t *samples, int count) {
+  double first = -1, last = -1;
+  int cycles = -1;
+  for (int n = 1; n < count; n++) {
+    if (samples[n - 1] < 0 && samples[n] >= 0) {
+      double t = n - 1 + (double)-samples[n - 1] / (samples[n] - samples[n - 1]);
+      if (first < 0) first = t;
+      last = t;
+      cycles++;
+    }
+  }
+  return cycles > 0 ? cycles * (double)RATE / (last - first) : 0;
+}
+
+static void test_interpolated_matches_sine(void) {
+  const int frequencies[] = { 100, 440, 880, 1000, 3000, 8000 };
+  for (int f : frequencies) {
+    DdsOscillator osc;
+    osc.setSampleRate(RATE);
+    osc.setTone(f, 1.0f);
+    osc.render(pcm, RATE);
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_ERROR_LSB, maxErrorAgainstSine(pcm, RATE, f, 1.0f));
+  }
+}
+
+static void test_volume_scales_the_amplitude(void) {
+  DdsOscillator osc;
+  osc.setSampleRate(RATE);
+  osc.setTone(880, 0.1f);
+  osc.render(pcm, RATE);
+  TEST_ASSERT_LESS_OR_EQUAL(2, maxErrorAgainstSine(pcm, RATE, 880, 0.1f));
+
+  int16_t peak = 0;
+  for (uint32_t n = 0; n < RATE; n++) if (pcm[n] > peak) peak = pcm[n];
+  TEST_ASSERT_INT_WITHIN(3, 3276, peak);
+
+  osc.setTone(880, 0.0f);
+  osc.render(pcm, 1000);
+  for (int n = 0; n < 1000; n++) TEST_ASSERT_EQUAL_INT16(0, pcm[n]);
+}
+
+// many small buffers give exactly what one big one gives, in both modes
+static void test_phase_continues_across_buffers(void) {
+  DdsMode modes[] = { DDS_MODE_INTERPOLATED, DDS_MODE_LOOP };
+  for (DdsMode mode : modes) {
+    DdsOscillator whole, chunked;
+    whole.setMode(mode);
+    chunked.setMode(mode);
+    whole.setSampleRate(RATE);
+    chunked.setSampleRate(RATE);
+    whole.setTone(1319, 0.5f);
+    chunked.setTone(1319, 0.5f);
+
+    whole.render(pcm, 10000);
+    for (int pos = 0, chunk = 1; pos < 10000; pos += chunk, chunk = chunk % 97 + 7) {
+      chunked.render(other + pos, pos + chunk > 10000 ? 10000 - pos : chunk);
+    }
+    TEST_ASSERT_EQUAL_MEMORY(pcm, other, 10000 * sizeof(int16_t));
+  }
+}
+
+// the looped table is the same sine, and its pitch error stays far below audible
+static void test_loop_mode_pitch_and_shape(void) {
+  const int frequencies[] = { 440, 880, 1047, 2093 };
+  for (int f : frequencies) {
+    DdsOscillator osc;
+    osc.setMode(DDS_MODE_LOOP);
+    osc.setSampleRate(RATE);
+    osc.setTone(f, 1.0f);
+    osc.render(pcm, RATE);
+
+    double measured = measuredFrequency(pcm, RATE);
+    TEST_ASSERT_LESS_THAN(1e-3, fabs(measured - f) / f);
+    // the loop plays its own, slightly shifted pitch; against that it is the same sine
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_ERROR_LSB, maxErrorAgainstSine(pcm, DdsOscillator::LOOP_TABLE_MAX, measured, 1.0f));
+  }
+}
+
+static void test_interpolated_pitch_is_exact(void) {
+  DdsOscillator osc;
+  osc.setSampleRate(RATE);
+  osc.setTone(880, 1.0f);
+  osc.render(pcm, RATE);
+  TEST_ASSERT_LESS_THAN(1e-5, fabs(measuredFrequency(pcm, RATE) - 880) / 880);
+}
+
+// a period longer than the loop table falls back to per-sample synthesis
+static void test_low_tone_in_loop_mode_falls_back(void) {
+  DdsOscillator looped, direct;
+  looped.setMode(DDS_MODE_LOOP);
+  looped.setSampleRate(RATE);
+  direct.setSampleRate(RATE);
+  looped.setTone(20, 1.0f);
+  direct.setTone(20, 1.0f);
+  looped.render(pcm, 5000);
+  direct.render(other, 5000);
+  TEST_ASSERT_EQUAL_MEMORY(other, pcm, 5000 * sizeof(int16_t));
+  TEST_ASSERT_LESS_OR_EQUAL(MAX_ERROR_LSB, maxErrorAgainstSine(pcm, 5000, 20, 1.0f));
+}
+
+// mix adds onto the buffer and clips instead of wrapping
+static void test_mix_adds_with_saturation(void) {
+  DdsOscillator a, b;
+  a.setSampleRate(RATE);
+  b.setSampleRate(RATE);
+  a.setTone(1000, 1.0f);
+  b.setTone(1000, 1.0f);
+  a.render(other, 1000);
+
+  for (int n = 0; n < 1000; n++) pcm[n] = 20000;
+  b.mix(pcm, 1000);
+  for (int n = 0; n < 1000; n++) {
+    int32_t expected = 20000 + other[n];
+    if (expected > 32767) expected = 32767;
+    TEST_ASSERT_EQUAL_INT16(expected, pcm[n]);
+  }
+}
+
+// the sinf() reference mode is the float sine to within rounding
+static void test_sine_mode_matches_sine(void) {
+  DdsOscillator osc;
+  osc.setMode(DDS_MODE_SINE);
+  osc.setSampleRate(RATE);
+  osc.setTone(1047, 1.0f);
+  osc.render(pcm, RATE);
+  TEST_ASSERT_LESS_OR_EQUAL(2, maxErrorAgainstSine(pcm, 4410, 1047, 1.0f));
+  TEST_ASSERT_LESS_THAN(1e-5, fabs(measuredFrequency(pcm, RATE) - 1047) / 1047);
+}
+
+// restarting the tone starts the waveform over
+static void test_reset_phase(void) {
+  DdsOscillator osc;
+  osc.setSampleRate(RATE);
+  osc.setTone(440, 1.0f);
+  osc.render(pcm, 777);
+  osc.resetPhase();
+  osc.render(pcm, 100);
+  TEST_ASSERT_LESS_OR_EQUAL(MAX_ERROR_LSB, maxErrorAgainstSine(pcm, 100, 440, 1.0f));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_interpolated_matches_sine);
+  RUN_TEST(test_volume_scales_the_amplitude);
+  RUN_TEST(test_phase_continues_across_buffers);
+  RUN_TEST(test_loop_mode_pitch_and_shape);
+  RUN_TEST(test_interpolated_pitch_is_exact);
+  RUN_TEST(test_low_tone_in_loop_mode_falls_back);
+  RUN_TEST(test_mix_adds_with_saturation);
+  RUN_TEST(test_sine_mode_matches_sine);
+  RUN_TEST(test_reset_phase);
+  return UNITY_END();
+}
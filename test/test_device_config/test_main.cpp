@@ -0,0 +1,170 @@
+// DeviceConfig::parse() on real /device-config bodies: every key, defaults for missing
+// ones, the older fallDetectionSensitivity name, and documents that have to be refused
+// as a whole (out of range, NaN/infinity, wrong types, broken JSON). Then apply() and
+// load() through an in-memory store.
+
+#include <unity.h>
+#include "DeviceConfig.h"
+#include "SimHal.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static bool parse(const char *json, DeviceSettings &out) {
+  return DeviceConfig::parse(json, strlen(json), out);
+}
+
+static bool accepted(const char *json) {
+  DeviceSettings s;
+  return parse(json, s);
+}
+
+static void test_full_document(void) {
+  const char *json =
+    "{\"freeFallThreshold\": 3.5, \"impactThreshold\": 24.5, \"inactivityThreshold\": 1.25,"
+    " \"gyroThreshold\": 300, \"postImpactWindowMs\": 4000, \"alarmDelayMs\": 15000,"
+    " \"requiredStillSamples\": 150, \"calibrationSamples\": 120, \"alarmFrequencyHz\": 2000,"
+    " \"alarmVolume\": 0.6, \"minPostureChangeDeg\": 45, \"firmwareChannel\": \"beta\"}";
+  DeviceSettings s;
+  TEST_ASSERT_TRUE(parse(json, s));
+  TEST_ASSERT_EQUAL_FLOAT(3.5F, s.freeFallThreshold);
+  TEST_ASSERT_EQUAL_FLOAT(24.5F, s.impactThreshold);
+  TEST_ASSERT_EQUAL_FLOAT(1.25F, s.inactivityThreshold);
+  TEST_ASSERT_EQUAL_FLOAT(300.0F, s.gyroThreshold);
+  TEST_ASSERT_EQUAL_UINT32(4000, s.postImpactWindowMs);
+  TEST_ASSERT_EQUAL_UINT32(15000, s.alarmDelayMs);
+  TEST_ASSERT_EQUAL_UINT32(150, s.requiredStillSamples);
+  TEST_ASSERT_EQUAL_UINT32(120, s.calibrationSamples);
+  TEST_ASSERT_EQUAL_UINT32(2000, s.alarmFrequencyHz);
+  TEST_ASSERT_EQUAL_FLOAT(0.6F, s.alarmVolume);
+  TEST_ASSERT_EQUAL_FLOAT(45.0F, s.minPostureChangeDeg);
+}
+
+static void test_missing_and_null_keys_keep_defaults(void) {
+  DeviceSettings defaults = DeviceConfig::defaults();
+  DeviceSettings s;
+  TEST_ASSERT_TRUE(parse("{}", s));
+  TEST_ASSERT_EQUAL_MEMORY(&defaults, &s, sizeof(s));
+
+  TEST_ASSERT_TRUE(parse("{\"alarmVolume\": null, \"alarmDelayMs\": 5000}", s));
+  TEST_ASSERT_EQUAL_FLOAT(defaults.alarmVolume, s.alarmVolume);
+  TEST_ASSERT_EQUAL_UINT32(5000, s.alarmDelayMs);
+  TEST_ASSERT_EQUAL_FLOAT(defaults.impactThreshold, s.impactThreshold);
+}
+
+// what the first server API sent; impactThreshold wins when both are there
+static void test_fall_detection_sensitivity(void) {
+  DeviceSettings s;
+  TEST_ASSERT_TRUE(parse("{\"fallDetectionSensitivity\": 20}", s));
+  TEST_ASSERT_EQUAL_FLOAT(20.0F, s.impactThreshold);
+  TEST_ASSERT_TRUE(parse("{\"impactThreshold\": 30, \"fallDetectionSensitivity\": 20}", s));
+  TEST_ASSERT_EQUAL_FLOAT(30.0F, s.impactThreshold);
+  TEST_ASSERT_FALSE(accepted("{\"fallDetectionSensitivity\": 200}"));
+}
+
+// one bad value refuses the document, the output is left alone
+static void test_out_of_range(void) {
+  const char *bad[] = {
+    "{\"freeFallThreshold\": 0.1}",
+    "{\"freeFallThreshold\": -3}",
+    "{\"impactThreshold\": 80}",
+    "{\"inactivityThreshold\": 10}",
+    "{\"gyroThreshold\": 5}",
+    "{\"gyroThreshold\": 501}",
+    "{\"postImpactWindowMs\": 100}",
+    "{\"alarmDelayMs\": 120001}",
+    "{\"requiredStillSamples\": 0}",
+    "{\"calibrationSamples\": 201}",
+    "{\"alarmFrequencyHz\": 99}",
+    "{\"alarmVolume\": 1.5}",
+    "{\"minPostureChangeDeg\": -1}",
+    "{\"minPostureChangeDeg\": 181}",
+    // 300 still samples of 10ms don't fit a 2s window
+    "{\"requiredStillSamples\": 300, \"postImpactWindowMs\": 2000}",
+  };
+  for (const char *json : bad) {
+    DeviceSettings s = DeviceConfig::defaults();
+    s.alarmVolume = 0.123F;
+    TEST_ASSERT_FALSE_MESSAGE(parse(json, s), json);
+    TEST_ASSERT_EQUAL_FLOAT(0.123F, s.alarmVolume);
+  }
+  // the range ends themselves are fine
+  TEST_ASSERT_TRUE(accepted("{\"freeFallThreshold\": 0.5, \"impactThreshold\": 78, \"alarmVolume\": 0}"));
+  TEST_ASSERT_TRUE(accepted("{\"gyroThreshold\": 500, \"alarmDelayMs\": 0, \"alarmVolume\": 1}"));
+}
+
+// JSON has no NaN; the literal is a syntax error and an overflowing number is infinity,
+// both have to be refused rather than end up in a comparison that is never true
+static void test_nan_and_infinity(void) {
+  TEST_ASSERT_FALSE(accepted("{\"impactThreshold\": NaN}"));
+  TEST_ASSERT_FALSE(accepted("{\"impactThreshold\": nan}"));
+  TEST_ASSERT_FALSE(accepted("{\"alarmVolume\": Infinity}"));
+  TEST_ASSERT_FALSE(accepted("{\"impactThreshold\": 1e999}"));
+  TEST_ASSERT_FALSE(accepted("{\"freeFallThreshold\": -1e999}"));
+
+  DeviceSettings s = DeviceConfig::defaults();
+  s.impactThreshold = NAN;
+  TEST_ASSERT_FALSE(DeviceConfig::validate(s));
+}
+
+static void test_wrong_types(void) {
+  TEST_ASSERT_FALSE(accepted("{\"impactThreshold\": \"24.5\"}"));
+  TEST_ASSERT_FALSE(accepted("{\"impactThreshold\": true}"));
+  TEST_ASSERT_FALSE(accepted("{\"alarmDelayMs\": -5}"));
+  TEST_ASSERT_FALSE(accepted("{\"alarmDelayMs\": 1500.5}"));
+  TEST_ASSERT_FALSE(accepted("{\"requiredStillSamples\": [50]}"));
+  TEST_ASSERT_FALSE(accepted("{\"fallDetectionSensitivity\": {\"level\": 3}}"));
+  // counts may come as plain integers only, thresholds as any number
+  TEST_ASSERT_TRUE(accepted("{\"impactThreshold\": 25, \"alarmDelayMs\": 1500}"));
+}
+
+static void test_broken_documents(void) {
+  TEST_ASSERT_FALSE(accepted(""));
+  TEST_ASSERT_FALSE(accepted("{\"impactThreshold\": 24.5"));
+  TEST_ASSERT_FALSE(accepted("[1, 2, 3]"));
+  TEST_ASSERT_FALSE(accepted("42"));
+  TEST_ASSERT_FALSE(accepted("<html>502 Bad Gateway</html>"));
+}
+
+// a parsed config goes through apply() into the store and comes back with load()
+static void test_apply_and_load(void) {
+  SimKeyValueStore store;
+  DeviceConfig config;
+  config.setStore(&store);
+  DeviceSettings s;
+  TEST_ASSERT_TRUE(parse("{\"impactThreshold\": 22, \"alarmVolume\": 0.4}", s));
+
+  uint32_t version = config.getVersion();
+  TEST_ASSERT_TRUE(config.apply(s, "\"v7\""));
+  TEST_ASSERT_TRUE(config.getVersion() != version);
+  TEST_ASSERT_EQUAL_UINT32(1, store.getPutCount());
+  // the same settings again: no new version, no flash write
+  version = config.getVersion();
+  TEST_ASSERT_TRUE(config.apply(s, "\"v7\""));
+  TEST_ASSERT_EQUAL_UINT32(version, config.getVersion());
+  TEST_ASSERT_EQUAL_UINT32(1, store.getPutCount());
+
+  DeviceConfig restored;
+  restored.setStore(&store);
+  TEST_ASSERT_TRUE(restored.load());
+  TEST_ASSERT_EQUAL_FLOAT(22.0F, restored.get().impactThreshold);
+  TEST_ASSERT_EQUAL_FLOAT(0.4F, restored.get().alarmVolume);
+  TEST_ASSERT_EQUAL_STRING("\"v7\"", restored.getEtag().c_str());
+
+  s.alarmVolume = 2.0F;
+  TEST_ASSERT_FALSE(config.apply(s, "\"v8\""));
+  TEST_ASSERT_EQUAL_FLOAT(0.4F, config.get().alarmVolume);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_full_document);
+  RUN_TEST(test_missing_and_null_keys_keep_defaults);
+  RUN_TEST(test_fall_detection_sensitivity);
+  RUN_TEST(test_out_of_range);
+  RUN_TEST(test_nan_and_infinity);
+  RUN_TEST(test_wrong_types);
+  RUN_TEST(test_broken_documents);
+  RUN_TEST(test_apply_and_load);
+  return UNITY_END();
+}
@@ -0,0 +1,93 @@
+// FallDetection's pre-impact history keeps one entry per SAMPLING_PERIOD_MS slot of sample
+// time, so it spans PRE_IMPACT_WINDOW_MS at every rate profile: idle samples fill every
+// other slot and the one in between repeats, burst samples share a slot and the fastest
+// rotation in it is kept, a gap repeats the last slot up to a full buffer.
+
+#include <unity.h>
+#include "FallDetection.h"
+#include "SimHal.h"
+
+static const uint32_t SLOT_US = SAMPLING_PERIOD_MS * 1000UL;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// lying still at 1g; the gyro magnitude carries a marker so each entry can be traced back
+static ImuSample makeSample(uint32_t timestampUs, uint32_t marker) {
+  ImuSample s;
+  memset(&s, 0, sizeof(s));
+  s.timestampUs = timestampUs;
+  s.accelZ = (int16_t)ACCEL_LSB_PER_G;
+  s.accelMagSq = (uint32_t)s.accelZ * s.accelZ;
+  s.gyroMagSq = marker;
+  return s;
+}
+
+struct Detector {
+  SimImuDevice imu;
+  SimClock clock;
+  DeviceConfig config;
+  GyroSensor sensor;
+  LedController led;
+  FallDetection detection;
+
+  Detector() : sensor(imu, clock, config), detection(sensor, led, config) {}
+};
+
+static void test_idle_rate_spans_the_window(void) {
+  static Detector d;
+  const uint32_t periodUs = 2 * SLOT_US;   // 50Hz
+  for (uint32_t i = 0; i < 100; i++) d.detection.detectFall(makeSample(i * periodUs, i));
+
+  CircularBuffer<uint32_t, GYRO_BUFFER_SIZE> &history = d.detection.getGyroBuffer();
+  TEST_ASSERT_EQUAL(GYRO_BUFFER_SIZE, history.size());
+  // sample 99 closed sample 98's slot and the empty one after it
+  TEST_ASSERT_EQUAL_UINT32(98, history.last());
+  TEST_ASSERT_EQUAL_UINT32(98, history[GYRO_BUFFER_SIZE - 2]);
+  // the oldest entry is PRE_IMPACT_WINDOW_MS back, not twice that
+  TEST_ASSERT_EQUAL_UINT32(99 - PRE_IMPACT_WINDOW_MS * 1000UL / periodUs, history.first());
+}
+
+static void test_burst_keeps_one_entry_per_slot(void) {
+  static Detector d;
+  const uint32_t periodUs = 1000;   // 1kHz
+  const uint32_t count = 2 * PRE_IMPACT_WINDOW_MS;
+  for (uint32_t i = 0; i <= count; i++) d.detection.detectFall(makeSample(i * periodUs, i));
+
+  CircularBuffer<uint32_t, GYRO_BUFFER_SIZE> &history = d.detection.getGyroBuffer();
+  TEST_ASSERT_EQUAL(GYRO_BUFFER_SIZE, history.size());
+  // each slot keeps its fastest rotation, here the last sample in it
+  const uint32_t perSlot = SLOT_US / periodUs;
+  TEST_ASSERT_EQUAL_UINT32(count - 1, history.last());
+  TEST_ASSERT_EQUAL_UINT32(count - PRE_IMPACT_WINDOW_MS + perSlot - 1, history.first());
+}
+
+static void test_gap_repeats_the_last_slot(void) {
+  static Detector d;
+  for (uint32_t i = 0; i < 10; i++) d.detection.detectFall(makeSample(i * SLOT_US, i));
+  // 200ms with nothing, then the sampling goes on
+  const uint32_t resumeUs = 9 * SLOT_US + 200000UL;
+  d.detection.detectFall(makeSample(resumeUs, 100));
+  d.detection.detectFall(makeSample(resumeUs + SLOT_US, 101));
+
+  CircularBuffer<uint32_t, GYRO_BUFFER_SIZE> &history = d.detection.getGyroBuffer();
+  TEST_ASSERT_EQUAL(9 + 200000UL / SLOT_US + 1, history.size());
+  TEST_ASSERT_EQUAL_UINT32(100, history.last());
+  TEST_ASSERT_EQUAL_UINT32(9, history[history.size() - 2]);
+  TEST_ASSERT_EQUAL_UINT32(9, history[9]);
+  TEST_ASSERT_EQUAL_UINT32(8, history[8]);
+
+  // longer than the window: the buffer holds the last slot throughout, no more
+  d.detection.detectFall(makeSample(resumeUs + 10000000UL, 200));
+  TEST_ASSERT_EQUAL(GYRO_BUFFER_SIZE, history.size());
+  TEST_ASSERT_EQUAL_UINT32(101, history.first());
+  TEST_ASSERT_EQUAL_UINT32(101, history.last());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_idle_rate_spans_the_window);
+  RUN_TEST(test_burst_keeps_one_entry_per_slot);
+  RUN_TEST(test_gap_repeats_the_last_slot);
+  return UNITY_END();
+}
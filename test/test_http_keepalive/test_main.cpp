@@ -0,0 +1,74 @@
+// NetworkManager keeps one keep-alive connection for every endpoint: token, registration,
+// alert, batch and config requests all go over the first handshake. Only a dropped
+// connection or a transport error costs another one. SimHttpTransport counts a handshake
+// whenever a request finds no open connection to its host, as HTTPClient with reuse on.
+
+#include <unity.h>
+#include "NetworkManager.h"
+#include "SimHal.h"
+
+static const TelemetrySample WINDOW[] = {
+  { 1000, 9.8F, 1.5F },
+  { 1010, 9.7F, 2.5F },
+  { 1020, 9.9F, 0.5F },
+};
+static const size_t WINDOW_SAMPLES = sizeof(WINDOW) / sizeof(WINDOW[0]);
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_all_endpoints_share_one_connection(void) {
+  static SimHttpTransport http;
+  static NetworkManager network(http);
+  static SimKeyValueStore nvs;
+  DeviceConfig config;
+  config.setStore(&nvs);
+  network.setStore(&nvs);
+
+  TEST_ASSERT_TRUE(network.initialize());   // token GET and registration POST
+  TEST_ASSERT_EQUAL(SEND_OK, network.sendSensorData(12.0F, 300.0F, true));
+  TEST_ASSERT_EQUAL(SEND_OK, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+  TEST_ASSERT_TRUE(network.fetchDeviceConfig(config));
+  TEST_ASSERT_TRUE(network.fetchDeviceConfig(config));   // 304
+  TEST_ASSERT_EQUAL(SEND_OK, network.sendSensorData(9.8F, 1.0F, false));
+
+  TEST_ASSERT_EQUAL_UINT32(7, network.getRequestCount());
+  TEST_ASSERT_EQUAL_UINT32(1, network.getHandshakeCount());
+}
+
+// the server closing the idle connection costs exactly one new handshake
+static void test_dropped_connection_handshakes_once(void) {
+  static SimHttpTransport http;
+  static NetworkManager network(http);
+  TEST_ASSERT_TRUE(network.initialize());
+  TEST_ASSERT_EQUAL(SEND_OK, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+  TEST_ASSERT_EQUAL_UINT32(1, network.getHandshakeCount());
+
+  http.dropConnection();
+  TEST_ASSERT_EQUAL(SEND_OK, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+  TEST_ASSERT_EQUAL(SEND_OK, network.sendSensorData(12.0F, 300.0F, true));
+  TEST_ASSERT_EQUAL_UINT32(2, network.getHandshakeCount());
+}
+
+// a transport error closes the connection, the first request after it opens a new one
+static void test_transport_error_reconnects(void) {
+  static SimHttpTransport http;
+  static NetworkManager network(http);
+  TEST_ASSERT_TRUE(network.initialize());
+  TEST_ASSERT_EQUAL_UINT32(1, network.getHandshakeCount());
+
+  http.setOnline(false);
+  TEST_ASSERT_EQUAL(SEND_RETRY, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+  http.setOnline(true);
+  TEST_ASSERT_EQUAL(SEND_OK, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+  TEST_ASSERT_EQUAL(SEND_OK, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+  TEST_ASSERT_EQUAL_UINT32(2, network.getHandshakeCount());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_all_endpoints_share_one_connection);
+  RUN_TEST(test_dropped_connection_handshakes_once);
+  RUN_TEST(test_transport_error_reconnects);
+  return UNITY_END();
+}
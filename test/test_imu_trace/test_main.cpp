@@ -0,0 +1,121 @@
+// TraceWriter queues blocks on add() and only writes them in drain(); what comes out reads
+// back sample for sample through TraceReader, and a queue the drain side never empties
+// drops whole blocks without blocking add().
+
+#include <unity.h>
+#include <vector>
+#include "ImuTrace.h"
+
+// a Print into memory, counts the flush() calls
+class MemoryPrint : public Print {
+public:
+  std::vector<uint8_t> data;
+  uint32_t flushes = 0;
+
+  size_t write(uint8_t b) { data.push_back(b); return 1; }
+  size_t write(const uint8_t *buffer, size_t size) { data.insert(data.end(), buffer, buffer + size); return size; }
+  void flush() { flushes++; }
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static RawImuSample makeSample(uint32_t i) {
+  RawImuSample s;
+  s.timestampUs = 1000000UL + i * 10000UL + (i % 7);
+  s.accelX = (int16_t)(i * 3);
+  s.accelY = (int16_t)-i;
+  s.accelZ = (int16_t)(4096 + i);
+  s.gyroX = (int16_t)(i * 11);
+  s.gyroY = (int16_t)(-7 * i);
+  s.gyroZ = (int16_t)(i ^ 0x55);
+  return s;
+}
+
+static void test_add_only_queues(void) {
+  MemoryPrint out;
+  TraceWriter writer;
+  writer.begin(&out, 10000, 0, true);
+  for (uint32_t i = 0; i < 3 * TRACE_BLOCK_SAMPLES; i++) writer.add(makeSample(i));
+  TEST_ASSERT_EQUAL(0, out.data.size());
+  TEST_ASSERT_EQUAL(0, out.flushes);
+
+  TEST_ASSERT_EQUAL(3, writer.drain());
+  TEST_ASSERT_EQUAL(3, out.flushes);
+  TEST_ASSERT_EQUAL_UINT32(3 * TRACE_BLOCK_SAMPLES, writer.getSamplesWritten());
+  TEST_ASSERT_EQUAL(0, writer.drain());
+}
+
+static void test_round_trip(void) {
+  MemoryPrint out;
+  TraceWriter writer;
+  writer.begin(&out, 10000);
+  const uint32_t count = 2 * TRACE_BLOCK_SAMPLES + 5;
+  for (uint32_t i = 0; i < count; i++) {
+    writer.add(makeSample(i));
+    if (i % 40 == 0) writer.drain();
+  }
+  writer.end();   // queues and writes the partial block
+  TEST_ASSERT_EQUAL_UINT32(count, writer.getSamplesWritten());
+  TEST_ASSERT_EQUAL_UINT32(0, writer.getDroppedSamples());
+
+  TraceReader reader(out.data.data(), out.data.size());
+  RawImuSample s;
+  for (uint32_t i = 0; i < count; i++) {
+    TEST_ASSERT_TRUE(reader.next(s));
+    RawImuSample expected = makeSample(i);
+    TEST_ASSERT_EQUAL_UINT32(expected.timestampUs, s.timestampUs);
+    TEST_ASSERT_EQUAL_INT16(expected.accelZ, s.accelZ);
+    TEST_ASSERT_EQUAL_INT16(expected.gyroZ, s.gyroZ);
+  }
+  TEST_ASSERT_FALSE(reader.next(s));
+  TEST_ASSERT_EQUAL_UINT32(0, reader.getCorruptBlocks());
+  TEST_ASSERT_EQUAL_UINT32(10000, reader.getSamplePeriodUs());
+}
+
+// with nobody draining, blocks beyond the queue are dropped and counted
+static void test_full_queue_drops_blocks(void) {
+  MemoryPrint out;
+  TraceWriter writer;
+  writer.begin(&out, 10000);
+  const uint32_t blocks = TRACE_QUEUE_BLOCKS + 3;
+  for (uint32_t i = 0; i < blocks * TRACE_BLOCK_SAMPLES; i++) writer.add(makeSample(i));
+  TEST_ASSERT_EQUAL_UINT32(3 * TRACE_BLOCK_SAMPLES, writer.getDroppedSamples());
+
+  TEST_ASSERT_EQUAL(TRACE_QUEUE_BLOCKS, writer.drain());
+  TraceReader reader(out.data.data(), out.data.size());
+  RawImuSample s;
+  uint32_t read = 0;
+  while (reader.next(s)) read++;
+  TEST_ASSERT_EQUAL_UINT32(TRACE_QUEUE_BLOCKS * TRACE_BLOCK_SAMPLES, read);
+}
+
+// the size limit is applied where the writing happens
+static void test_size_limit(void) {
+  MemoryPrint out;
+  TraceWriter writer;
+  const uint32_t blockBytes = sizeof(TraceBlock);
+  writer.begin(&out, 10000, 2 * blockBytes);
+  for (uint32_t i = 0; i < 4 * TRACE_BLOCK_SAMPLES; i++) writer.add(makeSample(i));
+  writer.drain();
+  TEST_ASSERT_EQUAL(2 * blockBytes, out.data.size());
+  TEST_ASSERT_EQUAL_UINT32(2 * TRACE_BLOCK_SAMPLES, writer.getDroppedSamples());
+}
+
+static void test_no_output_drops_silently(void) {
+  TraceWriter writer;
+  for (uint32_t i = 0; i < 100; i++) writer.add(makeSample(i));
+  TEST_ASSERT_EQUAL(0, writer.drain());
+  TEST_ASSERT_FALSE(writer.isActive());
+  TEST_ASSERT_EQUAL_UINT32(0, writer.getDroppedSamples());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_add_only_queues);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_full_queue_drops_blocks);
+  RUN_TEST(test_size_limit);
+  RUN_TEST(test_no_output_drops_silently);
+  return UNITY_END();
+}
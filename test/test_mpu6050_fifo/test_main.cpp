@@ -0,0 +1,206 @@
+// Mpu6050Fifo against the simulated MPU6050 register map (SimMpu6050 on the native Wire):
+// register setup, frame parsing, timestamps, chunked reads and overflow recovery.
+
+#include <unity.h>
+#include "Mpu6050Fifo.h"
+#include "SimHal.h"
+
+static const uint32_t PERIOD_US = 10000;
+
+static SimMpu6050 *sensor;
+static TwoWire *bus;
+static Mpu6050Fifo *fifo;
+
+void setUp(void) {
+  sensor = new SimMpu6050();
+  bus = new TwoWire();
+  bus->attach(SimMpu6050::ADDRESS, sensor);
+  fifo = new Mpu6050Fifo();
+}
+
+void tearDown(void) {
+  delete fifo;
+  delete bus;
+  delete sensor;
+}
+
+static RawImuSample frame(int16_t base) {
+  RawImuSample s;
+  s.timestampUs = 0;
+  s.accelX = base;
+  s.accelY = (int16_t)(base + 1);
+  s.accelZ = (int16_t)(base + 2);
+  s.gyroX = (int16_t)(-base);
+  s.gyroY = (int16_t)(-base - 1);
+  s.gyroZ = (int16_t)(-base - 2);
+  return s;
+}
+
+static void pushFrames(int count, int16_t firstBase) {
+  for (int i = 0; i < count; i++) {
+    sensor->pushFrame(frame((int16_t)(firstBase + i * 10)));
+  }
+}
+
+static void test_begin_programs_rate_fifo_and_overflow_interrupt(void) {
+  TEST_ASSERT_TRUE(fifo->begin(bus, SimMpu6050::ADDRESS, PERIOD_US));
+
+  TEST_ASSERT_EQUAL_UINT8(9, sensor->getRegister(MPU6050_REG_SMPLRT_DIV)); // 1kHz / 10
+  TEST_ASSERT_EQUAL_UINT8(MPU6050_FIFO_EN_ACCEL | MPU6050_FIFO_EN_XYZG, sensor->getRegister(MPU6050_REG_FIFO_EN));
+  TEST_ASSERT_EQUAL_UINT8(MPU6050_INT_FIFO_OFLOW, sensor->getRegister(MPU6050_REG_INT_ENABLE));
+  TEST_ASSERT_EQUAL_UINT8(MPU6050_USER_CTRL_FIFO_EN, sensor->getRegister(MPU6050_REG_USER_CTRL));
+}
+
+static void test_begin_fails_without_a_sensor(void) {
+  TwoWire empty;
+  TEST_ASSERT_FALSE(fifo->begin(&empty, SimMpu6050::ADDRESS, PERIOD_US));
+}
+
+static void test_frames_are_parsed_big_endian_and_signed(void) {
+  fifo->begin(bus, SimMpu6050::ADDRESS, PERIOD_US);
+  RawImuSample in;
+  in.accelX = 4096;
+  in.accelY = -4096;
+  in.accelZ = 32767;
+  in.gyroX = -32768;
+  in.gyroY = 0x0102;
+  in.gyroZ = -1;
+  sensor->pushFrame(in);
+
+  RawImuSample out[4];
+  TEST_ASSERT_EQUAL(1, fifo->readBurst(out, 4, 1000000));
+  TEST_ASSERT_EQUAL_INT16(4096, out[0].accelX);
+  TEST_ASSERT_EQUAL_INT16(-4096, out[0].accelY);
+  TEST_ASSERT_EQUAL_INT16(32767, out[0].accelZ);
+  TEST_ASSERT_EQUAL_INT16(-32768, out[0].gyroX);
+  TEST_ASSERT_EQUAL_INT16(0x0102, out[0].gyroY);
+  TEST_ASSERT_EQUAL_INT16(-1, out[0].gyroZ);
+  TEST_ASSERT_EQUAL(0, sensor->getFifoBytes());
+}
+
+static void test_available_counts_whole_frames_only(void) {
+  fifo->begin(bus, SimMpu6050::ADDRESS, PERIOD_US);
+  pushFrames(3, 0);
+  const uint8_t partial[5] = { 1, 2, 3, 4, 5 };
+  sensor->pushBytes(partial, sizeof(partial));
+
+  TEST_ASSERT_EQUAL_UINT16(3, fifo->available());
+}
+
+// more frames than one 120 byte I2C read holds, in order across the chunks
+static void test_burst_reads_in_chunks_keep_order(void) {
+  fifo->begin(bus, SimMpu6050::ADDRESS, PERIOD_US);
+  pushFrames(25, 100);
+
+  RawImuSample out[GYRO_FIFO_BURST_MAX];
+  TEST_ASSERT_EQUAL(25, fifo->readBurst(out, GYRO_FIFO_BURST_MAX, 1000000));
+  for (int i = 0; i < 25; i++) {
+    TEST_ASSERT_EQUAL_INT16(100 + i * 10, out[i].accelX);
+    TEST_ASSERT_EQUAL_INT16(-(100 + i * 10) - 2, out[i].gyroZ);
+  }
+}
+
+static void test_max_samples_leaves_the_rest_in_the_fifo(void) {
+  fifo->begin(bus, SimMpu6050::ADDRESS, PERIOD_US);
+  pushFrames(8, 0);
+
+  RawImuSample out[8];
+  TEST_ASSERT_EQUAL(5, fifo->readBurst(out, 5, 1000000));
+  TEST_ASSERT_EQUAL_UINT16(3, fifo->available());
+  TEST_ASSERT_EQUAL(3, fifo->readBurst(out, 8, 1030000));
+  TEST_ASSERT_EQUAL_INT16(50, out[0].accelX);
+}
+
+// newest frame at nowUs, the ones before it one period apart
+static void test_timestamps_end_at_now_one_period_apart(void) {
+  fifo->begin(bus, SimMpu6050::ADDRESS, PERIOD_US);
+  pushFrames(4, 0);
+
+  RawImuSample out[4];
+  TEST_ASSERT_EQUAL(4, fifo->readBurst(out, 4, 1000000));
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL_UINT32(1000000 - (3 - i) * PERIOD_US, out[i].timestampUs);
+  }
+}
+
+// a late read (jitter under a period) continues the evenly spaced timeline
+static void test_timestamps_continue_across_bursts(void) {
+  fifo->begin(bus, SimMpu6050::ADDRESS, PERIOD_US);
+  RawImuSample out[4];
+  pushFrames(2, 0);
+  fifo->readBurst(out, 4, 1000000);
+
+  pushFrames(3, 0);
+  TEST_ASSERT_EQUAL(3, fifo->readBurst(out, 4, 1000000 + 3 * PERIOD_US + 4000));
+  TEST_ASSERT_EQUAL_UINT32(1000000 + PERIOD_US, out[0].timestampUs);
+  TEST_ASSERT_EQUAL_UINT32(1000000 + 3 * PERIOD_US, out[2].timestampUs);
+}
+
+// more than a period off and the timeline snaps back to the clock
+static void test_timestamps_resync_after_drift(void) {
+  fifo->begin(bus, SimMpu6050::ADDRESS, PERIOD_US);
+  RawImuSample out[4];
+  pushFrames(1, 0);
+  fifo->readBurst(out, 4, 1000000);
+
+  pushFrames(2, 0);
+  TEST_ASSERT_EQUAL(2, fifo->readBurst(out, 4, 1500000));
+  TEST_ASSERT_EQUAL_UINT32(1500000 - PERIOD_US, out[0].timestampUs);
+  TEST_ASSERT_EQUAL_UINT32(1500000, out[1].timestampUs);
+}
+
+// an overflowed FIFO is no longer frame aligned: nothing is returned, it is reset
+static void test_overflow_is_counted_and_resets_the_fifo(void) {
+  fifo->begin(bus, SimMpu6050::ADDRESS, PERIOD_US);
+  uint32_t resets = sensor->getFifoResetCount();
+  pushFrames(MPU6050_FIFO_SIZE_BYTES / MPU6050_FIFO_FRAME_BYTES + 2, 0);
+
+  RawImuSample out[GYRO_FIFO_BURST_MAX];
+  TEST_ASSERT_EQUAL(0, fifo->readBurst(out, GYRO_FIFO_BURST_MAX, 1000000));
+  TEST_ASSERT_EQUAL_UINT32(1, fifo->getOverflowCount());
+  TEST_ASSERT_EQUAL_UINT32(resets + 1, sensor->getFifoResetCount());
+  TEST_ASSERT_EQUAL(0, sensor->getFifoBytes());
+
+  pushFrames(2, 7);
+  TEST_ASSERT_EQUAL(2, fifo->readBurst(out, GYRO_FIFO_BURST_MAX, 1100000));
+  TEST_ASSERT_EQUAL_INT16(7, out[0].accelX);
+  TEST_ASSERT_EQUAL_UINT32(1, fifo->getOverflowCount());
+}
+
+// a rate change drops the frames taken at the old rate and never stamps backwards
+static void test_rate_change_resets_and_keeps_time_monotonic(void) {
+  fifo->begin(bus, SimMpu6050::ADDRESS, PERIOD_US);
+  RawImuSample out[8];
+  pushFrames(3, 0);
+  fifo->readBurst(out, 8, 1000000);
+  uint32_t lastUs = out[2].timestampUs;
+
+  pushFrames(2, 0);
+  TEST_ASSERT_TRUE(fifo->setSamplePeriod(1000));
+  TEST_ASSERT_EQUAL_UINT8(0, sensor->getRegister(MPU6050_REG_SMPLRT_DIV));
+  TEST_ASSERT_EQUAL(0, sensor->getFifoBytes());
+
+  // the clock reads a little behind the last stamp, the new frames still come after it
+  pushFrames(5, 0);
+  TEST_ASSERT_EQUAL(5, fifo->readBurst(out, 8, lastUs + 2000));
+  TEST_ASSERT_GREATER_THAN_UINT32(lastUs, out[0].timestampUs);
+  for (int i = 1; i < 5; i++) {
+    TEST_ASSERT_EQUAL_UINT32(out[i - 1].timestampUs + 1000, out[i].timestampUs);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_programs_rate_fifo_and_overflow_interrupt);
+  RUN_TEST(test_begin_fails_without_a_sensor);
+  RUN_TEST(test_frames_are_parsed_big_endian_and_signed);
+  RUN_TEST(test_available_counts_whole_frames_only);
+  RUN_TEST(test_burst_reads_in_chunks_keep_order);
+  RUN_TEST(test_max_samples_leaves_the_rest_in_the_fifo);
+  RUN_TEST(test_timestamps_end_at_now_one_period_apart);
+  RUN_TEST(test_timestamps_continue_across_bursts);
+  RUN_TEST(test_timestamps_resync_after_drift);
+  RUN_TEST(test_overflow_is_counted_and_resets_the_fifo);
+  RUN_TEST(test_rate_change_resets_and_keeps_time_monotonic);
+  return UNITY_END();
+}
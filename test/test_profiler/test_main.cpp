@@ -0,0 +1,61 @@
+// Profiler histograms: bucket bounds, percentiles, and calls longer than the 32-bit
+// cycle counter, which go in the last bucket with their full length kept in max and mean.
+
+#include <unity.h>
+#include "Profiler.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// every cycle count lands in a bucket whose upper bound is at or above it, and the
+// previous bucket's bound is below it
+static void test_bucket_bounds(void) {
+  const uint32_t values[] = { 0, 1, 3, 4, 5, 7, 8, 100, 1000, 65535, 65536, 1000000, 0x7FFFFFFFUL, UINT32_MAX };
+  for (uint32_t v : values) {
+    uint32_t bucket = ProfileProbe::bucketFor(v);
+    TEST_ASSERT_LESS_THAN_UINT32(PROFILER_BUCKETS, bucket);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(v, ProfileProbe::bucketUpperBound(bucket));
+    if (bucket > 0) TEST_ASSERT_LESS_THAN_UINT32(v, ProfileProbe::bucketUpperBound(bucket - 1));
+  }
+}
+
+static void test_percentiles(void) {
+  static ProfileProbe probe("test.percentiles");
+  for (uint32_t i = 1; i <= 100; i++) probe.record(i * 1000);
+  TEST_ASSERT_EQUAL_UINT32(100, probe.count);
+  // bucket resolution is 25%
+  TEST_ASSERT_UINT32_WITHIN(50000 / 4, 50000, (uint32_t)Profiler::percentile(probe, 50));
+  TEST_ASSERT_UINT32_WITHIN(99000 / 4, 99000, (uint32_t)Profiler::percentile(probe, 99));
+  TEST_ASSERT_EQUAL_UINT64(100000, Profiler::percentile(probe, 100));
+}
+
+// a 30s HTTP request at 240MHz is 7.2e9 cycles, past what a uint32_t holds
+static void test_long_calls_saturate_the_histogram_only(void) {
+  static ProfileProbe probe("test.long");
+  const uint64_t longCall = 7200000000ULL;
+  probe.record(1000);
+  probe.record(longCall);
+  TEST_ASSERT_EQUAL_UINT64(longCall, probe.maxCycles);
+  TEST_ASSERT_EQUAL_UINT64(longCall + 1000, probe.totalCycles);
+  TEST_ASSERT_EQUAL_UINT32(1, probe.buckets[PROFILER_BUCKETS - 1]);
+  TEST_ASSERT_EQUAL_UINT64(longCall, Profiler::percentile(probe, 99));
+  TEST_ASSERT_TRUE(Profiler::percentile(probe, 50) <= 1250);
+}
+
+static void test_reset(void) {
+  static ProfileProbe probe("test.reset");
+  probe.record(12345);
+  Profiler::reset();
+  TEST_ASSERT_EQUAL_UINT32(0, probe.count);
+  TEST_ASSERT_EQUAL_UINT64(0, probe.maxCycles);
+  TEST_ASSERT_EQUAL_UINT64(0, Profiler::percentile(probe, 50));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bucket_bounds);
+  RUN_TEST(test_percentiles);
+  RUN_TEST(test_long_calls_saturate_the_histogram_only);
+  RUN_TEST(test_reset);
+  return UNITY_END();
+}
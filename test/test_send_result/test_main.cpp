@@ -0,0 +1,74 @@
+// NetworkManager sorts every send into sent, worth retrying or rejected: transport errors,
+// 5xx, 408 and 429 are kept for later, any other 4xx would fail the same way forever and is
+// dropped. A 401 or 403 gets one new token and registration, and is retried later if the
+// server still refuses it.
+
+#include <unity.h>
+#include "NetworkManager.h"
+#include "SimHal.h"
+
+static const TelemetrySample WINDOW[] = {
+  { 1000, 9.8F, 1.5F },
+  { 1010, 9.7F, 2.5F },
+};
+static const size_t WINDOW_SAMPLES = sizeof(WINDOW) / sizeof(WINDOW[0]);
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_client_errors_are_rejected(void) {
+  static SimHttpTransport http;
+  static NetworkManager network(http);
+  TEST_ASSERT_TRUE(network.initialize());
+
+  http.setStatusCode(400);
+  TEST_ASSERT_EQUAL(SEND_REJECTED, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+  http.setStatusCode(404);
+  TEST_ASSERT_EQUAL(SEND_REJECTED, network.sendSensorData(12.0F, 300.0F, true));
+  http.setStatusCode(413);
+  TEST_ASSERT_EQUAL(SEND_REJECTED, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+}
+
+static void test_server_and_transport_errors_retry(void) {
+  static SimHttpTransport http;
+  static NetworkManager network(http);
+  TEST_ASSERT_TRUE(network.initialize());
+
+  http.setStatusCode(503);
+  TEST_ASSERT_EQUAL(SEND_RETRY, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+  http.setStatusCode(429);
+  TEST_ASSERT_EQUAL(SEND_RETRY, network.sendSensorData(12.0F, 300.0F, true));
+  http.setStatusCode(HTTP_STATUS_OK);
+  http.setOnline(false);
+  TEST_ASSERT_EQUAL(SEND_RETRY, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+  http.setOnline(true);
+  TEST_ASSERT_EQUAL(SEND_OK, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+}
+
+// one re-auth per request, not a loop: a server that keeps refusing the new token gets
+// the request back as a retry, the record itself is not at fault
+static void test_unauthorized_reauthenticates_once(void) {
+  static SimHttpTransport http;
+  static NetworkManager network(http);
+  TEST_ASSERT_TRUE(network.initialize());
+  uint32_t before = network.getRequestCount();
+
+  http.setStatusCode(401);
+  TEST_ASSERT_EQUAL(SEND_RETRY, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+  // the batch, then the token GET that failed
+  TEST_ASSERT_EQUAL_UINT32(before + 2, network.getRequestCount());
+
+  // the token is fetched again before the next send, which goes through
+  http.setStatusCode(HTTP_STATUS_OK);
+  before = network.getRequestCount();
+  TEST_ASSERT_EQUAL(SEND_OK, network.sendSensorBatch(WINDOW, WINDOW_SAMPLES));
+  TEST_ASSERT_TRUE(network.getRequestCount() > before + 1);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_client_errors_are_rejected);
+  RUN_TEST(test_server_and_transport_errors_retry);
+  RUN_TEST(test_unauthorized_reauthenticates_once);
+  return UNITY_END();
+}
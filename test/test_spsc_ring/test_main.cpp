@@ -0,0 +1,151 @@
+// SpscRing: the single-threaded contract, then a producer and a consumer on two
+// std::threads hammering the same ring.
+
+#include <unity.h>
+#include <thread>
+#include "SpscRing.h"
+
+static const uint32_t STRESS_ITEMS = 2000000;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_pops_in_push_order(void) {
+  SpscRing<int, 8> ring;
+  for (int i = 0; i < 5; i++) TEST_ASSERT_TRUE(ring.push(i));
+  TEST_ASSERT_EQUAL(5, ring.size());
+
+  int value = -1;
+  for (int i = 0; i < 5; i++) {
+    TEST_ASSERT_TRUE(ring.pop(value));
+    TEST_ASSERT_EQUAL_INT(i, value);
+  }
+  TEST_ASSERT_TRUE(ring.isEmpty());
+  TEST_ASSERT_FALSE(ring.pop(value));
+}
+
+static void test_full_ring_drops_the_new_item(void) {
+  SpscRing<int, 4> ring;
+  for (int i = 0; i < 4; i++) TEST_ASSERT_TRUE(ring.push(i));
+  TEST_ASSERT_FALSE(ring.push(99));
+  TEST_ASSERT_FALSE(ring.push(100));
+  TEST_ASSERT_EQUAL_UINT32(2, ring.droppedCount());
+  TEST_ASSERT_EQUAL(4, ring.size());
+
+  int value = -1;
+  ring.pop(value);
+  TEST_ASSERT_EQUAL_INT(0, value);
+  TEST_ASSERT_TRUE(ring.push(4)); // room again
+  for (int expected = 1; expected <= 4; expected++) {
+    ring.pop(value);
+    TEST_ASSERT_EQUAL_INT(expected, value);
+  }
+}
+
+static void test_peek_does_not_consume(void) {
+  SpscRing<int, 4> ring;
+  int value = 0;
+  TEST_ASSERT_FALSE(ring.peek(value));
+  ring.push(7);
+  ring.push(8);
+  TEST_ASSERT_TRUE(ring.peek(value));
+  TEST_ASSERT_EQUAL_INT(7, value);
+  TEST_ASSERT_TRUE(ring.peek(value));
+  TEST_ASSERT_EQUAL_INT(7, value);
+  TEST_ASSERT_EQUAL(2, ring.size());
+}
+
+// many laps around the storage, the masks have to keep order and size right
+static void test_wraps_around_many_times(void) {
+  SpscRing<uint32_t, 4> ring;
+  uint32_t next = 0, expected = 0, value = 0;
+  for (int lap = 0; lap < 1000; lap++) {
+    while (ring.push(next)) next++;
+    TEST_ASSERT_EQUAL(4, ring.size());
+    ring.pop(value);
+    TEST_ASSERT_EQUAL_UINT32(expected++, value);
+    ring.pop(value);
+    TEST_ASSERT_EQUAL_UINT32(expected++, value);
+  }
+  TEST_ASSERT_EQUAL_UINT32(1000, ring.droppedCount());
+}
+
+// big enough that a torn copy would be visible: every field carries the sequence number
+struct Record {
+  uint32_t sequence;
+  uint32_t words[15];
+};
+
+// the producer waits for room, so every item must arrive, once, in order, intact
+static void test_threads_lossless_in_order(void) {
+  static SpscRing<Record, 64> ring;
+  std::thread producer([]() {
+    Record r;
+    for (uint32_t i = 0; i < STRESS_ITEMS; i++) {
+      r.sequence = i;
+      for (int w = 0; w < 15; w++) r.words[w] = i * 31 + w;
+      while (!ring.push(r)) std::this_thread::yield();
+    }
+  });
+
+  uint32_t expected = 0, torn = 0, outOfOrder = 0;
+  Record r;
+  while (expected < STRESS_ITEMS) {
+    if (!ring.pop(r)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (r.sequence != expected) outOfOrder++;
+    for (int w = 0; w < 15; w++) {
+      if (r.words[w] != r.sequence * 31 + w) torn++;
+    }
+    expected = r.sequence + 1;
+  }
+  producer.join();
+
+  TEST_ASSERT_EQUAL_UINT32(0, outOfOrder);
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_TRUE(ring.isEmpty());
+}
+
+// the sampling task never waits: what doesn't fit is dropped and counted, what gets
+// through is still in order, and nothing is lost without being counted
+static void test_threads_dropping_producer_accounts_for_everything(void) {
+  static SpscRing<uint32_t, 16> ring;
+  std::atomic<bool> done(false);
+  std::thread producer([&done]() {
+    for (uint32_t i = 0; i < STRESS_ITEMS; i++) ring.push(i);
+    done.store(true, std::memory_order_release);
+  });
+
+  uint32_t received = 0, outOfOrder = 0, value = 0;
+  bool haveLast = false;
+  uint32_t last = 0;
+  while (true) {
+    bool finished = done.load(std::memory_order_acquire);
+    while (ring.pop(value)) {
+      if (haveLast && value <= last) outOfOrder++;
+      last = value;
+      haveLast = true;
+      received++;
+    }
+    if (finished) break;
+    std::this_thread::yield();
+  }
+  producer.join();
+  while (ring.pop(value)) received++;
+
+  TEST_ASSERT_EQUAL_UINT32(0, outOfOrder);
+  TEST_ASSERT_EQUAL_UINT32(STRESS_ITEMS, received + ring.droppedCount());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_pops_in_push_order);
+  RUN_TEST(test_full_ring_drops_the_new_item);
+  RUN_TEST(test_peek_does_not_consume);
+  RUN_TEST(test_wraps_around_many_times);
+  RUN_TEST(test_threads_lossless_in_order);
+  RUN_TEST(test_threads_dropping_producer_accounts_for_everything);
+  return UNITY_END();
+}
@@ -0,0 +1,159 @@
+// The integer sample path compares squared magnitudes in counts^2 against thresholds
+// squared once (ACCEL_SQ_COUNTS / GYRO_SQ_COUNTS). It has to take the same decisions as
+// the old float path (m/s^2 and deg/s through sqrtf), and the telemetry batcher has to
+// produce the same values whether it converts itself or is handed floats.
+
+#include <unity.h>
+#include "DeviceConfig.h"
+#include "ImuSample.h"
+#include "TelemetryBatcher.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint32_t magSq(int32_t x, int32_t y, int32_t z) {
+  return (uint32_t)(x * x) + (uint32_t)(y * y) + (uint32_t)(z * z);
+}
+
+static uint32_t rng = 1;
+
+static float uniform(float low, float high) {
+  rng = rng * 1664525UL + 1013904223UL;
+  return low + (high - low) * (rng >> 8) / 16777216.0F;
+}
+
+// random count vectors with magnitudes within 10% of the threshold: the squared comparison
+// may only disagree with the float one within a count of the threshold itself
+static void assertSameDecisions(float threshold, float countsPerUnit, uint32_t thresholdSq) {
+  uint32_t below = 0, outsideBand = 0;
+  rng = 1;
+  for (uint32_t i = 0; i < 200000; i++) {
+    float radius = uniform(0.9F, 1.1F) * threshold * countsPerUnit;
+    float dx = uniform(-1, 1), dy = uniform(-1, 1), dz = uniform(-1, 1);
+    float norm = sqrtf(dx * dx + dy * dy + dz * dz);
+    if (norm < 0.01F) continue;
+    int32_t x = lroundf(dx / norm * radius), y = lroundf(dy / norm * radius), z = lroundf(dz / norm * radius);
+
+    uint32_t sq = magSq(x, y, z);
+    float magnitude = sqrtf((float)sq) / countsPerUnit;
+    bool squaredBelow = sq < thresholdSq;
+    if (squaredBelow != (magnitude < threshold) && fabsf(magnitude - threshold) * countsPerUnit > 1.0F) {
+      outsideBand++;
+    }
+    if (squaredBelow) below++;
+  }
+  // both sides of the threshold were exercised
+  TEST_ASSERT_GREATER_THAN_UINT32(50000, below);
+  TEST_ASSERT_LESS_THAN_UINT32(150000, below);
+  TEST_ASSERT_EQUAL_UINT32(0, outsideBand);
+}
+
+static void test_free_fall_threshold_matches_float(void) {
+  DeviceSettings settings = DeviceConfig::defaults();
+  assertSameDecisions(settings.freeFallThreshold, ACCEL_COUNTS_PER_MS2, ACCEL_SQ_COUNTS(settings.freeFallThreshold));
+}
+
+static void test_impact_threshold_matches_float(void) {
+  DeviceSettings settings = DeviceConfig::defaults();
+  assertSameDecisions(settings.impactThreshold, ACCEL_COUNTS_PER_MS2, ACCEL_SQ_COUNTS(settings.impactThreshold));
+}
+
+static void test_gyro_threshold_matches_float(void) {
+  DeviceSettings settings = DeviceConfig::defaults();
+  assertSameDecisions(settings.gyroThreshold, GYRO_LSB_PER_DPS, GYRO_SQ_COUNTS(settings.gyroThreshold));
+}
+
+// the stillness band |accel - 9.8| < inactivityThreshold as two squared bounds
+static void test_stillness_band_matches_float(void) {
+  DeviceSettings settings = DeviceConfig::defaults();
+  uint32_t minSq = ACCEL_SQ_COUNTS(9.8F - settings.inactivityThreshold);
+  uint32_t maxSq = ACCEL_SQ_COUNTS(9.8F + settings.inactivityThreshold);
+  uint32_t outsideBand = 0;
+  for (int32_t z = 0; z <= 2 * (int32_t)ACCEL_LSB_PER_G; z++) {
+    uint32_t sq = magSq(0, 0, z);
+    float magnitude = sqrtf((float)sq) / ACCEL_COUNTS_PER_MS2;
+    bool still = sq > minSq && sq < maxSq;
+    float distance = fabsf(fabsf(magnitude - 9.8F) - settings.inactivityThreshold) * ACCEL_COUNTS_PER_MS2;
+    if (still != (fabsf(magnitude - 9.8F) < settings.inactivityThreshold) && distance > 1.0F) outsideBand++;
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, outsideBand);
+}
+
+// the largest magnitude a clamped sample can have still fits the 32 bit square
+static void test_full_scale_square_does_not_wrap(void) {
+  uint32_t sq = magSq(-32768, -32768, -32768);
+  TEST_ASSERT_EQUAL_UINT32(3221225472UL, sq);
+  TEST_ASSERT_TRUE(sq > ACCEL_SQ_COUNTS(DeviceConfig::defaults().impactThreshold));
+}
+
+static ImuSample makeSample(uint32_t timestampUs, int16_t az, int16_t gx) {
+  ImuSample s;
+  memset(&s, 0, sizeof(s));
+  s.timestampUs = timestampUs;
+  s.accelZ = az;
+  s.gyroX = gx;
+  s.accelMagSq = magSq(0, 0, az);
+  s.gyroMagSq = magSq(gx, 0, 0);
+  return s;
+}
+
+// the batcher converts a kept sample exactly like the float helpers do
+static void test_batcher_converts_kept_samples(void) {
+  TelemetryBatcher fromSamples(10, 1000), fromFloats(10, 1000);
+  for (uint32_t i = 0; i < 10; i++) {
+    ImuSample s = makeSample(i * 10000, (int16_t)(ACCEL_LSB_PER_G + 97 * i), (int16_t)(131 * i));
+    TEST_ASSERT_TRUE(fromSamples.add(i * SAMPLING_PERIOD_MS, s));
+    TEST_ASSERT_TRUE(fromFloats.add(i * SAMPLING_PERIOD_MS, s.accelMagnitude(), s.gyroMagnitude()));
+  }
+  TEST_ASSERT_EQUAL(10, fromSamples.count());
+  TEST_ASSERT_EQUAL_MEMORY(fromFloats.samples(), fromSamples.samples(), 10 * sizeof(TelemetrySample));
+  TEST_ASSERT_FLOAT_WITHIN(0.001F, 1.0F, fromSamples.samples()[9].gyro / (131 * 9 / GYRO_LSB_PER_DPS));
+}
+
+// one sample per spacing slot, rounded to the nearest; a full window refuses the next one
+static void test_batcher_skips_and_fills(void) {
+  TelemetryBatcher batcher(3, 1000);
+  ImuSample s = makeSample(0, (int16_t)ACCEL_LSB_PER_G, 0);
+  TEST_ASSERT_TRUE(batcher.add(0, s));
+  TEST_ASSERT_TRUE(batcher.add(TELEMETRY_MIN_SPACING_MS / 2 - 1, s));
+  TEST_ASSERT_EQUAL(1, batcher.count());
+  // a nominal sample a little early still gets its slot, a second one in it doesn't
+  TEST_ASSERT_TRUE(batcher.add(TELEMETRY_MIN_SPACING_MS - 1, s));
+  TEST_ASSERT_TRUE(batcher.add(TELEMETRY_MIN_SPACING_MS + 2, s));
+  TEST_ASSERT_EQUAL(2, batcher.count());
+  TEST_ASSERT_TRUE(batcher.add(2 * TELEMETRY_MIN_SPACING_MS, s));
+  TEST_ASSERT_FALSE(batcher.add(3 * TELEMETRY_MIN_SPACING_MS, s));
+  TEST_ASSERT_EQUAL(3, batcher.count());
+  TEST_ASSERT_TRUE(batcher.shouldFlush(2 * TELEMETRY_MIN_SPACING_MS));
+  TEST_ASSERT_FLOAT_WITHIN(0.001F, 9.80665F, batcher.samples()[2].accel);
+}
+
+// the nominal rate with a few ms of jitter keeps every sample, a 1kHz burst one per slot
+static void test_batcher_jitter_and_burst(void) {
+  const int32_t jitterMs[] = { 0, -3, 4, -1, 2 };
+  ImuSample s = makeSample(0, (int16_t)ACCEL_LSB_PER_G, 0);
+  TelemetryBatcher nominal(50, 1000);
+  for (uint32_t i = 0; i < 40; i++) {
+    nominal.add(100 + i * TELEMETRY_MIN_SPACING_MS + jitterMs[i % 5], s);
+  }
+  TEST_ASSERT_EQUAL(40, nominal.count());
+
+  TelemetryBatcher burst(50, 1000);
+  for (uint32_t t = 0; t < 40 * TELEMETRY_MIN_SPACING_MS - TELEMETRY_MIN_SPACING_MS / 2; t++) {
+    burst.add(100 + t, s);
+  }
+  TEST_ASSERT_EQUAL(40, burst.count());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_free_fall_threshold_matches_float);
+  RUN_TEST(test_impact_threshold_matches_float);
+  RUN_TEST(test_gyro_threshold_matches_float);
+  RUN_TEST(test_stillness_band_matches_float);
+  RUN_TEST(test_full_scale_square_does_not_wrap);
+  RUN_TEST(test_batcher_converts_kept_samples);
+  RUN_TEST(test_batcher_skips_and_fills);
+  RUN_TEST(test_batcher_jitter_and_burst);
+  return UNITY_END();
+}
@@ -0,0 +1,107 @@
+// TelemetryBatcher window timing: a window is due when it holds batchSize samples or its
+// first sample is flushIntervalMs old, clear() starts the next one from scratch, and
+// configure() takes effect on the window already being filled.
+
+#include <unity.h>
+#include "TelemetryBatcher.h"
+
+static const uint32_t T0 = 50000;   // ms, any start works; the batcher only looks at differences
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// fills one sample per nominal slot starting at startMs
+static void fill(TelemetryBatcher &batcher, uint32_t startMs, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    TEST_ASSERT_TRUE(batcher.add(startMs + i * TELEMETRY_MIN_SPACING_MS, 9.8F, (float)i));
+  }
+}
+
+static void test_empty_window_never_flushes(void) {
+  TelemetryBatcher batcher(10, 1000);
+  TEST_ASSERT_FALSE(batcher.shouldFlush(T0));
+  TEST_ASSERT_FALSE(batcher.shouldFlush(T0 + 1000000UL));
+}
+
+static void test_flush_on_size(void) {
+  TelemetryBatcher batcher(10, 60000);
+  fill(batcher, T0, 9);
+  TEST_ASSERT_FALSE(batcher.shouldFlush(T0 + 9 * TELEMETRY_MIN_SPACING_MS));
+  fill(batcher, T0 + 9 * TELEMETRY_MIN_SPACING_MS, 1);
+  TEST_ASSERT_TRUE(batcher.shouldFlush(T0 + 9 * TELEMETRY_MIN_SPACING_MS));
+  // full: the next sample is refused and left for the caller to add after clear()
+  TEST_ASSERT_FALSE(batcher.add(T0 + 10 * TELEMETRY_MIN_SPACING_MS, 9.8F, 10.0F));
+  TEST_ASSERT_EQUAL(10, batcher.count());
+  TEST_ASSERT_EQUAL_FLOAT(8.0F, batcher.samples()[8].gyro);
+}
+
+// the age counts from the window's first sample, not from the last one or from clear()
+static void test_flush_on_interval(void) {
+  TelemetryBatcher batcher(100, 1000);
+  fill(batcher, T0, 3);
+  TEST_ASSERT_FALSE(batcher.shouldFlush(T0 + 999));
+  TEST_ASSERT_TRUE(batcher.shouldFlush(T0 + 1000));
+  TEST_ASSERT_EQUAL(3, batcher.count());
+
+  batcher.clear();
+  TEST_ASSERT_FALSE(batcher.shouldFlush(T0 + 5000));
+  fill(batcher, T0 + 5000, 1);
+  TEST_ASSERT_FALSE(batcher.shouldFlush(T0 + 5999));
+  TEST_ASSERT_TRUE(batcher.shouldFlush(T0 + 6000));
+}
+
+// the window restarts its slot grid after clear(), whatever the old window's phase was
+static void test_clear_restarts_slots(void) {
+  TelemetryBatcher batcher(100, 1000);
+  fill(batcher, T0, 5);
+  batcher.clear();
+  TEST_ASSERT_TRUE(batcher.add(T0 + 3, 9.8F, 0));
+  TEST_ASSERT_TRUE(batcher.add(T0 + 3 + TELEMETRY_MIN_SPACING_MS, 9.8F, 1));
+  TEST_ASSERT_EQUAL(2, batcher.count());
+  TEST_ASSERT_EQUAL_UINT32(T0 + 3, batcher.samples()[0].timestampMs);
+}
+
+// shrinking the window below what it already holds makes it due at once, a shorter
+// interval applies to the age of the current window
+static void test_configure_mid_window(void) {
+  TelemetryBatcher batcher(50, 60000);
+  fill(batcher, T0, 20);
+  TEST_ASSERT_FALSE(batcher.shouldFlush(T0 + 200));
+
+  batcher.configure(10, 60000);
+  TEST_ASSERT_TRUE(batcher.shouldFlush(T0 + 200));
+  TEST_ASSERT_FALSE(batcher.add(T0 + 200, 9.8F, 0));
+  TEST_ASSERT_EQUAL(20, batcher.count());
+  batcher.clear();
+  fill(batcher, T0 + 1000, 9);
+  TEST_ASSERT_FALSE(batcher.shouldFlush(T0 + 1100));
+
+  batcher.configure(50, 500);
+  TEST_ASSERT_FALSE(batcher.shouldFlush(T0 + 1499));
+  TEST_ASSERT_TRUE(batcher.shouldFlush(T0 + 1500));
+  TEST_ASSERT_EQUAL(9, batcher.count());
+}
+
+// the window storage is fixed: a size of 0 or past the capacity is clamped
+static void test_configure_clamps(void) {
+  TelemetryBatcher batcher(TELEMETRY_BATCH_CAPACITY + 50, 600000UL);
+  fill(batcher, T0, TELEMETRY_BATCH_CAPACITY);
+  TEST_ASSERT_TRUE(batcher.shouldFlush(T0));
+  TEST_ASSERT_FALSE(batcher.add(T0 + TELEMETRY_BATCH_CAPACITY * TELEMETRY_MIN_SPACING_MS, 9.8F, 0));
+
+  batcher.clear();
+  batcher.configure(0, 600000UL);
+  fill(batcher, T0, 1);
+  TEST_ASSERT_TRUE(batcher.shouldFlush(T0));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_window_never_flushes);
+  RUN_TEST(test_flush_on_size);
+  RUN_TEST(test_flush_on_interval);
+  RUN_TEST(test_clear_restarts_slots);
+  RUN_TEST(test_configure_mid_window);
+  RUN_TEST(test_configure_clamps);
+  return UNITY_END();
+}
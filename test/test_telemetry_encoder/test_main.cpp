@@ -0,0 +1,237 @@
+// TelemetryWriter: CBOR byte for byte against RFC 8949, JSON text, escaping, overflow,
+// and the payloads NetworkManager sends, checked by parsing them back.
+
+#include <unity.h>
+#include <ArduinoJson.h>
+#include "TelemetryEncoder.h"
+
+static uint8_t buffer[TELEMETRY_PAYLOAD_BUFFER];
+
+void setUp(void) {
+  memset(buffer, 0xEE, sizeof(buffer));
+}
+
+void tearDown(void) {}
+
+static void assertBytes(const uint8_t *expected, size_t count, const TelemetryWriter &w) {
+  TEST_ASSERT_FALSE(w.overflowed());
+  TEST_ASSERT_EQUAL(count, w.size());
+  TEST_ASSERT_EQUAL_MEMORY(expected, w.data(), count);
+}
+
+static const char *jsonText(const TelemetryWriter &w) {
+  static char text[256];
+  size_t n = w.size() < sizeof(text) - 1 ? w.size() : sizeof(text) - 1;
+  memcpy(text, w.data(), n);
+  text[n] = '\0';
+  return text;
+}
+
+static void test_cbor_map_of_uint_and_bool(void) {
+  TelemetryWriter w(buffer, sizeof(buffer), TELEMETRY_FORMAT_CBOR);
+  w.beginMap(2);
+  w.key("a"); w.value((uint32_t)1);
+  w.key("b"); w.value(true);
+  w.endMap();
+  const uint8_t expected[] = { 0xA2, 0x61, 'a', 0x01, 0x61, 'b', 0xF5 };
+  assertBytes(expected, sizeof(expected), w);
+  TEST_ASSERT_EQUAL_STRING("application/cbor", w.contentType());
+}
+
+// the argument always takes the shortest head that fits
+static void test_cbor_uint_heads(void) {
+  TelemetryWriter w(buffer, sizeof(buffer), TELEMETRY_FORMAT_CBOR);
+  w.beginArray(6);
+  w.value((uint32_t)23);
+  w.value((uint32_t)24);
+  w.value((uint32_t)255);
+  w.value((uint32_t)256);
+  w.value((uint32_t)65536);
+  w.value((uint32_t)4294967295UL);
+  w.endArray();
+  const uint8_t expected[] = {
+    0x86,
+    0x17,
+    0x18, 0x18,
+    0x18, 0xFF,
+    0x19, 0x01, 0x00,
+    0x1A, 0x00, 0x01, 0x00, 0x00,
+    0x1A, 0xFF, 0xFF, 0xFF, 0xFF,
+  };
+  assertBytes(expected, sizeof(expected), w);
+}
+
+static void test_cbor_floats_are_single_precision_big_endian(void) {
+  TelemetryWriter w(buffer, sizeof(buffer), TELEMETRY_FORMAT_CBOR);
+  w.beginArray(3);
+  w.value(1.0F);
+  w.value(-9.81F);
+  w.value(NAN);
+  w.endArray();
+  const uint8_t expected[] = {
+    0x83,
+    0xFA, 0x3F, 0x80, 0x00, 0x00,
+    0xFA, 0xC1, 0x1C, 0xF5, 0xC3,
+    0xFA, 0x7F, 0xC0, 0x00, 0x00,
+  };
+  assertBytes(expected, sizeof(expected), w);
+}
+
+static void test_cbor_text_and_false(void) {
+  TelemetryWriter w(buffer, sizeof(buffer), TELEMETRY_FORMAT_CBOR);
+  w.beginMap(1);
+  w.key("platform"); w.value("ESP32");
+  w.endMap();
+  w.value(false);
+  const uint8_t expected[] = { 0xA1, 0x68, 'p', 'l', 'a', 't', 'f', 'o', 'r', 'm', 0x65, 'E', 'S', 'P', '3', '2', 0xF4 };
+  assertBytes(expected, sizeof(expected), w);
+}
+
+static void test_json_nested_text(void) {
+  TelemetryWriter w(buffer, sizeof(buffer), TELEMETRY_FORMAT_JSON);
+  w.beginMap(3);
+  w.key("n"); w.value((uint32_t)42);
+  w.key("list");
+  w.beginArray(2);
+  w.value(true);
+  w.beginMap(1);
+  w.key("x"); w.value(1.5F);
+  w.endMap();
+  w.endArray();
+  w.key("s"); w.value("ok");
+  w.endMap();
+  TEST_ASSERT_FALSE(w.overflowed());
+  TEST_ASSERT_EQUAL_STRING("{\"n\":42,\"list\":[true,{\"x\":1.5}],\"s\":\"ok\"}", jsonText(w));
+  TEST_ASSERT_EQUAL_STRING("application/json", w.contentType());
+}
+
+static void test_json_escapes_strings(void) {
+  TelemetryWriter w(buffer, sizeof(buffer), TELEMETRY_FORMAT_JSON);
+  w.value("a\"b\\c\n");
+  TEST_ASSERT_EQUAL_STRING("\"a\\\"b\\\\c\\u000a\"", jsonText(w));
+}
+
+// JSON has no NaN or Infinity, they go out as null like ArduinoJson does
+static void test_json_non_finite_floats_are_null(void) {
+  TelemetryWriter w(buffer, sizeof(buffer), TELEMETRY_FORMAT_JSON);
+  w.beginArray(3);
+  w.value(NAN);
+  w.value(INFINITY);
+  w.value(-2.25F);
+  w.endArray();
+  TEST_ASSERT_EQUAL_STRING("[null,null,-2.25]", jsonText(w));
+}
+
+// writing stops at the capacity, nothing past it is touched, and overflowed() says so
+static void test_overflow_is_reported_and_bounded(void) {
+  TelemetryFormat formats[] = { TELEMETRY_FORMAT_CBOR, TELEMETRY_FORMAT_JSON };
+  for (TelemetryFormat format : formats) {
+    memset(buffer, 0xEE, sizeof(buffer));
+    TelemetryWriter w(buffer, 16, format);
+    TelemetryPayload::registration(w, "a-token-much-longer-than-sixteen-bytes");
+    TEST_ASSERT_TRUE(w.overflowed());
+    TEST_ASSERT_LESS_OR_EQUAL(16, w.size());
+    TEST_ASSERT_EQUAL_HEX8(0xEE, buffer[16]);
+  }
+}
+
+// the registration NetworkManager posts, read back as JSON
+static void test_registration_payload(void) {
+  TelemetryWriter w(buffer, sizeof(buffer), TELEMETRY_FORMAT_JSON);
+  TelemetryPayload::registration(w, "tok\"en");
+  TEST_ASSERT_FALSE(w.overflowed());
+
+  StaticJsonDocument<512> doc;
+  TEST_ASSERT_FALSE(deserializeJson(doc, (const char *)w.data(), w.size()));
+  TEST_ASSERT_EQUAL_STRING(DEVICE_ID, doc["deviceId"].as<const char *>());
+  TEST_ASSERT_EQUAL_STRING("ESP32", doc["platform"].as<const char *>());
+  TEST_ASSERT_EQUAL_STRING("tok\"en", doc["token"].as<const char *>());
+}
+
+// same fields the ArduinoJson version of sendSensorData produced, nested dataJson included
+static void test_fall_payload_matches_the_old_fields(void) {
+  TelemetryWriter w(buffer, sizeof(buffer), TELEMETRY_FORMAT_JSON);
+  TelemetryPayload::sensorData(w, 25.5F, 310.25F, true, 123456);
+  TEST_ASSERT_FALSE(w.overflowed());
+
+  StaticJsonDocument<1024> doc;
+  TEST_ASSERT_FALSE(deserializeJson(doc, (const char *)w.data(), w.size()));
+  TEST_ASSERT_EQUAL_FLOAT(25.5F, doc["accel"].as<float>());
+  TEST_ASSERT_EQUAL_FLOAT(310.25F, doc["gyro"].as<float>());
+  TEST_ASSERT_TRUE(doc["fallDetected"].as<bool>());
+  TEST_ASSERT_EQUAL_UINT32(123456, doc["timestamp"].as<uint32_t>());
+  TEST_ASSERT_EQUAL_STRING("FALL_DETECTED", doc["emergencyType"].as<const char *>());
+  TEST_ASSERT_EQUAL_STRING("HIGH", doc["severity"].as<const char *>());
+  TEST_ASSERT_TRUE(doc["requiresResponse"].as<bool>());
+  TEST_ASSERT_EQUAL_FLOAT(25.5F, doc["dataJson"]["accel"].as<float>());
+  TEST_ASSERT_EQUAL_STRING(DEVICE_ID, doc["dataJson"]["deviceId"].as<const char *>());
+  TEST_ASSERT_EQUAL_UINT32(123456, doc["dataJson"]["detectionTime"].as<uint32_t>());
+}
+
+// a full window with the widest values still fits the payload buffer as JSON
+static void test_full_batch_fits_the_payload_buffer(void) {
+  static TelemetrySample samples[TELEMETRY_BATCH_CAPACITY];
+  for (size_t i = 0; i < TELEMETRY_BATCH_CAPACITY; i++) {
+    samples[i].timestampMs = 4000000000UL + i;
+    samples[i].accel = -123.456F;
+    samples[i].gyro = -1234.56F;
+  }
+  TelemetryWriter w(buffer, sizeof(buffer), TELEMETRY_FORMAT_JSON);
+  TelemetryPayload::sensorBatch(w, samples, TELEMETRY_BATCH_CAPACITY);
+  TEST_ASSERT_FALSE(w.overflowed());
+
+  DynamicJsonDocument doc(32768);
+  TEST_ASSERT_FALSE(deserializeJson(doc, (const char *)w.data(), w.size()));
+  TEST_ASSERT_EQUAL_UINT32(TELEMETRY_BATCH_CAPACITY, doc["count"].as<uint32_t>());
+  JsonArray list = doc["samples"].as<JsonArray>();
+  TEST_ASSERT_EQUAL(TELEMETRY_BATCH_CAPACITY, list.size());
+  TEST_ASSERT_EQUAL_UINT32(4000000000UL + TELEMETRY_BATCH_CAPACITY - 1, list[TELEMETRY_BATCH_CAPACITY - 1]["t"].as<uint32_t>());
+  TEST_ASSERT_FLOAT_WITHIN(0.01F, -1234.56F, list[0]["gyro"].as<float>());
+}
+
+// one sample batch in CBOR, byte for byte
+static void test_cbor_batch_layout(void) {
+  TelemetrySample sample = { 1000, 1.0F, 0.0F };
+  TelemetryWriter w(buffer, sizeof(buffer), TELEMETRY_FORMAT_CBOR);
+  TelemetryPayload::sensorBatch(w, &sample, 1);
+  TEST_ASSERT_FALSE(w.overflowed());
+
+  size_t idLength = strlen(DEVICE_ID);
+  const uint8_t *p = w.data();
+  TEST_ASSERT_EQUAL_HEX8(0xA5, *p++);
+  TEST_ASSERT_EQUAL_HEX8(0x68, *p++);
+  TEST_ASSERT_EQUAL_MEMORY("deviceId", p, 8);
+  p += 8;
+  p += idLength < 24 ? 1 : 2; // text head
+  TEST_ASSERT_EQUAL_MEMORY(DEVICE_ID, p, idLength);
+  p += idLength;
+  const uint8_t rest[] = {
+    0x6C, 'f', 'a', 'l', 'l', 'D', 'e', 't', 'e', 'c', 't', 'e', 'd', 0xF4,
+    0x69, 't', 'i', 'm', 'e', 's', 't', 'a', 'm', 'p', 0x19, 0x03, 0xE8,
+    0x65, 'c', 'o', 'u', 'n', 't', 0x01,
+    0x67, 's', 'a', 'm', 'p', 'l', 'e', 's', 0x81,
+    0xA3,
+    0x61, 't', 0x19, 0x03, 0xE8,
+    0x65, 'a', 'c', 'c', 'e', 'l', 0xFA, 0x3F, 0x80, 0x00, 0x00,
+    0x64, 'g', 'y', 'r', 'o', 0xFA, 0x00, 0x00, 0x00, 0x00,
+  };
+  TEST_ASSERT_EQUAL(sizeof(rest), w.size() - (size_t)(p - w.data()));
+  TEST_ASSERT_EQUAL_MEMORY(rest, p, sizeof(rest));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_cbor_map_of_uint_and_bool);
+  RUN_TEST(test_cbor_uint_heads);
+  RUN_TEST(test_cbor_floats_are_single_precision_big_endian);
+  RUN_TEST(test_cbor_text_and_false);
+  RUN_TEST(test_json_nested_text);
+  RUN_TEST(test_json_escapes_strings);
+  RUN_TEST(test_json_non_finite_floats_are_null);
+  RUN_TEST(test_overflow_is_reported_and_bounded);
+  RUN_TEST(test_registration_payload);
+  RUN_TEST(test_fall_payload_matches_the_old_fields);
+  RUN_TEST(test_full_batch_fits_the_payload_buffer);
+  RUN_TEST(test_cbor_batch_layout);
+  return UNITY_END();
+}
@@ -0,0 +1,287 @@
+// TelemetryStore on the file-backed flash emulator (native FS.h): replay order, reboots,
+// power cuts, flush policy, the persisted read cursor, rotation and corrupt records.
+
+#include <unity.h>
+#include <filesystem>
+#include "SimHal.h"
+#include "TelemetryStore.h"
+
+static const size_t BATCH = 20;
+static std::string root;
+static SimKeyValueStore *nvs;
+static FS *flash;
+
+// tags every sample of a batch with its number, so replay order is checkable
+static void makeBatch(uint32_t n, TelemetrySample *samples) {
+  for (size_t i = 0; i < BATCH; i++) {
+    samples[i].timestampMs = n * 1000 + i;
+    samples[i].accel = 9.8F;
+    samples[i].gyro = (float)n;
+  }
+}
+
+static bool appendBatch(TelemetryStore &store, uint32_t n) {
+  TelemetrySample samples[BATCH];
+  makeBatch(n, samples);
+  return store.appendBatch(samples, BATCH);
+}
+
+// the batch number of the next record, -1 for an alert, -2 when nothing is left
+static StoredRecord record;
+static int32_t replayNext(TelemetryStore &store) {
+  if (!store.peekNext(record)) return -2;
+  store.consumeNext();
+  if (record.type == STORED_FALL_ALERT) return -1;
+  return (int32_t)(record.timestampMs / 1000);
+}
+
+// the store a fresh boot would see: same flash contents, same NVS
+static FS *reboot() {
+  delete flash;
+  flash = new FS(root.c_str());
+  return flash;
+}
+
+void setUp(void) {
+  root = (std::filesystem::temp_directory_path() / "fallsense_test_store").string();
+  flash = new FS(root.c_str());
+  flash->format();
+  nvs = new SimKeyValueStore();
+  nativeAdvanceTimeUs(STORE_FLUSH_INTERVAL_MS * 1000UL); // well past boot
+}
+
+void tearDown(void) {
+  flash->format();
+  delete flash;
+  delete nvs;
+}
+
+static void test_replays_in_order_alerts_first(void) {
+  TelemetryStore store;
+  store.setCursorStore(nvs);
+  TEST_ASSERT_TRUE(store.begin(*flash));
+  TEST_ASSERT_FALSE(store.hasPending());
+
+  appendBatch(store, 1);
+  appendBatch(store, 2);
+  TEST_ASSERT_TRUE(store.appendAlert(25.0F, 300.0F, 4242));
+  appendBatch(store, 3);
+
+  TEST_ASSERT_EQUAL_INT32(-1, replayNext(store));
+  TEST_ASSERT_EQUAL_UINT32(4242, record.timestampMs);
+  TEST_ASSERT_EQUAL_FLOAT(25.0F, record.accel);
+  TEST_ASSERT_EQUAL_INT32(1, replayNext(store));
+  TEST_ASSERT_EQUAL(BATCH, record.sampleCount);
+  TEST_ASSERT_EQUAL_FLOAT(1.0F, record.samples[BATCH - 1].gyro);
+  TEST_ASSERT_EQUAL_INT32(2, replayNext(store));
+  TEST_ASSERT_EQUAL_INT32(3, replayNext(store));
+  TEST_ASSERT_EQUAL_INT32(-2, replayNext(store));
+  TEST_ASSERT_FALSE(store.hasPending());
+}
+
+// peek without consume hands out the same record again
+static void test_peek_without_consume_repeats(void) {
+  TelemetryStore store;
+  store.begin(*flash);
+  appendBatch(store, 7);
+  appendBatch(store, 8);
+
+  TEST_ASSERT_TRUE(store.peekNext(record));
+  TEST_ASSERT_TRUE(store.peekNext(record));
+  TEST_ASSERT_EQUAL_UINT32(7000, record.timestampMs);
+}
+
+// within the flush interval appends don't commit metadata, only the first one does
+static void test_appends_are_not_flushed_one_by_one(void) {
+  TelemetryStore store;
+  store.begin(*flash);
+  uint32_t commits = flash->getCommitCount();
+
+  for (uint32_t n = 0; n < 10; n++) {
+    appendBatch(store, n);
+    nativeAdvanceTimeUs(1000000);
+  }
+  TEST_ASSERT_EQUAL_UINT32(commits + 1, flash->getCommitCount());
+
+  nativeAdvanceTimeUs(STORE_FLUSH_INTERVAL_MS * 1000UL);
+  appendBatch(store, 10);
+  TEST_ASSERT_EQUAL_UINT32(commits + 2, flash->getCommitCount());
+}
+
+// a power cut loses at most what came in since the last flush; alerts are always flushed
+static void test_power_cut_keeps_flushed_records_and_alerts(void) {
+  {
+    TelemetryStore store;
+    store.begin(*flash);
+    appendBatch(store, 1);          // flushed, first append in a while
+    appendBatch(store, 2);          // within the interval, not yet
+    store.appendAlert(20.0F, 200.0F, 99);
+    flash->powerCut();
+  }
+
+  TelemetryStore store;
+  store.begin(*reboot());
+  TEST_ASSERT_EQUAL_INT32(-1, replayNext(store));
+  TEST_ASSERT_EQUAL_INT32(1, replayNext(store));
+  TEST_ASSERT_EQUAL_INT32(-2, replayNext(store));
+}
+
+static void test_survives_reboot(void) {
+  {
+    TelemetryStore store;
+    store.begin(*flash);
+    for (uint32_t n = 1; n <= 4; n++) appendBatch(store, n);
+  } // closing the file flushes, like an orderly restart
+
+  TelemetryStore store;
+  TEST_ASSERT_TRUE(store.begin(*reboot()));
+  TEST_ASSERT_TRUE(store.hasPendingBatches());
+  for (int32_t n = 1; n <= 4; n++) TEST_ASSERT_EQUAL_INT32(n, replayNext(store));
+  TEST_ASSERT_EQUAL_INT32(-2, replayNext(store));
+}
+
+// what was replayed before the last cursor save is not sent again: everything in the
+// segments before, and whole STORE_CURSOR_SAVE_RECORDS steps into the current one
+static void test_cursor_resumes_replay_after_reboot(void) {
+  const uint32_t perSegment = STORE_BATCH_SEGMENT_BYTES / (8 + BATCH * sizeof(TelemetrySample));
+  const uint32_t total = 2 * perSegment + 5;
+  const uint32_t resumeAt = perSegment + STORE_CURSOR_SAVE_RECORDS;
+  {
+    TelemetryStore store;
+    store.setCursorStore(nvs);
+    store.begin(*flash);
+    for (uint32_t n = 0; n < total - 1; n++) appendBatch(store, n);
+    nativeAdvanceTimeUs(STORE_FLUSH_INTERVAL_MS * 1000UL);
+    appendBatch(store, total - 1);   // flushes the tail
+    store.appendAlert(30.0F, 100.0F, 7);
+    TEST_ASSERT_EQUAL_INT32(-1, replayNext(store));
+    for (int32_t n = 0; n < (int32_t)resumeAt + 3; n++) TEST_ASSERT_EQUAL_INT32(n, replayNext(store));
+    flash->powerCut();
+  }
+
+  TelemetryStore store;
+  store.setCursorStore(nvs);
+  store.begin(*reboot());
+  for (int32_t n = resumeAt; n < (int32_t)total; n++) TEST_ASSERT_EQUAL_INT32(n, replayNext(store));
+  TEST_ASSERT_EQUAL_INT32(-2, replayNext(store));
+}
+
+// draining a backlog writes the cursor per segment and per STORE_CURSOR_SAVE_RECORDS,
+// not once per record
+static void test_replay_saves_cursor_sparingly(void) {
+  const uint32_t perSegment = STORE_BATCH_SEGMENT_BYTES / (8 + BATCH * sizeof(TelemetrySample));
+  const uint32_t total = 3 * perSegment;
+  TelemetryStore store;
+  store.setCursorStore(nvs);
+  store.begin(*flash);
+  for (uint32_t n = 0; n < total; n++) appendBatch(store, n);
+
+  uint32_t puts = nvs->getPutCount();
+  for (int32_t n = 0; n < (int32_t)total; n++) TEST_ASSERT_EQUAL_INT32(n, replayNext(store));
+  TEST_ASSERT_EQUAL_INT32(-2, replayNext(store));
+  uint32_t writes = nvs->getPutCount() - puts;
+  TEST_ASSERT_TRUE(writes <= 3 + total / STORE_CURSOR_SAVE_RECORDS);
+  TEST_ASSERT_TRUE(writes < total / 4);
+}
+
+// segment numbers start over once everything was replayed; the cursor from before must
+// not make the new segment look half sent
+static void test_stale_cursor_does_not_skip_new_data(void) {
+  {
+    TelemetryStore store;
+    store.setCursorStore(nvs);
+    store.begin(*flash);
+    appendBatch(store, 1);
+    appendBatch(store, 2);
+    replayNext(store);
+    TEST_ASSERT_EQUAL_INT32(2, replayNext(store));
+    TEST_ASSERT_FALSE(store.hasPending());
+  }
+  // enough to reach the segment number the old cursor pointed at
+  const uint32_t perSegment = STORE_BATCH_SEGMENT_BYTES / (8 + BATCH * sizeof(TelemetrySample));
+  const uint32_t count = perSegment * 2 + 1;
+  {
+    TelemetryStore store;
+    store.setCursorStore(nvs);
+    store.begin(*reboot());
+    for (uint32_t n = 10; n < 10 + count; n++) appendBatch(store, n);
+  }
+
+  TelemetryStore store;
+  store.setCursorStore(nvs);
+  store.begin(*reboot());
+  for (int32_t n = 10; n < (int32_t)(10 + count); n++) TEST_ASSERT_EQUAL_INT32(n, replayNext(store));
+  TEST_ASSERT_EQUAL_INT32(-2, replayNext(store));
+}
+
+// a full log drops its oldest segment; what is left still comes out in order
+static void test_rotation_drops_oldest_segment_when_full(void) {
+  TelemetryStore store;
+  store.begin(*flash);
+  const uint32_t recordBytes = 8 + BATCH * sizeof(TelemetrySample);
+  const uint32_t perSegment = STORE_BATCH_SEGMENT_BYTES / recordBytes;
+  const uint32_t total = perSegment * (STORE_BATCH_SEGMENTS + 2);
+
+  for (uint32_t n = 0; n < total; n++) {
+    TEST_ASSERT_TRUE(appendBatch(store, n));
+  }
+  TEST_ASSERT_GREATER_THAN_UINT32(0, store.getDroppedSegments());
+
+  int32_t first = replayNext(store);
+  TEST_ASSERT_GREATER_THAN(0, first);
+  int32_t last = first, count = 1, next;
+  while ((next = replayNext(store)) >= 0) {
+    TEST_ASSERT_EQUAL_INT32(last + 1, next);
+    last = next;
+    count++;
+  }
+  TEST_ASSERT_EQUAL_INT32(total - 1, last);
+  TEST_ASSERT_LESS_OR_EQUAL((int32_t)(perSegment * STORE_BATCH_SEGMENTS), count);
+}
+
+// a damaged record ends its segment, the following segments are still replayed
+static void test_corrupt_record_skips_rest_of_segment(void) {
+  const uint32_t recordBytes = 8 + BATCH * sizeof(TelemetrySample);
+  const uint32_t perSegment = STORE_BATCH_SEGMENT_BYTES / recordBytes;
+  {
+    TelemetryStore store;
+    store.begin(*flash);
+    for (uint32_t n = 0; n < perSegment + 2; n++) appendBatch(store, n);
+  }
+
+  // flip a payload byte of the second record in the first segment
+  std::string first;
+  for (const auto &entry : std::filesystem::directory_iterator(root + "/store")) {
+    std::string name = entry.path().string();
+    bool batchSegment = entry.path().filename().string().compare(0, 2, "t_") == 0;
+    if (batchSegment && (first.empty() || name < first)) first = name;
+  }
+  FILE *f = fopen(first.c_str(), "r+b");
+  TEST_ASSERT_NOT_NULL(f);
+  fseek(f, recordBytes + 20, SEEK_SET);
+  fputc(0x5A, f);
+  fclose(f);
+
+  TelemetryStore store;
+  store.begin(*reboot());
+  TEST_ASSERT_EQUAL_INT32(0, replayNext(store));
+  TEST_ASSERT_EQUAL_INT32((int32_t)perSegment, replayNext(store));
+  TEST_ASSERT_EQUAL_INT32((int32_t)perSegment + 1, replayNext(store));
+  TEST_ASSERT_EQUAL_INT32(-2, replayNext(store));
+}
+
+int main(int argc, char **argv) {
+  Serial.setQuiet(true);
+  UNITY_BEGIN();
+  RUN_TEST(test_replays_in_order_alerts_first);
+  RUN_TEST(test_peek_without_consume_repeats);
+  RUN_TEST(test_appends_are_not_flushed_one_by_one);
+  RUN_TEST(test_power_cut_keeps_flushed_records_and_alerts);
+  RUN_TEST(test_survives_reboot);
+  RUN_TEST(test_cursor_resumes_replay_after_reboot);
+  RUN_TEST(test_replay_saves_cursor_sparingly);
+  RUN_TEST(test_stale_cursor_does_not_skip_new_data);
+  RUN_TEST(test_rotation_drops_oldest_segment_when_full);
+  RUN_TEST(test_corrupt_record_skips_rest_of_segment);
+  return UNITY_END();
+}
@@ -0,0 +1,196 @@
+// ToneVoice PCM against a float sine reference: step timing to the sample, rests, sweeps,
+// layering a beep over the alarm, and patterns that would never render a sample.
+
+#include <unity.h>
+#include "ToneSequencer.h"
+
+static const uint32_t RATE = 44100;
+// as in test_dds_oscillator, plus a count for the volume scaling of the step level
+static const int32_t MAX_ERROR_LSB = 6;
+static int16_t pcm[RATE];
+static int16_t other[RATE];
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static int32_t maxErrorAgainstSine(const int16_t *samples, int count, double frequency, float volume) {
+  int32_t amplitude = (int32_t)(volume * 32767.0f);
+  int32_t worst = 0;
+  for (int n = 0; n < count; n++) {
+    double reference = sin(2.0 * M_PI * frequency * n / RATE) * amplitude;
+    int32_t error = (int32_t)fabs(samples[n] - reference);
+    if (error > worst) worst = error;
+  }
+  return worst;
+}
+
+// frequency from the first and last rising zero crossing, crossing times interpolated
+static double measuredFrequency(const int16_t *samples, int count) {
+  double first = -1, last = -1;
+  int cycles = -1;
+  for (int n = 1; n < count; n++) {
+    if (samples[n - 1] < 0 && samples[n] >= 0) {
+      double t = n - 1 + (double)-samples[n - 1] / (samples[n] - samples[n - 1]);
+      if (first < 0) first = t;
+      last = t;
+      cycles++;
+    }
+  }
+  return cycles > 0 ? cycles * (double)RATE / (last - first) : 0;
+}
+
+// the loop mode plays a pitch a few ppm off, so the shape is compared at the pitch played
+static void assertTone(const int16_t *samples, int count, int frequency, float volume) {
+  double measured = measuredFrequency(samples, count);
+  TEST_ASSERT_LESS_THAN(1e-3, fabs(measured - frequency) / frequency);
+  TEST_ASSERT_LESS_OR_EQUAL(MAX_ERROR_LSB, maxErrorAgainstSine(samples, count, measured, volume));
+}
+
+static bool silent(const int16_t *samples, int count) {
+  for (int n = 0; n < count; n++) {
+    if (samples[n] != 0) return false;
+  }
+  return true;
+}
+
+// one steady tone is the float sine at the step level, in whichever synth mode is built
+static void test_steady_step_matches_sine(void) {
+  static const ToneStep steps[] = { { 880, 880, 1000, 128 } };
+  static const TonePattern pattern = TONE_PATTERN(steps, false);
+  ToneVoice voice;
+  voice.setSampleRate(RATE);
+  TEST_ASSERT_TRUE(voice.play(&pattern, 1.0f));
+  voice.render(pcm, RATE, false);
+  assertTone(pcm, RATE, 880, 128 / 255.0f);
+}
+
+// the pulse: 150ms of tone, 150ms of rest, to the sample and across buffer boundaries
+static void test_pulse_timing_is_exact(void) {
+  ToneVoice voice;
+  voice.setSampleRate(RATE);
+  TEST_ASSERT_TRUE(voice.play(&TONE_PATTERN_PULSE, 1.0f));
+  for (int pos = 0; pos < 30000; pos += AUDIO_BUFFER_SAMPLES) {
+    voice.render(pcm + pos, AUDIO_BUFFER_SAMPLES, false);
+  }
+
+  const int step = 150 * RATE / 1000;
+  assertTone(pcm, step, ALARM_SOUND_FREQUENCY_HZ, 1.0f);
+  TEST_ASSERT_TRUE(silent(pcm + step, step));
+  // the tone comes back where the rest ends, not a sample earlier
+  TEST_ASSERT_FALSE(silent(pcm + 2 * step, 8));
+  TEST_ASSERT_TRUE(voice.isActive());
+}
+
+// the siren goes from 600 to 1200Hz in the first step: count the cycles in each quarter
+static void test_sweep_rises(void) {
+  ToneVoice voice;
+  voice.setSampleRate(RATE);
+  voice.play(&TONE_PATTERN_SIREN, 1.0f);
+  voice.render(pcm, RATE / 2, false);
+
+  const int quarter = RATE / 8;
+  int previous = 0;
+  for (int q = 0; q < 4; q++) {
+    int crossings = 0;
+    for (int n = q * quarter + 1; n < (q + 1) * quarter; n++) {
+      if (pcm[n - 1] < 0 && pcm[n] >= 0) crossings++;
+    }
+    // 125ms at 600..1200Hz is 75..150 cycles
+    TEST_ASSERT_INT_WITHIN(40, 112, crossings);
+    TEST_ASSERT_GREATER_THAN(previous, crossings);
+    previous = crossings;
+  }
+}
+
+// a pattern that doesn't repeat stops after its last step and leaves silence
+static void test_chime_stops(void) {
+  ToneVoice voice;
+  voice.setSampleRate(RATE);
+  voice.play(&TONE_PATTERN_CHIME, 1.0f);
+  const int length = 600 * RATE / 1000;
+  voice.render(pcm, length + 1000, false);
+  TEST_ASSERT_FALSE(voice.isActive());
+  TEST_ASSERT_FALSE(silent(pcm + length - 8, 8));
+  TEST_ASSERT_TRUE(silent(pcm + length, 1000));
+}
+
+// the beep adds onto the alarm already in the buffer and clips instead of wrapping
+static void test_beep_mixes_over_alarm(void) {
+  static const ToneStep steps[] = { { 1000, 1000, 500, 255 } };
+  static const TonePattern pattern = TONE_PATTERN(steps, false);
+  ToneVoice alarm, beep, beepAlone;
+  alarm.setSampleRate(RATE);
+  beep.setSampleRate(RATE);
+  beepAlone.setSampleRate(RATE);
+  alarm.play(&pattern, 1.0f);
+  beep.play(&pattern, 1.0f);
+  beepAlone.play(&pattern, 1.0f);
+
+  alarm.render(pcm, 2000, false);
+  beepAlone.render(other, 2000, false);
+  beep.render(pcm, 2000, true);
+  for (int n = 0; n < 2000; n++) {
+    int32_t expected = 2 * other[n];
+    if (expected > 32767) expected = 32767;
+    if (expected < -32768) expected = -32768;
+    TEST_ASSERT_EQUAL_INT16(expected, pcm[n]);
+  }
+}
+
+// an idle voice mixing leaves the buffer alone, rendering writes silence
+static void test_idle_voice(void) {
+  ToneVoice voice;
+  for (int n = 0; n < 100; n++) pcm[n] = 1234;
+  voice.render(pcm, 100, true);
+  for (int n = 0; n < 100; n++) TEST_ASSERT_EQUAL_INT16(1234, pcm[n]);
+  voice.render(pcm, 100, false);
+  TEST_ASSERT_TRUE(silent(pcm, 100));
+}
+
+// steps too short for a single sample: refused up front, or skipped among real ones
+static void test_zero_length_steps(void) {
+  static const ToneStep empty[] = { { 880, 880, 0, 255 }, { 0, 0, 0, 0 } };
+  static const TonePattern emptyPattern = TONE_PATTERN(empty, true);
+  ToneVoice voice;
+  voice.setSampleRate(RATE);
+  TEST_ASSERT_FALSE(voice.play(&emptyPattern, 1.0f));
+  TEST_ASSERT_FALSE(voice.isActive());
+  TEST_ASSERT_FALSE(voice.play(NULL, 1.0f));
+
+  static const ToneStep mixed[] = { { 440, 440, 0, 255 }, { 880, 880, 10, 255 }, { 0, 0, 0, 0 } };
+  static const TonePattern mixedPattern = TONE_PATTERN(mixed, true);
+  TEST_ASSERT_TRUE(voice.play(&mixedPattern, 1.0f));
+  voice.render(pcm, RATE, false);
+  TEST_ASSERT_TRUE(voice.isActive());
+  // back to back 10ms steps of the same tone make one continuous 880Hz sine
+  assertTone(pcm, RATE, 880, 1.0f);
+}
+
+// 1ms steps are a sample long at 44.1kHz and nothing at 500Hz: the voice stops after one
+// empty cycle instead of spinning in render
+static void test_rate_change_under_a_pattern_stops(void) {
+  static const ToneStep steps[] = { { 880, 880, 1, 255 }, { 0, 0, 1, 0 } };
+  static const TonePattern pattern = TONE_PATTERN(steps, true);
+  ToneVoice voice;
+  voice.setSampleRate(RATE);
+  TEST_ASSERT_TRUE(voice.play(&pattern, 1.0f));
+  voice.render(pcm, 200, false);
+  TEST_ASSERT_TRUE(voice.isActive());
+
+  voice.setSampleRate(500);
+  voice.render(pcm, 200, false);
+  TEST_ASSERT_FALSE(voice.isActive());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_steady_step_matches_sine);
+  RUN_TEST(test_pulse_timing_is_exact);
+  RUN_TEST(test_sweep_rises);
+  RUN_TEST(test_chime_stops);
+  RUN_TEST(test_beep_mixes_over_alarm);
+  RUN_TEST(test_idle_voice);
+  RUN_TEST(test_zero_length_steps);
+  RUN_TEST(test_rate_change_under_a_pattern_stops);
+  return UNITY_END();
+}
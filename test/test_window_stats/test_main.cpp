@@ -0,0 +1,129 @@
+// WindowStats: mean, variance, min and max after every push, checked against a plain
+// recompute over the CircularBuffer it sits next to.
+
+#include <unity.h>
+#include "WindowStats.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+template <typename T, size_t N>
+static void assertMatchesBuffer(const WindowStats<T, N> &stats, CircularBuffer<T, N> &buffer, float tolerance) {
+  TEST_ASSERT_EQUAL(buffer.size(), stats.size());
+  double total = 0;
+  T lo = buffer[0], hi = buffer[0];
+  for (size_t i = 0; i < buffer.size(); i++) {
+    total += buffer[i];
+    if (buffer[i] < lo) lo = buffer[i];
+    if (buffer[i] > hi) hi = buffer[i];
+  }
+  double mean = total / buffer.size();
+  double m2 = 0;
+  for (size_t i = 0; i < buffer.size(); i++) m2 += (buffer[i] - mean) * (buffer[i] - mean);
+  double variance = m2 / buffer.size();
+
+  TEST_ASSERT_EQUAL(lo, stats.min());
+  TEST_ASSERT_EQUAL(hi, stats.max());
+  TEST_ASSERT_FLOAT_WITHIN(tolerance * (fabs(mean) + 1), (float)mean, stats.mean());
+  TEST_ASSERT_FLOAT_WITHIN(tolerance * (variance + mean * mean + 1), (float)variance, stats.variance());
+}
+
+static void test_empty_window(void) {
+  WindowStats<uint32_t, 8> stats;
+  TEST_ASSERT_EQUAL(0, stats.size());
+  TEST_ASSERT_EQUAL_FLOAT(0, stats.mean());
+  TEST_ASSERT_EQUAL_FLOAT(0, stats.variance());
+  TEST_ASSERT_EQUAL_UINT32(0, stats.min());
+  TEST_ASSERT_EQUAL_UINT32(0, stats.max());
+}
+
+static void test_filling_up(void) {
+  CircularBuffer<uint32_t, 4> buffer;
+  WindowStats<uint32_t, 4> stats;
+  const uint32_t values[] = { 10, 30, 20, 40 };
+  for (size_t i = 0; i < 4; i++) {
+    stats.push(buffer, values[i]);
+    assertMatchesBuffer(stats, buffer, 1e-6F);
+  }
+  TEST_ASSERT_TRUE(stats.isFull());
+  TEST_ASSERT_EQUAL_FLOAT(25.0F, stats.mean());
+  TEST_ASSERT_EQUAL_FLOAT(125.0F, stats.variance());
+}
+
+// the maximum leaves the window and the next largest takes over, same for the minimum
+static void test_extremes_slide_out(void) {
+  CircularBuffer<uint32_t, 3> buffer;
+  WindowStats<uint32_t, 3> stats;
+  stats.push(buffer, 100);
+  stats.push(buffer, 5);
+  stats.push(buffer, 50);
+  TEST_ASSERT_EQUAL_UINT32(100, stats.max());
+  TEST_ASSERT_EQUAL_UINT32(5, stats.min());
+  stats.push(buffer, 20);   // 100 leaves
+  TEST_ASSERT_EQUAL_UINT32(50, stats.max());
+  stats.push(buffer, 30);   // 5 leaves
+  TEST_ASSERT_EQUAL_UINT32(20, stats.min());
+  stats.push(buffer, 25);   // 50 leaves
+  TEST_ASSERT_EQUAL_UINT32(30, stats.max());
+  TEST_ASSERT_EQUAL_UINT32(20, stats.min());
+}
+
+static void test_constant_values_have_no_variance(void) {
+  CircularBuffer<uint32_t, 16> buffer;
+  WindowStats<uint32_t, 16> stats;
+  for (int i = 0; i < 100; i++) stats.push(buffer, 16777216UL);
+  TEST_ASSERT_EQUAL_FLOAT(16777216.0F, stats.mean());
+  TEST_ASSERT_FLOAT_WITHIN(1.0F, 0.0F, stats.variance());
+  TEST_ASSERT_EQUAL_UINT32(16777216UL, stats.min());
+  TEST_ASSERT_EQUAL_UINT32(16777216UL, stats.max());
+}
+
+// long run of squared magnitudes around 1g (counts^2, ~1.7e7) with falls mixed in; the
+// periodic resync keeps the running mean/variance from drifting away
+static void test_long_run_of_squared_magnitudes(void) {
+  CircularBuffer<uint32_t, 50> buffer;
+  WindowStats<uint32_t, 50> stats;
+  uint32_t rng = 7;
+  for (uint32_t i = 0; i < 100000; i++) {
+    rng = rng * 1664525UL + 1013904223UL;
+    uint32_t counts = 4096 + (rng >> 22) - 512;
+    if (i % 997 < 20) counts = 300 + (rng >> 26);      // free fall
+    if (i % 997 == 25) counts = 30000;                  // impact
+    stats.push(buffer, counts * counts);
+    if (i % 101 == 0 || i > 99900) assertMatchesBuffer(stats, buffer, 1e-3F);
+  }
+}
+
+static void test_signed_values(void) {
+  CircularBuffer<int16_t, 5> buffer;
+  WindowStats<int16_t, 5> stats;
+  const int16_t values[] = { -3, 7, -12, 0, 4, -1, 9, -30, 2 };
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    stats.push(buffer, values[i]);
+    assertMatchesBuffer(stats, buffer, 1e-5F);
+  }
+  TEST_ASSERT_EQUAL_INT16(-30, stats.min());
+  TEST_ASSERT_EQUAL_INT16(9, stats.max());
+}
+
+// many laps around the deque storage, the fronts must still expire at the right push
+static void test_many_windows(void) {
+  CircularBuffer<uint32_t, 7> buffer;
+  WindowStats<uint32_t, 7> stats;
+  for (uint32_t i = 0; i < 1000000; i++) {
+    stats.push(buffer, (i * 2654435761UL) >> 20);
+  }
+  assertMatchesBuffer(stats, buffer, 1e-4F);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_window);
+  RUN_TEST(test_filling_up);
+  RUN_TEST(test_extremes_slide_out);
+  RUN_TEST(test_constant_values_have_no_variance);
+  RUN_TEST(test_long_run_of_squared_magnitudes);
+  RUN_TEST(test_signed_values);
+  RUN_TEST(test_many_windows);
+  return UNITY_END();
+}
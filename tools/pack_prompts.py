@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Pack WAV files into the prompt partition image read by PromptLibrary.
+
+The order of the WAV files on the command line is the prompt ID order, so it has to
+match the PromptId enum in include/PromptLibrary.h:
+
+    tools/pack_prompts.py -o prompts.bin fall_detected.wav help_called.wav alarm_cancelled.wav
+
+Input has to be 16-bit PCM. Stereo is mixed down to mono. There is no resampling, so
+record/export at AUDIO_SAMPLE_RATE (Config.h) or pass --rate to check for it.
+
+Flash the result to the "prompts" partition (offset from partitions.csv):
+
+    esptool.py --chip esp32 write_flash 0x300000 prompts.bin
+"""
+
+import argparse
+import array
+import struct
+import sys
+import wave
+
+MAGIC = 0x504D5250  # "PRMP"
+VERSION = 1
+HEADER = struct.Struct("<IHHII")   # magic, version, count, sample_rate, reserved
+ENTRY = struct.Struct("<II")       # offset, sample_count
+PARTITION_SIZE = 0xF0000           # keep in sync with partitions.csv
+
+
+def read_wav(path, gain):
+    with wave.open(path, "rb") as wav:
+        if wav.getsampwidth() != 2:
+            sys.exit("%s: only 16-bit PCM is supported" % path)
+        channels = wav.getnchannels()
+        rate = wav.getframerate()
+        samples = array.array("h", wav.readframes(wav.getnframes()))
+
+    if sys.byteorder != "little":
+        samples.byteswap()
+
+    if channels > 1:
+        samples = array.array("h", (
+            sum(samples[i:i + channels]) // channels
+            for i in range(0, len(samples), channels)))
+
+    if gain != 1.0:
+        samples = array.array("h", (
+            max(-32768, min(32767, int(s * gain))) for s in samples))
+
+    return rate, samples
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("wavs", nargs="+", help="WAV files in PromptId order")
+    parser.add_argument("-o", "--output", required=True, help="partition image to write")
+    parser.add_argument("--rate", type=int, default=44100, help="expected sample rate (default 44100)")
+    parser.add_argument("--gain", type=float, default=1.0, help="scale all samples, prompts play unscaled on the device")
+    args = parser.parse_args(argv)
+
+    clips = []
+    for path in args.wavs:
+        rate, samples = read_wav(path, args.gain)
+        if rate != args.rate:
+            sys.exit("%s: %d Hz, expected %d Hz" % (path, rate, args.rate))
+        clips.append((path, samples))
+
+    # header and entries are multiples of 4 bytes, so padding each clip keeps them all aligned
+    offset = HEADER.size + ENTRY.size * len(clips)
+    entries = []
+    data = bytearray()
+    for path, samples in clips:
+        entries.append((offset, len(samples)))
+        raw = samples.tobytes() if sys.byteorder == "little" else _swapped(samples)
+        raw += bytes(-len(raw) % 4)
+        data += raw
+        offset += len(raw)
+        print("%2d  %-32s %7d samples  %6.2f s" % (len(entries) - 1, path, len(samples), len(samples) / float(args.rate)))
+
+    image = bytearray(HEADER.pack(MAGIC, VERSION, len(clips), args.rate, 0))
+    for entry in entries:
+        image += ENTRY.pack(*entry)
+    image += data
+
+    if len(image) > PARTITION_SIZE:
+        sys.exit("image is %d bytes, the prompt partition only holds %d" % (len(image), PARTITION_SIZE))
+
+    with open(args.output, "wb") as out:
+        out.write(image)
+    print("wrote %s, %d of %d bytes used" % (args.output, len(image), PARTITION_SIZE))
+
+
+def _swapped(samples):
+    copy = array.array("h", samples)
+    copy.byteswap()
+    return copy.tobytes()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Round trip for pack_prompts.py: pack WAVs, then read the image back the way
+PromptLibrary does (header, index, 4-byte aligned clips inside the image).
+
+    python3 tools/test_pack_prompts.py
+"""
+
+import array
+import contextlib
+import io
+import os
+import struct
+import sys
+import tempfile
+import unittest
+import wave
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import pack_prompts  # noqa: E402
+
+
+def write_wav(path, samples, channels=1, rate=44100):
+    data = array.array("h", samples)
+    if sys.byteorder != "little":
+        data.byteswap()
+    with wave.open(path, "wb") as wav:
+        wav.setnchannels(channels)
+        wav.setsampwidth(2)
+        wav.setframerate(rate)
+        wav.writeframes(data.tobytes())
+
+
+def parse_image(image):
+    """Clips by prompt ID, with the checks of PromptLibrary::begin() and getClip()."""
+    magic, version, count, rate, _ = pack_prompts.HEADER.unpack_from(image, 0)
+    assert magic == pack_prompts.MAGIC and version == pack_prompts.VERSION
+    assert pack_prompts.HEADER.size + count * pack_prompts.ENTRY.size <= len(image)
+    clips = []
+    for i in range(count):
+        offset, sample_count = pack_prompts.ENTRY.unpack_from(
+            image, pack_prompts.HEADER.size + i * pack_prompts.ENTRY.size)
+        assert offset % 4 == 0, "clip %d at offset %d is not aligned" % (i, offset)
+        assert offset + 2 * sample_count <= len(image)
+        clips.append(list(struct.unpack_from("<%dh" % sample_count, image, offset)))
+    return rate, clips
+
+
+class PackPromptsTest(unittest.TestCase):
+
+    def setUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        self.dir.cleanup()
+
+    def path(self, name):
+        return os.path.join(self.dir.name, name)
+
+    def pack(self, *args):
+        with contextlib.redirect_stdout(io.StringIO()):
+            pack_prompts.main(list(args) + ["-o", self.path("prompts.bin")])
+        with open(self.path("prompts.bin"), "rb") as image:
+            return image.read()
+
+    def test_odd_lengths_round_trip_aligned(self):
+        # 1, 2, 3 and 5 samples: every remainder of the clip size modulo 4 bytes
+        lengths = [1, 2, 3, 5]
+        expected = []
+        for i, length in enumerate(lengths):
+            samples = [(i * 1000 + n * 7919) % 65536 - 32768 for n in range(length)]
+            write_wav(self.path("%d.wav" % i), samples)
+            expected.append(samples)
+        image = self.pack(*[self.path("%d.wav" % i) for i in range(len(lengths))])
+
+        rate, clips = parse_image(image)
+        self.assertEqual(44100, rate)
+        self.assertEqual(expected, clips)
+        self.assertEqual(0, len(image) % 4)
+
+    def test_stereo_is_mixed_down(self):
+        write_wav(self.path("stereo.wav"), [100, 300, -32768, -32768, 32767, 1], channels=2)
+        _, clips = parse_image(self.pack(self.path("stereo.wav")))
+        self.assertEqual([[200, -32768, 16384]], clips)
+
+    def test_gain_clips(self):
+        write_wav(self.path("loud.wav"), [20000, -20000, 100])
+        _, clips = parse_image(self.pack("--gain", "2", self.path("loud.wav")))
+        self.assertEqual([[32767, -32768, 200]], clips)
+
+    def test_wrong_rate_is_refused(self):
+        write_wav(self.path("slow.wav"), [0] * 10, rate=22050)
+        with self.assertRaises(SystemExit):
+            self.pack(self.path("slow.wav"))
+
+
+if __name__ == "__main__":
+    unittest.main()